@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Common.h"
+
+struct AllocationCount
+{
+    uint64_t    numAllocations;
+    uint64_t    numBytes;
+};
+
+// Counts every call to the global operator new, which FezViewer.cpp and FezBatch.cpp replace when the build
+// defines COUNT_ALLOCATIONS. That costs every allocation in the process two atomic adds, so the viewer leaves
+// it off and its counts stay at zero, FezBatch always defines it for -loadbench. Take a snapshot before some
+// work and subtract it afterwards.
+class AllocationStats
+{
+public:
+
+    static atomic<uint64_t> s_numAllocations;
+    static atomic<uint64_t> s_numBytes;
+
+    static bool IsCounting()
+    {
+#ifdef COUNT_ALLOCATIONS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    static AllocationCount Get()
+    {
+        AllocationCount count = { s_numAllocations, s_numBytes };
+        return count;
+    }
+
+    static AllocationCount Since(const AllocationCount& start)
+    {
+        AllocationCount count = { s_numAllocations - start.numAllocations, s_numBytes - start.numBytes };
+        return count;
+    }
+};
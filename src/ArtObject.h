@@ -1,83 +1,119 @@
 #pragma once
 
 #include "Common.h"
+#include "TextureCache.h"
+#include "Frustum.h"
+#include "NumberParser.h"
+#include "CompactMesh.h"
+#include "LoadProfiler.h"
 
 class ArtObject
 {
 public:
     
     TriMesh m_mesh;
-    Surface m_surface;
-    gl::Texture* m_pTexture;
+    CompactMesh m_compactMesh;  // replaces m_mesh after Compact()
+    TextureRef m_texture;
 
     ArtObject(const XmlTree& ao, const Vec3f& aoPos, const Quatf& aoRot, const Vec3f& aoScale, const Vec3f& offset, const fs::path& surfPng)
     {
-        vector<Vec3f> positions;
-        vector<Vec3f> normals;
-        vector<Vec2f> texcoords;
-        vector<uint32_t> indices;
+        // Count the children first so the mesh arrays are sized once and filled in place
         const XmlTree& xmlVertices = ao.getChild("ArtObject/ShaderInstancedIndexedPrimitives/Vertices");
+        const size_t numVertices = distance(xmlVertices.begin(), xmlVertices.end());
+        vector<Vec3f>& positions = m_mesh.getVertices();
+        vector<Vec3f>& normals = m_mesh.getNormals();
+        vector<Vec2f>& texcoords = m_mesh.getTexCoords();
+        positions.resize(numVertices);
+        normals.resize(numVertices);
+        texcoords.resize(numVertices);
         
-        for (auto vertex : xmlVertices)
+        size_t i = 0;
+        for (const auto& vertex : xmlVertices)
         {
             const XmlTree& posXml = vertex.getChild("Position/Vector3");
-            Vec3f pos = Vec3f(posXml["x"].getValue<float>(),
-                              posXml["y"].getValue<float>(),
-                              posXml["z"].getValue<float>());
+            Vec3f pos = Vec3f(NumberParser::ToFloat(posXml["x"].getValue()),
+                              NumberParser::ToFloat(posXml["y"].getValue()),
+                              NumberParser::ToFloat(posXml["z"].getValue()));
             pos = pos * aoRot;
             pos *= aoScale;
             pos += aoPos + offset;
-            positions.push_back(pos);
+            positions[i] = pos;
             
             const XmlTree& normXml = vertex.getChild("Normal");
-            normals.push_back(gc_normals[normXml.getValue<int>()]);
+            normals[i] = gc_normals[NumberParser::ToInt(normXml.getValue())];
             
             const XmlTree& coordXml = vertex.getChild("TextureCoord/Vector2");
-            texcoords.push_back(Vec2f(coordXml["x"].getValue<float>(),
-                                      coordXml["y"].getValue<float>()));
+            texcoords[i] = Vec2f(NumberParser::ToFloat(coordXml["x"].getValue()),
+                                 NumberParser::ToFloat(coordXml["y"].getValue()));
+            i++;
         }
         
-        m_mesh.appendVertices(&positions[0], positions.size());
-        m_mesh.appendNormals(&normals[0], normals.size());
-        m_mesh.appendTexCoords(&texcoords[0], texcoords.size());
-        
         const XmlTree& xmlIndices = ao.getChild("ArtObject/ShaderInstancedIndexedPrimitives/Indices");
-        for (auto index : xmlIndices)
+        vector<uint32_t>& indices = m_mesh.getIndices();
+        indices.resize(distance(xmlIndices.begin(), xmlIndices.end()));
+        i = 0;
+        for (const auto& index : xmlIndices)
         {
-            indices.push_back(index.getValue<uint32_t>());
+            indices[i++] = NumberParser::ToInt(index.getValue());
         }
-        m_mesh.appendIndices(&indices[0], indices.size());
+        LoadProfiler::Count(LOAD_VERTICES, numVertices);
         
-        m_surface = loadImage(surfPng);
-        m_pTexture = nullptr;
+        m_texture = TextureCache::s_cache.Acquire(surfPng, SamplerState(GL_NEAREST));
     }
     
-    ArtObject(const TriMesh& mesh, const Surface& surf)
+    ArtObject(const TriMesh& mesh, const TextureRef& texture)
     {
         m_mesh = mesh;
-        m_surface = surf;
-        m_pTexture = nullptr;
+        m_texture = texture;
     }
     
     ~ArtObject()
     {
-        delete m_pTexture;
+
+    }
+
+    // Swaps the float mesh for a quantized one when it fits, see CompactMesh
+    bool Compact()
+    {
+        if (!m_compactMesh.Build(m_mesh))
+        {
+            return false;
+        }
+        m_mesh = TriMesh();
+        return true;
+    }
+
+    // The mesh is already in world space
+    Bounds GetBounds() const
+    {
+        if (!m_compactMesh.IsEmpty())
+        {
+            return m_compactMesh.m_bounds;
+        }
+        Bounds bounds;
+        for (const Vec3f& pos : m_mesh.getVertices())
+        {
+            bounds.Include(pos);
+        }
+        return bounds;
     }
 
     void Draw()
     {
-        if (!m_pTexture)
+        const gl::Texture& texture = m_texture->GetTexture();
+        texture.enableAndBind();
+        FrameProfiler::CountStateChanges(1);
+        if (!m_compactMesh.IsEmpty())
         {
-            m_pTexture = new gl::Texture(m_surface);
-            m_pTexture->setMinFilter(GL_NEAREST);
-            m_pTexture->setMagFilter(GL_NEAREST);
+            m_compactMesh.Draw();
+            FrameProfiler::CountDraw(m_compactMesh.m_indices.size() / 3);
         }
         else
         {
-            m_pTexture->enableAndBind();
             gl::draw(m_mesh);
-            m_pTexture->disable();
-            m_pTexture->unbind();
+            FrameProfiler::CountDraw(m_mesh.getNumTriangles());
         }
+        texture.disable();
+        texture.unbind();
     }
 };
\ No newline at end of file
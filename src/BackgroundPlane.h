@@ -1,6 +1,10 @@
 #pragma once
 
 #include "Common.h"
+#include "TextureCache.h"
+#include "Frustum.h"
+#include "ViewState.h"
+#include "LoadProfiler.h"
 
 #define TEX_EPSILON 0.005f  // offsets edges of sprite to prevent texture bleeding
 
@@ -21,9 +25,10 @@ class BackgroundPlane
 public:
    
     TriMesh m_mesh;
-    Surface m_surface;
-    gl::Texture* m_pTexture;
-    deque<uint32_t> m_frames;
+    TextureRef m_texture;
+    vector<uint32_t> m_frames;
+    vector<uint32_t> m_frameEnds;      // running sum of m_frames, built by BuildTimeline()
+    uint32_t m_uniformDuration;        // of every frame when they all match, otherwise 0
     deque<Vec2f> m_texIndices;
     uint32_t m_numFrames;
     Vec2f m_spriteScale;
@@ -52,6 +57,7 @@ public:
                     const bool clampTexture,
                     const Vec2d& repeat,
                     const fs::path& surfPng) :
+        m_uniformDuration(0),
         m_numFrames(1),
         m_spriteScale(Vec2f(1.f,1.f)),
         m_packedScale(Vec2f(1.f,1.f)),
@@ -64,16 +70,18 @@ public:
         m_repeat(repeat),
         m_totalDuration(0)
     {
-        vector<Vec3f> positions;
-        vector<Vec3f> normals;
-        vector<Vec2f> texcoords;
-        const auto image = loadImage(surfPng);
         Vec2f bpDim;
         Vec2f bpActualDim;
         Vec2f imageDim;
         
-        imageDim.x = image->getWidth();
-        imageDim.y = image->getHeight();
+        // Only the dimensions are needed here, the pixels come from the shared surface cache below
+        Vec2i imageSize;
+        if (!ReadPngSize(surfPng, &imageSize))
+        {
+            imageSize = SurfaceCache::s_cache.Load(surfPng).getSize();
+        }
+        imageDim.x = imageSize.x;
+        imageDim.y = imageSize.y;
         
         if (pAnimXml)
         {
@@ -138,6 +146,7 @@ public:
             }
 
             m_numFrames = m_frames.size();
+            BuildTimeline();
         }
         else
         {
@@ -152,14 +161,13 @@ public:
         m_scale = bpScale * Vec3f(bpActualDim.x / 16, bpActualDim.y / 16, 1.f);
         m_rot = bpRot;
 
+        m_mesh.getVertices().assign(&c_positions[0], &c_positions[4]);
+        m_mesh.getNormals().assign(4, norm);
+        vector<Vec2f>& texcoords = m_mesh.getTexCoords();
+        texcoords.assign(&c_texcoords[0], &c_texcoords[4]);
         for (uint32_t i = 0; i < 4; i++)
         {
-            normals.push_back(norm);
-            
-            Vec3f pos = c_positions[i];
-            positions.push_back(pos);
-            
-            Vec2f texcoord = c_texcoords[i];
+            Vec2f& texcoord = texcoords[i];
             if (m_repeat.x || m_clampTexture)
             {
                 texcoord.x *= bpScale.x;
@@ -168,131 +176,166 @@ public:
             {
                 texcoord.y *= bpScale.y;
             }
-            texcoords.push_back(texcoord);
         }
-
-        m_mesh.appendVertices(&positions[0], 4);
-        m_mesh.appendNormals(&normals[0], 4);
-        m_mesh.appendTexCoords(&texcoords[0], 4);
-        m_mesh.appendIndices(&c_indices[0], 6);
+        m_mesh.getIndices().assign(&c_indices[0], &c_indices[6]);
+        LoadProfiler::Count(LOAD_VERTICES, 4);
                 
-        m_surface = loadImage(surfPng);
-        m_pTexture = nullptr;
+        m_texture = TextureCache::s_cache.Acquire(surfPng, GetSamplerState());
+        m_texture->IsTranslucent();     // scanned here on the loader rather than by the first draw
     }
-    
+
+    // Used by the baked level loader, which restores the remaining members and the texture directly
+    BackgroundPlane(const TriMesh& mesh) :
+        m_uniformDuration(0),
+        m_numFrames(1),
+        m_spriteScale(Vec2f(1.f,1.f)),
+        m_packedScale(Vec2f(1.f,1.f)),
+        m_packOffset(Vec2f(0.f,0.f)),
+        m_doubleSided(false),
+        m_billboard(false),
+        m_lightmap(false),
+        m_pixelatedLightmap(false),
+        m_clampTexture(false),
+        m_repeat(Vec2d(false, false)),
+        m_totalDuration(0)
+    {
+        m_mesh = mesh;
+    }
+
     ~BackgroundPlane()
     {
-        delete m_pTexture;
+
     }
 
-    void Draw(const CameraPersp& camera)
+    SamplerState GetSamplerState() const
     {
-        if (!m_pTexture)
-        {
-            m_pTexture = new gl::Texture(m_surface);
+        return SamplerState((m_lightmap && !m_pixelatedLightmap) ? GL_LINEAR : GL_NEAREST,
+                            m_repeat.x ? GL_REPEAT : GL_CLAMP,
+                            m_repeat.y ? GL_REPEAT : GL_CLAMP);
+    }
 
-            if (m_lightmap && !m_pixelatedLightmap)
+    // Billboards turn about Y to face the camera, so they are bounded for any rotation
+    Bounds GetBounds() const
+    {
+        Bounds bounds;
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            const Vec3f scaled = m_mesh.getVertices()[i] * m_scale;
+            if (m_billboard)
             {
-                m_pTexture->setMinFilter(GL_LINEAR);
-                m_pTexture->setMagFilter(GL_LINEAR);
+                const float radius = Vec2f(scaled.x, scaled.z).length();
+                bounds.Include(m_pos + Vec3f(-radius, scaled.y, -radius));
+                bounds.Include(m_pos + Vec3f(radius, scaled.y, radius));
             }
             else
             {
-                m_pTexture->setMinFilter(GL_NEAREST);
-                m_pTexture->setMagFilter(GL_NEAREST);
+                bounds.Include(m_pos + scaled * m_rot);
             }
+        }
+        return bounds;
+    }
 
-            if (m_repeat.x)
-            {
-                m_pTexture->setWrapS(GL_REPEAT);
-            }
-            else
+    // Must be called again whenever m_frames changes
+    void BuildTimeline()
+    {
+        m_frameEnds.resize(m_frames.size());
+        m_uniformDuration = m_frames.empty() ? 0 : m_frames[0];
+        uint32_t end = 0;
+        for (size_t i = 0; i < m_frames.size(); i++)
+        {
+            end += m_frames[i];
+            m_frameEnds[i] = end;
+            if (m_frames[i] != m_uniformDuration)
             {
-                m_pTexture->setWrapS(GL_CLAMP);
+                m_uniformDuration = 0;
             }
+        }
+        ASSERT(end == m_totalDuration);
+    }
 
-            if (m_repeat.y)
-            {
-                m_pTexture->setWrapT(GL_REPEAT);
-            }
-            else
-            {
-                m_pTexture->setWrapT(GL_CLAMP);
-            }
+    // Index into m_texIndices of the frame showing at the given time.
+    // A frame shows while the offset into the loop is in (start, end], so this is the first frame whose
+    // end is not before the offset, the same frame the original linear walk over m_frames stopped at.
+    uint32_t GetFrameIndex(const double seconds) const
+    {
+        if (m_frameEnds.empty() || m_totalDuration == 0)
+        {
+            return 0;
         }
-        else
+
+        const uint32_t timeOffset = (uint32_t)(seconds * 10000000) % m_totalDuration;
+        if (m_uniformDuration)
         {
-            uint32_t index = 0;
-            
-            if (m_frames.size() > 0 && m_totalDuration > 0)
-            {
-                uint32_t timeOffset = (uint32_t)(getElapsedSeconds() * 10000000) % m_totalDuration;
-                ASSERT(timeOffset < m_totalDuration);
-                
-                while (timeOffset > m_frames[index])
-                {
-                    timeOffset -= m_frames[index];
-                    index++;
-                    ASSERT(index < m_frames.size());
-                }
-            }
-            
-            m_pTexture->enableAndBind();
-            
-            if (m_doubleSided)
-            {
-                glDisable(GL_CULL_FACE);
-            }
-            if (m_lightmap)
-            {
-                glBlendFunc(GL_ONE, GL_ONE);
-            }
+            return timeOffset == 0 ? 0 : (timeOffset - 1) / m_uniformDuration;
+        }
+        const uint32_t index = lower_bound(m_frameEnds.begin(), m_frameEnds.end(), timeOffset) - m_frameEnds.begin();
+        ASSERT(index < m_frameEnds.size());
+        return index;
+    }
 
-            glMatrixMode(GL_TEXTURE);
-            glPushMatrix();
-            gl::scale(m_spriteScale * m_packedScale);
-            gl::translate(m_packOffset + m_texIndices[index] + 2 * m_packOffset * m_texIndices[index]);
+    // Multiplies the current texture matrix to select the given frame
+    void ApplyTextureTransform(const uint32_t index) const
+    {
+        gl::scale(m_spriteScale * m_packedScale);
+        gl::translate(m_packOffset + m_texIndices[index] + 2 * m_packOffset * m_texIndices[index]);
+    }
 
-            glMatrixMode(GL_MODELVIEW);
-            glPushMatrix();
+    // Multiplies the current modelview matrix by the plane's transform
+    void ApplyTransform(const float billboardAngle) const
+    {
+        gl::translate(m_pos);
+        if (m_billboard)
+        {
+            gl::rotate(Vec3f(0.f, billboardAngle, 0.f));
+        }
+        else
+        {
+            gl::rotate(m_rot);
+        }
+        gl::scale(m_scale);
+    }
 
-            if (m_billboard)
-            {
-                Vec3f mRight, mUp;
-                camera.getBillboardVectors(&mRight, &mUp);
-                float angleRad = ci::math<float>::acos(mRight.dot(Vec3f(1.f, 0.f, 0.f)));
-                float angleDeg = angleRad * 180.0 / M_PI;
-                angleDeg *= (mRight.z > 0 ? -1 : 1);    // get full 360 degree (signed) rotation
-                gl::translate(m_pos);
-                gl::rotate(Vec3f(0.f, angleDeg, 0.f));
-                gl::scale(m_scale);
-                gl::draw(m_mesh);
-            }
-            else
-            {
-                gl::translate(m_pos);
-                gl::rotate(m_rot);
-                gl::scale(m_scale);
-                gl::draw(m_mesh);
-            }
+    void Draw(const ViewState& view)
+    {
+        const gl::Texture& texture = m_texture->GetTexture();
+        const uint32_t index = GetFrameIndex(view.seconds);
+        
+        texture.enableAndBind();
+        
+        if (m_doubleSided)
+        {
+            glDisable(GL_CULL_FACE);
+        }
+        if (m_lightmap)
+        {
+            glBlendFunc(GL_ONE, GL_ONE);
+        }
 
-            glMatrixMode(GL_TEXTURE);
-            glPopMatrix();
+        glMatrixMode(GL_TEXTURE);
+        glPushMatrix();
+        ApplyTextureTransform(index);
 
-            glMatrixMode(GL_MODELVIEW);
-            glPopMatrix();
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+        ApplyTransform(view.billboardAngle);
+        gl::draw(m_mesh);
 
-            if (m_doubleSided)
-            {
-                glEnable(GL_CULL_FACE);
-            }
-            if (m_lightmap)
-            {
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-            }
+        glMatrixMode(GL_TEXTURE);
+        glPopMatrix();
 
-            m_pTexture->disable();
-            m_pTexture->unbind();
+        glMatrixMode(GL_MODELVIEW);
+        glPopMatrix();
+
+        if (m_doubleSided)
+        {
+            glEnable(GL_CULL_FACE);
         }
+        if (m_lightmap)
+        {
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        }
+
+        texture.disable();
+        texture.unbind();
     }
 };
\ No newline at end of file
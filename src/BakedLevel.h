@@ -0,0 +1,380 @@
+#pragma once
+
+#include "Common.h"
+#include "TrileSet.h"
+#include "ArtObject.h"
+#include "BackgroundPlane.h"
+#include "boost/interprocess/file_mapping.hpp"
+#include "boost/interprocess/mapped_region.hpp"
+#include <fstream>
+
+// A baked level is one little-endian file holding everything a level references:
+//   BakedHeader
+//   strings         (uint32_t length + chars, texture and source paths relative to the baked file)
+//   sources         (BakedSource[], every file the level was baked from)
+//   trile keys      (BakedMeshHeader, Vec3f positions, Vec2f texcoords, uint32_t indices, uint8_t normals)
+//   trile instances (BakedTrileInstance[])
+//   art objects     (BakedMeshHeader, Vec3f positions, Vec3f normals, Vec2f texcoords, uint32_t indices)
+//   planes          (BakedBackgroundPlane, uint32_t frame durations, Vec2f frame tex indices)
+// Every array starts 4 byte aligned so the mapped file can be read in place.
+
+#define BAKED_LEVEL_MAGIC       0x425A4546  // "FEZB"
+#define BAKED_LEVEL_VERSION     2
+#define BAKED_LEVEL_EXTENSION   ".fezb"
+
+enum BakedPlaneFlags
+{
+    BAKED_PLANE_DOUBLE_SIDED        = 1 << 0,
+    BAKED_PLANE_BILLBOARD           = 1 << 1,
+    BAKED_PLANE_LIGHTMAP            = 1 << 2,
+    BAKED_PLANE_PIXELATED_LIGHTMAP  = 1 << 3,
+    BAKED_PLANE_CLAMP_TEXTURE       = 1 << 4,
+    BAKED_PLANE_REPEAT_X            = 1 << 5,
+    BAKED_PLANE_REPEAT_Y            = 1 << 6,
+};
+
+struct BakedHeader
+{
+    uint32_t    magic;
+    uint32_t    version;
+    Vec3f       dimensions;
+    uint32_t    trileSetTexture;    // string index
+    uint32_t    numStrings;
+    uint32_t    numSources;
+    uint32_t    numTrileKeys;
+    uint32_t    numTrileInstances;
+    uint32_t    numArtObjects;
+    uint32_t    numBackgroundPlanes;
+};
+
+struct BakedSource
+{
+    uint32_t    path;               // string index
+    uint32_t    lastWriteTime[2];   // time_t when it was read for baking, low word first
+};
+
+struct BakedMeshHeader
+{
+    uint32_t    id;                 // trile key, or string index of the art object texture
+    uint32_t    numVertices;
+    uint32_t    numIndices;
+};
+
+struct BakedTrileInstance
+{
+    uint32_t    key;
+    uint32_t    orient;
+    Vec3f       pos;
+    Vec3f       emplacement;
+};
+
+struct BakedBackgroundPlane
+{
+    uint32_t    texture;            // string index
+    uint32_t    flags;              // BakedPlaneFlags
+    uint32_t    numFrames;
+    uint32_t    numTexIndices;
+    uint32_t    totalDuration;
+    Vec3f       pos;
+    Vec3f       scale;
+    float       rot[4];             // w, x, y, z
+    Vec3f       normal;
+    Vec2f       texcoords[4];
+    Vec2f       spriteScale;
+    Vec2f       packedScale;
+    Vec2f       packOffset;
+};
+
+class BakedLevelWriter
+{
+public:
+
+    fs::path                    m_bakedDir;
+    BakedHeader                 m_header;
+    vector<string>              m_strings;
+    map<string, uint32_t>       m_stringIndices;
+    vector<BakedSource>         m_sources;
+    vector<uint8_t>             m_trileKeys;
+    vector<BakedTrileInstance>  m_trileInstances;
+    vector<uint8_t>             m_artObjects;
+    vector<uint8_t>             m_backgroundPlanes;
+
+    BakedLevelWriter(const fs::path& bakedDir) :
+        m_bakedDir(bakedDir),
+        m_header()
+    {
+        m_header.magic = BAKED_LEVEL_MAGIC;
+        m_header.version = BAKED_LEVEL_VERSION;
+    }
+
+    void SetDimensions(const Vec3f& dimensions)
+    {
+        m_header.dimensions = dimensions;
+    }
+
+    void SetTrileSetTexture(const fs::path& png)
+    {
+        m_header.trileSetTexture = AddString(png);
+    }
+
+    void AddSource(const fs::path& path, const time_t lastWriteTime)
+    {
+        const BakedSource source = { AddString(path), { (uint32_t)(uint64_t)lastWriteTime, (uint32_t)((uint64_t)lastWriteTime >> 32) } };
+        m_sources.push_back(source);
+        m_header.numSources++;
+    }
+
+    void AddTrileSet(const TrileSet& trileSet)
+    {
+        for (const auto& entry : trileSet.m_geometry)
+        {
+            const TrileGeometry& geometry = entry.second;
+            const BakedMeshHeader header = { entry.first, (uint32_t)geometry.positions.size(), (uint32_t)geometry.indices.size() };
+            Append(m_trileKeys, &header, 1);
+            Append(m_trileKeys, geometry.positions.empty() ? nullptr : &geometry.positions[0], geometry.positions.size());
+            Append(m_trileKeys, geometry.texcoords.empty() ? nullptr : &geometry.texcoords[0], geometry.texcoords.size());
+            Append(m_trileKeys, geometry.indices.empty() ? nullptr : &geometry.indices[0], geometry.indices.size());
+            Append(m_trileKeys, geometry.normals.empty() ? nullptr : &geometry.normals[0], geometry.normals.size());
+            m_header.numTrileKeys++;
+        }
+    }
+
+    void AddTrileInstance(const uint32_t key, const uint32_t orient, const Vec3f& pos, const Vec3f& emplacement)
+    {
+        const BakedTrileInstance instance = { key, orient, pos, emplacement };
+        m_trileInstances.push_back(instance);
+        m_header.numTrileInstances++;
+    }
+
+    void AddArtObject(const ArtObject& ao, const fs::path& png)
+    {
+        const TriMesh& mesh = ao.m_mesh;
+        const BakedMeshHeader header = { AddString(png), (uint32_t)mesh.getNumVertices(), (uint32_t)mesh.getNumIndices() };
+        Append(m_artObjects, &header, 1);
+        Append(m_artObjects, mesh.getVertices().empty() ? nullptr : &mesh.getVertices()[0], mesh.getNumVertices());
+        Append(m_artObjects, mesh.getNormals().empty() ? nullptr : &mesh.getNormals()[0], mesh.getNormals().size());
+        Append(m_artObjects, mesh.getTexCoords().empty() ? nullptr : &mesh.getTexCoords()[0], mesh.getTexCoords().size());
+        Append(m_artObjects, mesh.getIndices().empty() ? nullptr : &mesh.getIndices()[0], mesh.getNumIndices());
+        m_header.numArtObjects++;
+    }
+
+    void AddBackgroundPlane(const BackgroundPlane& bp, const fs::path& png)
+    {
+        BakedBackgroundPlane record = BakedBackgroundPlane();
+        record.texture = AddString(png);
+        record.flags = (bp.m_doubleSided ? BAKED_PLANE_DOUBLE_SIDED : 0) |
+                       (bp.m_billboard ? BAKED_PLANE_BILLBOARD : 0) |
+                       (bp.m_lightmap ? BAKED_PLANE_LIGHTMAP : 0) |
+                       (bp.m_pixelatedLightmap ? BAKED_PLANE_PIXELATED_LIGHTMAP : 0) |
+                       (bp.m_clampTexture ? BAKED_PLANE_CLAMP_TEXTURE : 0) |
+                       (bp.m_repeat.x ? BAKED_PLANE_REPEAT_X : 0) |
+                       (bp.m_repeat.y ? BAKED_PLANE_REPEAT_Y : 0);
+        record.numFrames = bp.m_frames.size();
+        record.numTexIndices = bp.m_texIndices.size();
+        record.totalDuration = bp.m_totalDuration;
+        record.pos = bp.m_pos;
+        record.scale = bp.m_scale;
+        record.rot[0] = bp.m_rot.w;
+        record.rot[1] = bp.m_rot.v.x;
+        record.rot[2] = bp.m_rot.v.y;
+        record.rot[3] = bp.m_rot.v.z;
+        record.normal = bp.m_mesh.getNormals()[0];
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            record.texcoords[i] = bp.m_mesh.getTexCoords()[i];
+        }
+        record.spriteScale = bp.m_spriteScale;
+        record.packedScale = bp.m_packedScale;
+        record.packOffset = bp.m_packOffset;
+        Append(m_backgroundPlanes, &record, 1);
+
+        const vector<Vec2f> texIndices(bp.m_texIndices.begin(), bp.m_texIndices.end());
+        Append(m_backgroundPlanes, bp.m_frames.empty() ? nullptr : &bp.m_frames[0], bp.m_frames.size());
+        Append(m_backgroundPlanes, texIndices.empty() ? nullptr : &texIndices[0], texIndices.size());
+        m_header.numBackgroundPlanes++;
+    }
+
+    bool Write(const fs::path& bakedFile)
+    {
+        vector<uint8_t> strings;
+        for (const string& str : m_strings)
+        {
+            const uint32_t length = str.size();
+            Append(strings, &length, 1);
+            Append(strings, str.c_str(), length);
+        }
+        m_header.numStrings = m_strings.size();
+
+        ofstream out(bakedFile.string().c_str(), ios::out | ios::binary | ios::trunc);
+        if (!out)
+        {
+            return false;
+        }
+        out.write((const char*)&m_header, sizeof(m_header));
+        WriteBlock(out, strings);
+        if (!m_sources.empty())
+        {
+            out.write((const char*)&m_sources[0], m_sources.size() * sizeof(BakedSource));
+        }
+        WriteBlock(out, m_trileKeys);
+        if (!m_trileInstances.empty())
+        {
+            out.write((const char*)&m_trileInstances[0], m_trileInstances.size() * sizeof(BakedTrileInstance));
+        }
+        WriteBlock(out, m_artObjects);
+        WriteBlock(out, m_backgroundPlanes);
+        return out.good();
+    }
+
+private:
+
+    // Texture paths are stored relative to the baked file so the content folder can be moved
+    uint32_t AddString(const fs::path& path)
+    {
+        string str = path.string();
+        const string prefix = m_bakedDir.string() + '/';
+        if (str.compare(0, prefix.size(), prefix) == 0)
+        {
+            str = str.substr(prefix.size());
+        }
+
+        const auto it = m_stringIndices.find(str);
+        if (it != m_stringIndices.end())
+        {
+            return it->second;
+        }
+        const uint32_t index = m_strings.size();
+        m_strings.push_back(str);
+        m_stringIndices.insert(make_pair(str, index));
+        return index;
+    }
+
+    template<typename T>
+    static void Append(vector<uint8_t>& block, const T* pData, const size_t count)
+    {
+        const size_t bytes = count * sizeof(T);
+        const size_t padded = (bytes + 3) & ~3;
+        const size_t offset = block.size();
+        block.resize(offset + padded, 0);
+        if (bytes)
+        {
+            memcpy(&block[offset], pData, bytes);
+        }
+    }
+
+    static void WriteBlock(ofstream& out, const vector<uint8_t>& block)
+    {
+        if (!block.empty())
+        {
+            out.write((const char*)&block[0], block.size());
+        }
+    }
+};
+
+class BakedLevelReader
+{
+public:
+
+    boost::interprocess::file_mapping   m_file;
+    boost::interprocess::mapped_region  m_region;
+    const BakedHeader*                  m_pHeader;
+    const uint8_t*                      m_pCursor;
+    const uint8_t*                      m_pEnd;
+
+    BakedLevelReader() :
+        m_pHeader(nullptr),
+        m_pCursor(nullptr),
+        m_pEnd(nullptr)
+    {
+    }
+
+    bool Open(const fs::path& bakedFile)
+    {
+        try
+        {
+            boost::interprocess::file_mapping file(bakedFile.string().c_str(), boost::interprocess::read_only);
+            boost::interprocess::mapped_region region(file, boost::interprocess::read_only);
+            m_file.swap(file);
+            m_region.swap(region);
+        }
+        catch (boost::interprocess::interprocess_exception&)
+        {
+            return false;
+        }
+
+        m_pCursor = (const uint8_t*)m_region.get_address();
+        m_pEnd = m_pCursor + m_region.get_size();
+        LoadProfiler::Count(LOAD_BYTES_READ, m_region.get_size());
+        m_pHeader = Read<BakedHeader>(1);
+        return m_pHeader &&
+               m_pHeader->magic == BAKED_LEVEL_MAGIC &&
+               m_pHeader->version == BAKED_LEVEL_VERSION;
+    }
+
+    // Returns a pointer into the mapped file, or nullptr if the file is truncated
+    template<typename T>
+    const T* Read(const uint32_t count)
+    {
+        const size_t padded = (count * sizeof(T) + 3) & ~3;
+        if (!m_pCursor || (size_t)(m_pEnd - m_pCursor) < padded)
+        {
+            m_pCursor = nullptr;
+            return nullptr;
+        }
+        const T* pData = (const T*)m_pCursor;
+        m_pCursor += padded;
+        return pData;
+    }
+
+    bool ReadString(string* pStr)
+    {
+        const uint32_t* pLength = Read<uint32_t>(1);
+        if (!pLength)
+        {
+            return false;
+        }
+        const char* pChars = Read<char>(*pLength);
+        if (!pChars)
+        {
+            return false;
+        }
+        pStr->assign(pChars, *pLength);
+        return true;
+    }
+
+    // For data that was read but doesn't make sense, later reads fail as if the file were truncated
+    void Fail()
+    {
+        m_pCursor = nullptr;
+    }
+
+    bool Failed() const
+    {
+        return m_pCursor == nullptr;
+    }
+
+    static time_t GetLastWriteTime(const BakedSource& source)
+    {
+        return (time_t)(((uint64_t)source.lastWriteTime[1] << 32) | source.lastWriteTime[0]);
+    }
+
+    // The mesh builders index the vertices, and gc_normals for trile keys, without checking
+    static bool IsValidMesh(const uint32_t* pIndices, const uint32_t numIndices, const uint32_t numVertices, const uint8_t* pNormals = nullptr)
+    {
+        for (uint32_t i = 0; i < numIndices; i++)
+        {
+            if (pIndices[i] >= numVertices)
+            {
+                return false;
+            }
+        }
+        for (uint32_t i = 0; pNormals && i < numVertices; i++)
+        {
+            if (pNormals[i] >= sizeof(gc_normals) / sizeof(gc_normals[0]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
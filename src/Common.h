@@ -11,9 +11,13 @@
 #include "cinder/ImageIo.h"
 #include "cinder/Text.h"
 #include "cinder/Timeline.h"
+#include "cinder/Timer.h"
 #include "boost/algorithm/String.hpp"
+#include <algorithm>
+#include <atomic>
 #include <list>
 #include <map>
+#include <set>
 #include <vector>
 #include <deque>
 #include "Resources.h"
@@ -39,4 +43,12 @@ struct RenderObject
 {
     TriMesh     mesh;
     uint32_t    textureIndex;
-};
\ No newline at end of file
+};
+
+// Functions
+
+// The app's console, or stderr in the tools that run without an App so their reports on stdout stay clean
+inline ostream& Log()
+{
+    return App::get() ? console() : cerr;
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include "Common.h"
+#include "cinder/gl/Vbo.h"
+#include "Frustum.h"
+
+#define COMPACT_POSITION_SCALE      256.f       // positions are stored on a 1/256 grid
+#define COMPACT_TEXCOORD_SCALE      32767.f     // [0,1] texcoords, GL_SHORT is the widest type glTexCoordPointer takes
+#define COMPACT_POSITION_TOLERANCE  (0.5f / COMPACT_POSITION_SCALE)     // per axis, rounding to the nearest step
+#define COMPACT_TEXCOORD_TOLERANCE  (0.5f / COMPACT_TEXCOORD_SCALE)
+
+// 12 bytes instead of the 32 of a float position, normal and texcoord
+struct CompactVertex
+{
+    int16_t     position[3];    // relative to the mesh origin, in 1/COMPACT_POSITION_SCALE units
+    uint8_t     normal;         // index into gc_normals
+    uint8_t     pad;
+    int16_t     texcoord[2];    // in 1/COMPACT_TEXCOORD_SCALE units
+};
+
+// Quantized copy of a TriMesh for static geometry, drawn by the fixed function pipeline with the
+// dequantization folded into the modelview and texture matrices.
+// Build() rounds every component to the nearest step, so decoding is within the tolerances per axis, and
+// refuses meshes it can't represent: positions further than +-127 units from the origin, texcoords outside
+// [0,1] or normals off the axes.
+class CompactMesh
+{
+public:
+
+    vector<CompactVertex>   m_vertices;
+    vector<uint32_t>        m_indices;
+    Vec3f                   m_origin;       // on the integer grid, so meshes that share a vertex quantize it identically
+    Bounds                  m_bounds;
+
+    CompactMesh() :
+        m_origin(Vec3f::zero()),
+        m_uploaded(false)
+    {
+    }
+
+    bool Build(const TriMesh& mesh)
+    {
+        Clear();
+        const vector<Vec3f>& positions = mesh.getVertices();
+        const vector<Vec3f>& normals = mesh.getNormals();
+        const vector<Vec2f>& texcoords = mesh.getTexCoords();
+        if (positions.empty() || normals.size() != positions.size() || texcoords.size() != positions.size())
+        {
+            return false;
+        }
+
+        for (const Vec3f& pos : positions)
+        {
+            m_bounds.Include(pos);
+        }
+        const Vec3f center = m_bounds.GetCenter();
+        m_origin = Vec3f(math<float>::floor(center.x), math<float>::floor(center.y), math<float>::floor(center.z));
+
+        m_vertices.resize(positions.size());
+        for (size_t i = 0; i < positions.size(); i++)
+        {
+            CompactVertex& vertex = m_vertices[i];
+            const Vec3f pos = (positions[i] - m_origin) * COMPACT_POSITION_SCALE;
+            for (uint32_t axis = 0; axis < 3; axis++)
+            {
+                if (math<float>::abs(pos[axis]) > 32767.f)
+                {
+                    Clear();
+                    return false;
+                }
+                vertex.position[axis] = (int16_t)math<float>::floor(pos[axis] + 0.5f);
+            }
+
+            const Vec2f& texcoord = texcoords[i];
+            if (texcoord.x < 0.f || texcoord.x > 1.f || texcoord.y < 0.f || texcoord.y > 1.f)
+            {
+                Clear();
+                return false;
+            }
+            vertex.texcoord[0] = (int16_t)math<float>::floor(texcoord.x * COMPACT_TEXCOORD_SCALE + 0.5f);
+            vertex.texcoord[1] = (int16_t)math<float>::floor(texcoord.y * COMPACT_TEXCOORD_SCALE + 0.5f);
+
+            vertex.normal = 0;
+            vertex.pad = 0;
+            for (uint8_t n = 1; n < extent<decltype(gc_normals)>::value; n++)
+            {
+                if (normals[i].dot(gc_normals[n]) > normals[i].dot(gc_normals[vertex.normal]))
+                {
+                    vertex.normal = n;
+                }
+            }
+
+            if (normals[i].dot(gc_normals[vertex.normal]) < 0.999f)
+            {
+                Clear();
+                return false;
+            }
+        }
+
+        m_indices = mesh.getIndices();
+        return true;
+    }
+
+    Vec3f DecodePosition(const size_t i) const
+    {
+        const int16_t* pos = m_vertices[i].position;
+        return m_origin + Vec3f(pos[0], pos[1], pos[2]) / COMPACT_POSITION_SCALE;
+    }
+
+    Vec3f DecodeNormal(const size_t i) const
+    {
+        return gc_normals[m_vertices[i].normal];
+    }
+
+    Vec2f DecodeTexcoord(const size_t i) const
+    {
+        const int16_t* texcoord = m_vertices[i].texcoord;
+        return Vec2f(texcoord[0], texcoord[1]) / COMPACT_TEXCOORD_SCALE;
+    }
+
+    bool IsEmpty() const
+    {
+        return m_indices.empty();
+    }
+
+    size_t GetNumVertices() const
+    {
+        return m_vertices.size();
+    }
+
+    size_t GetVertexBytes() const
+    {
+        return m_vertices.size() * sizeof(CompactVertex);
+    }
+
+    // What the same vertices take as a TriMesh with positions, normals and texcoords
+    static size_t GetFloatVertexBytes(const size_t numVertices)
+    {
+        return numVertices * (sizeof(Vec3f) * 2 + sizeof(Vec2f));
+    }
+
+    // Must be called on the GL thread, uploads on first use. Normals aren't bound, nothing is lit.
+    void Draw()
+    {
+        if (IsEmpty())
+        {
+            return;
+        }
+        if (!m_uploaded)
+        {
+            m_vertexVbo = gl::Vbo(GL_ARRAY_BUFFER);
+            m_vertexVbo.bufferData(m_vertices.size() * sizeof(CompactVertex), &m_vertices[0], GL_STATIC_DRAW);
+            m_indexVbo = gl::Vbo(GL_ELEMENT_ARRAY_BUFFER);
+            m_indexVbo.bufferData(m_indices.size() * sizeof(uint32_t), &m_indices[0], GL_STATIC_DRAW);
+            m_uploaded = true;
+        }
+
+        gl::pushModelView();
+        gl::translate(m_origin);
+        gl::scale(Vec3f::one() / COMPACT_POSITION_SCALE);
+        glMatrixMode(GL_TEXTURE);
+        glPushMatrix();
+        glLoadIdentity();
+        glScalef(1.f / COMPACT_TEXCOORD_SCALE, 1.f / COMPACT_TEXCOORD_SCALE, 1.f);
+        glMatrixMode(GL_MODELVIEW);
+
+        m_vertexVbo.bind();
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glVertexPointer(3, GL_SHORT, sizeof(CompactVertex), (const GLvoid*)offsetof(CompactVertex, position));
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glTexCoordPointer(2, GL_SHORT, sizeof(CompactVertex), (const GLvoid*)offsetof(CompactVertex, texcoord));
+        m_indexVbo.bind();
+        glDrawElements(GL_TRIANGLES, m_indices.size(), GL_UNSIGNED_INT, 0);
+        m_indexVbo.unbind();
+        m_vertexVbo.unbind();
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+
+        glMatrixMode(GL_TEXTURE);
+        glPopMatrix();
+        glMatrixMode(GL_MODELVIEW);
+        gl::popModelView();
+    }
+
+    void Clear()
+    {
+        m_vertices.clear();
+        m_indices.clear();
+        m_origin = Vec3f::zero();
+        m_bounds = Bounds();
+        m_uploaded = false;
+    }
+
+private:
+
+    gl::Vbo     m_vertexVbo;
+    gl::Vbo     m_indexVbo;
+    bool        m_uploaded;
+};
@@ -0,0 +1,444 @@
+#include "Common.h"
+#include "Trile.h"
+#include "ArtObject.h"
+#include "BackgroundPlane.h"
+#include "PlaneRenderQueue.h"
+#include "PlaneInstancing.h"
+#include "ViewState.h"
+#include "WorkerPool.h"
+#include "AllocationStats.h"
+#include "LevelLoader.h"
+#include "Scene.h"
+#include "SoftwareRenderer.h"
+#include "LoadProfiler.h"
+#include "LoadBenchmark.h"
+#include "FrameProfiler.h"
+
+#define RENDER_WIDTH    1280    // of the images written by -render
+#define RENDER_HEIGHT   720
+
+// The statics FezViewer.cpp defines for the app
+gl::Texture* Trile::s_pTexture;
+SurfaceCache SurfaceCache::s_cache;
+TextureCache TextureCache::s_cache;
+atomic<uint64_t> AllocationStats::s_numAllocations;
+atomic<uint64_t> AllocationStats::s_numBytes;
+LoadProfiler LoadProfiler::s_profiler;
+LOAD_THREAD_LOCAL ScopedLoadTimer* ScopedLoadTimer::s_pCurrent;
+FrameProfiler FrameProfiler::s_profiler;
+
+#ifdef COUNT_ALLOCATIONS
+// Counted replacements of the global allocation functions, the array forms forward to these. The FezBatch
+// projects define COUNT_ALLOCATIONS in every configuration, so -loadbench always reports allocations.
+void* operator new(size_t size)
+{
+    AllocationStats::s_numAllocations++;
+    AllocationStats::s_numBytes += size;
+    void* p = malloc(size ? size : 1);
+    if (!p)
+    {
+        throw bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) throw()
+{
+    free(p);
+}
+#endif
+
+// The viewer's batch jobs as a console tool, so they run without a window, a display or GL. Levels and
+// art objects are loaded by the same LevelLoader the viewer uses and drawn by the SoftwareRenderer.
+class FezBatch
+{
+  public:
+    FezBatch();
+    int run(const vector<string>& args);
+    void print(const string& str);
+    void setupLoader(LevelLoader& loader, Scene& scene);
+    vector<fs::path> expandBatchPaths(const vector<fs::path>& paths);
+    int renderBatch();
+    int benchmarkBatch();
+    bool renderFile(const fs::path& file);
+    void drawScene(const Scene& scene, const float zoom, SoftwareRenderer& renderer);
+    bool writeRender(SoftwareRenderer& renderer, const fs::path& png, const fs::path& file);
+
+    bool                    m_verbose;
+    bool                    m_bake;
+    bool                    m_xmlTree;
+    bool                    m_compactVertices;
+    bool                    m_staticBatching;
+    bool                    m_greedyMeshing;
+    vector<fs::path>        m_renderPaths;  // levels, art objects or directories of them to render
+    fs::path                m_renderOutput;
+    vector<fs::path>        m_benchmarkPaths;   // levels, art objects or directories of them to time loading
+    fs::path                m_benchmarkOutput;  // the JSON report, also printed to the console
+    LoadBenchmark           m_loadBenchmark;
+    fs::path                m_loadTrace;    // Chrome trace of every load's phases and assets
+    WorkerPool              m_workerPool;
+    mutex                   m_printMutex;   // keeps the lines of files loading side by side apart
+};
+
+FezBatch::FezBatch() :
+    m_verbose(false),
+    m_bake(false),
+    m_xmlTree(false),
+    m_compactVertices(false),
+    m_staticBatching(false),
+    m_greedyMeshing(false),
+    m_renderOutput("renders")
+{
+}
+
+int FezBatch::run(const vector<string>& args)
+{
+    string previousArg;
+    for (auto arg : args)
+    {
+        if (previousArg == "-render")
+        {
+            m_renderPaths.push_back(arg);
+        }
+        else if (previousArg == "-renderout")
+        {
+            m_renderOutput = arg;
+        }
+        else if (previousArg == "-loadbench")
+        {
+            m_benchmarkPaths.push_back(arg);
+        }
+        else if (previousArg == "-loadbenchruns")
+        {
+            m_loadBenchmark.m_numRuns = max(atoi(arg.c_str()), 1);
+        }
+        else if (previousArg == "-loadbenchout")
+        {
+            m_benchmarkOutput = arg;
+        }
+        else if (previousArg == "-loadtrace")
+        {
+            m_loadTrace = arg;
+        }
+        previousArg = arg;
+        if (arg == "-verbose")
+        {
+            m_verbose = true;
+        }
+        if (arg == "-bake")
+        {
+            m_bake = true;
+        }
+        if (arg == "-xmltree")
+        {
+            m_xmlTree = true;
+        }
+        if (arg == "-compact")
+        {
+            m_compactVertices = true;
+        }
+        if (arg == "-staticbatch")
+        {
+            m_staticBatching = true;
+        }
+        if (arg == "-greedymesh")
+        {
+            m_staticBatching = true;
+            m_greedyMeshing = true;
+        }
+    }
+
+    if (!m_benchmarkPaths.empty())
+    {
+        return benchmarkBatch();
+    }
+    if (!m_renderPaths.empty())
+    {
+        return renderBatch();
+    }
+    cout << "Usage: FezBatch -render <level, art object or directory> [-render ...] [-renderout <directory>]" << endl <<
+            "       FezBatch -loadbench <level, art object or directory> [-loadbench ...] [-loadbenchruns <n>] [-loadbenchout <file>]" << endl <<
+            "       [-loadtrace <file>] [-verbose] [-bake] [-xmltree] [-compact] [-staticbatch] [-greedymesh]" << endl;
+    return 1;
+}
+
+void FezBatch::print(const string& str)
+{
+    lock_guard<mutex> lock( m_printMutex );
+    Log() << str << endl;
+}
+
+// The scene is applied as soon as it is handed over
+void FezBatch::setupLoader(LevelLoader& loader, Scene& scene)
+{
+    loader.m_verbose = m_verbose;
+    loader.m_bake = m_bake;
+    loader.m_xmlTree = m_xmlTree;
+    loader.m_staticBatching = m_staticBatching;
+    loader.m_greedyMeshing = m_greedyMeshing;
+    loader.m_compactVertices = m_compactVertices;
+    loader.m_publish = [&](SceneBatchRef& pBatch)
+    {
+        scene.Apply(*pBatch);
+        pBatch = nullptr;
+        return true;
+    };
+    loader.m_display = [&](const string& str)
+    {
+        if (m_verbose || str.compare(0, 6, "ERROR!") == 0)
+        {
+            print(str);
+        }
+    };
+}
+
+// Directories are replaced by the .xml files they contain, in name order
+vector<fs::path> FezBatch::expandBatchPaths(const vector<fs::path>& paths)
+{
+    vector<fs::path> files;
+    for (const fs::path& path : paths)
+    {
+        if (fs::is_directory(path))
+        {
+            vector<fs::path> directoryFiles;
+            for (fs::directory_iterator it(path), end; it != end; ++it)
+            {
+                if (getPathExtension(it->path().string()) == "xml")
+                {
+                    directoryFiles.push_back(it->path());
+                }
+            }
+            sort(directoryFiles.begin(), directoryFiles.end());
+            files.insert(files.end(), directoryFiles.begin(), directoryFiles.end());
+        }
+        else
+        {
+            files.push_back(path);
+        }
+    }
+    return files;
+}
+
+// Loads each level and art object given with -render and writes a software rendered image of it to the
+// -renderout directory. Directories render every .xml they contain. Every file is a task of its own that
+// loads, draws and rasterizes it, so as many files are in flight as the pool has workers, and the loads'
+// own tasks share the workers with them. Returns the exit code, non-zero if any file failed.
+int FezBatch::renderBatch()
+{
+    const vector<fs::path> files = expandBatchPaths(m_renderPaths);
+
+    boost::system::error_code error;
+    fs::create_directories(m_renderOutput, error);
+
+    Timer timer(true);
+    LoadProfiler::s_profiler.Begin();
+    atomic<uint32_t> numRendered(0);
+    m_workerPool.ParallelFor(files.size(), [&](uint32_t i)
+    {
+        if (renderFile(files[i]))
+        {
+            numRendered++;
+        }
+    });
+
+    if (!m_loadTrace.empty())
+    {
+        ofstream out(m_loadTrace.string().c_str());
+        LoadProfiler::s_profiler.WriteTrace(out);
+    }
+    if (m_verbose)
+    {
+        Log() << LoadProfiler::s_profiler.GetSummary();
+    }
+
+    ostringstream displayString;
+    displayString << "Rendered " << numRendered.load() << " of " << files.size() << " files to " << m_renderOutput <<
+                     " in " << timer.getSeconds() << " seconds";
+    print(displayString.str());
+    return numRendered == files.size() ? 0 : 1;
+}
+
+// Loads each file given with -loadbench through the full pipeline several times and reports every load's
+// phases as JSON. Files load one after another so their phases and allocations aren't mixed up, and the
+// surface cache is cleared between loads so images decode again. Returns the exit code, non-zero if any
+// file failed to load.
+int FezBatch::benchmarkBatch()
+{
+    const vector<fs::path> files = expandBatchPaths(m_benchmarkPaths);
+    m_loadBenchmark.m_files.clear();
+    bool loadedAll = true;
+    for (const fs::path& file : files)
+    {
+        Scene scene;
+        LevelLoader loader(m_workerPool);
+        setupLoader(loader, scene);
+        loader.m_loadTrace = m_loadTrace;
+
+        LoadBenchmarkFile result;
+        result.path = file;
+        result.loaded = true;
+        for (uint32_t n = 0; n < m_loadBenchmark.m_numRuns; n++)
+        {
+            scene.Clear();
+            SurfaceCache::s_cache.Clear();
+            TextureCache::s_cache.ResetStats();
+
+            LoadBenchmarkRun run;
+            const AllocationCount startAllocations = AllocationStats::Get();
+            Timer timer(true);
+            const bool loaded = loader.Load(file);
+            loader.m_loadPhases.End();
+            run.seconds = timer.getSeconds();
+            run.allocations = AllocationStats::Since(startAllocations);
+            run.phases = loader.m_loadPhases.m_phases;
+            result.runs.push_back(run);
+            result.loaded = result.loaded && loaded;
+            if (!loaded)
+            {
+                break;
+            }
+        }
+        result.numTriles = scene.m_triles.size();
+        result.numArtObjects = scene.m_artObjects.size();
+        result.numBackgroundPlanes = scene.m_backgroundPlanes.size();
+        m_loadBenchmark.m_files.push_back(result);
+        loadedAll = loadedAll && result.loaded;
+    }
+    SurfaceCache::s_cache.Clear();
+    m_loadBenchmark.m_peakResidentBytes = LoadBenchmark::GetPeakResidentBytes();
+
+    m_loadBenchmark.WriteJson(cout);
+    if (!m_benchmarkOutput.empty())
+    {
+        ofstream out(m_benchmarkOutput.string().c_str());
+        m_loadBenchmark.WriteJson(out);
+    }
+    return loadedAll ? 0 : 1;
+}
+
+// Runs on the worker pool, the loader reports why a file didn't load
+bool FezBatch::renderFile(const fs::path& file)
+{
+    Scene scene;
+    LevelLoader loader(m_workerPool);
+    setupLoader(loader, scene);
+    loader.m_sharedProfile = true;     // begun and reported by renderBatch()
+    if (!loader.Load(file))
+    {
+        return false;
+    }
+
+    SoftwareRenderer renderer;
+    drawScene(scene, LevelLoader::GetViewDistance(file), renderer);
+    return writeRender(renderer, m_renderOutput / (file.stem().string() + ".png"), file);
+}
+
+// Draws the scene from the initial camera the way the viewer would
+void FezBatch::drawScene(const Scene& scene, const float zoom, SoftwareRenderer& renderer)
+{
+    CameraPersp camera;
+    camera.setPerspective(60, (float)RENDER_WIDTH / RENDER_HEIGHT, 1, 1000);
+    camera.lookAt(Vec3f(0, 0, zoom), Vec3f::zero());
+    ViewState view;
+    view.Set(camera, 0.0, true);
+
+    renderer.Begin(RENDER_WIDTH, RENDER_HEIGHT, Colorf(0.2f, 0.2f, 0.3f), view.viewProjection);
+
+    const Vec4f noFrame(1.f, 1.f, 0.f, 0.f);
+    if (!scene.m_triles.empty() && scene.m_trileSurface)
+    {
+        const uint32_t texture = renderer.AddTexture(scene.m_trileSurface, SamplerState(GL_NEAREST));
+        for (const Trile& trile : scene.m_triles)
+        {
+            const TriMesh& mesh = trile.m_pGeometry->meshes[trile.m_orient];
+            renderer.Draw(mesh.getVertices(), mesh.getTexCoords(), mesh.getIndices(), trile.m_pos, texture, noFrame, SOFTWARE_CULL_BACK);
+        }
+    }
+
+    for (const ArtObject& ao : scene.m_artObjects)
+    {
+        if (!ao.m_texture)
+        {
+            continue;
+        }
+        const uint32_t texture = renderer.AddTexture(ao.m_texture->m_surface, ao.m_texture->m_sampler);
+        if (ao.m_compactMesh.IsEmpty())
+        {
+            renderer.Draw(ao.m_mesh.getVertices(), ao.m_mesh.getTexCoords(), ao.m_mesh.getIndices(), Vec3f::zero(), texture, noFrame, SOFTWARE_CULL_BACK);
+        }
+        else
+        {
+            vector<Vec3f> positions(ao.m_compactMesh.GetNumVertices());
+            vector<Vec2f> texcoords(positions.size());
+            for (size_t i = 0; i < positions.size(); i++)
+            {
+                positions[i] = ao.m_compactMesh.DecodePosition(i);
+                texcoords[i] = ao.m_compactMesh.DecodeTexcoord(i);
+            }
+            renderer.Draw(positions, texcoords, ao.m_compactMesh.m_indices, Vec3f::zero(), texture, noFrame, SOFTWARE_CULL_BACK);
+        }
+    }
+
+    // In the plane queue's order, so the lightmaps add onto everything they light
+    PlaneRenderQueue planeQueue;
+    for (uint32_t i = 0; i < scene.m_backgroundPlanes.size(); i++)
+    {
+        planeQueue.Add(i, scene.m_backgroundPlanes[i], view);
+    }
+    planeQueue.Sort();
+
+    const float angle = view.billboardAngle * (float)M_PI / 180.f;
+    const float s = math<float>::sin(angle);
+    const float c = math<float>::cos(angle);
+    for (const PlaneDrawItem& item : planeQueue.m_items)
+    {
+        const BackgroundPlane& bp = scene.m_backgroundPlanes[item.index];
+        if (!bp.m_texture || bp.m_texIndices.empty())
+        {
+            continue;
+        }
+
+        // Same transform as ApplyTransform(), applied to the vertices
+        vector<Vec3f> positions = bp.m_mesh.getVertices();
+        for (Vec3f& pos : positions)
+        {
+            const Vec3f scaled = pos * bp.m_scale;
+            pos = bp.m_billboard ? Vec3f(c * scaled.x + s * scaled.z, scaled.y, c * scaled.z - s * scaled.x) : scaled * bp.m_rot;
+        }
+
+        const uint32_t texture = renderer.AddTexture(bp.m_texture->m_surface, bp.m_texture->m_sampler);
+        const uint32_t flags = (bp.m_doubleSided ? 0 : SOFTWARE_CULL_BACK) | (bp.m_lightmap ? SOFTWARE_ADDITIVE : 0);
+        renderer.Draw(positions, bp.m_mesh.getTexCoords(), bp.m_mesh.getIndices(), bp.m_pos, texture,
+                      PlaneInstanceGroups::PackFrame(bp, bp.GetFrameIndex(0.0)), flags);
+    }
+}
+
+// Rasterizes a drawn scene and writes it to png
+bool FezBatch::writeRender(SoftwareRenderer& renderer, const fs::path& png, const fs::path& file)
+{
+    renderer.Resolve(m_workerPool);
+
+    try
+    {
+        writeImage(png, renderer.GetSurface());
+    }
+    catch (...)
+    {
+        ostringstream displayString;
+        displayString << "ERROR! Failed to write render: " << png;
+        print(displayString.str());
+        return false;
+    }
+
+    ostringstream displayString;
+    displayString << "Rendered " << file.filename() << " (" << renderer.GetNumTriangles() << " triangles) to " << png;
+    print(displayString.str());
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    const vector<string> args(argv + 1, argv + argc);
+    FezBatch batch;
+    return batch.run(args);
+}
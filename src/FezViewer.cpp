@@ -1,9 +1,46 @@
 #include "Common.h"
 #include "Trile.h"
+#include "TrileRenderer.h"
+#include "StaticBatch.h"
+#include "GreedyMesh.h"
+#include "SceneChunks.h"
+#include "SceneStore.h"
+#include "SceneBatch.h"
+#include "SceneBenchmark.h"
+#include "SpscQueue.h"
+#include "HandoffBenchmark.h"
+#include "NumberParserBenchmark.h"
+#include "PlaneRenderQueue.h"
+#include "PlaneRenderer.h"
+#include "ViewState.h"
 #include "ArtObject.h"
 #include "BackgroundPlane.h"
+#include "BakedLevel.h"
+#include "WorkerPool.h"
+#include "AllocationStats.h"
+#include "FileWatcher.h"
+#include "LevelLoader.h"
+#include "Scene.h"
+#include "FrameProfiler.h"
+
+enum TrileRenderMode
+{
+    TRILE_RENDER_PER_INSTANCE,
+    TRILE_RENDER_INSTANCED,
+    TRILE_RENDER_STATIC_BATCH,
+    NUM_TRILE_RENDER_MODES
+};
+
+const char* gc_trileRenderModeNames[] = { "Per Instance", "Instanced", "Static Batch" };
 
 gl::Texture* Trile::s_pTexture;
+SurfaceCache SurfaceCache::s_cache;
+TextureCache TextureCache::s_cache;
+atomic<uint64_t> AllocationStats::s_numAllocations;
+atomic<uint64_t> AllocationStats::s_numBytes;
+LoadProfiler LoadProfiler::s_profiler;
+LOAD_THREAD_LOCAL ScopedLoadTimer* ScopedLoadTimer::s_pCurrent;
+FrameProfiler FrameProfiler::s_profiler;
 
 class FezViewer : public AppBasic
 {
@@ -13,8 +50,12 @@ class FezViewer : public AppBasic
     void shutdown();
     void setDisplayString(const string& str);
     void spawnLoader(fs::path file);
-    void loadArtObject();
-    void loadLevel();
+    void pollWatchedFiles();
+    void clearLevel();
+    bool publishSceneBatch(SceneBatchRef& pBatch);
+    void applySceneBatches();
+    void applySceneBatch(SceneBatch& batch);
+    void drawText();
     void resize();
     void resetCamera(float zoom);
     void mouseDown(MouseEvent event);
@@ -28,20 +69,34 @@ class FezViewer : public AppBasic
     MayaCamUI               m_camera;
     fs::path                m_file;
     bool                    m_verbose;
-    Vec3f                   m_dimensions;
+    bool                    m_watch;        // reload what changes in the files the level was loaded from
+    double                  m_lastWatchPoll;
+    bool                    m_showFrameProfile; // the frame profiler's averages replace the text overlay
+    fs::path                m_frameCsv;         // where 'P' writes the frame profiler's history
+    fs::path                m_openFile;         // given on the command line, opened once setup is done
     shared_ptr<thread>      m_thread;
-    mutex                   m_mutex;
-    bool                    m_exit;
+    WorkerPool              m_workerPool;
+    shared_ptr<LevelLoader> m_pLoader;      // runs on m_thread, its options are set from the command line
+    mutex                   m_textMutex;    // guards the text box, draw() only ever tries it
+    SpscQueue<SceneBatchRef, SCENE_QUEUE_CAPACITY>  m_sceneQueue;   // built by the loader thread, applied by draw()
     bool                    m_quit;
 
-    deque<Trile>            m_triles;
-    Surface                 m_trileSurface;
+    Scene                   m_scene;        // what the loader has handed over so far
+    TrileInstanceGroups     m_trileGroups;
+    TrileRenderer           m_trileRenderer;
+    TrileRenderMode         m_trileRenderMode;
     gl::Texture             m_trileTexture;
     bool                    m_trileTexReload;
 
-    deque<ArtObject>        m_artObjects;
-
-    deque<BackgroundPlane>  m_backgroundPlanes;
+    PlaneRenderQueue        m_planeQueue;
+    PlaneInstanceGroups     m_planeGroups;
+    PlaneRenderer           m_planeRenderer;
+    vector<uint8_t>         m_planeVisible;
+    PlaneQueueStats         m_planeStats;   // of the last frame, over every draw path
+    
+    ViewState               m_view;
+    bool                    m_frustumCulling;
+    size_t                  m_numGroupedTriles;   // triles m_trileGroups was last built from
     
     TextBox*                m_pText;    // Cinder bug requires this to be a pointer, initialized in setup()
     gl::Texture             m_textTexture;
@@ -65,12 +120,20 @@ void FezViewer::setup()
 #else 
     m_verbose = false;
 #endif
-    m_dimensions = Vec3f::zero();
+    m_watch = false;
+    m_lastWatchPoll = 0.0;
+    m_showFrameProfile = false;
+    m_frameCsv = "frame_profile.csv";
     m_thread = nullptr;
-    m_exit = false;
+    m_pLoader = shared_ptr<LevelLoader>(new LevelLoader(m_workerPool));
+    m_pLoader->m_publish = bind(&FezViewer::publishSceneBatch, this, placeholders::_1);
+    m_pLoader->m_display = bind(&FezViewer::setDisplayString, this, placeholders::_1);
     m_quit = false;
     
     m_trileTexReload = false;
+    m_frustumCulling = true;
+    m_numGroupedTriles = 0;
+    m_trileRenderMode = TRILE_RENDER_INSTANCED;
 
     m_pText = new TextBox();
     m_pText->setFont(Font(app::loadResource(RES_MY_FONT), 30));
@@ -85,14 +148,68 @@ void FezViewer::setup()
     timeline().apply(&m_textAlpha, 0.f, 1.f, EaseOutExpo()).appendTo(&m_textAlpha);
     
     const auto args = getArgs();
+    string previousArg;
     for (auto arg : args)
     {
+        const string extension = "." + getPathExtension(arg);
+        if (previousArg == "-loadtrace")
+        {
+            m_pLoader->m_loadTrace = arg;
+        }
+        else if (previousArg == "-framecsv")
+        {
+            m_frameCsv = arg;
+        }
+        else if (extension == ".xml" || extension == BAKED_LEVEL_EXTENSION)
+        {
+            m_openFile = arg;
+        }
+        previousArg = arg;
         if (arg == "-verbose")
         {
             m_verbose = true;
         }
-        // TODO: how to handle loading file from command line?
+        if (arg == "-bake")
+        {
+            m_pLoader->m_bake = true;
+        }
+        if (arg == "-xmltree")
+        {
+            m_pLoader->m_xmlTree = true;
+        }
+        if (arg == "-watch")
+        {
+            m_watch = true;
+        }
+        if (arg == "-staticbatch")
+        {
+            m_pLoader->m_staticBatching = true;
+            m_trileRenderMode = TRILE_RENDER_STATIC_BATCH;
+        }
+        if (arg == "-compact")
+        {
+            m_pLoader->m_compactVertices = true;
+        }
+        if (arg == "-greedymesh")
+        {
+            m_pLoader->m_staticBatching = true;
+            m_pLoader->m_greedyMeshing = true;
+            m_trileRenderMode = TRILE_RENDER_STATIC_BATCH;
+        }
+        if (arg == "-scenebench")
+        {
+            SceneBenchmark::Run(SCENE_BENCHMARK_INSTANCES, console());
+        }
+        if (arg == "-handoffbench")
+        {
+            HandoffBenchmark::Run(HANDOFF_BENCHMARK_TRILES, console());
+        }
+        if (arg == "-parsebench")
+        {
+            NumberParserBenchmark::Run(PARSE_BENCHMARK_NUMBERS, console());
+        }
     }
+    m_pLoader->m_verbose = m_verbose;
     
     if (m_verbose)
     {
@@ -111,6 +228,16 @@ void FezViewer::setup()
     
     resetCamera(25.f);
     
+    m_trileRenderer.Setup();
+    m_planeRenderer.Setup();
+    memset(&m_planeStats, 0, sizeof(m_planeStats));
+    FrameProfiler::s_profiler.Setup();
+    if (m_pLoader->m_greedyMeshing)
+    {
+        m_scene.m_greedyMesh.Setup();
+        m_pLoader->m_greedyMeshing = m_scene.m_greedyMesh.m_supported;
+    }
+    
     const Vec3f vertices[] = { Vec3f( -8.f,  8.f,  8.f ),   // 0
                                Vec3f( -8.f, -8.f,  8.f ),   // 1
                                Vec3f(  8.f, -8.f,  8.f ),   // 2
@@ -144,12 +271,17 @@ void FezViewer::setup()
     Surface surf = Surface(1, 1, false);
     surf.setPixel(Vec2i::zero(), ColorAf(0.7f, 0.7f, 0.7f));
     
-    m_artObjects.push_back(ArtObject(mesh, surf));
+    m_scene.m_artObjects.push_back(ArtObject(mesh, TextureCache::Wrap(surf, SamplerState(GL_NEAREST))));
+    
+    if (!m_openFile.empty())
+    {
+        spawnLoader(m_openFile);
+    }
 }
 
 void FezViewer::shutdown()
 {
-    m_exit = true;
+    m_pLoader->m_exit = true;
     if (m_thread)
     {
         m_thread->join();
@@ -160,11 +292,11 @@ void FezViewer::shutdown()
 
 void FezViewer::setDisplayString(const string& str)
 {
-    
-    lock_guard<mutex> lock( m_mutex );
-    m_pText->setText(str);
-    m_textAlpha = 1.f;
-    m_textReload = true;
+    {
+        lock_guard<mutex> lock( m_textMutex );
+        m_pText->setText(str);
+        m_textReload = true;
+    }
      
     if (m_verbose)
     {
@@ -174,465 +306,92 @@ void FezViewer::setDisplayString(const string& str)
 
 void FezViewer::spawnLoader(const fs::path file)
 {
-    m_exit = 1;
+    m_pLoader->m_exit = true;
     if (m_thread)
     {
         m_thread->join();
         m_thread = nullptr;
     }
     
-    m_triles.clear();
-    m_trileTexReload = false;
-    Trile::s_pTexture = nullptr;
-    
-    m_artObjects.clear();
-    
-    m_backgroundPlanes.clear();
+    clearLevel();
 
     m_file = file;
-    m_exit = 0;
+    m_pLoader->m_exit = false;
     
-    const string directory = (--file.parent_path().end())->string();
-    if (directory == "levels")
-    {
-        resetCamera(25.f);
-        m_thread = shared_ptr<thread>( new thread( bind( &FezViewer::loadLevel, this ) ) );
-    }
-    else if (directory == "art objects")
+    // The loader reports files it can't load itself
+    const float zoom = LevelLoader::GetViewDistance(file);
+    if (zoom > 0.f)
     {
-        resetCamera(15.f);
-        m_thread = shared_ptr<thread>( new thread( bind( &FezViewer::loadArtObject, this ) ) );
-    }
-    else
-    {
-        ostringstream displayString;
-        displayString << "ERROR! Expected a 'level' or 'art object' .xml file:\n" << file;
-        setDisplayString(displayString.str());
+        resetCamera(zoom);
     }
+    m_thread = shared_ptr<thread>( new thread( bind( &LevelLoader::Load, m_pLoader.get(), file ) ) );
 }
 
-void FezViewer::loadArtObject()
+// Releases everything the last load built, the loader thread must not be running
+void FezViewer::clearLevel()
 {
-    // TODO: path.preferred_separator doesn't work on windows
-    const auto sep = '/';
+    m_scene.Clear();
+    m_trileGroups.Clear();
+    m_trileRenderer.Clear();
+    m_trileTexReload = false;
+    Trile::s_pTexture = nullptr;
     
-    // Load art objects
-    fs::path artObjectXml = m_file;
-    if (getPathExtension(artObjectXml.string()) != "xml")
-    {
-        ostringstream displayString;
-        displayString << "ERROR! Art Object extension is not .xml: " << artObjectXml;
-        setDisplayString(displayString.str());
-        return;
-    }
-
-    if (exists(artObjectXml))
-    {
-        ostringstream displayString;
-        displayString << "Loading Art Object .xml: " << artObjectXml.filename();
-        setDisplayString(displayString.str());
-    }
-    else
-    {
-        ostringstream displayString;
-        displayString << "ERROR! Missing Art Object .xml: " << artObjectXml;
-        setDisplayString(displayString.str());
-        return;
-    }
-    const XmlTree aoXml = XmlTree(loadFile(artObjectXml));
-    const XmlTree& lookAtXml = aoXml.getChild("ArtObject/Size/Vector3");
-    m_dimensions = Vec3f(lookAtXml.getAttributeValue<float>("x"),
-                         lookAtXml.getAttributeValue<float>("y"),
-                         lookAtXml.getAttributeValue<float>("z"));
-
-    string aoPngName;
-    if (aoXml.getChild("ArtObject").hasAttribute("cubemapPath"))
-    {
-        // The XBOX content contains a "cubemapPath" attribute with the .png name
-        aoPngName = aoXml.getChild("ArtObject")["cubemapPath"].getValue();
-    }
-    else
-    {
-        // The PC content infers the .png name from the "name" attribute
-        aoPngName = aoXml.getChild("ArtObject")["name"].getValue();
-    }
-
-    boost::algorithm::to_lower(aoPngName);
-    fs::path artObjectPng = m_file.parent_path().string() + sep + aoPngName + ".png";
-    if (exists(artObjectPng))
-    {
-        ostringstream displayString;
-        displayString << "Loading Art Object .png: " << artObjectPng.filename();
-        setDisplayString(displayString.str());
-    }
-    else
-    {
-        ostringstream displayString;
-        displayString << "ERROR! Missing Art Object .png: " << artObjectPng;
-        setDisplayString(displayString.str());
-        return;
-    }
+    m_planeQueue.Reset();
+    m_planeGroups.Clear();
+    m_numGroupedTriles = 0;
     
-    Vec3f pos = Vec3f::zero(); // counteract offset from level loader
-    Quatf rot = Quatf(0,0,0);
-    Vec3f scale = Vec3f(1.f, 1.f, 1.f);
-    Vec3f offset = -m_dimensions/2;
+    SceneBatchRef pBatch;
+    while (m_sceneQueue.Pop(&pBatch))
     {
-        lock_guard<mutex> lock( m_mutex );
-        if (m_exit) { return; }
-        m_artObjects.push_back(ArtObject(aoXml, pos, rot, scale, offset, artObjectPng));
     }
+    m_pLoader->Clear();
     
-    ostringstream displayString;
-    displayString << "Finished Loading " << m_file.filename().string();
-    setDisplayString(displayString.str());
+    SurfaceCache::s_cache.Clear();
+    TextureCache::s_cache.ResetStats();
 }
 
-void FezViewer::loadLevel()
+// Hands part of the scene to the GL thread and leaves pBatch empty, waiting while draw() catches up on
+// a full queue. Returns false if the loader is asked to exit.
+bool FezViewer::publishSceneBatch(SceneBatchRef& pBatch)
 {
-    ci::ThreadSetup threadSetup; // Required for cinder multithreading
-    double startTime = getElapsedSeconds();
-    
-    // TODO: path.preferred_separator doesn't work on windows
-    const auto sep = '/';
-    
-    // Load the level data
-    console() << "Loading Level: " << m_file.string() << endl;
-    XmlTree level = XmlTree(loadFile(m_file));
-    const XmlTree& lookAtXml = level.getChild("Level/Size/Vector3");
-    m_dimensions = Vec3f(lookAtXml.getAttributeValue<float>("x"),
-                         lookAtXml.getAttributeValue<float>("y"),
-                         lookAtXml.getAttributeValue<float>("z"));
-
-    // Load trile sets
-    string trileSetName = level.getChild("Level")["trileSetName"].getValue();
-    if (m_verbose)
+    while (!m_sceneQueue.Push(pBatch))
     {
-        console() << "Trile Set Name: " << trileSetName << endl;
+        if (m_pLoader->m_exit) { return false; }
+        this_thread::yield();
     }
-    boost::algorithm::to_lower(trileSetName);
-    fs::path trileSetPath = m_file.parent_path().string() + sep + ".." + sep + "trile sets" + sep + trileSetName;
-    fs::path trileSetPng = trileSetPath.string() + ".png";
-    fs::path trileSetXml = trileSetPath.string() + ".xml";
-
-    if (exists(trileSetPng))
-    {
-        ostringstream displayString;
-        displayString << "Loading Trile Set .png: " << trileSetPng.filename();
-        setDisplayString(displayString.str());
-    }
-    else
-    {
-        ostringstream displayString;
-        displayString << "ERROR! Missing Trile Set .png: " << trileSetPng;
-        setDisplayString(displayString.str());
-        return;
-    }
-
-    m_trileSurface = loadImage(trileSetPng);
-    m_trileTexReload = true;
+    return !m_pLoader->m_exit;
+}
 
-    if (exists(trileSetXml))
-    {
-        ostringstream displayString;
-        displayString << "Loading Trile Set .xml: " << trileSetXml.filename();
-        setDisplayString(displayString.str());
-    }
-    else
-    {
-        ostringstream displayString;
-        displayString << "ERROR! Missing Trile Set .xml: " << trileSetXml;
-        setDisplayString(displayString.str());
-        return;
-    }
-    const XmlTree trileSet = XmlTree(loadFile(trileSetXml));
-    string trileSetName2 = trileSet.getChild("TrileSet")["name"].getValue();
-    boost::algorithm::to_lower(trileSetName2);
-    if (trileSetName != trileSetName2)
-    {
-        console() << "WARNING! Trile Set Name Mismatch: " << trileSetName << ", " << trileSetName2 << endl;
-    }
-    map<uint32_t, XmlTree> trileMap;
-    for (const auto& trileEntry : trileSet.getChild("TrileSet/Triles"))
-    {
-        uint32_t key = trileEntry["key"].getValue<int>();
-        if (trileMap.find(key) != trileMap.end())
-        {
-            console() << "WARNING! Duplicate trile key: " << key << endl;
-        }
-        else
-        {
-            ostringstream displayString;
-            displayString << "Mapping Trile #" << key;
-            setDisplayString(displayString.str());
-            trileMap.insert(make_pair(key, trileEntry));
-        }
-        if (m_exit) { return; }
-    }
-    
-    // Load all level triles
-    const XmlTree& levelTriles = level.getChild("Level/Triles");
-    int numLevelTriles = 0;
-    for (const auto& trile : levelTriles)
+// Runs on the GL thread at the start of every frame, takes what the loader has finished without waiting.
+// At least one batch is applied, then only as many as fit in the frame's budget.
+void FezViewer::applySceneBatches()
+{
+    const double start = getElapsedSeconds();
+    SceneBatchRef pBatch;
+    while (m_sceneQueue.Pop(&pBatch))
     {
-        const XmlTree& emplacementXml = trile.getChild("TrileEmplacement");
-        Vec3f emplacement = Vec3f(emplacementXml["x"].getValue<float>(),
-                                  emplacementXml["y"].getValue<float>(),
-                                  emplacementXml["z"].getValue<float>());
-        {
-            numLevelTriles++;
-            int tid = trile.getChild("TrileInstance")["trileId"].getValue<int>();
-
-            ostringstream displayString;
-            displayString << "Loading Trile " << numLevelTriles << " - Map ID: " << tid;
-            setDisplayString(displayString.str());
-
-            if (trileMap.find(tid) != trileMap.end())
-            {
-                const XmlTree& posXml = trile.getChild("TrileInstance/Position/Vector3");
-                Vec3f pos = Vec3f(posXml["x"].getValue<float>(),
-                                  posXml["y"].getValue<float>(),
-                                  posXml["z"].getValue<float>());
-                int orient = trile.getChild("TrileInstance")["orientation"].getValue<int>();
-                
-                {
-                    lock_guard<mutex> lock( m_mutex );
-                    if (m_exit) { return; }
-                    m_triles.push_back(Trile(trileMap[tid], pos, orient, emplacement, -m_dimensions/2));
-                }
-            }
-            else
-            {
-                ostringstream displayString;
-                displayString << "Skipping Trile " << numLevelTriles;
-                setDisplayString(displayString.str());
-            }
-        }
-
-        if (trile.hasChild("TrileInstance/OverlappedTriles"))
+        applySceneBatch(*pBatch);
+        pBatch = nullptr;
+        if (getElapsedSeconds() - start >= SCENE_APPLY_SECONDS)
         {
-            numLevelTriles++;
-            int tid = trile.getChild("TrileInstance/OverlappedTriles/TrileInstance")["trileId"].getValue<int>();
-
-            ostringstream displayString;
-            displayString << "Loading Trile " << numLevelTriles << " - Map ID: " << tid;
-            setDisplayString(displayString.str());
-            
-            if (trileMap.find(tid) != trileMap.end())
-            {
-                const XmlTree& posXml = trile.getChild("TrileInstance/OverlappedTriles/TrileInstance/Position/Vector3");
-                Vec3f pos = Vec3f(posXml["x"].getValue<float>(),
-                                  posXml["y"].getValue<float>(),
-                                  posXml["z"].getValue<float>());
-                int orient = trile.getChild("TrileInstance/OverlappedTriles/TrileInstance")["orientation"].getValue<int>();
-                
-                {
-                    lock_guard<mutex> lock( m_mutex );
-                    if (m_exit) { return; }
-                    m_triles.push_back(Trile(trileMap[tid], pos, orient, emplacement, -m_dimensions/2));
-                }
-            }
-            else
-            {
-                ostringstream displayString;
-                displayString << "Skipping Trile " << numLevelTriles;
-                setDisplayString(displayString.str());
-            }
+            break;
         }
     }
-    console() << "Loaded " << numLevelTriles << " Level Triles" << endl;
-
-    // Load art objects
-    fs::path artObjectsPath = m_file.parent_path().string() + sep + ".." + sep + "art objects" + sep;
-    const XmlTree& levelArtObjects = level.getChild("Level/ArtObjects");
-    int numLevelArtObjects = 0;
-    for (const auto& object : levelArtObjects)
-    {
-        numLevelArtObjects++;
-        string aoName = object.getChild("ArtObjectInstance")["name"].getValue();
-
-        ostringstream displayString;
-        displayString << "Loading Art Object " << numLevelArtObjects << ": " << aoName;
-        setDisplayString(displayString.str());
-        
-        boost::algorithm::to_lower(aoName);
-        fs::path artObjectXml = artObjectsPath.string() + aoName + ".xml";
-        
-        if (exists(artObjectXml))
-        {
-            ostringstream displayString;
-            displayString << "Loading Art Object .xml: " << artObjectXml.filename();
-            setDisplayString(displayString.str());
-        }
-        else
-        {
-            ostringstream displayString;
-            displayString << "ERROR! Missing Art Object .xml: " << artObjectXml;
-            setDisplayString(displayString.str());
-            return;
-        }
-        const XmlTree aoXml = XmlTree(loadFile(artObjectXml));
-        string aoName2 = aoXml.getChild("ArtObject")["name"].getValue();
-        boost::algorithm::to_lower(aoName2);
-        if (aoName != aoName2)
-        {
-            console() << "WARNING! Art Object Name Mismatch: " << aoName << ", " << aoName2 << endl;
-        }
-        
-        string aoPngName;
-        if (aoXml.getChild("ArtObject").hasAttribute("cubemapPath"))
-        {
-            // The XBOX content contains a "cubemapPath" attribute with the .png name
-            aoPngName = aoXml.getChild("ArtObject")["cubemapPath"].getValue();
-            boost::algorithm::to_lower(aoPngName);
-        }
-        else
-        {
-            // The PC content infers the .png name from the "name" attribute
-            aoPngName = aoName2;
-        }
-
-        fs::path artObjectPng = artObjectsPath.string() + aoPngName + ".png";
-        if (exists(artObjectPng))
-        {
-            ostringstream displayString;
-            displayString << "Loading Art Object .png: " << artObjectPng.filename();
-            setDisplayString(displayString.str());
-        }
-        else
-        {
-            ostringstream displayString;
-            displayString << "ERROR! Missing Art Object .png: " << artObjectPng;
-            setDisplayString(displayString.str());
-            return;
-        }
-        
-        const XmlTree& posXml = object.getChild("ArtObjectInstance/Position/Vector3");
-        Vec3f pos = Vec3f(posXml["x"].getValue<float>(),
-                          posXml["y"].getValue<float>(),
-                          posXml["z"].getValue<float>());
-        const XmlTree& rotXml = object.getChild("ArtObjectInstance/Rotation/Quaternion");
-        Quatf rot = Quatf(rotXml["w"].getValue<float>(),
-                          rotXml["x"].getValue<float>(),
-                          rotXml["y"].getValue<float>(),
-                          rotXml["z"].getValue<float>() );
-        const XmlTree& scaleXml = object.getChild("ArtObjectInstance/Scale/Vector3");
-        Vec3f scale = Vec3f(scaleXml["x"].getValue<float>(),
-                            scaleXml["y"].getValue<float>(),
-                            scaleXml["z"].getValue<float>());
-        Vec3f offset = -m_dimensions/2 - Vec3f(0.5, 0.5, 0.5);
-        {
-            lock_guard<mutex> lock( m_mutex );
-            if (m_exit) { return; }
-            m_artObjects.push_back(ArtObject(aoXml, pos, rot, scale, offset, artObjectPng));
-        }
-    }
-    console() << "Loaded " << numLevelArtObjects << " Art Objects" << endl;
-
-    // Load background planes
-    fs::path backgroundPlanePath = m_file.parent_path().string() + sep + ".." + sep + "background planes" + sep;
-    const XmlTree& levelBackgroundPlanes = level.getChild("Level/BackgroundPlanes");
-    int numLevelBackgroundPlanes = 0;
+}
 
-    for (const auto& plane : levelBackgroundPlanes)
+// What the batch replaces is swapped into it, so the caller releases it with the batch
+void FezViewer::applySceneBatch(SceneBatch& batch)
+{
+    if (batch.trileSurface)
     {
-        numLevelBackgroundPlanes++;
-        string bpName = plane.getChild("BackgroundPlane")["textureName"].getValue();
-        std::replace(bpName.begin(), bpName.end(), '\\', '/');    // Mac doesn't like backslash separators
-        boost::algorithm::to_lower(bpName);
-
-        ostringstream displayString;
-        displayString << "Loading Background Plane " << numLevelBackgroundPlanes << ": " << bpName;
-        setDisplayString(displayString.str());
-        
-        fs::path backgroundPlanePng;
-        XmlTree* pAnimXml = nullptr;
-        XmlTree animXml;
-        
-        if (plane.getChild("BackgroundPlane")["animated"].getValue() == "True")
-        {
-            fs::path backgroundPlaneXml = backgroundPlanePath.string() + bpName + ".xml";
-            backgroundPlanePng = backgroundPlanePath.string() + bpName + ".ani.png";
-
-            if (exists(backgroundPlaneXml))
-            {
-                ostringstream displayString;
-                displayString << "Loading Background Plane .xml: " << backgroundPlaneXml.filename();
-                setDisplayString(displayString.str());
-            }
-            else
-            {
-                ostringstream displayString;
-                displayString << "ERROR! Missing Trile Set .xml: " << backgroundPlaneXml;
-                setDisplayString(displayString.str());
-                return;
-            }
-            animXml = XmlTree(loadFile(backgroundPlaneXml));
-            pAnimXml = &animXml;
-        }
-        else
-        {
-            backgroundPlanePng = backgroundPlanePath.string() + bpName + ".png";
-        }
-
-        if (exists(backgroundPlanePng))
-        {
-            ostringstream displayString;
-            displayString << "Loading Background Plane .png: " << backgroundPlanePng.filename();
-            setDisplayString(displayString.str());
-        }
-        else
-        {
-            ostringstream displayString;
-            displayString << "ERROR! Missing Background Plane .png: " << backgroundPlanePng;
-            setDisplayString(displayString.str());
-            return;
-        }
-        
-        const XmlTree& posXml = plane.getChild("BackgroundPlane/Position/Vector3");
-        Vec3f pos = Vec3f(posXml["x"].getValue<float>(),
-                          posXml["y"].getValue<float>(),
-                          posXml["z"].getValue<float>());
-        const XmlTree& rotXml = plane.getChild("BackgroundPlane/Rotation/Quaternion");
-        Quatf rot = Quatf(rotXml["w"].getValue<float>(),
-                          rotXml["x"].getValue<float>(),
-                          rotXml["y"].getValue<float>(),
-                          rotXml["z"].getValue<float>() );
-        const XmlTree scaleXml = plane.getChild("BackgroundPlane/Scale/Vector3");
-        Vec3f scale = Vec3f(scaleXml["x"].getValue<float>(),
-                            scaleXml["y"].getValue<float>(),
-                            scaleXml["z"].getValue<float>());
-        Vec3f offset = Vec3f(-m_dimensions/2);
-        
-        bool doubleSided = plane.getChild("BackgroundPlane")["doubleSided"].getValue() == "True";
-        bool billboard = plane.getChild("BackgroundPlane")["billboard"].getValue() == "True";
-        bool lightmap = plane.getChild("BackgroundPlane")["lightMap"].getValue() == "True";
-        bool pixelatedLightmap = plane.getChild("BackgroundPlane")["pixelatedLightmap"].getValue() == "True";
-        bool clampTexture = plane.getChild("BackgroundPlane")["clampTexture"].getValue() == "True";
-        
-        Vec2d repeat = Vec2d(false, false);
-        if (pAnimXml)
-        {
-            repeat.x = plane.getChild("BackgroundPlane")["xTextureRepeat"].getValue() == "True";
-            repeat.y = plane.getChild("BackgroundPlane")["yTextureRepeat"].getValue() == "True";
-        }
-        {
-            lock_guard<mutex> lock( m_mutex );
-            if (m_exit) { return; }
-            m_backgroundPlanes.push_back(BackgroundPlane(pos, rot, scale, pAnimXml, offset, doubleSided, billboard,
-                                                         lightmap, pixelatedLightmap, clampTexture, repeat,
-                                                         backgroundPlanePng));
-        }
+        m_trileTexReload = true;
     }
-    console() << "Loaded " << numLevelBackgroundPlanes << " Background Planes" << endl;
-    ostringstream displayString;
-    displayString << "Finished Loading " << m_file.filename().string() <<
-                     "  (" << numLevelTriles << " Triles, " << numLevelArtObjects << " Art Objects, " << numLevelBackgroundPlanes << " Background Planes)";
-    if (m_verbose)
+    if (batch.pBackgroundPlanes || !batch.backgroundPlaneReloads.empty())
     {
-        displayString << endl << getElapsedSeconds() - startTime << " Seconds";
+        m_planeGroups.Clear();     // regrouped by the next draw, a reloaded plane may have changed texture or state
+        m_planeQueue.Reset();
     }
-    setDisplayString(displayString.str());
+    m_scene.Apply(batch);
 }
 
 void FezViewer::resize()
@@ -641,7 +400,7 @@ void FezViewer::resize()
     cam.setPerspective(60, getWindowAspectRatio(), 1, 1000);
     m_camera.setCurrentCam(cam);
 
-    lock_guard<mutex> lock(m_mutex);
+    lock_guard<mutex> lock(m_textMutex);
     m_pText->setSize(Vec2f(getWindowWidth(), TextBox::GROW));
 }
 
@@ -685,6 +444,49 @@ void FezViewer::keyDown(KeyEvent event)
     {
         spawnLoader(getOpenFilePath(getAppPath()));
     }
+    if (event.getChar() == 't')
+    {
+        // Cycle through the trile render modes this machine and load support
+        do
+        {
+            m_trileRenderMode = (TrileRenderMode)((m_trileRenderMode + 1) % NUM_TRILE_RENDER_MODES);
+        } while ((m_trileRenderMode == TRILE_RENDER_INSTANCED && !m_trileRenderer.m_supported) ||
+                 (m_trileRenderMode == TRILE_RENDER_STATIC_BATCH && !m_pLoader->m_staticBatching));
+        
+        ostringstream displayString;
+        displayString << "Trile Render Mode: " << gc_trileRenderModeNames[m_trileRenderMode];
+        setDisplayString(displayString.str());
+    }
+    if (event.getChar() == 'c')
+    {
+        m_frustumCulling = !m_frustumCulling;
+        
+        ostringstream displayString;
+        displayString << "Frustum Culling: " << (m_frustumCulling ? "On" : "Off");
+        setDisplayString(displayString.str());
+    }
+    if (event.getChar() == 'l')
+    {
+        const string summary = LoadProfiler::s_profiler.GetSummary();
+        setDisplayString(summary.empty() ? "No Load Profile" : "Load Profile:\n" + summary);
+    }
+    if (event.getChar() == 'p')
+    {
+        m_showFrameProfile = !m_showFrameProfile;
+        if (!m_showFrameProfile)
+        {
+            setDisplayString("Frame Profile: Off");
+        }
+    }
+    if (event.getChar() == 'P')
+    {
+        ofstream out(m_frameCsv.string().c_str());
+        FrameProfiler::s_profiler.WriteCsv(out);
+        
+        ostringstream displayString;
+        displayString << (out ? "Wrote Frame Profile: " : "ERROR! Failed to write Frame Profile: ") << m_frameCsv;
+        setDisplayString(displayString.str());
+    }
     if (event.getChar() == 'f')
     {
         setFullScreen(!isFullScreen());
@@ -692,7 +494,7 @@ void FezViewer::keyDown(KeyEvent event)
     }
     if (event.getChar() == KeyEvent::KEY_ESCAPE)
     {
-        m_exit = true;
+        m_pLoader->m_exit = true;
         if (m_thread)
         {
             m_thread->join();
@@ -714,29 +516,80 @@ void FezViewer::update()
     {
         quit();
     }
+    
+    if (m_watch && m_pLoader->m_finished && getElapsedSeconds() - m_lastWatchPoll >= WATCH_POLL_SECONDS)
+    {
+        m_lastWatchPoll = getElapsedSeconds();
+        pollWatchedFiles();
+    }
 }
 
-void FezViewer::draw()
+// Edits to the level or its trile set reload everything, art objects, background planes and the trile set
+// texture are reloaded on their own and swapped into place
+void FezViewer::pollWatchedFiles()
 {
+    const vector<WatchedFile> changed = m_pLoader->m_fileWatcher.Poll();
+    if (changed.empty())
     {
-        lock_guard<mutex> lock( m_mutex );
-
-        if (m_trileTexReload)
+        return;
+    }
+    for (const WatchedFile& file : changed)
+    {
+        if (file.type == WATCHED_LEVEL || file.type == WATCHED_TRILE_SET)
         {
-            m_trileTexture = gl::Texture(m_trileSurface);
-            m_trileTexture.setMinFilter(GL_NEAREST);
-            m_trileTexture.setMagFilter(GL_NEAREST);
-            Trile::s_pTexture = &m_trileTexture;
-            m_trileTexReload = false;
+            console() << "Changed: " << file.path.string() << endl;
+            spawnLoader(m_file);
+            return;
         }
-        
-        if (m_textReload)
+    }
+    
+    // The loader has finished, its thread only needs joining
+    m_pLoader->m_finished = false;
+    if (m_thread)
+    {
+        m_thread->join();
+    }
+    m_thread = shared_ptr<thread>( new thread( bind( &LevelLoader::Reload, m_pLoader.get(), changed ) ) );
+}
+
+void FezViewer::draw()
+{
+    FrameProfiler& profiler = FrameProfiler::s_profiler;
+    profiler.BeginFrame();
+    profiler.BeginPass(FRAME_PASS_UPLOADS);
+    
+    // Whatever the loader has handed over since the last frame, nothing here waits on it
+    applySceneBatches();
+    if (m_trileTexReload)
+    {
+        m_trileTexture = gl::Texture(m_scene.m_trileSurface);
+        m_trileTexture.setMinFilter(GL_NEAREST);
+        m_trileTexture.setMagFilter(GL_NEAREST);
+        Trile::s_pTexture = &m_trileTexture;
+        m_trileTexReload = false;
+        FrameProfiler::CountTextureUpload();
+    }
+    
+    // Skipped for a frame while another thread is setting the text
+    {
+        unique_lock<mutex> lock( m_textMutex, try_to_lock );
+        if (lock.owns_lock())
         {
-            m_textTexture = gl::Texture(m_pText->render());
-            m_textReload = false;
-            timeline().clear();
-            timeline().apply(&m_textAlpha, 1.f, 5.f);
-            timeline().apply(&m_textAlpha, 0.f, 1.f, EaseOutExpo()).appendTo(&m_textAlpha);
+            if (m_showFrameProfile && getElapsedFrames() % FRAME_PROFILE_REFRESH_FRAMES == 0)
+            {
+                m_pText->setText("Frame Profile:\n" + profiler.GetSummary());
+                m_textReload = true;
+            }
+            
+            if (m_textReload)
+            {
+                m_textTexture = gl::Texture(m_pText->render());
+                m_textReload = false;
+                m_textAlpha = 1.f;
+                timeline().clear();
+                timeline().apply(&m_textAlpha, 1.f, 5.f);
+                timeline().apply(&m_textAlpha, 0.f, 1.f, EaseOutExpo()).appendTo(&m_textAlpha);
+            }
         }
     }
     
@@ -758,43 +611,190 @@ void FezViewer::draw()
     // TODO: Why do the dimensions of the level not bound the level?
     // gl::drawStrokedCube(Vec3f::zero(), m_dimensions/2);
     
+    // Sampled once and shared by every draw path below
+    m_view.Set(m_camera.getCamera(), getElapsedSeconds(), m_frustumCulling);
+    
     glEnable(GL_TEXTURE_2D);
+    profiler.BeginPass(FRAME_PASS_CULL);
+    const bool visibilityChanged = m_scene.m_sceneChunks.Cull(m_view.frustum);
+    const bool stored = !m_scene.m_sceneStore.IsEmpty();
+    if (stored)
     {
-        lock_guard<mutex> lock( m_mutex );
+        m_scene.m_sceneStore.Cull(m_scene.m_sceneChunks, m_view.frustum);
+    }
 
-        // Draw Triles
-        for (Trile& trile : m_triles)
+    // Draw Triles, the static batch only exists once the loader has finished the trile pass
+    profiler.BeginPass(FRAME_PASS_TRILES);
+    if (m_trileRenderMode == TRILE_RENDER_STATIC_BATCH && m_scene.m_staticBatch.m_numTriles == m_scene.m_triles.size() && Trile::s_pTexture)
+    {
+        m_scene.m_staticBatch.Draw(*Trile::s_pTexture, m_view.frustum);
+        m_scene.m_greedyMesh.Draw(*Trile::s_pTexture, m_view.frustum);
+    }
+    else if (m_trileRenderMode != TRILE_RENDER_PER_INSTANCE && m_trileRenderer.m_supported)
+    {
+        // Only the instances in visible chunks are uploaded, so regroup when that set changes
+        if (m_numGroupedTriles != m_scene.m_triles.size() || visibilityChanged)
+        {
+            if (stored)
+            {
+                m_trileGroups.Build(m_scene.m_sceneStore);
+            }
+            else
+            {
+                m_trileGroups.Build(m_scene.m_triles);
+            }
+            m_trileRenderer.Upload(m_trileGroups);
+            m_numGroupedTriles = m_scene.m_triles.size();
+        }
+        if (Trile::s_pTexture)
+        {
+            m_trileRenderer.Draw(m_trileGroups, *Trile::s_pTexture);
+        }
+    }
+    else if (stored)
+    {
+        if (Trile::s_pTexture)
+        {
+            Trile::s_pTexture->enableAndBind();
+            FrameProfiler::CountStateChanges(1);
+            for (size_t i = 0; i < m_scene.m_sceneStore.GetNumTriles(); i++)
+            {
+                if (m_scene.m_sceneStore.m_trileVisible[i] && m_view.frustum.Intersects(m_scene.m_sceneStore.m_trileBounds[i]))
+                {
+                    const TriMesh& mesh = m_scene.m_sceneStore.m_trileGeometry[i]->meshes[m_scene.m_sceneStore.m_trileOrients[i]];
+                    gl::pushModelView();
+                    gl::translate(m_scene.m_sceneStore.m_trilePositions[i]);
+                    gl::draw(mesh);
+                    gl::popModelView();
+                    FrameProfiler::CountDraw(mesh.getNumTriangles());
+                }
+            }
+            Trile::s_pTexture->disable();
+            Trile::s_pTexture->unbind();
+        }
+    }
+    else
+    {
+        for (Trile& trile : m_scene.m_triles)
         {
             trile.Draw();
         }
+    }
 
-        // Draw Art Objects
-        for (ArtObject& ao : m_artObjects)
+    // Draw Art Objects
+    profiler.BeginPass(FRAME_PASS_ART_OBJECTS);
+    if (stored)
+    {
+        for (size_t i = 0; i < m_scene.m_sceneStore.GetNumArtObjects(); i++)
+        {
+            if (m_scene.m_sceneStore.m_artObjectVisible[i])
+            {
+                m_scene.m_sceneStore.m_artObjects[i]->Draw();
+            }
+        }
+    }
+    else
+    {
+        for (ArtObject& ao : m_scene.m_artObjects)
         {
             ao.Draw();
         }
-        
-        // Draw Background Plane
-        for (BackgroundPlane& bp : m_backgroundPlanes)
+    }
+    
+    // Draw Background Planes, sorted into state coherent batches and instanced where supported
+    profiler.BeginPass(FRAME_PASS_PLANES);
+    if (m_planeRenderer.m_supported)
+    {
+        if (m_planeGroups.m_numPlanes != m_scene.m_backgroundPlanes.size())
         {
-            bp.Draw(m_camera.getCamera());
+            m_planeGroups.Build(m_scene.m_backgroundPlanes);
+            m_planeGroups.UpdateFrames(m_scene.m_backgroundPlanes, m_view.seconds);
+            m_planeRenderer.Upload(m_planeGroups);
+        }
+        else if (stored)
+        {
+            if (m_scene.m_sceneStore.Animate(m_view.seconds) && m_planeGroups.UpdateFrames(m_scene.m_backgroundPlanes, m_scene.m_sceneStore))
+            {
+                m_planeRenderer.UploadFrames(m_planeGroups);
+            }
+        }
+        else if (m_planeGroups.UpdateFrames(m_scene.m_backgroundPlanes, m_view.seconds))
+        {
+            m_planeRenderer.UploadFrames(m_planeGroups);
         }
         
-        gl::popModelView();
-        
-        gl::pushMatrices();
-        gl::setMatricesWindow(getWindowSize());
-        gl::disableDepthRead();
-        gl::disableDepthWrite();
-        gl::color(ColorA(1.f, 1.f, 1.f, m_textAlpha));
-        glFrontFace(GL_CCW);
-        
-        gl::draw(m_textTexture, Vec2f(0, getWindowHeight() - m_textTexture.getHeight()));
-        
-        gl::enableDepthRead();
-        gl::enableDepthWrite();
-        gl::popMatrices();
+        if (!stored)
+        {
+            m_planeVisible.assign(m_scene.m_backgroundPlanes.size(), 1);
+        }
+        const vector<uint8_t>& visible = stored ? m_scene.m_sceneStore.m_planeVisible : m_planeVisible;
+
+        // Cutouts, then the translucent planes back to front, then the lightmaps over everything
+        m_planeRenderer.Draw(m_planeGroups, visible, m_view, false);
+        PlaneQueueStats planeStats = m_planeRenderer.m_stats;
+        m_planeQueue.Clear();
+        for (const uint32_t i : m_planeGroups.m_translucent)
+        {
+            if (visible[i])
+            {
+                m_planeQueue.Add(i, m_scene.m_backgroundPlanes[i], m_view);
+            }
+        }
+        m_planeQueue.Sort();
+        m_planeQueue.Submit(m_scene.m_backgroundPlanes, m_view);
+        planeStats.Add(m_planeQueue.m_stats);
+        m_planeRenderer.Draw(m_planeGroups, visible, m_view, true);
+        planeStats.Add(m_planeRenderer.m_stats);
+        m_planeStats = planeStats;
+    }
+    else
+    {
+        m_planeQueue.Clear();
+        for (uint32_t i = 0; i < m_scene.m_backgroundPlanes.size(); i++)
+        {
+            if (!stored)
+            {
+                m_planeQueue.Add(i, m_scene.m_backgroundPlanes[i], m_view);
+            }
+            else if (m_scene.m_sceneStore.m_planeVisible[i])
+            {
+                m_planeQueue.Add(i, m_scene.m_sceneStore, m_view);
+            }
+        }
+        m_planeQueue.Sort();
+        m_planeQueue.Submit(m_scene.m_backgroundPlanes, m_view);
+        m_planeStats = m_planeQueue.m_stats;
+    }
+    
+    const PlaneQueueStats& stats = m_planeStats;
+    FrameProfiler::CountStateChanges(stats.textureBinds + stats.blendChanges + stats.cullChanges);
+    if (m_verbose && getElapsedFrames() % 600 == 0 && stats.numDraws > 0)
+    {
+        console() << "Background Planes: " << stats.numDraws << " Draws, " << stats.textureBinds << " Texture Binds, " <<
+                     stats.blendChanges << " Blend Changes, " << stats.cullChanges << " Cull Changes" << endl;
     }
+    
+    gl::popModelView();
+    
+    profiler.BeginPass(FRAME_PASS_OVERLAY);
+    drawText();
+    profiler.EndFrame();
+}
+
+void FezViewer::drawText()
+{
+    gl::pushMatrices();
+    gl::setMatricesWindow(getWindowSize());
+    gl::disableDepthRead();
+    gl::disableDepthWrite();
+    gl::color(ColorA(1.f, 1.f, 1.f, m_textAlpha));
+    glFrontFace(GL_CCW);
+    
+    gl::draw(m_textTexture, Vec2f(0, getWindowHeight() - m_textTexture.getHeight()));
+    
+    gl::enableDepthRead();
+    gl::enableDepthWrite();
+    gl::popMatrices();
 }
 
 // This line tells Cinder to actually create the application
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Common.h"
+
+#define WATCH_POLL_SECONDS 0.5  // between checks of the watched files
+
+enum WatchedFileType
+{
+    WATCHED_LEVEL,              // the opened file, anything it affects is reloaded from scratch
+    WATCHED_TRILE_SET,
+    WATCHED_TRILE_SET_TEXTURE,
+    WATCHED_ART_OBJECT,         // the .xml or .png of the art objects in m_indices
+    WATCHED_BACKGROUND_PLANE    // the .xml or .png of the background planes in m_indices
+};
+
+struct WatchedFile
+{
+    fs::path            path;
+    WatchedFileType     type;
+    time_t              lastWriteTime;
+    vector<uint32_t>    indices;        // of the objects loaded from the file, in container order
+};
+
+// Remembers the files a load read and polls their modification times, so the viewer can reload only what
+// an edit affects. Polling a few hundred timestamps is cheap enough for the main thread and needs nothing
+// platform specific. Files that are missing while an editor saves them are skipped until they reappear.
+class FileWatcher
+{
+public:
+
+    // Thread safe, a file referenced by several objects is polled once for all of them
+    void Watch(const fs::path& path, const WatchedFileType type, const uint32_t index = 0)
+    {
+        lock_guard<mutex> lock( m_mutex );
+        auto it = m_files.find(path.string());
+        if (it == m_files.end())
+        {
+            WatchedFile file;
+            file.path = path;
+            file.type = type;
+            file.lastWriteTime = GetLastWriteTime(path);
+            it = m_files.insert(make_pair(path.string(), file)).first;
+        }
+        vector<uint32_t>& indices = it->second.indices;
+        if ((type == WATCHED_ART_OBJECT || type == WATCHED_BACKGROUND_PLANE) && find(indices.begin(), indices.end(), index) == indices.end())
+        {
+            indices.push_back(index);
+        }
+    }
+
+    // Returns the files written since they were watched or last polled
+    vector<WatchedFile> Poll()
+    {
+        vector<WatchedFile> changed;
+        lock_guard<mutex> lock( m_mutex );
+        for (auto& entry : m_files)
+        {
+            WatchedFile& file = entry.second;
+            const time_t lastWriteTime = GetLastWriteTime(file.path);
+            if (lastWriteTime != 0 && lastWriteTime != file.lastWriteTime)
+            {
+                file.lastWriteTime = lastWriteTime;
+                changed.push_back(file);
+            }
+        }
+        return changed;
+    }
+
+    // With the modification times they had when they were watched
+    vector<WatchedFile> GetFiles()
+    {
+        vector<WatchedFile> files;
+        lock_guard<mutex> lock( m_mutex );
+        for (const auto& entry : m_files)
+        {
+            files.push_back(entry.second);
+        }
+        return files;
+    }
+
+    size_t GetNumFiles()
+    {
+        lock_guard<mutex> lock( m_mutex );
+        return m_files.size();
+    }
+
+    void Clear()
+    {
+        lock_guard<mutex> lock( m_mutex );
+        m_files.clear();
+    }
+
+    // 0 for a missing file
+    static time_t GetLastWriteTime(const fs::path& path)
+    {
+        boost::system::error_code error;
+        const time_t lastWriteTime = fs::last_write_time(path, error);
+        return error ? 0 : lastWriteTime;
+    }
+
+private:
+
+    mutex                       m_mutex;
+    map<string, WatchedFile>    m_files;
+};
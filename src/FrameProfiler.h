@@ -0,0 +1,261 @@
+#pragma once
+
+#include "Common.h"
+
+#define FRAME_PROFILE_HISTORY           600     // frames kept for the averages and the CSV
+#define FRAME_PROFILE_QUERY_LATENCY     4       // frames a GPU timer query gets before it is read back
+#define FRAME_PROFILE_REFRESH_FRAMES    30      // between overlay updates
+
+enum FramePass
+{
+    FRAME_PASS_UPLOADS,     // textures created or replaced before drawing, including the first use of one
+    FRAME_PASS_CULL,
+    FRAME_PASS_TRILES,
+    FRAME_PASS_ART_OBJECTS,
+    FRAME_PASS_PLANES,
+    FRAME_PASS_OVERLAY,
+    NUM_FRAME_PASSES
+};
+
+const char* const gc_framePassNames[] = { "Uploads", "Cull", "Triles", "Art Objects", "Planes", "Overlay" };
+
+struct FrameCounts
+{
+    uint32_t    draws;
+    uint32_t    triangles;
+    uint32_t    stateChanges;   // texture binds, blend and cull changes
+    uint32_t    textureUploads;
+};
+
+struct FrameSample
+{
+    uint32_t    frame;
+    double      seconds;                        // CPU time of the whole frame
+    double      cpuSeconds[NUM_FRAME_PASSES];
+    double      gpuSeconds[NUM_FRAME_PASSES];   // negative until the timer query is read back, or without support
+    FrameCounts counts[NUM_FRAME_PASSES];
+};
+
+// Times the passes of draw() on the CPU and, with timer queries, on the GPU, and counts the draw calls,
+// triangles and state changes the renderers report while each pass is open. Keeps the last
+// FRAME_PROFILE_HISTORY frames for the overlay averages and the CSV dump. GL thread only.
+class FrameProfiler
+{
+public:
+
+    static FrameProfiler s_profiler;
+
+    bool    m_gpuSupported;
+
+    FrameProfiler() :
+        m_gpuSupported(false),
+        m_pass(NUM_FRAME_PASSES),
+        m_frame(0),
+        m_frameStart(0.0),
+        m_passStart(0.0)
+    {
+        memset(&m_current, 0, sizeof(m_current));
+    }
+
+    // Must be called with the GL context current
+    void Setup()
+    {
+        m_gpuSupported = gl::isExtensionAvailable("GL_ARB_timer_query") || gl::isExtensionAvailable("GL_EXT_timer_query");
+        if (m_gpuSupported)
+        {
+            glGenQueries(FRAME_PROFILE_QUERY_LATENCY * NUM_FRAME_PASSES, &m_queries[0][0]);
+            memset(m_queryIssued, 0, sizeof(m_queryIssued));
+        }
+    }
+
+    // Renderers call these while they draw, counts outside a pass are dropped
+    static void CountDraw(const uint32_t numTriangles)
+    {
+        if (s_profiler.m_pass < NUM_FRAME_PASSES)
+        {
+            s_profiler.m_current.counts[s_profiler.m_pass].draws++;
+            s_profiler.m_current.counts[s_profiler.m_pass].triangles += numTriangles;
+        }
+    }
+
+    static void CountStateChanges(const uint32_t numChanges)
+    {
+        if (s_profiler.m_pass < NUM_FRAME_PASSES)
+        {
+            s_profiler.m_current.counts[s_profiler.m_pass].stateChanges += numChanges;
+        }
+    }
+
+    static void CountTextureUpload()
+    {
+        if (s_profiler.m_pass < NUM_FRAME_PASSES)
+        {
+            s_profiler.m_current.counts[s_profiler.m_pass].textureUploads++;
+        }
+    }
+
+    void BeginFrame()
+    {
+        ReadQueries();
+        memset(&m_current, 0, sizeof(m_current));
+        m_current.frame = m_frame;
+        for (uint32_t pass = 0; pass < NUM_FRAME_PASSES; pass++)
+        {
+            m_current.gpuSeconds[pass] = -1.0;
+        }
+        m_frameStart = getElapsedSeconds();
+    }
+
+    // Passes don't nest, beginning one ends the open one
+    void BeginPass(const FramePass pass)
+    {
+        EndPass();
+        m_pass = pass;
+        m_passStart = getElapsedSeconds();
+        if (m_gpuSupported)
+        {
+            const uint32_t slot = m_frame % FRAME_PROFILE_QUERY_LATENCY;
+            glBeginQuery(GL_TIME_ELAPSED_EXT, m_queries[slot][pass]);
+        }
+    }
+
+    void EndPass()
+    {
+        if (m_pass == NUM_FRAME_PASSES)
+        {
+            return;
+        }
+        m_current.cpuSeconds[m_pass] += getElapsedSeconds() - m_passStart;
+        if (m_gpuSupported)
+        {
+            glEndQuery(GL_TIME_ELAPSED_EXT);
+            m_queryIssued[m_frame % FRAME_PROFILE_QUERY_LATENCY][m_pass] = true;
+        }
+        m_pass = NUM_FRAME_PASSES;
+    }
+
+    void EndFrame()
+    {
+        EndPass();
+        m_current.seconds = getElapsedSeconds() - m_frameStart;
+        m_history.push_back(m_current);
+        if (m_history.size() > FRAME_PROFILE_HISTORY)
+        {
+            m_history.pop_front();
+        }
+        m_frame++;
+    }
+
+    // Averages over the kept frames, one line per pass
+    string GetSummary() const
+    {
+        ostringstream summary;
+        summary.setf(ios::fixed);
+        summary.precision(2);
+        if (m_history.empty())
+        {
+            return summary.str();
+        }
+
+        double frameSeconds = 0.0;
+        for (const FrameSample& sample : m_history)
+        {
+            frameSeconds += sample.seconds;
+        }
+        summary << "Frame: " << frameSeconds * 1000.0 / m_history.size() << " ms CPU over " << m_history.size() << " frames" << endl;
+
+        for (uint32_t pass = 0; pass < NUM_FRAME_PASSES; pass++)
+        {
+            double cpuSeconds = 0.0;
+            double gpuSeconds = 0.0;
+            uint32_t numGpuSamples = 0;
+            uint64_t draws = 0, triangles = 0, stateChanges = 0, textureUploads = 0;
+            for (const FrameSample& sample : m_history)
+            {
+                cpuSeconds += sample.cpuSeconds[pass];
+                if (sample.gpuSeconds[pass] >= 0.0)
+                {
+                    gpuSeconds += sample.gpuSeconds[pass];
+                    numGpuSamples++;
+                }
+                draws += sample.counts[pass].draws;
+                triangles += sample.counts[pass].triangles;
+                stateChanges += sample.counts[pass].stateChanges;
+                textureUploads += sample.counts[pass].textureUploads;
+            }
+            const double n = (double)m_history.size();
+            summary << gc_framePassNames[pass] << ": " << cpuSeconds * 1000.0 / n << " ms";
+            if (numGpuSamples > 0)
+            {
+                summary << ", GPU " << gpuSeconds * 1000.0 / numGpuSamples << " ms";
+            }
+            summary.precision(0);
+            summary << ", " << draws / n << " draws, " << triangles / n << " tris, " << stateChanges / n << " changes";
+            if (textureUploads > 0)
+            {
+                summary << ", " << textureUploads << " uploads";
+            }
+            summary.precision(2);
+            summary << endl;
+        }
+        return summary.str();
+    }
+
+    // One row per frame and pass
+    void WriteCsv(ostream& out) const
+    {
+        out << "frame,pass,cpuMs,gpuMs,draws,triangles,stateChanges,textureUploads" << endl;
+        for (const FrameSample& sample : m_history)
+        {
+            for (uint32_t pass = 0; pass < NUM_FRAME_PASSES; pass++)
+            {
+                const FrameCounts& counts = sample.counts[pass];
+                out << sample.frame << "," << gc_framePassNames[pass] << "," << sample.cpuSeconds[pass] * 1000.0 << ",";
+                if (sample.gpuSeconds[pass] >= 0.0)
+                {
+                    out << sample.gpuSeconds[pass] * 1000.0;
+                }
+                out << "," << counts.draws << "," << counts.triangles << "," << counts.stateChanges << "," << counts.textureUploads << endl;
+            }
+        }
+    }
+
+private:
+
+    uint32_t            m_pass;     // NUM_FRAME_PASSES outside a pass
+    uint32_t            m_frame;
+    double              m_frameStart;
+    double              m_passStart;
+    FrameSample         m_current;
+    deque<FrameSample>  m_history;
+    GLuint              m_queries[FRAME_PROFILE_QUERY_LATENCY][NUM_FRAME_PASSES];
+    bool                m_queryIssued[FRAME_PROFILE_QUERY_LATENCY][NUM_FRAME_PASSES];
+
+    // Results of the frame that used this frame's query slot, if the GPU has them, so reading never stalls
+    void ReadQueries()
+    {
+        if (!m_gpuSupported || m_frame < FRAME_PROFILE_QUERY_LATENCY)
+        {
+            return;
+        }
+        const uint32_t slot = m_frame % FRAME_PROFILE_QUERY_LATENCY;
+        const uint32_t age = FRAME_PROFILE_QUERY_LATENCY;
+        FrameSample* pSample = m_history.size() >= age ? &m_history[m_history.size() - age] : nullptr;
+        for (uint32_t pass = 0; pass < NUM_FRAME_PASSES; pass++)
+        {
+            if (!m_queryIssued[slot][pass])
+            {
+                continue;
+            }
+            GLint available = 0;
+            glGetQueryObjectiv(m_queries[slot][pass], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available && pSample)
+            {
+                GLuint64EXT nanoseconds = 0;
+                glGetQueryObjectui64vEXT(m_queries[slot][pass], GL_QUERY_RESULT, &nanoseconds);
+                pSample->gpuSeconds[pass] = nanoseconds / 1000000000.0;
+            }
+            m_queryIssued[slot][pass] = false;
+        }
+    }
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "Common.h"
+#include <cfloat>
+
+// World-space axis aligned bounds, empty until the first point is included
+struct Bounds
+{
+    Vec3f min;
+    Vec3f max;
+
+    Bounds() :
+        min(Vec3f(FLT_MAX, FLT_MAX, FLT_MAX)),
+        max(Vec3f(-FLT_MAX, -FLT_MAX, -FLT_MAX))
+    {
+    }
+
+    Bounds(const Vec3f& boundsMin, const Vec3f& boundsMax) :
+        min(boundsMin),
+        max(boundsMax)
+    {
+    }
+
+    bool IsEmpty() const
+    {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    Vec3f GetCenter() const
+    {
+        return (min + max) * 0.5f;
+    }
+
+    void Include(const Vec3f& point)
+    {
+        min = Vec3f(std::min(min.x, point.x), std::min(min.y, point.y), std::min(min.z, point.z));
+        max = Vec3f(std::max(max.x, point.x), std::max(max.y, point.y), std::max(max.z, point.z));
+    }
+
+    void Include(const Bounds& bounds)
+    {
+        if (!bounds.IsEmpty())
+        {
+            Include(bounds.min);
+            Include(bounds.max);
+        }
+    }
+};
+
+// The six clip planes of a view-projection matrix, extracted as in Gribb & Hartmann.
+// Plain math with no GL calls, a default constructed frustum contains everything.
+class Frustum
+{
+public:
+
+    Vec4f m_planes[6];  // (normal, distance), pointing inwards, not normalized
+
+    Frustum()
+    {
+    }
+
+    explicit Frustum(const Matrix44f& viewProjection)
+    {
+        Set(viewProjection);
+    }
+
+    void Set(const Matrix44f& viewProjection)
+    {
+        for (uint32_t axis = 0; axis < 3; axis++)
+        {
+            for (uint32_t col = 0; col < 4; col++)
+            {
+                const float w = viewProjection.at(3, col);
+                const float v = viewProjection.at(axis, col);
+                m_planes[axis * 2][col] = w + v;        // left, bottom, near
+                m_planes[axis * 2 + 1][col] = w - v;    // right, top, far
+            }
+        }
+    }
+
+    // Conservative, boxes near a frustum corner may pass without being inside
+    bool Intersects(const Bounds& bounds) const
+    {
+        if (bounds.IsEmpty())
+        {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < 6; i++)
+        {
+            const Vec4f& plane = m_planes[i];
+            const Vec3f farthest(plane.x >= 0.f ? bounds.max.x : bounds.min.x,
+                                 plane.y >= 0.f ? bounds.max.y : bounds.min.y,
+                                 plane.z >= 0.f ? bounds.max.z : bounds.min.z);
+            if (plane.x * farthest.x + plane.y * farthest.y + plane.z * farthest.z + plane.w < 0.f)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "Common.h"
+
+#define GEOMETRY_ARENA_BLOCK_SIZE   (1 << 20)
+
+// A run of elements in a GeometryArena, with the subset of the vector interface the geometry code uses.
+// Only for plain data like Vec3f, elements are never constructed or destroyed.
+template<typename T>
+struct ArenaArray
+{
+    T*          m_pData;
+    uint32_t    m_size;
+
+    ArenaArray() :
+        m_pData(nullptr),
+        m_size(0)
+    {
+    }
+
+    uint32_t size() const           { return m_size; }
+    bool empty() const              { return m_size == 0; }
+    T* begin()                      { return m_pData; }
+    T* end()                        { return m_pData + m_size; }
+    const T* begin() const          { return m_pData; }
+    const T* end() const            { return m_pData + m_size; }
+    T& operator[](const size_t i)   { return m_pData[i]; }
+    const T& operator[](const size_t i) const { return m_pData[i]; }
+};
+
+// Bump allocator for geometry that lives as long as its level, so thousands of small arrays
+// cost a handful of allocations. Memory is released all at once by Clear().
+class GeometryArena
+{
+public:
+
+    GeometryArena() :
+        m_used(0),
+        m_capacity(0),
+        m_bytesUsed(0)
+    {
+    }
+
+    // Thread safe
+    template<typename T>
+    ArenaArray<T> Allocate(const uint32_t count)
+    {
+        ArenaArray<T> array;
+        if (count == 0)
+        {
+            return array;
+        }
+
+        const size_t bytes = (count * sizeof(T) + 15) & ~(size_t)15;
+        lock_guard<mutex> lock( m_mutex );
+        if (m_blocks.empty() || m_used + bytes > m_capacity)
+        {
+            m_capacity = max<size_t>(bytes, GEOMETRY_ARENA_BLOCK_SIZE);
+            m_blocks.push_back(unique_ptr<uint8_t[]>(new uint8_t[m_capacity]));
+            m_used = 0;
+        }
+        array.m_pData = (T*)(m_blocks.back().get() + m_used);
+        array.m_size = count;
+        m_used += bytes;
+        m_bytesUsed += bytes;
+        return array;
+    }
+
+    template<typename T>
+    ArenaArray<T> Copy(const T* pData, const uint32_t count)
+    {
+        ArenaArray<T> array = Allocate<T>(count);
+        copy(pData, pData + count, array.begin());
+        return array;
+    }
+
+    uint32_t GetNumBlocks() const
+    {
+        return m_blocks.size();
+    }
+
+    size_t GetBytesUsed() const
+    {
+        return m_bytesUsed;
+    }
+
+    // Not thread safe, every array handed out is invalidated
+    void Clear()
+    {
+        m_blocks.clear();
+        m_used = 0;
+        m_capacity = 0;
+        m_bytesUsed = 0;
+    }
+
+    void Swap(GeometryArena& other)
+    {
+        m_blocks.swap(other.m_blocks);
+        swap(m_used, other.m_used);
+        swap(m_capacity, other.m_capacity);
+        swap(m_bytesUsed, other.m_bytesUsed);
+    }
+
+private:
+
+    vector<unique_ptr<uint8_t[]> >  m_blocks;
+    size_t                          m_used;         // of the last block
+    size_t                          m_capacity;     // of the last block
+    size_t                          m_bytesUsed;
+    mutex                           m_mutex;
+};
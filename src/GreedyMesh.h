@@ -0,0 +1,352 @@
+#pragma once
+
+#include "Common.h"
+#include "cinder/gl/Vbo.h"
+#include "cinder/gl/GlslProg.h"
+#include "Trile.h"
+#include "TrileCulling.h"
+#include "StaticBatch.h"
+#include "FrameProfiler.h"
+#include <unordered_set>
+
+// A merged quad repeats its atlas region once per cell, so the texcoord counts cells and the vertex
+// color carries the region as (origin, extent) for the fragment shader to wrap inside it
+static const char* c_greedyMeshVert =
+    "#version 120\n"
+    "varying vec4 atlasRect;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+    "    atlasRect = gl_Color;\n"
+    "    gl_Position = ftransform();\n"
+    "}\n";
+
+static const char* c_greedyMeshFrag =
+    "#version 120\n"
+    "uniform sampler2D tex;\n"
+    "varying vec4 atlasRect;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_FragColor = texture2D(tex, atlasRect.xy + fract(gl_TexCoord[0].st) * atlasRect.zw);\n"
+    "}\n";
+
+// Faces can only merge when they lie in the same plane and show the same atlas region the same way
+struct GreedyFaceKey
+{
+    uint64_t    chunk;      // SceneChunks key, merged quads stay inside their scene chunk
+    uint8_t     side;
+    int32_t     depth;      // cell coordinate along the side's axis
+    Vec2f       origin;     // texcoord at the quad's (0,0) corner
+    Vec2f       extent;     // signed size of the atlas region
+    bool        swapped;    // texture x runs along v instead of u
+    bool        ccw;
+
+    bool operator<(const GreedyFaceKey& rhs) const
+    {
+        if (chunk != rhs.chunk) { return chunk < rhs.chunk; }
+        if (side != rhs.side) { return side < rhs.side; }
+        if (depth != rhs.depth) { return depth < rhs.depth; }
+        if (origin.x != rhs.origin.x) { return origin.x < rhs.origin.x; }
+        if (origin.y != rhs.origin.y) { return origin.y < rhs.origin.y; }
+        if (extent.x != rhs.extent.x) { return extent.x < rhs.extent.x; }
+        if (extent.y != rhs.extent.y) { return extent.y < rhs.extent.y; }
+        if (swapped != rhs.swapped) { return swapped < rhs.swapped; }
+        return ccw < rhs.ccw;
+    }
+};
+
+// Merges runs of identical, coplanar unit quads on the trile grid into larger quads.
+// Only faces whose atlas region is an axis aligned rectangle can repeat, everything else is left
+// to the static batch through m_mergedSides. Build() is plain CPU code meant for the loader thread.
+class GreedyMesh
+{
+public:
+
+    deque<TriMesh>      m_chunks;
+    vector<Bounds>      m_bounds;       // per chunk
+    vector<gl::VboMesh> m_vboMeshes;
+    vector<uint8_t>     m_mergedSides;  // per trile, in container order, sides that were merged here
+    uint32_t            m_maxVertices;
+    uint32_t            m_numFaces;     // unit quads merged
+    uint32_t            m_numQuads;     // quads emitted for them
+    gl::GlslProg        m_shader;
+    bool                m_supported;
+
+    GreedyMesh(const uint32_t maxVertices = STATIC_BATCH_MAX_VERTICES) :
+        m_maxVertices(maxVertices),
+        m_numFaces(0),
+        m_numQuads(0),
+        m_supported(false),
+        m_lastChunk(0)
+    {
+    }
+
+    // Must be called with the GL context current
+    void Setup()
+    {
+        try
+        {
+            m_shader = gl::GlslProg(c_greedyMeshVert, c_greedyMeshFrag);
+            m_supported = true;
+        }
+        catch (gl::GlslProgCompileExc& exc)
+        {
+            console() << "WARNING! Greedy mesh shader failed to compile, faces will not be merged: " << exc.what() << endl;
+            m_supported = false;
+        }
+    }
+
+    // pHiddenSides optionally holds a TrileCulling mask per trile, faces on those sides are skipped
+    template<typename TrileContainer>
+    void Build(const TrileContainer& triles, const vector<uint8_t>* pHiddenSides = nullptr)
+    {
+        ClearGeometry();
+        m_mergedSides.assign(triles.size(), 0);
+
+        // Cells of every plane, keyed by what they show
+        map<GreedyFaceKey, vector<Vec2i> > planes;
+        const Vec3f gridOffset = TrileCulling::FindGridOffset(triles);
+
+        uint32_t i = 0;
+        for (const Trile& trile : triles)
+        {
+            const TrileFaces& faces = trile.m_pGeometry->faces[trile.m_orient];
+            const uint8_t hiddenSides = pHiddenSides ? (*pHiddenSides)[i] : 0;
+            const Vec3i cell = TrileCulling::GetCell(trile);
+
+            // Triles placed off the grid the others share keep their own faces
+            if (!TrileCulling::IsOnGrid(trile, gridOffset))
+            {
+                i++;
+                continue;
+            }
+
+            for (uint8_t side = 0; side < NUM_TRILE_SIDES; side++)
+            {
+                GreedyFaceKey key;
+                if (!(faces.quadSides & (1 << side)) || (hiddenSides & (1 << side)) ||
+                    !MakeKey(side, cell, faces.quads[side], &key))
+                {
+                    continue;
+                }
+
+                key.chunk = SceneChunks::GetChunkKey(trile.GetBounds().GetCenter());
+                planes[key].push_back(Vec2i(cell[(side + 1) % 3], cell[(side + 2) % 3]));
+                m_mergedSides[i] |= 1 << side;
+                m_numFaces++;
+            }
+            i++;
+        }
+
+        for (const auto& plane : planes)
+        {
+            MergePlane(plane.first, plane.second, gridOffset);
+        }
+    }
+
+    // Must be called on the GL thread
+    void Draw(const gl::Texture& texture, const Frustum& frustum = Frustum())
+    {
+        if (!m_supported || m_chunks.empty())
+        {
+            return;
+        }
+
+        if (m_vboMeshes.size() != m_chunks.size())
+        {
+            m_vboMeshes.clear();
+            for (const TriMesh& chunk : m_chunks)
+            {
+                m_vboMeshes.push_back(gl::VboMesh(chunk));
+            }
+        }
+
+        m_shader.bind();
+        m_shader.uniform("tex", 0);
+        texture.bind();
+        FrameProfiler::CountStateChanges(1);
+        for (size_t i = 0; i < m_vboMeshes.size(); i++)
+        {
+            if (frustum.Intersects(m_bounds[i]))
+            {
+                gl::draw(m_vboMeshes[i]);
+                FrameProfiler::CountDraw(m_chunks[i].getNumTriangles());
+            }
+        }
+        texture.unbind();
+        m_shader.unbind();
+    }
+
+    uint32_t GetNumVertices() const
+    {
+        return m_numQuads * 4;
+    }
+
+    void Clear()
+    {
+        ClearGeometry();
+        m_mergedSides.clear();
+    }
+
+    // Swaps the built geometry only, the shader stays with the renderer that compiled it
+    void Swap(GreedyMesh& other)
+    {
+        m_chunks.swap(other.m_chunks);
+        m_bounds.swap(other.m_bounds);
+        m_vboMeshes.swap(other.m_vboMeshes);
+        m_mergedSides.swap(other.m_mergedSides);
+        swap(m_maxVertices, other.m_maxVertices);
+        swap(m_numFaces, other.m_numFaces);
+        swap(m_numQuads, other.m_numQuads);
+    }
+
+private:
+
+    uint64_t            m_lastChunk;    // of the last quad appended
+
+    void ClearGeometry()
+    {
+        m_chunks.clear();
+        m_bounds.clear();
+        m_vboMeshes.clear();
+        m_lastChunk = 0;
+        m_numFaces = 0;
+        m_numQuads = 0;
+    }
+
+    // Fails when the face's atlas region is not an axis aligned rectangle, which fract() can't repeat
+    static bool MakeKey(const uint8_t side, const Vec3i& cell, const TrileQuad& quad, GreedyFaceKey* pKey)
+    {
+        const float c_epsilon = 0.0001f;
+        const Vec2f texU = quad.texcoords[1] - quad.texcoords[0];
+        const Vec2f texV = quad.texcoords[2] - quad.texcoords[0];
+        if (quad.texcoords[3].distanceSquared(quad.texcoords[0] + texU + texV) > c_epsilon * c_epsilon)
+        {
+            return false;
+        }
+
+        if (math<float>::abs(texU.y) < c_epsilon && math<float>::abs(texV.x) < c_epsilon)
+        {
+            pKey->extent = Vec2f(texU.x, texV.y);
+            pKey->swapped = false;
+        }
+        else if (math<float>::abs(texU.x) < c_epsilon && math<float>::abs(texV.y) < c_epsilon)
+        {
+            pKey->extent = Vec2f(texV.x, texU.y);
+            pKey->swapped = true;
+        }
+        else
+        {
+            return false;
+        }
+
+        pKey->side = side;
+        pKey->depth = cell[side % 3];
+        pKey->origin = quad.texcoords[0];
+        pKey->ccw = quad.ccw;
+        return true;
+    }
+
+    static uint64_t PlaneCellKey(const int32_t u, const int32_t v)
+    {
+        return ((uint64_t)(uint32_t)u << 32) | (uint64_t)(uint32_t)v;
+    }
+
+    // Grows each quad along u first, then along v while the whole row below is still free
+    void MergePlane(const GreedyFaceKey& key, vector<Vec2i> cells, const Vec3f& gridOffset)
+    {
+        sort(cells.begin(), cells.end(), [](const Vec2i& a, const Vec2i& b)
+        {
+            return a.y != b.y ? a.y < b.y : a.x < b.x;
+        });
+
+        unordered_set<uint64_t> remaining;
+        for (const Vec2i& cell : cells)
+        {
+            remaining.insert(PlaneCellKey(cell.x, cell.y));
+        }
+
+        for (const Vec2i& cell : cells)
+        {
+            if (remaining.find(PlaneCellKey(cell.x, cell.y)) == remaining.end())
+            {
+                continue;
+            }
+
+            int32_t width = 1;
+            while (remaining.find(PlaneCellKey(cell.x + width, cell.y)) != remaining.end())
+            {
+                width++;
+            }
+
+            int32_t height = 1;
+            for (bool rowFree = true; rowFree; )
+            {
+                for (int32_t u = 0; u < width && rowFree; u++)
+                {
+                    rowFree = remaining.find(PlaneCellKey(cell.x + u, cell.y + height)) != remaining.end();
+                }
+                if (rowFree)
+                {
+                    height++;
+                }
+            }
+
+            for (int32_t v = 0; v < height; v++)
+            {
+                for (int32_t u = 0; u < width; u++)
+                {
+                    remaining.erase(PlaneCellKey(cell.x + u, cell.y + v));
+                }
+            }
+            AppendQuad(key, cell, width, height, gridOffset);
+        }
+    }
+
+    void AppendQuad(const GreedyFaceKey& key, const Vec2i& cell, const int32_t width, const int32_t height, const Vec3f& gridOffset)
+    {
+        if (m_chunks.empty() || key.chunk != m_lastChunk || m_chunks.back().getNumVertices() + 4 > m_maxVertices)
+        {
+            m_chunks.push_back(TriMesh());
+            m_bounds.push_back(Bounds());
+            m_lastChunk = key.chunk;
+        }
+        TriMesh& chunk = m_chunks.back();
+        const uint32_t baseVertex = chunk.getNumVertices();
+
+        const uint32_t axis = key.side % 3;
+        const uint32_t uAxis = (key.side + 1) % 3;
+        const uint32_t vAxis = (key.side + 2) % 3;
+        const ColorAf atlasRect(key.origin.x, key.origin.y, key.extent.x, key.extent.y);
+
+        // Corners in the same (0,0), (1,0), (0,1), (1,1) order as TrileQuad
+        for (uint32_t corner = 0; corner < 4; corner++)
+        {
+            const float du = (float)((corner & 1) ? width : 0);
+            const float dv = (float)((corner & 2) ? height : 0);
+
+            Vec3f pos;
+            pos[axis] = gridOffset[axis] + key.depth + (key.side < 3 ? -0.5f : 0.5f);
+            pos[uAxis] = gridOffset[uAxis] + cell.x - 0.5f + du;
+            pos[vAxis] = gridOffset[vAxis] + cell.y - 0.5f + dv;
+
+            chunk.appendVertex(pos);
+            m_bounds.back().Include(pos);
+            chunk.appendNormal(gc_normals[key.side]);
+            chunk.appendTexCoord(key.swapped ? Vec2f(dv, du) : Vec2f(du, dv));
+            chunk.appendColorRgba(atlasRect);
+        }
+
+        if (key.ccw)
+        {
+            chunk.appendTriangle(baseVertex, baseVertex + 1, baseVertex + 3);
+            chunk.appendTriangle(baseVertex, baseVertex + 3, baseVertex + 2);
+        }
+        else
+        {
+            chunk.appendTriangle(baseVertex, baseVertex + 3, baseVertex + 1);
+            chunk.appendTriangle(baseVertex, baseVertex + 2, baseVertex + 3);
+        }
+        m_numQuads++;
+    }
+};
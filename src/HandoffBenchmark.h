@@ -0,0 +1,217 @@
+#pragma once
+
+#include "Common.h"
+#include "SceneBatch.h"
+#include "SpscQueue.h"
+#include "ViewState.h"
+
+#define HANDOFF_BENCHMARK_TRILES        1000000
+#define HANDOFF_BENCHMARK_FRAME_SECONDS (1.0 / 60.0)    // frames start no closer together, like a vsynced draw()
+
+// Stresses the handoff of loaded triles to the draw loop with a synthetic loader thread, once the way the
+// loader used to share the scene behind a mutex and once through the scene batch queue. Each frame culls
+// everything handed over so far, like draw() does before the scene chunks exist. Reports how long frames
+// were held up by the handoff and how fast the loader got its triles across, and checks that every trile
+// arrived exactly once and in the order it was loaded. Run with -handoffbench.
+class HandoffBenchmark
+{
+public:
+
+    // Returns false if either handoff lost, repeated or reordered a trile
+    static bool Run(const uint32_t numTriles, ostream& out)
+    {
+        bool passed = true;
+        TrileGeometry geometry;
+        for (uint32_t orient = 0; orient < NUM_ORIENTATIONS; orient++)
+        {
+            geometry.bounds[orient] = Bounds(Vec3f(-0.5f, -0.5f, -0.5f), Vec3f(0.5f, 0.5f, 0.5f));
+        }
+        const uint32_t side = (uint32_t)math<float>::ceil(math<float>::pow((float)numTriles, 1.f / 3.f));
+
+        CameraPersp camera;
+        camera.setPerspective(60.f, 16.f / 9.f, 1.f, 1000.f);
+        camera.lookAt(Vec3f(0.f, 0.f, (float)side), Vec3f(side / 2.f, 0.f, 0.f));
+        ViewState view;
+        view.Set(camera, 0.0, true);
+
+        out << "Handoff Benchmark: " << numTriles << " Triles, " << SCENE_BATCH_TRILES << " per Batch" << endl;
+
+        // Mutex, the loader holds the lock while it places a batch worth of triles and the frame holds it
+        // while it walks them
+        {
+            HandoffStats stats;
+            deque<Trile> triles;
+            mutex sceneMutex;
+            atomic<bool> done(false);
+            Timer timer(true);
+            thread loader([&]()
+            {
+                for (uint32_t i = 0; i < numTriles; i += SCENE_BATCH_TRILES)
+                {
+                    lock_guard<mutex> lock( sceneMutex );
+                    for (uint32_t j = i; j < min(i + SCENE_BATCH_TRILES, numTriles); j++)
+                    {
+                        triles.push_back(MakeTrile(geometry, j, side));
+                    }
+                }
+                stats.loadSeconds = timer.getSeconds();
+                done = true;
+            });
+            bool finished = false;
+            while (!finished)
+            {
+                finished = done;
+                const double frameStart = timer.getSeconds();
+                {
+                    lock_guard<mutex> lock( sceneMutex );
+                    stats.AddStall(timer.getSeconds() - frameStart);
+                    stats.numVisible = Cull(triles, view);
+                    stats.AddFrame(triles.size() == numTriles, timer.getSeconds());
+                }
+                WaitForFrame(timer, frameStart);
+            }
+            loader.join();
+            stats.numMisplaced = CountMisplaced(triles, numTriles);
+            passed = passed && stats.numMisplaced == 0;
+            Print(out, "Mutex", stats, numTriles);
+        }
+
+        // Queue, the loader fills private batches and the frame applies what has arrived, within its budget
+        {
+            HandoffStats stats;
+            deque<Trile> triles;
+            SpscQueue<SceneBatchRef, SCENE_QUEUE_CAPACITY> queue;
+            atomic<bool> done(false);
+            Timer timer(true);
+            thread loader([&]()
+            {
+                SceneBatchRef pBatch(new SceneBatch());
+                for (uint32_t i = 0; i < numTriles; i++)
+                {
+                    pBatch->triles.push_back(MakeTrile(geometry, i, side));
+                    if (pBatch->triles.size() == SCENE_BATCH_TRILES || i + 1 == numTriles)
+                    {
+                        while (!queue.Push(pBatch))
+                        {
+                            this_thread::yield();
+                        }
+                        pBatch = SceneBatchRef(new SceneBatch());
+                    }
+                }
+                stats.loadSeconds = timer.getSeconds();
+                done = true;
+            });
+            bool finished = false;
+            while (!finished)
+            {
+                finished = done && queue.IsEmpty();
+                const double frameStart = timer.getSeconds();
+                SceneBatchRef pBatch;
+                while (queue.Pop(&pBatch))
+                {
+                    triles.insert(triles.end(), pBatch->triles.begin(), pBatch->triles.end());
+                    pBatch = nullptr;
+                    if (timer.getSeconds() - frameStart >= SCENE_APPLY_SECONDS)
+                    {
+                        break;
+                    }
+                }
+                stats.AddStall(timer.getSeconds() - frameStart);
+                stats.numVisible = Cull(triles, view);
+                stats.AddFrame(triles.size() == numTriles, timer.getSeconds());
+                WaitForFrame(timer, frameStart);
+            }
+            loader.join();
+            stats.numMisplaced = CountMisplaced(triles, numTriles);
+            passed = passed && stats.numMisplaced == 0;
+            Print(out, "Queue", stats, numTriles);
+        }
+        return passed;
+    }
+
+    // Triles made by MakeTrile() are keyed by their load order, counts the ones not where that puts them
+    // and the ones missing or extra
+    static uint32_t CountMisplaced(const deque<Trile>& triles, const uint32_t numTriles)
+    {
+        uint32_t numMisplaced = max(triles.size(), (size_t)numTriles) - min(triles.size(), (size_t)numTriles);
+        for (uint32_t i = 0; i < min(triles.size(), (size_t)numTriles); i++)
+        {
+            numMisplaced += triles[i].m_key != i ? 1 : 0;
+        }
+        return numMisplaced;
+    }
+
+    static Trile MakeTrile(const TrileGeometry& geometry, const uint32_t i, const uint32_t side)
+    {
+        const Vec3f pos = Vec3f((float)(i % side), (float)(i / side % side), (float)(i / side / side)) - Vec3f::one() * (side / 2.f);
+        return Trile(&geometry, i, Vec3f::zero(), i % NUM_ORIENTATIONS, Vec3f::zero(), pos);
+    }
+
+private:
+
+    struct HandoffStats
+    {
+        uint32_t    numFrames;
+        uint32_t    numVisible;         // in the last frame, which saw every trile
+        uint32_t    numMisplaced;       // triles lost, repeated or out of load order once all arrived
+        double      stallSeconds;       // waiting for the lock, or applying batches
+        double      maxStallSeconds;
+        double      loadSeconds;        // until the loader had placed every trile
+        double      completeSeconds;    // until a frame first drew every trile
+
+        HandoffStats() :
+            numFrames(0),
+            numVisible(0),
+            numMisplaced(0),
+            stallSeconds(0.0),
+            maxStallSeconds(0.0),
+            loadSeconds(0.0),
+            completeSeconds(0.0)
+        {
+        }
+
+        void AddStall(const double seconds)
+        {
+            stallSeconds += seconds;
+            maxStallSeconds = max(maxStallSeconds, seconds);
+        }
+
+        void AddFrame(const bool complete, const double seconds)
+        {
+            numFrames++;
+            if (complete && completeSeconds == 0.0)
+            {
+                completeSeconds = seconds;
+            }
+        }
+    };
+
+    static void WaitForFrame(const Timer& timer, const double frameStart)
+    {
+        while (timer.getSeconds() - frameStart < HANDOFF_BENCHMARK_FRAME_SECONDS)
+        {
+            this_thread::yield();
+        }
+    }
+
+    static uint32_t Cull(const deque<Trile>& triles, const ViewState& view)
+    {
+        uint32_t numVisible = 0;
+        for (const Trile& trile : triles)
+        {
+            numVisible += view.frustum.Intersects(trile.GetBounds()) ? 1 : 0;
+        }
+        return numVisible;
+    }
+
+    static void Print(ostream& out, const char* handoff, const HandoffStats& stats, const uint32_t numTriles)
+    {
+        out << "  " << handoff << ": " << stats.numFrames << " frames stalled " << stats.stallSeconds * 1000 << " ms, " <<
+               "longest " << stats.maxStallSeconds * 1000 << " ms, loaded " << numTriles / max(stats.loadSeconds, 1e-9) / 1000000 << " M triles/s, " <<
+               "all drawn after " << stats.completeSeconds * 1000 << " ms, " << stats.numVisible << " visible" << endl;
+        if (stats.numMisplaced > 0)
+        {
+            out << "ERROR! " << handoff << " handoff misplaced " << stats.numMisplaced << " triles" << endl;
+        }
+    }
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Common.h"
+#include "LoadProfiler.h"
+#include <fstream>
+
+// Reads the dimensions from the IHDR chunk of a .png without decoding it
+inline bool ReadPngSize(const fs::path& png, Vec2i* pSize)
+{
+    static const uint8_t c_signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+    uint8_t header[24];
+    ifstream in(png.string().c_str(), ios::in | ios::binary);
+    if (!in.read((char*)header, sizeof(header)))
+    {
+        return false;
+    }
+    if (memcmp(header, c_signature, sizeof(c_signature)) != 0 || memcmp(&header[12], "IHDR", 4) != 0)
+    {
+        return false;
+    }
+
+    pSize->x = (header[16] << 24) | (header[17] << 16) | (header[18] << 8) | header[19];
+    pSize->y = (header[20] << 24) | (header[21] << 16) | (header[22] << 8) | header[23];
+    return true;
+}
+
+// Decodes a .png, counted towards the current load's profile
+inline Surface DecodeImage(const fs::path& png)
+{
+    LoadProfiler::CountFile(png);
+    LoadProfiler::Count(LOAD_IMAGES, 1);
+    return loadImage(png);
+}
+
+// Process-wide cache of decoded images keyed by path, so every plane or
+// object referencing the same .png shares one decode and one copy of the pixels
+class SurfaceCache
+{
+public:
+
+    static SurfaceCache s_cache;
+
+    uint32_t m_hits;
+    uint32_t m_misses;
+
+    SurfaceCache() :
+        m_hits(0),
+        m_misses(0)
+    {
+    }
+
+    // Thread safe, concurrent requests for the same path wait for a single decode
+    Surface Load(const fs::path& png)
+    {
+        shared_ptr<Entry> pEntry;
+        {
+            lock_guard<mutex> lock( m_mutex );
+            auto& entry = m_entries[png.string()];
+            if (!entry)
+            {
+                entry = shared_ptr<Entry>(new Entry());
+            }
+            pEntry = entry;
+        }
+
+        lock_guard<mutex> lock( pEntry->m_mutex );
+        if (!pEntry->m_loaded)
+        {
+            pEntry->m_surface = DecodeImage(png);
+            pEntry->m_loaded = true;
+            lock_guard<mutex> statsLock( m_mutex );
+            m_misses++;
+        }
+        else
+        {
+            lock_guard<mutex> statsLock( m_mutex );
+            m_hits++;
+        }
+        return pEntry->m_surface;
+    }
+
+    // The next Load() of the path decodes the file again, surfaces already handed out are unaffected
+    void Invalidate(const fs::path& png)
+    {
+        lock_guard<mutex> lock( m_mutex );
+        m_entries.erase(png.string());
+    }
+
+    void Clear()
+    {
+        lock_guard<mutex> lock( m_mutex );
+        m_entries.clear();
+        m_hits = 0;
+        m_misses = 0;
+    }
+
+private:
+
+    struct Entry
+    {
+        mutex   m_mutex;
+        Surface m_surface;
+        bool    m_loaded;
+
+        Entry() :
+            m_loaded(false)
+        {
+        }
+    };
+
+    mutex                           m_mutex;
+    map<string, shared_ptr<Entry>>  m_entries;
+};
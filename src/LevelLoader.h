@@ -0,0 +1,1145 @@
+#pragma once
+
+#include "Common.h"
+#include "Trile.h"
+#include "TrileSet.h"
+#include "TrileCulling.h"
+#include "StaticBatch.h"
+#include "GreedyMesh.h"
+#include "SceneChunks.h"
+#include "SceneStore.h"
+#include "SceneBatch.h"
+#include "ArtObject.h"
+#include "BackgroundPlane.h"
+#include "BakedLevel.h"
+#include "LevelReader.h"
+#include "WorkerPool.h"
+#include "AllocationStats.h"
+#include "FileWatcher.h"
+#include "LoadProfiler.h"
+#include "TextureCache.h"
+
+// Loads a level or art object on the calling thread and hands the scene to its owner a SceneBatch at a
+// time, through m_publish. Nothing here needs GL or an App, so the viewer runs it on its loader thread and
+// FezBatch runs one per file on the worker pool. Progress and errors go to m_display, or the console if
+// it isn't set.
+class LevelLoader
+{
+public:
+
+    // Options, set before a load
+    bool                    m_verbose;
+    bool                    m_bake;
+    bool                    m_xmlTree;          // load through XmlTree instead of streaming the level and trile set
+    bool                    m_staticBatching;
+    bool                    m_greedyMeshing;    // only where the greedy mesh can be drawn
+    bool                    m_compactVertices;  // quantize the static batch and art object meshes
+    bool                    m_sharedProfile;    // loads run side by side, their owner begins and reports the profile
+    fs::path                m_loadTrace;        // Chrome trace of every load's phases and assets
+
+    // Set by the owner, called on the loading thread
+    function<bool(SceneBatchRef&)>  m_publish;  // hands the batch over and leaves it empty, false stops the load
+    function<void(const string&)>   m_display;
+
+    // Of the last load
+    fs::path                m_file;
+    Vec3f                   m_dimensions;
+    TrileSet                m_trileSet;         // the handed over triles point into it
+    FileWatcher             m_fileWatcher;
+    atomic<bool>            m_finished;         // the last load or reload finished and left its objects in level order
+    vector<LevelArtObjectRecord>    m_levelArtObjects;          // to reload single objects from
+    vector<LevelPlaneRecord>        m_levelBackgroundPlanes;
+    LoadPhases              m_loadPhases;
+    atomic<bool>            m_exit;             // asks a running load to stop, it returns at the next check
+
+    LevelLoader(WorkerPool& workerPool) :
+        m_verbose(false),
+        m_bake(false),
+        m_xmlTree(false),
+        m_staticBatching(false),
+        m_greedyMeshing(false),
+        m_compactVertices(false),
+        m_sharedProfile(false),
+        m_dimensions(Vec3f::zero()),
+        m_finished(false),
+        m_exit(false),
+        m_workerPool(workerPool)
+    {
+        memset(&m_loadAllocations, 0, sizeof(m_loadAllocations));
+    }
+
+    // How far from a file's scene the camera starts, zero if it is neither a level nor an art object
+    static float GetViewDistance(const fs::path& file)
+    {
+        const string directory = (--file.parent_path().end())->string();
+        if (directory == "levels")
+        {
+            return 25.f;
+        }
+        if (directory == "art objects")
+        {
+            return 15.f;
+        }
+        return 0.f;
+    }
+
+    // Replaces the last load with the file's, returns whether it finished
+    bool Load(const fs::path& file)
+    {
+        ci::ThreadSetup threadSetup; // Required for cinder multithreading
+        Clear();
+        m_file = file;
+
+        const string directory = (--file.parent_path().end())->string();
+        if (directory == "levels")
+        {
+            LoadLevel();
+        }
+        else if (directory == "art objects")
+        {
+            LoadArtObject();
+        }
+        else
+        {
+            ostringstream displayString;
+            displayString << "ERROR! Expected a 'level' or 'art object' .xml file:\n" << file;
+            Display(displayString.str());
+        }
+        return m_finished;
+    }
+
+    // For -watch, rebuilds only the objects loaded from the changed files. The objects they replace go
+    // back with the scene batch and are released by the owner, their textures and buffers may be GL objects.
+    void Reload(const vector<WatchedFile> changed)
+    {
+        ci::ThreadSetup threadSetup; // Required for cinder multithreading
+        Timer timer(true);
+        m_finished = false;
+
+        // TODO: path.preferred_separator doesn't work on windows
+        const auto sep = '/';
+
+        SceneBatchRef pBatch(new SceneBatch());
+        set<uint32_t> artObjectIndices;
+        set<uint32_t> backgroundPlaneIndices;
+        for (const WatchedFile& file : changed)
+        {
+            Log() << "Changed: " << file.path.string() << endl;
+            if (getPathExtension(file.path.string()) == "png")
+            {
+                TextureCache::s_cache.Invalidate(file.path);
+            }
+            if (file.type == WATCHED_TRILE_SET_TEXTURE)
+            {
+                pBatch->trileSurface = DecodeImage(file.path);
+            }
+            else if (file.type == WATCHED_ART_OBJECT)
+            {
+                artObjectIndices.insert(file.indices.begin(), file.indices.end());
+            }
+            else if (file.type == WATCHED_BACKGROUND_PLANE)
+            {
+                backgroundPlaneIndices.insert(file.indices.begin(), file.indices.end());
+            }
+        }
+
+        fs::path artObjectsPath = m_file.parent_path().string() + sep + ".." + sep + "art objects" + sep;
+        const vector<uint32_t> artObjectReloads(artObjectIndices.begin(), artObjectIndices.end());
+        vector<shared_ptr<ArtObject>> artObjects(artObjectReloads.size());
+        m_workerPool.ParallelFor(artObjectReloads.size(), [&](uint32_t i)
+        {
+            if (m_exit) { return; }
+            fs::path artObjectPng;
+            artObjects[i] = LoadLevelArtObject(m_levelArtObjects[artObjectReloads[i]], artObjectReloads[i] + 1, artObjectsPath, &artObjectPng);
+        });
+        for (size_t i = 0; i < artObjectReloads.size(); i++)
+        {
+            if (!artObjects[i]) { continue; }  // the error has already been displayed, the old object stays
+            if (m_compactVertices)
+            {
+                artObjects[i]->Compact();
+            }
+            pBatch->artObjectReloads.push_back(make_pair(artObjectReloads[i], artObjects[i]));
+        }
+
+        fs::path backgroundPlanePath = m_file.parent_path().string() + sep + ".." + sep + "background planes" + sep;
+        const vector<uint32_t> backgroundPlaneReloads(backgroundPlaneIndices.begin(), backgroundPlaneIndices.end());
+        vector<shared_ptr<BackgroundPlane>> backgroundPlanes(backgroundPlaneReloads.size());
+        m_workerPool.ParallelFor(backgroundPlaneReloads.size(), [&](uint32_t i)
+        {
+            if (m_exit) { return; }
+            fs::path backgroundPlanePng;
+            backgroundPlanes[i] = LoadLevelBackgroundPlane(m_levelBackgroundPlanes[backgroundPlaneReloads[i]], backgroundPlaneReloads[i] + 1,
+                                                           backgroundPlanePath, &backgroundPlanePng);
+        });
+        for (size_t i = 0; i < backgroundPlaneReloads.size(); i++)
+        {
+            if (!backgroundPlanes[i]) { continue; }
+            pBatch->backgroundPlaneReloads.push_back(make_pair(backgroundPlaneReloads[i], backgroundPlanes[i]));
+        }
+        if (!Publish(pBatch)) { return; }
+
+        ostringstream displayString;
+        displayString << "Reloaded " << artObjectReloads.size() << " Art Objects, " << backgroundPlaneReloads.size() << " Background Planes";
+        if (m_verbose)
+        {
+            displayString << endl << timer.getSeconds() << " Seconds";
+        }
+        Display(displayString.str());
+        m_finished = true;
+    }
+
+    // Releases what the last load kept for reloads, the owner clears what it was handed
+    void Clear()
+    {
+        m_trileSet.Clear();
+        m_fileWatcher.Clear();
+        m_finished = false;
+        m_levelArtObjects.clear();
+        m_levelBackgroundPlanes.clear();
+    }
+
+    void Display(const string& str)
+    {
+        if (m_display)
+        {
+            m_display(str);
+        }
+        else if (m_verbose || str.compare(0, 6, "ERROR!") == 0)
+        {
+            Log() << str << endl;
+        }
+    }
+
+private:
+
+    WorkerPool&             m_workerPool;
+    AllocationCount         m_loadAllocations;  // at the start of the current load
+
+    bool Publish(SceneBatchRef& pBatch)
+    {
+        return m_publish(pBatch) && !m_exit;
+    }
+
+    // Closes the last phase of a finished load and reports its profile
+    void FinishProfile()
+    {
+        m_loadPhases.End();
+        if (m_sharedProfile)
+        {
+            return;
+        }
+        if (!m_loadTrace.empty())
+        {
+            ofstream out(m_loadTrace.string().c_str());
+            LoadProfiler::s_profiler.WriteTrace(out);
+        }
+        if (m_verbose)
+        {
+            Log() << LoadProfiler::s_profiler.GetSummary();
+        }
+    }
+
+    void LoadArtObject()
+    {
+        // TODO: path.preferred_separator doesn't work on windows
+        const auto sep = '/';
+
+        // Load art objects
+        fs::path artObjectXml = m_file;
+        if (getPathExtension(artObjectXml.string()) != "xml")
+        {
+            ostringstream displayString;
+            displayString << "ERROR! Art Object extension is not .xml: " << artObjectXml;
+            Display(displayString.str());
+            return;
+        }
+
+        if (exists(artObjectXml))
+        {
+            ostringstream displayString;
+            displayString << "Loading Art Object .xml: " << artObjectXml.filename();
+            Display(displayString.str());
+        }
+        else
+        {
+            ostringstream displayString;
+            displayString << "ERROR! Missing Art Object .xml: " << artObjectXml;
+            Display(displayString.str());
+            return;
+        }
+        m_fileWatcher.Watch(artObjectXml, WATCHED_LEVEL);
+        m_loadPhases.Begin(!m_sharedProfile);
+        m_loadPhases.Mark("art object xml");
+        LoadProfiler::CountFile(artObjectXml);
+        const XmlTree aoXml = XmlTree(loadFile(artObjectXml));
+        const XmlTree& lookAtXml = aoXml.getChild("ArtObject/Size/Vector3");
+        m_dimensions = Vec3f(lookAtXml.getAttributeValue<float>("x"),
+                             lookAtXml.getAttributeValue<float>("y"),
+                             lookAtXml.getAttributeValue<float>("z"));
+
+        string aoPngName;
+        if (aoXml.getChild("ArtObject").hasAttribute("cubemapPath"))
+        {
+            // The XBOX content contains a "cubemapPath" attribute with the .png name
+            aoPngName = aoXml.getChild("ArtObject")["cubemapPath"].getValue();
+        }
+        else
+        {
+            // The PC content infers the .png name from the "name" attribute
+            aoPngName = aoXml.getChild("ArtObject")["name"].getValue();
+        }
+
+        boost::algorithm::to_lower(aoPngName);
+        fs::path artObjectPng = m_file.parent_path().string() + sep + aoPngName + ".png";
+        if (exists(artObjectPng))
+        {
+            ostringstream displayString;
+            displayString << "Loading Art Object .png: " << artObjectPng.filename();
+            Display(displayString.str());
+        }
+        else
+        {
+            ostringstream displayString;
+            displayString << "ERROR! Missing Art Object .png: " << artObjectPng;
+            Display(displayString.str());
+            return;
+        }
+
+        Vec3f pos = Vec3f::zero(); // counteract offset from level loader
+        Quatf rot = Quatf(0,0,0);
+        Vec3f scale = Vec3f(1.f, 1.f, 1.f);
+        Vec3f offset = -m_dimensions/2;
+        m_loadPhases.Mark("art object");
+        SceneBatchRef pBatch(new SceneBatch());
+        pBatch->pArtObjects = shared_ptr<deque<ArtObject>>(new deque<ArtObject>());
+        pBatch->pArtObjects->push_back(ArtObject(aoXml, pos, rot, scale, offset, artObjectPng));
+        if (!Publish(pBatch)) { return; }
+        m_fileWatcher.Watch(artObjectPng, WATCHED_LEVEL);
+        FinishProfile();
+        m_finished = true;
+
+        ostringstream displayString;
+        displayString << "Finished Loading " << m_file.filename().string();
+        Display(displayString.str());
+    }
+
+    void LoadLevel()
+    {
+        Timer timer(true);
+        m_loadAllocations = AllocationStats::Get();
+        m_loadPhases.Begin(!m_sharedProfile);
+        m_fileWatcher.Watch(m_file, WATCHED_LEVEL);
+
+        // TODO: path.preferred_separator doesn't work on windows
+        const auto sep = '/';
+
+        // Prefer a baked level when none of the files it was baked from has changed since
+        fs::path bakedFile = m_file;
+        bakedFile.replace_extension(BAKED_LEVEL_EXTENSION);
+        const bool isBakedFile = (bakedFile == m_file);
+        if (isBakedFile || (!m_bake && exists(bakedFile)))
+        {
+            m_loadPhases.Mark("baked level");
+            if (LoadBakedLevel(bakedFile, isBakedFile))
+            {
+                FinishProfile();
+                return;
+            }
+            if (isBakedFile)
+            {
+                ostringstream displayString;
+                displayString << "ERROR! Invalid baked level: " << bakedFile;
+                Display(displayString.str());
+                return;
+            }
+            Log() << "WARNING! Ignoring invalid or out of date baked level: " << bakedFile << endl;
+        }
+        BakedLevelWriter baker(m_file.parent_path());
+
+        // Load the level data
+        m_loadPhases.Mark("level xml");
+        Log() << "Loading Level: " << m_file.string() << endl;
+        LevelReader level;
+        if (m_xmlTree)
+        {
+            LoadProfiler::CountFile(m_file);
+            level.ReadTree(XmlTree(loadFile(m_file)));
+        }
+        else if (!level.Read(m_file))
+        {
+            ostringstream displayString;
+            displayString << "ERROR! Invalid Level .xml: " << m_file;
+            Display(displayString.str());
+            return;
+        }
+        m_dimensions = level.m_size;
+        baker.SetDimensions(m_dimensions);
+
+        // Load trile sets
+        string trileSetName = level.m_trileSetName;
+        if (m_verbose)
+        {
+            Log() << "Trile Set Name: " << trileSetName << endl;
+        }
+        boost::algorithm::to_lower(trileSetName);
+        fs::path trileSetPath = m_file.parent_path().string() + sep + ".." + sep + "trile sets" + sep + trileSetName;
+        fs::path trileSetPng = trileSetPath.string() + ".png";
+        fs::path trileSetXml = trileSetPath.string() + ".xml";
+
+        if (exists(trileSetPng))
+        {
+            ostringstream displayString;
+            displayString << "Loading Trile Set .png: " << trileSetPng.filename();
+            Display(displayString.str());
+        }
+        else
+        {
+            ostringstream displayString;
+            displayString << "ERROR! Missing Trile Set .png: " << trileSetPng;
+            Display(displayString.str());
+            return;
+        }
+
+        m_loadPhases.Mark("trile set png");
+        SceneBatchRef pBatch(new SceneBatch());
+        pBatch->trileSurface = DecodeImage(trileSetPng);
+        if (!Publish(pBatch)) { return; }
+        baker.SetTrileSetTexture(trileSetPng);
+        m_fileWatcher.Watch(trileSetPng, WATCHED_TRILE_SET_TEXTURE);
+
+        if (exists(trileSetXml))
+        {
+            ostringstream displayString;
+            displayString << "Loading Trile Set .xml: " << trileSetXml.filename();
+            Display(displayString.str());
+        }
+        else
+        {
+            ostringstream displayString;
+            displayString << "ERROR! Missing Trile Set .xml: " << trileSetXml;
+            Display(displayString.str());
+            return;
+        }
+        m_fileWatcher.Watch(trileSetXml, WATCHED_TRILE_SET);
+        m_loadPhases.Mark("trile set xml");
+        TrileSet trileGeometry;
+        string trileSetName2;
+        if (m_xmlTree)
+        {
+            LoadProfiler::CountFile(trileSetXml);
+            const XmlTree trileSet = XmlTree(loadFile(trileSetXml));
+            trileSetName2 = trileSet.getChild("TrileSet")["name"].getValue();
+            vector<pair<const XmlTree*, TrileGeometry*>> trileEntries;
+            for (const auto& trileEntry : trileSet.getChild("TrileSet/Triles"))
+            {
+                uint32_t key = trileEntry["key"].getValue<int>();
+                if (trileGeometry.Contains(key))
+                {
+                    Log() << "WARNING! Duplicate trile key: " << key << endl;
+                }
+                else
+                {
+                    trileEntries.push_back(make_pair(&trileEntry, &trileGeometry.m_geometry[key]));
+                }
+            }
+            m_loadPhases.Mark("trile mapping");
+            {
+                ostringstream displayString;
+                displayString << "Mapping " << trileEntries.size() << " Triles";
+                Display(displayString.str());
+            }
+            m_workerPool.ParallelFor(trileEntries.size(), [&](uint32_t i)
+            {
+                if (m_exit) { return; }
+                trileGeometry.ParseTrile(*trileEntries[i].first, trileEntries[i].second);
+            });
+        }
+        else
+        {
+            TrileSetReader reader;
+            if (!reader.Read(trileSetXml, &trileGeometry))
+            {
+                ostringstream displayString;
+                displayString << "ERROR! Invalid Trile Set .xml: " << trileSetXml;
+                Display(displayString.str());
+                return;
+            }
+            trileSetName2 = reader.m_name;
+            for (const uint32_t key : reader.m_duplicateKeys)
+            {
+                Log() << "WARNING! Duplicate trile key: " << key << endl;
+            }
+
+            // The reader only fills the raw arrays, the meshes are built here
+            vector<TrileGeometry*> trileEntries;
+            for (auto& entry : trileGeometry.m_geometry)
+            {
+                trileEntries.push_back(&entry.second);
+            }
+            m_loadPhases.Mark("trile mapping");
+            {
+                ostringstream displayString;
+                displayString << "Mapping " << trileEntries.size() << " Triles";
+                Display(displayString.str());
+            }
+            m_workerPool.ParallelFor(trileEntries.size(), [&](uint32_t i)
+            {
+                if (m_exit) { return; }
+                TrileSet::BuildMeshes(*trileEntries[i]);
+            });
+        }
+        if (m_exit) { return; }
+        boost::algorithm::to_lower(trileSetName2);
+        if (trileSetName != trileSetName2)
+        {
+            Log() << "WARNING! Trile Set Name Mismatch: " << trileSetName << ", " << trileSetName2 << endl;
+        }
+        if (m_bake)
+        {
+            baker.AddTrileSet(trileGeometry);
+        }
+        m_trileSet.Swap(trileGeometry);
+
+        // Load all level triles, handed over a batch at a time
+        m_loadPhases.Mark("triles");
+        deque<Trile> triles;
+        pBatch = SceneBatchRef(new SceneBatch());
+        int numLevelTriles = 0;
+        int numSkippedTriles = 0;
+        for (const LevelTrileRecord& trile : level.m_triles)
+        {
+            numLevelTriles++;
+            const int tid = trile.trileId;
+
+            const TrileGeometry* pGeometry = m_trileSet.Find(tid);
+            if (pGeometry)
+            {
+                triles.push_back(Trile(pGeometry, tid, trile.position, trile.orientation, trile.emplacement, -m_dimensions/2));
+                pBatch->triles.push_back(triles.back());
+                if (pBatch->triles.size() == SCENE_BATCH_TRILES)
+                {
+                    // Progress once per batch, formatting it per trile would cost more than placing the trile
+                    ostringstream displayString;
+                    displayString << "Loading Triles " << numLevelTriles << " of " << level.m_triles.size();
+                    Display(displayString.str());
+
+                    if (!Publish(pBatch)) { return; }
+                    pBatch = SceneBatchRef(new SceneBatch());
+                }
+                if (m_bake)
+                {
+                    baker.AddTrileInstance(tid, trile.orientation, trile.position, trile.emplacement);
+                }
+            }
+            else
+            {
+                numSkippedTriles++;
+            }
+        }
+        if (!Publish(pBatch)) { return; }
+        Log() << "Loaded " << numLevelTriles << " Level Triles" << endl;
+        if (numSkippedTriles > 0)
+        {
+            Log() << "WARNING! Skipped " << numSkippedTriles << " Triles Missing from the Trile Set" << endl;
+        }
+        if (m_staticBatching)
+        {
+            m_loadPhases.Mark("static batch");
+            if (!BuildStaticBatch(triles)) { return; }
+        }
+
+        // Load art objects, each one parses its own .xml and decodes its own .png so they go wide on the worker pool
+        m_loadPhases.Mark("art objects");
+        fs::path artObjectsPath = m_file.parent_path().string() + sep + ".." + sep + "art objects" + sep;
+        const vector<LevelArtObjectRecord>& levelArtObjects = level.m_artObjects;
+        int numLevelArtObjects = levelArtObjects.size();
+        vector<shared_ptr<ArtObject>> artObjects(numLevelArtObjects);
+        vector<fs::path> artObjectPngs(numLevelArtObjects);
+        m_workerPool.ParallelFor(numLevelArtObjects, [&](uint32_t i)
+        {
+            if (m_exit) { return; }
+            artObjects[i] = LoadLevelArtObject(levelArtObjects[i], i + 1, artObjectsPath, &artObjectPngs[i]);
+        });
+        pBatch = SceneBatchRef(new SceneBatch());
+        pBatch->pArtObjects = shared_ptr<deque<ArtObject>>(new deque<ArtObject>());
+        for (int i = 0; i < numLevelArtObjects; i++)
+        {
+            if (!artObjects[i]) { return; }    // the error has already been displayed
+            if (m_bake)
+            {
+                baker.AddArtObject(*artObjects[i], artObjectPngs[i]);
+            }
+            if (m_compactVertices)
+            {
+                artObjects[i]->Compact();
+            }
+            pBatch->pArtObjects->push_back(*artObjects[i]);
+        }
+        Log() << "Loaded " << numLevelArtObjects << " Art Objects" << endl;
+        if (m_compactVertices && m_verbose)
+        {
+            size_t numVertices = 0;
+            size_t compactBytes = 0;
+            uint32_t numCompact = 0;
+            for (int i = 0; i < numLevelArtObjects; i++)
+            {
+                const ArtObject& ao = *artObjects[i];
+                numVertices += ao.m_compactMesh.GetNumVertices() + ao.m_mesh.getNumVertices();
+                compactBytes += ao.m_compactMesh.GetVertexBytes() + CompactMesh::GetFloatVertexBytes(ao.m_mesh.getNumVertices());
+                numCompact += ao.m_compactMesh.IsEmpty() ? 0 : 1;
+            }
+            Log() << "Compact Art Objects: " << CompactMesh::GetFloatVertexBytes(numVertices) / 1024 << " KB -> " << compactBytes / 1024 << " KB, " <<
+                     numCompact << " of " << numLevelArtObjects << " quantized" << endl;
+        }
+
+        // Load background planes
+        m_loadPhases.Mark("background planes");
+        fs::path backgroundPlanePath = m_file.parent_path().string() + sep + ".." + sep + "background planes" + sep;
+        const vector<LevelPlaneRecord>& levelBackgroundPlanes = level.m_backgroundPlanes;
+        int numLevelBackgroundPlanes = levelBackgroundPlanes.size();
+        vector<shared_ptr<BackgroundPlane>> backgroundPlanes(numLevelBackgroundPlanes);
+        vector<fs::path> backgroundPlanePngs(numLevelBackgroundPlanes);
+        m_workerPool.ParallelFor(numLevelBackgroundPlanes, [&](uint32_t i)
+        {
+            if (m_exit) { return; }
+            backgroundPlanes[i] = LoadLevelBackgroundPlane(levelBackgroundPlanes[i], i + 1, backgroundPlanePath, &backgroundPlanePngs[i]);
+        });
+        pBatch->pBackgroundPlanes = shared_ptr<deque<BackgroundPlane>>(new deque<BackgroundPlane>());
+        for (int i = 0; i < numLevelBackgroundPlanes; i++)
+        {
+            if (!backgroundPlanes[i]) { return; }  // the error has already been displayed
+            pBatch->pBackgroundPlanes->push_back(*backgroundPlanes[i]);
+            if (m_bake)
+            {
+                baker.AddBackgroundPlane(*backgroundPlanes[i], backgroundPlanePngs[i]);
+            }
+        }
+        Log() << "Loaded " << numLevelBackgroundPlanes << " Background Planes" << endl;
+
+        if (m_bake)
+        {
+            m_loadPhases.Mark("bake");
+            for (const WatchedFile& file : m_fileWatcher.GetFiles())
+            {
+                baker.AddSource(file.path, file.lastWriteTime);
+            }
+            if (baker.Write(bakedFile))
+            {
+                Log() << "Baked Level: " << bakedFile.string() << endl;
+            }
+            else
+            {
+                Log() << "ERROR! Failed to write baked level: " << bakedFile.string() << endl;
+            }
+        }
+
+        // The art objects and planes go over together with the scene chunks built against them
+        m_loadPhases.Mark("scene chunks");
+        BuildSceneChunks(triles, pBatch.get());
+        if (!Publish(pBatch)) { return; }
+        m_levelArtObjects.swap(level.m_artObjects);
+        m_levelBackgroundPlanes.swap(level.m_backgroundPlanes);
+        FinishProfile();
+        m_finished = true;
+
+        ostringstream displayString;
+        displayString << "Finished Loading " << m_file.filename().string() <<
+                         "  (" << numLevelTriles << " Triles, " << numLevelArtObjects << " Art Objects, " << numLevelBackgroundPlanes << " Background Planes)";
+        if (m_verbose)
+        {
+            displayString << endl << timer.getSeconds() << " Seconds";
+            PrintTextureStats();
+            PrintAllocationStats();
+        }
+        Display(displayString.str());
+    }
+
+    // Runs on the worker pool, returns nullptr after displaying the error if a file is missing
+    shared_ptr<ArtObject> LoadLevelArtObject(const LevelArtObjectRecord& object, const int index, const fs::path& artObjectsPath, fs::path* pArtObjectPng)
+    {
+        string aoName = object.name;
+        ScopedLoadTimer timer("Art Object " + aoName);
+
+        ostringstream displayString;
+        displayString << "Loading Art Object " << index << ": " << aoName;
+        Display(displayString.str());
+
+        boost::algorithm::to_lower(aoName);
+        fs::path artObjectXml = artObjectsPath.string() + aoName + ".xml";
+
+        if (exists(artObjectXml))
+        {
+            ostringstream displayString;
+            displayString << "Loading Art Object .xml: " << artObjectXml.filename();
+            Display(displayString.str());
+        }
+        else
+        {
+            ostringstream displayString;
+            displayString << "ERROR! Missing Art Object .xml: " << artObjectXml;
+            Display(displayString.str());
+            return nullptr;
+        }
+        LoadProfiler::CountFile(artObjectXml);
+        const XmlTree aoXml = XmlTree(loadFile(artObjectXml));
+        string aoName2 = aoXml.getChild("ArtObject")["name"].getValue();
+        boost::algorithm::to_lower(aoName2);
+        if (aoName != aoName2)
+        {
+            Log() << "WARNING! Art Object Name Mismatch: " << aoName << ", " << aoName2 << endl;
+        }
+
+        string aoPngName;
+        if (aoXml.getChild("ArtObject").hasAttribute("cubemapPath"))
+        {
+            // The XBOX content contains a "cubemapPath" attribute with the .png name
+            aoPngName = aoXml.getChild("ArtObject")["cubemapPath"].getValue();
+            boost::algorithm::to_lower(aoPngName);
+        }
+        else
+        {
+            // The PC content infers the .png name from the "name" attribute
+            aoPngName = aoName2;
+        }
+
+        fs::path artObjectPng = artObjectsPath.string() + aoPngName + ".png";
+        if (exists(artObjectPng))
+        {
+            ostringstream displayString;
+            displayString << "Loading Art Object .png: " << artObjectPng.filename();
+            Display(displayString.str());
+        }
+        else
+        {
+            ostringstream displayString;
+            displayString << "ERROR! Missing Art Object .png: " << artObjectPng;
+            Display(displayString.str());
+            return nullptr;
+        }
+        m_fileWatcher.Watch(artObjectXml, WATCHED_ART_OBJECT, index - 1);
+        m_fileWatcher.Watch(artObjectPng, WATCHED_ART_OBJECT, index - 1);
+
+        Vec3f offset = -m_dimensions/2 - Vec3f(0.5, 0.5, 0.5);
+        *pArtObjectPng = artObjectPng;
+        return shared_ptr<ArtObject>(new ArtObject(aoXml, object.position, object.rotation, object.scale, offset, artObjectPng));
+    }
+
+    // Runs on the worker pool, returns nullptr after displaying the error if a file is missing
+    shared_ptr<BackgroundPlane> LoadLevelBackgroundPlane(const LevelPlaneRecord& plane, const int index, const fs::path& backgroundPlanePath, fs::path* pBackgroundPlanePng)
+    {
+        string bpName = plane.textureName;
+        std::replace(bpName.begin(), bpName.end(), '\\', '/');    // Mac doesn't like backslash separators
+        boost::algorithm::to_lower(bpName);
+        ScopedLoadTimer timer("Background Plane " + bpName);
+
+        ostringstream displayString;
+        displayString << "Loading Background Plane " << index << ": " << bpName;
+        Display(displayString.str());
+
+        fs::path backgroundPlanePng;
+        XmlTree* pAnimXml = nullptr;
+        XmlTree animXml;
+
+        if (plane.animated)
+        {
+            fs::path backgroundPlaneXml = backgroundPlanePath.string() + bpName + ".xml";
+            backgroundPlanePng = backgroundPlanePath.string() + bpName + ".ani.png";
+
+            if (exists(backgroundPlaneXml))
+            {
+                ostringstream displayString;
+                displayString << "Loading Background Plane .xml: " << backgroundPlaneXml.filename();
+                Display(displayString.str());
+            }
+            else
+            {
+                ostringstream displayString;
+                displayString << "ERROR! Missing Trile Set .xml: " << backgroundPlaneXml;
+                Display(displayString.str());
+                return nullptr;
+            }
+            m_fileWatcher.Watch(backgroundPlaneXml, WATCHED_BACKGROUND_PLANE, index - 1);
+            LoadProfiler::CountFile(backgroundPlaneXml);
+            animXml = XmlTree(loadFile(backgroundPlaneXml));
+            pAnimXml = &animXml;
+        }
+        else
+        {
+            backgroundPlanePng = backgroundPlanePath.string() + bpName + ".png";
+        }
+
+        if (exists(backgroundPlanePng))
+        {
+            ostringstream displayString;
+            displayString << "Loading Background Plane .png: " << backgroundPlanePng.filename();
+            Display(displayString.str());
+        }
+        else
+        {
+            ostringstream displayString;
+            displayString << "ERROR! Missing Background Plane .png: " << backgroundPlanePng;
+            Display(displayString.str());
+            return nullptr;
+        }
+        m_fileWatcher.Watch(backgroundPlanePng, WATCHED_BACKGROUND_PLANE, index - 1);
+
+        Vec3f offset = Vec3f(-m_dimensions/2);
+        Vec2d repeat = Vec2d(plane.xTextureRepeat, plane.yTextureRepeat);
+        *pBackgroundPlanePng = backgroundPlanePng;
+        return shared_ptr<BackgroundPlane>(new BackgroundPlane(plane.position, plane.rotation, plane.scale, pAnimXml, offset,
+                                                               plane.doubleSided, plane.billboard, plane.lightmap,
+                                                               plane.pixelatedLightmap, plane.clampTexture, repeat,
+                                                               backgroundPlanePng));
+    }
+
+    // Returns false without showing anything if the file can't be used, so the level .xml can be loaded
+    // instead. A file opened directly is loaded even if its sources have changed.
+    bool LoadBakedLevel(const fs::path& bakedFile, const bool isBakedFile)
+    {
+        Timer timer(true);
+
+        // TODO: path.preferred_separator doesn't work on windows
+        const auto sep = '/';
+
+        BakedLevelReader reader;
+        if (!reader.Open(bakedFile))
+        {
+            return false;
+        }
+        const BakedHeader& header = *reader.m_pHeader;
+        m_dimensions = header.dimensions;
+
+        vector<fs::path> paths;
+        for (uint32_t i = 0; i < header.numStrings; i++)
+        {
+            string path;
+            if (!reader.ReadString(&path))
+            {
+                break;
+            }
+            paths.push_back(bakedFile.parent_path().string() + sep + path);
+        }
+        const BakedSource* pSources = reader.Read<BakedSource>(header.numSources);
+        for (uint32_t i = 0; i < header.numSources && pSources; i++)
+        {
+            if (pSources[i].path >= paths.size())
+            {
+                reader.Fail();
+            }
+        }
+        if (reader.Failed() || header.trileSetTexture >= paths.size())
+        {
+            ostringstream displayString;
+            displayString << "ERROR! Corrupt baked level: " << bakedFile;
+            Display(displayString.str());
+            return true;
+        }
+
+        // Every source is checked, an edit to the trile set or to a texture is as stale as one to the level
+        for (uint32_t i = 0; i < header.numSources; i++)
+        {
+            const fs::path& source = paths[pSources[i].path];
+            if (FileWatcher::GetLastWriteTime(source) != BakedLevelReader::GetLastWriteTime(pSources[i]))
+            {
+                Log() << "WARNING! Changed since the level was baked: " << source.string() << endl;
+                if (!isBakedFile)
+                {
+                    return false;
+                }
+            }
+        }
+        Log() << "Loading Baked Level: " << bakedFile.string() << endl;
+        for (uint32_t i = 0; i < header.numSources; i++)
+        {
+            m_fileWatcher.Watch(paths[pSources[i].path], WATCHED_LEVEL);
+        }
+
+        // Load trile set
+        const fs::path& trileSetPng = paths[header.trileSetTexture];
+        if (!exists(trileSetPng))
+        {
+            ostringstream displayString;
+            displayString << "ERROR! Missing Trile Set .png: " << trileSetPng;
+            Display(displayString.str());
+            return true;
+        }
+        SceneBatchRef pBatch(new SceneBatch());
+        pBatch->trileSurface = DecodeImage(trileSetPng);
+        if (!Publish(pBatch)) { return true; }
+
+        TrileSet trileGeometry;
+        for (uint32_t i = 0; i < header.numTrileKeys; i++)
+        {
+            const BakedMeshHeader* pMesh = reader.Read<BakedMeshHeader>(1);
+            if (!pMesh) { break; }
+            const Vec3f* pPositions = reader.Read<Vec3f>(pMesh->numVertices);
+            const Vec2f* pTexcoords = reader.Read<Vec2f>(pMesh->numVertices);
+            const uint32_t* pIndices = reader.Read<uint32_t>(pMesh->numIndices);
+            const uint8_t* pNormals = reader.Read<uint8_t>(pMesh->numVertices);
+            if (reader.Failed()) { break; }
+            if (!BakedLevelReader::IsValidMesh(pIndices, pMesh->numIndices, pMesh->numVertices, pNormals))
+            {
+                reader.Fail();
+                break;
+            }
+            trileGeometry.AddTrile(pMesh->id, pPositions, pNormals, pTexcoords, pMesh->numVertices, pIndices, pMesh->numIndices);
+        }
+        m_trileSet.Swap(trileGeometry);
+
+        // Load trile instances, handed over a batch at a time
+        deque<Trile> triles;
+        const BakedTrileInstance* pInstances = reader.Read<BakedTrileInstance>(header.numTrileInstances);
+        if (pInstances)
+        {
+            pBatch = SceneBatchRef(new SceneBatch());
+            for (uint32_t i = 0; i < header.numTrileInstances; i++)
+            {
+                const BakedTrileInstance& instance = pInstances[i];
+                if (instance.orient >= NUM_ORIENTATIONS)
+                {
+                    reader.Fail();
+                    break;
+                }
+                const TrileGeometry* pGeometry = m_trileSet.Find(instance.key);
+                if (pGeometry)
+                {
+                    triles.push_back(Trile(pGeometry, instance.key, instance.pos, instance.orient, instance.emplacement, -m_dimensions/2));
+                    pBatch->triles.push_back(triles.back());
+                    if (pBatch->triles.size() == SCENE_BATCH_TRILES)
+                    {
+                        if (!Publish(pBatch)) { return true; }
+                        pBatch = SceneBatchRef(new SceneBatch());
+                    }
+                }
+            }
+            if (!Publish(pBatch)) { return true; }
+        }
+        if (m_staticBatching && !reader.Failed())
+        {
+            if (!BuildStaticBatch(triles)) { return true; }
+        }
+
+        // Load art objects
+        pBatch = SceneBatchRef(new SceneBatch());
+        pBatch->pArtObjects = shared_ptr<deque<ArtObject>>(new deque<ArtObject>());
+        for (uint32_t i = 0; i < header.numArtObjects && !reader.Failed(); i++)
+        {
+            const BakedMeshHeader* pMesh = reader.Read<BakedMeshHeader>(1);
+            if (!pMesh) { break; }
+            const Vec3f* pPositions = reader.Read<Vec3f>(pMesh->numVertices);
+            const Vec3f* pNormals = reader.Read<Vec3f>(pMesh->numVertices);
+            const Vec2f* pTexcoords = reader.Read<Vec2f>(pMesh->numVertices);
+            const uint32_t* pIndices = reader.Read<uint32_t>(pMesh->numIndices);
+            if (reader.Failed()) { break; }
+            if (pMesh->id >= paths.size() || !BakedLevelReader::IsValidMesh(pIndices, pMesh->numIndices, pMesh->numVertices))
+            {
+                reader.Fail();
+                break;
+            }
+
+            const fs::path& artObjectPng = paths[pMesh->id];
+            if (!exists(artObjectPng))
+            {
+                ostringstream displayString;
+                displayString << "ERROR! Missing Art Object .png: " << artObjectPng;
+                Display(displayString.str());
+                return true;
+            }
+
+            TriMesh mesh;
+            mesh.appendVertices(pPositions, pMesh->numVertices);
+            mesh.appendNormals(pNormals, pMesh->numVertices);
+            mesh.appendTexCoords(pTexcoords, pMesh->numVertices);
+            mesh.appendIndices(pIndices, pMesh->numIndices);
+            const TextureRef texture = TextureCache::s_cache.Acquire(artObjectPng, SamplerState(GL_NEAREST));
+            ArtObject ao(mesh, texture);
+            if (m_compactVertices)
+            {
+                ao.Compact();
+            }
+            pBatch->pArtObjects->push_back(ao);
+        }
+
+        // Load background planes
+        pBatch->pBackgroundPlanes = shared_ptr<deque<BackgroundPlane>>(new deque<BackgroundPlane>());
+        for (uint32_t i = 0; i < header.numBackgroundPlanes && !reader.Failed(); i++)
+        {
+            const BakedBackgroundPlane* pPlane = reader.Read<BakedBackgroundPlane>(1);
+            if (!pPlane) { break; }
+            const uint32_t* pFrames = reader.Read<uint32_t>(pPlane->numFrames);
+            const Vec2f* pTexIndices = reader.Read<Vec2f>(pPlane->numTexIndices);
+            if (reader.Failed()) { break; }
+            if (pPlane->texture >= paths.size() || pPlane->numTexIndices == 0)
+            {
+                reader.Fail();
+                break;
+            }
+
+            const fs::path& backgroundPlanePng = paths[pPlane->texture];
+            if (!exists(backgroundPlanePng))
+            {
+                ostringstream displayString;
+                displayString << "ERROR! Missing Background Plane .png: " << backgroundPlanePng;
+                Display(displayString.str());
+                return true;
+            }
+
+            const Vec3f normals[4] = { pPlane->normal, pPlane->normal, pPlane->normal, pPlane->normal };
+            TriMesh mesh;
+            mesh.appendVertices(&c_positions[0], 4);
+            mesh.appendNormals(&normals[0], 4);
+            mesh.appendTexCoords(&pPlane->texcoords[0], 4);
+            mesh.appendIndices(&c_indices[0], 6);
+
+            BackgroundPlane bp(mesh);
+            bp.m_frames.assign(pFrames, pFrames + pPlane->numFrames);
+            bp.m_texIndices.assign(pTexIndices, pTexIndices + pPlane->numTexIndices);
+            bp.m_numFrames = pPlane->numFrames ? pPlane->numFrames : 1;
+            bp.m_spriteScale = pPlane->spriteScale;
+            bp.m_packedScale = pPlane->packedScale;
+            bp.m_packOffset = pPlane->packOffset;
+            bp.m_doubleSided = (pPlane->flags & BAKED_PLANE_DOUBLE_SIDED) != 0;
+            bp.m_billboard = (pPlane->flags & BAKED_PLANE_BILLBOARD) != 0;
+            bp.m_lightmap = (pPlane->flags & BAKED_PLANE_LIGHTMAP) != 0;
+            bp.m_pixelatedLightmap = (pPlane->flags & BAKED_PLANE_PIXELATED_LIGHTMAP) != 0;
+            bp.m_clampTexture = (pPlane->flags & BAKED_PLANE_CLAMP_TEXTURE) != 0;
+            bp.m_repeat = Vec2d((pPlane->flags & BAKED_PLANE_REPEAT_X) != 0, (pPlane->flags & BAKED_PLANE_REPEAT_Y) != 0);
+            bp.m_totalDuration = pPlane->totalDuration;
+            bp.BuildTimeline();
+            bp.m_pos = pPlane->pos;
+            bp.m_scale = pPlane->scale;
+            bp.m_rot = Quatf(pPlane->rot[0], pPlane->rot[1], pPlane->rot[2], pPlane->rot[3]);
+            bp.m_texture = TextureCache::s_cache.Acquire(backgroundPlanePng, bp.GetSamplerState());
+            bp.m_texture->IsTranslucent();
+            pBatch->pBackgroundPlanes->push_back(bp);
+        }
+
+        ostringstream displayString;
+        if (reader.Failed())
+        {
+            if (!Publish(pBatch)) { return true; }  // what was read before the corruption is still shown
+            displayString << "ERROR! Corrupt baked level: " << bakedFile;
+        }
+        else
+        {
+            BuildSceneChunks(triles, pBatch.get());
+            if (!Publish(pBatch)) { return true; }
+            m_finished = true;     // its sources are watched as the level, edits to any of them load it from scratch
+
+            displayString << "Finished Loading " << bakedFile.filename().string() <<
+                             "  (" << header.numTrileInstances << " Triles, " << header.numArtObjects << " Art Objects, " << header.numBackgroundPlanes << " Background Planes)";
+            if (m_verbose)
+            {
+                displayString << endl << timer.getSeconds() << " Seconds";
+                PrintTextureStats();
+                PrintAllocationStats();
+            }
+        }
+        Display(displayString.str());
+        return true;
+    }
+
+    void PrintTextureStats()
+    {
+        const TextureCacheStats stats = TextureCache::s_cache.GetStats();
+        Log() << "Textures: " << stats.numTextures << " unique, " << stats.hits << " hits, " << stats.misses << " misses, " <<
+                 stats.residentCpuBytes / 1024 << " KB resident, " << stats.residentGpuBytes / 1024 << " KB uploaded" << endl;
+    }
+
+    void PrintAllocationStats()
+    {
+        const AllocationCount load = AllocationStats::Since(m_loadAllocations);
+        Log() << "Allocations: ";
+        if (AllocationStats::IsCounting())
+        {
+            Log() << load.numAllocations << " while loading, " << load.numBytes / 1024 << " KB, ";
+        }
+        else
+        {
+            Log() << "not counted without COUNT_ALLOCATIONS, ";
+        }
+        Log() << "trile geometry arena: " << m_trileSet.m_arena.GetNumBlocks() << " blocks, " << m_trileSet.m_arena.GetBytesUsed() / 1024 << " KB" << endl;
+    }
+
+    // Runs once every trile has been placed, from the loader's own copy of the triles.
+    // Returns false if the loader is asked to exit.
+    bool BuildStaticBatch(const deque<Trile>& triles)
+    {
+        Display("Culling Hidden Trile Faces");
+        TrileCulling culling;
+        culling.Build(triles);
+
+        // Faces taken by the greedy mesh are left out of the static batch like hidden ones
+        SceneBatchRef pBatch(new SceneBatch());
+        pBatch->pStaticBatch = shared_ptr<StaticBatch>(new StaticBatch());
+        pBatch->pGreedyMesh = shared_ptr<GreedyMesh>(new GreedyMesh());
+        GreedyMesh& greedyMesh = *pBatch->pGreedyMesh;
+        vector<uint8_t> batchedSides = culling.m_hiddenSides;
+        if (m_greedyMeshing)
+        {
+            Display("Greedy Meshing Trile Faces");
+            greedyMesh.Build(triles, &culling.m_hiddenSides);
+            for (size_t i = 0; i < batchedSides.size(); i++)
+            {
+                batchedSides[i] |= greedyMesh.m_mergedSides[i];
+            }
+        }
+
+        Display("Building Trile Static Batch");
+        StaticBatch& staticBatch = *pBatch->pStaticBatch;
+        staticBatch.Build(triles, &batchedSides);
+        if (m_verbose)
+        {
+            Log() << "Hidden Faces: " << culling.m_numHiddenTriangles << " of " << culling.m_numTriangles << " Triangles Removed" << endl;
+            Log() << "Static Batch: " << staticBatch.m_numTriles << " Triles in " << staticBatch.m_chunks.size() << " Chunks" << endl;
+        }
+        if (m_compactVertices)
+        {
+            const size_t floatBytes = staticBatch.GetVertexBytes();
+            const uint32_t numCompact = staticBatch.Compact();
+            if (m_verbose)
+            {
+                Log() << "Compact Static Batch: " << floatBytes / 1024 << " KB -> " << staticBatch.GetVertexBytes() / 1024 << " KB, " <<
+                         numCompact << " of " << staticBatch.m_chunks.size() << " Chunks quantized" << endl;
+            }
+        }
+        if (m_greedyMeshing)
+        {
+            const uint32_t batchVertices = staticBatch.GetNumVertices();
+            Log() << "Greedy Mesh: " << greedyMesh.m_numFaces << " Faces merged into " << greedyMesh.m_numQuads << " Quads in " <<
+                     greedyMesh.m_chunks.size() << " Chunks, " << batchVertices + greedyMesh.m_numFaces * 4 << " -> " <<
+                     batchVertices + greedyMesh.GetNumVertices() << " Vertices" << endl;
+        }
+
+        return Publish(pBatch);
+    }
+
+    // Runs once the level is complete, until the owner applies the batch everything is drawn unculled
+    // straight from the containers. The store points into the batch's art objects, which keep their
+    // addresses when they are swapped into the scene.
+    void BuildSceneChunks(const deque<Trile>& triles, SceneBatch* pBatch)
+    {
+        pBatch->pSceneChunks = shared_ptr<SceneChunks>(new SceneChunks());
+        SceneChunks& sceneChunks = *pBatch->pSceneChunks;
+        sceneChunks.AddTriles(triles);
+        sceneChunks.AddArtObjects(*pBatch->pArtObjects);
+        sceneChunks.AddBackgroundPlanes(*pBatch->pBackgroundPlanes);
+
+        pBatch->pSceneStore = shared_ptr<SceneStore>(new SceneStore());
+        SceneStore& sceneStore = *pBatch->pSceneStore;
+        sceneStore.AddTriles(triles);
+        sceneStore.AddArtObjects(*pBatch->pArtObjects);
+        sceneStore.AddBackgroundPlanes(*pBatch->pBackgroundPlanes);
+        sceneStore.AssignChunks(sceneChunks);
+        if (m_verbose)
+        {
+            Log() << "Scene Chunks: " << sceneChunks.m_chunks.size() << " of " << SCENE_CHUNK_SIZE << "^3" << endl;
+            Log() << "Scene Store: " << sceneStore.GetNumTriles() << " Triles, " << sceneStore.GetNumArtObjects() << " Art Objects, " <<
+                     sceneStore.GetNumBackgroundPlanes() << " Background Planes, " << sceneStore.m_animatedPlanes.size() << " Animated" << endl;
+        }
+    }
+
+    LevelLoader(const LevelLoader&);
+    LevelLoader& operator=(const LevelLoader&);
+};
@@ -0,0 +1,533 @@
+#pragma once
+
+#include "Common.h"
+#include "TrileSet.h"
+#include "XmlPullParser.h"
+
+struct LevelTrileRecord
+{
+    int32_t     trileId;
+    int32_t     orientation;
+    Vec3f       position;
+    Vec3f       emplacement;
+
+    LevelTrileRecord() :
+        trileId(0),
+        orientation(0),
+        position(Vec3f::zero()),
+        emplacement(Vec3f::zero())
+    {
+    }
+};
+
+struct LevelArtObjectRecord
+{
+    string      name;
+    Vec3f       position;
+    Quatf       rotation;
+    Vec3f       scale;
+
+    LevelArtObjectRecord() :
+        position(Vec3f::zero()),
+        scale(Vec3f::one())
+    {
+    }
+};
+
+struct LevelPlaneRecord
+{
+    string      textureName;
+    Vec3f       position;
+    Quatf       rotation;
+    Vec3f       scale;
+    bool        animated;
+    bool        doubleSided;
+    bool        billboard;
+    bool        lightmap;
+    bool        pixelatedLightmap;
+    bool        clampTexture;
+    bool        xTextureRepeat;
+    bool        yTextureRepeat;
+
+    LevelPlaneRecord() :
+        position(Vec3f::zero()),
+        scale(Vec3f::one()),
+        animated(false),
+        doubleSided(false),
+        billboard(false),
+        lightmap(false),
+        pixelatedLightmap(false),
+        clampTexture(false),
+        xTextureRepeat(false),
+        yTextureRepeat(false)
+    {
+    }
+};
+
+// Pulls the parts of a level .xml the viewer uses into flat record arrays.
+// Read() streams the mapped file and never builds a DOM, ReadTree() extracts the same records from an XmlTree
+// so the two can be compared. An overlapped trile gets its own record right after the one it overlaps.
+class LevelReader
+{
+public:
+
+    Vec3f                           m_size;
+    string                          m_trileSetName;
+    vector<LevelTrileRecord>        m_triles;
+    vector<LevelArtObjectRecord>    m_artObjects;
+    vector<LevelPlaneRecord>        m_backgroundPlanes;
+
+    LevelReader() :
+        m_size(Vec3f::zero())
+    {
+    }
+
+    bool Read(const fs::path& levelXml)
+    {
+        Clear();
+        XmlPullParser parser;
+        if (!parser.Open(levelXml))
+        {
+            return false;
+        }
+
+        // Upper bounds, overlapped triles are counted with the rest
+        m_triles.reserve(CountTags(parser, "<TrileInstance "));
+        m_artObjects.reserve(CountTags(parser, "<ArtObjectInstance "));
+        m_backgroundPlanes.reserve(CountTags(parser, "<BackgroundPlane "));
+
+        if (!ReadRoot(parser, "Level"))
+        {
+            return false;
+        }
+        m_trileSetName = parser.GetAttributeString("trileSetName");
+
+        while (parser.NextChild(1))
+        {
+            const uint32_t depth = parser.GetDepth();
+            if (parser.IsNamed("Size"))
+            {
+                ReadChildVector3(parser, &m_size);
+            }
+            else if (parser.IsNamed("Triles"))
+            {
+                while (parser.NextChild(depth))
+                {
+                    ReadTrileEntry(parser);
+                }
+            }
+            else if (parser.IsNamed("ArtObjects"))
+            {
+                while (parser.NextChild(depth))
+                {
+                    ReadArtObjectEntry(parser);
+                }
+            }
+            else if (parser.IsNamed("BackgroundPlanes"))
+            {
+                while (parser.NextChild(depth))
+                {
+                    ReadBackgroundPlaneEntry(parser);
+                }
+            }
+        }
+        return !parser.Failed();
+    }
+
+    // Throws like the XmlTree accessors when the level is missing something
+    void ReadTree(const XmlTree& level)
+    {
+        Clear();
+
+        const XmlTree& sizeXml = level.getChild("Level/Size/Vector3");
+        m_size = GetVector3(sizeXml);
+        m_trileSetName = level.getChild("Level")["trileSetName"].getValue();
+
+        for (const auto& trile : level.getChild("Level/Triles"))
+        {
+            LevelTrileRecord record;
+            record.emplacement = GetVector3(trile.getChild("TrileEmplacement"));
+            record.trileId = trile.getChild("TrileInstance")["trileId"].getValue<int>();
+            record.orientation = trile.getChild("TrileInstance")["orientation"].getValue<int>();
+            record.position = GetVector3(trile.getChild("TrileInstance/Position/Vector3"));
+            m_triles.push_back(record);
+
+            if (trile.hasChild("TrileInstance/OverlappedTriles"))
+            {
+                const XmlTree& overlappedXml = trile.getChild("TrileInstance/OverlappedTriles/TrileInstance");
+                record.trileId = overlappedXml["trileId"].getValue<int>();
+                record.orientation = overlappedXml["orientation"].getValue<int>();
+                record.position = GetVector3(overlappedXml.getChild("Position/Vector3"));
+                m_triles.push_back(record);
+            }
+        }
+
+        for (const auto& object : level.getChild("Level/ArtObjects"))
+        {
+            const XmlTree& objectXml = object.getChild("ArtObjectInstance");
+            LevelArtObjectRecord record;
+            record.name = objectXml["name"].getValue();
+            record.position = GetVector3(objectXml.getChild("Position/Vector3"));
+            record.rotation = GetQuaternion(objectXml.getChild("Rotation/Quaternion"));
+            record.scale = GetVector3(objectXml.getChild("Scale/Vector3"));
+            m_artObjects.push_back(record);
+        }
+
+        for (const auto& plane : level.getChild("Level/BackgroundPlanes"))
+        {
+            const XmlTree& planeXml = plane.getChild("BackgroundPlane");
+            LevelPlaneRecord record;
+            record.textureName = planeXml["textureName"].getValue();
+            record.position = GetVector3(planeXml.getChild("Position/Vector3"));
+            record.rotation = GetQuaternion(planeXml.getChild("Rotation/Quaternion"));
+            record.scale = GetVector3(planeXml.getChild("Scale/Vector3"));
+            record.animated = planeXml["animated"].getValue() == "True";
+            record.doubleSided = planeXml["doubleSided"].getValue() == "True";
+            record.billboard = planeXml["billboard"].getValue() == "True";
+            record.lightmap = planeXml["lightMap"].getValue() == "True";
+            record.pixelatedLightmap = planeXml["pixelatedLightmap"].getValue() == "True";
+            record.clampTexture = planeXml["clampTexture"].getValue() == "True";
+            if (record.animated)
+            {
+                record.xTextureRepeat = planeXml["xTextureRepeat"].getValue() == "True";
+                record.yTextureRepeat = planeXml["yTextureRepeat"].getValue() == "True";
+            }
+            m_backgroundPlanes.push_back(record);
+        }
+    }
+
+    void Clear()
+    {
+        m_size = Vec3f::zero();
+        m_trileSetName.clear();
+        m_triles.clear();
+        m_artObjects.clear();
+        m_backgroundPlanes.clear();
+    }
+
+    // Shared helpers for the streaming readers
+
+    // Skips the prolog and returns whether the root element has the expected name
+    static bool ReadRoot(XmlPullParser& parser, const char* name)
+    {
+        XmlEvent event;
+        do
+        {
+            event = parser.Next();
+        }
+        while (event == XML_TEXT);
+        return event == XML_START_ELEMENT && parser.IsNamed(name);
+    }
+
+    // Advances to the first child with the given name of the current element
+    static bool FindChild(XmlPullParser& parser, const char* name)
+    {
+        const uint32_t depth = parser.GetDepth();
+        while (parser.NextChild(depth))
+        {
+            if (parser.IsNamed(name))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // On <Position>, <Scale> etc. reads their <Vector3> child
+    static void ReadChildVector3(XmlPullParser& parser, Vec3f* pVector)
+    {
+        if (FindChild(parser, "Vector3"))
+        {
+            *pVector = Vec3f(parser.GetAttributeFloat("x"),
+                             parser.GetAttributeFloat("y"),
+                             parser.GetAttributeFloat("z"));
+        }
+    }
+
+    static void ReadChildVector2(XmlPullParser& parser, Vec2f* pVector)
+    {
+        if (FindChild(parser, "Vector2"))
+        {
+            *pVector = Vec2f(parser.GetAttributeFloat("x"),
+                             parser.GetAttributeFloat("y"));
+        }
+    }
+
+    static void ReadChildQuaternion(XmlPullParser& parser, Quatf* pQuat)
+    {
+        if (FindChild(parser, "Quaternion"))
+        {
+            *pQuat = Quatf(parser.GetAttributeFloat("w"),
+                           parser.GetAttributeFloat("x"),
+                           parser.GetAttributeFloat("y"),
+                           parser.GetAttributeFloat("z"));
+        }
+    }
+
+private:
+
+    static uint32_t CountTags(const XmlPullParser& parser, const char* tag)
+    {
+        const char* pData = parser.GetData();
+        const char* pEnd = pData + parser.GetSize();
+        const char* pTagEnd = tag + strlen(tag);
+        uint32_t count = 0;
+        for (const char* p = search(pData, pEnd, tag, pTagEnd); p != pEnd; p = search(p + 1, pEnd, tag, pTagEnd))
+        {
+            count++;
+        }
+        return count;
+    }
+
+    static Vec3f GetVector3(const XmlTree& xml)
+    {
+        return Vec3f(xml["x"].getValue<float>(),
+                     xml["y"].getValue<float>(),
+                     xml["z"].getValue<float>());
+    }
+
+    static Quatf GetQuaternion(const XmlTree& xml)
+    {
+        return Quatf(xml["w"].getValue<float>(),
+                     xml["x"].getValue<float>(),
+                     xml["y"].getValue<float>(),
+                     xml["z"].getValue<float>());
+    }
+
+    // <Entry><TrileEmplacement/><TrileInstance><Position/><OverlappedTriles><TrileInstance/>...
+    void ReadTrileEntry(XmlPullParser& parser)
+    {
+        LevelTrileRecord record;
+        LevelTrileRecord overlapped;
+        bool hasInstance = false;
+        bool hasOverlapped = false;
+
+        const uint32_t depth = parser.GetDepth();
+        while (parser.NextChild(depth))
+        {
+            if (parser.IsNamed("TrileEmplacement"))
+            {
+                record.emplacement = Vec3f(parser.GetAttributeFloat("x"),
+                                           parser.GetAttributeFloat("y"),
+                                           parser.GetAttributeFloat("z"));
+            }
+            else if (parser.IsNamed("TrileInstance"))
+            {
+                ReadTrileInstance(parser, &record, &overlapped, &hasOverlapped);
+                hasInstance = true;
+            }
+        }
+
+        if (hasInstance)
+        {
+            m_triles.push_back(record);
+            if (hasOverlapped)
+            {
+                overlapped.emplacement = record.emplacement;
+                m_triles.push_back(overlapped);
+            }
+        }
+    }
+
+    // Only the first overlapped trile is kept, pOverlapped is nullptr for the overlapped trile itself
+    static void ReadTrileInstance(XmlPullParser& parser, LevelTrileRecord* pRecord, LevelTrileRecord* pOverlapped, bool* pHasOverlapped)
+    {
+        pRecord->trileId = parser.GetAttributeInt("trileId");
+        pRecord->orientation = parser.GetAttributeInt("orientation");
+
+        const uint32_t depth = parser.GetDepth();
+        while (parser.NextChild(depth))
+        {
+            if (parser.IsNamed("Position"))
+            {
+                ReadChildVector3(parser, &pRecord->position);
+            }
+            else if (pOverlapped && parser.IsNamed("OverlappedTriles") && FindChild(parser, "TrileInstance"))
+            {
+                ReadTrileInstance(parser, pOverlapped, nullptr, nullptr);
+                *pHasOverlapped = true;
+            }
+        }
+    }
+
+    // <Entry><ArtObjectInstance name=""><Position/><Rotation/><Scale/>
+    void ReadArtObjectEntry(XmlPullParser& parser)
+    {
+        if (!FindChild(parser, "ArtObjectInstance"))
+        {
+            return;
+        }
+
+        LevelArtObjectRecord record;
+        record.name = parser.GetAttributeString("name");
+
+        const uint32_t depth = parser.GetDepth();
+        while (parser.NextChild(depth))
+        {
+            if (parser.IsNamed("Position"))
+            {
+                ReadChildVector3(parser, &record.position);
+            }
+            else if (parser.IsNamed("Rotation"))
+            {
+                ReadChildQuaternion(parser, &record.rotation);
+            }
+            else if (parser.IsNamed("Scale"))
+            {
+                ReadChildVector3(parser, &record.scale);
+            }
+        }
+        m_artObjects.push_back(record);
+    }
+
+    // <Entry><BackgroundPlane textureName="" animated="" ...><Position/><Rotation/><Scale/>
+    void ReadBackgroundPlaneEntry(XmlPullParser& parser)
+    {
+        if (!FindChild(parser, "BackgroundPlane"))
+        {
+            return;
+        }
+
+        LevelPlaneRecord record;
+        record.textureName = parser.GetAttributeString("textureName");
+        record.animated = parser.GetAttributeBool("animated");
+        record.doubleSided = parser.GetAttributeBool("doubleSided");
+        record.billboard = parser.GetAttributeBool("billboard");
+        record.lightmap = parser.GetAttributeBool("lightMap");
+        record.pixelatedLightmap = parser.GetAttributeBool("pixelatedLightmap");
+        record.clampTexture = parser.GetAttributeBool("clampTexture");
+        if (record.animated)
+        {
+            record.xTextureRepeat = parser.GetAttributeBool("xTextureRepeat");
+            record.yTextureRepeat = parser.GetAttributeBool("yTextureRepeat");
+        }
+
+        const uint32_t depth = parser.GetDepth();
+        while (parser.NextChild(depth))
+        {
+            if (parser.IsNamed("Position"))
+            {
+                ReadChildVector3(parser, &record.position);
+            }
+            else if (parser.IsNamed("Rotation"))
+            {
+                ReadChildQuaternion(parser, &record.rotation);
+            }
+            else if (parser.IsNamed("Scale"))
+            {
+                ReadChildVector3(parser, &record.scale);
+            }
+        }
+        m_backgroundPlanes.push_back(record);
+    }
+};
+
+// Streams a trile set .xml into raw TrileGeometry arrays, leaving TrileSet::BuildMeshes() to the caller
+// so the meshes can be built in parallel.
+// The element counts aren't known until a trile is parsed, so each trile goes through scratch arrays
+// that keep their capacity between triles and is then copied once into the TrileSet arena.
+class TrileSetReader
+{
+public:
+
+    string              m_name;
+    vector<uint32_t>    m_duplicateKeys;    // skipped, the first entry wins
+
+    bool Read(const fs::path& trileSetXml, TrileSet* pTrileSet)
+    {
+        m_name.clear();
+        m_duplicateKeys.clear();
+
+        XmlPullParser parser;
+        if (!parser.Open(trileSetXml) || !LevelReader::ReadRoot(parser, "TrileSet"))
+        {
+            return false;
+        }
+        m_name = parser.GetAttributeString("name");
+
+        while (parser.NextChild(1))
+        {
+            if (!parser.IsNamed("Triles"))
+            {
+                continue;
+            }
+            const uint32_t depth = parser.GetDepth();
+            while (parser.NextChild(depth))
+            {
+                const uint32_t key = parser.GetAttributeInt("key");
+                if (pTrileSet->Contains(key))
+                {
+                    m_duplicateKeys.push_back(key);
+                    continue;
+                }
+                m_positions.clear();
+                m_normals.clear();
+                m_texcoords.clear();
+                m_indices.clear();
+                if (LevelReader::FindChild(parser, "Trile") &&
+                    LevelReader::FindChild(parser, "Geometry") &&
+                    LevelReader::FindChild(parser, "ShaderInstancedIndexedPrimitives"))
+                {
+                    ReadPrimitives(parser);
+                }
+                pTrileSet->SetTrileArrays(key, m_positions.data(), m_normals.data(), m_texcoords.data(), m_positions.size(),
+                                          m_indices.data(), m_indices.size());
+            }
+        }
+        return !parser.Failed();
+    }
+
+private:
+
+    vector<Vec3f>       m_positions;
+    vector<uint8_t>     m_normals;
+    vector<Vec2f>       m_texcoords;
+    vector<uint32_t>    m_indices;
+
+    // <Vertices><VertexPositionNormalTextureInstance><Position/><Normal/><TextureCoord/>...<Indices><Index/>...
+    void ReadPrimitives(XmlPullParser& parser)
+    {
+        const uint32_t depth = parser.GetDepth();
+        while (parser.NextChild(depth))
+        {
+            const uint32_t listDepth = parser.GetDepth();
+            if (parser.IsNamed("Vertices"))
+            {
+                while (parser.NextChild(listDepth))
+                {
+                    Vec3f position = Vec3f::zero();
+                    XmlString normal;
+                    Vec2f texcoord = Vec2f::zero();
+                    const uint32_t vertexDepth = parser.GetDepth();
+                    while (parser.NextChild(vertexDepth))
+                    {
+                        if (parser.IsNamed("Position"))
+                        {
+                            LevelReader::ReadChildVector3(parser, &position);
+                        }
+                        else if (parser.IsNamed("Normal"))
+                        {
+                            parser.ReadText(&normal);
+                        }
+                        else if (parser.IsNamed("TextureCoord"))
+                        {
+                            LevelReader::ReadChildVector2(parser, &texcoord);
+                        }
+                    }
+                    m_positions.push_back(position);
+                    m_normals.push_back(normal.empty() ? 0 : XmlPullParser::ParseInt(normal));
+                    m_texcoords.push_back(texcoord);
+                }
+            }
+            else if (parser.IsNamed("Indices"))
+            {
+                while (parser.NextChild(listDepth))
+                {
+                    XmlString index;
+                    parser.ReadText(&index);
+                    m_indices.push_back(index.empty() ? 0 : XmlPullParser::ParseInt(index));
+                }
+            }
+        }
+    }
+};
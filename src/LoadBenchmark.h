@@ -0,0 +1,138 @@
+#pragma once
+
+#include "Common.h"
+#include "LoadProfiler.h"
+
+#if defined( CINDER_MSW )
+    #include <windows.h>
+    #include <psapi.h>
+    #pragma comment(lib, "psapi.lib")
+#else
+    #include <sys/resource.h>
+#endif
+
+#define LOAD_BENCHMARK_RUNS 5   // loads of each file unless -loadbenchruns says otherwise
+
+struct LoadBenchmarkRun
+{
+    double              seconds;
+    AllocationCount     allocations;
+    vector<LoadPhase>   phases;
+};
+
+struct LoadBenchmarkFile
+{
+    fs::path                    path;
+    bool                        loaded;     // every run finished without an error
+    uint32_t                    numTriles;
+    uint32_t                    numArtObjects;
+    uint32_t                    numBackgroundPlanes;
+    vector<LoadBenchmarkRun>    runs;
+};
+
+// Collects repeated loads of a list of files and reports them as JSON, one object per file with every
+// run's phases and the best and mean time of each phase. Run with FezBatch -loadbench.
+class LoadBenchmark
+{
+public:
+
+    vector<LoadBenchmarkFile>   m_files;
+    uint32_t                    m_numRuns;
+    uint64_t                    m_peakResidentBytes;    // a high-water mark of the whole process, so once for every file
+
+    LoadBenchmark() :
+        m_numRuns(LOAD_BENCHMARK_RUNS),
+        m_peakResidentBytes(0)
+    {
+    }
+
+    static uint64_t GetPeakResidentBytes()
+    {
+#if defined( CINDER_MSW )
+        PROCESS_MEMORY_COUNTERS counters;
+        return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+        {
+            return 0;
+        }
+    #if defined( __APPLE__ )
+        return usage.ru_maxrss;         // bytes
+    #else
+        return usage.ru_maxrss * 1024;  // kilobytes
+    #endif
+#endif
+    }
+
+    void WriteJson(ostream& out) const
+    {
+        out << "{" << endl;
+        out << "  \"runs\": " << m_numRuns << "," << endl;
+        out << "  \"allocationsCounted\": " << (AllocationStats::IsCounting() ? "true" : "false") << "," << endl;
+        out << "  \"peakResidentBytes\": " << m_peakResidentBytes << "," << endl;
+        out << "  \"files\": [" << endl;
+        for (size_t f = 0; f < m_files.size(); f++)
+        {
+            const LoadBenchmarkFile& file = m_files[f];
+            out << "    {" << endl;
+            out << "      \"path\": \"" << LoadProfiler::EscapeJson(file.path.string()) << "\"," << endl;
+            out << "      \"loaded\": " << (file.loaded ? "true" : "false") << "," << endl;
+            out << "      \"triles\": " << file.numTriles << "," << endl;
+            out << "      \"artObjects\": " << file.numArtObjects << "," << endl;
+            out << "      \"backgroundPlanes\": " << file.numBackgroundPlanes << "," << endl;
+
+            out << "      \"runs\": [" << endl;
+            for (size_t r = 0; r < file.runs.size(); r++)
+            {
+                const LoadBenchmarkRun& run = file.runs[r];
+                out << "        { \"seconds\": " << run.seconds << ", \"allocations\": " << run.allocations.numAllocations <<
+                       ", \"bytes\": " << run.allocations.numBytes << ", \"phases\": [";
+                for (size_t p = 0; p < run.phases.size(); p++)
+                {
+                    const LoadPhase& phase = run.phases[p];
+                    out << (p ? ", " : "") << "{ \"name\": \"" << LoadProfiler::EscapeJson(phase.name) << "\", \"seconds\": " << phase.seconds <<
+                           ", \"allocations\": " << phase.allocations.numAllocations << ", \"bytes\": " << phase.allocations.numBytes;
+                    for (uint32_t c = 0; c < NUM_LOAD_COUNTERS; c++)
+                    {
+                        out << ", \"" << gc_loadCounterNames[c] << "\": " << phase.counts.counts[c];
+                    }
+                    out << " }";
+                }
+                out << "] }" << (r + 1 < file.runs.size() ? "," : "") << endl;
+            }
+            out << "      ]," << endl;
+
+            // Phases by name in first seen order, a baked level and a level .xml mark different ones
+            vector<string> names;
+            map<string, vector<double> > seconds;
+            for (const LoadBenchmarkRun& run : file.runs)
+            {
+                for (const LoadPhase& phase : run.phases)
+                {
+                    if (seconds.find(phase.name) == seconds.end())
+                    {
+                        names.push_back(phase.name);
+                    }
+                    seconds[phase.name].push_back(phase.seconds);
+                }
+            }
+            out << "      \"phases\": [" << endl;
+            for (size_t p = 0; p < names.size(); p++)
+            {
+                const vector<double>& times = seconds[names[p]];
+                double sum = 0.0;
+                for (const double time : times)
+                {
+                    sum += time;
+                }
+                out << "        { \"name\": \"" << LoadProfiler::EscapeJson(names[p]) << "\", \"minSeconds\": " << *min_element(times.begin(), times.end()) <<
+                       ", \"meanSeconds\": " << sum / times.size() << " }" << (p + 1 < names.size() ? "," : "") << endl;
+            }
+            out << "      ]" << endl;
+            out << "    }" << (f + 1 < m_files.size() ? "," : "") << endl;
+        }
+        out << "  ]" << endl;
+        out << "}" << endl;
+    }
+};
@@ -0,0 +1,328 @@
+#pragma once
+
+#include "Common.h"
+#include "AllocationStats.h"
+
+#if defined( CINDER_MSW )
+    #define LOAD_THREAD_LOCAL __declspec(thread)
+#else
+    #define LOAD_THREAD_LOCAL __thread
+#endif
+
+#define LOAD_PROFILE_SLOWEST_ASSETS 8   // listed by the text summary
+
+enum LoadCounter
+{
+    LOAD_BYTES_READ,        // of the .xml, .png and baked files opened
+    LOAD_VERTICES,          // built into meshes
+    LOAD_IMAGES,            // decoded
+    NUM_LOAD_COUNTERS
+};
+
+const char* const gc_loadCounterNames[] = { "bytesRead", "vertices", "images" };
+
+struct LoadCounts
+{
+    uint64_t    counts[NUM_LOAD_COUNTERS];
+};
+
+struct LoadEvent
+{
+    string      name;
+    const char* category;   // "phase" or "asset"
+    uint32_t    threadId;   // small ids in first seen order, the thread that started the profile is 0
+    double      start;      // seconds since the profile began
+    double      duration;
+    LoadCounts  counts;
+};
+
+// Collects the timed events of one load from every thread that takes part in it, and keeps running
+// totals of the counters. Counting is a few atomic adds and events are only added when a phase or
+// asset finishes, so it stays enabled for every load.
+class LoadProfiler
+{
+public:
+
+    static LoadProfiler s_profiler;
+
+    LoadProfiler() :
+        m_timer(true)
+    {
+    }
+
+    // Safe from any thread, the count is also charged to the thread's innermost ScopedLoadTimer
+    static void Count(const LoadCounter counter, const uint64_t n);
+
+    // The size of a file about to be read in full
+    static void CountFile(const fs::path& path)
+    {
+        boost::system::error_code error;
+        const uintmax_t size = fs::file_size(path, error);
+        Count(LOAD_BYTES_READ, error ? 0 : (uint64_t)size);
+    }
+
+    void Begin()
+    {
+        lock_guard<mutex> lock( m_mutex );
+        m_events.clear();
+        m_threadIds.clear();
+        m_threadIds[this_thread::get_id()] = 0;
+        m_timer.start();
+    }
+
+    double GetSeconds() const
+    {
+        return m_timer.getSeconds();
+    }
+
+    LoadCounts GetTotals() const
+    {
+        LoadCounts totals;
+        for (uint32_t c = 0; c < NUM_LOAD_COUNTERS; c++)
+        {
+            totals.counts[c] = m_totals[c];
+        }
+        return totals;
+    }
+
+    void AddEvent(LoadEvent event)
+    {
+        lock_guard<mutex> lock( m_mutex );
+        const auto it = m_threadIds.insert(make_pair(this_thread::get_id(), (uint32_t)m_threadIds.size())).first;
+        event.threadId = it->second;
+        m_events.push_back(event);
+    }
+
+    vector<LoadEvent> GetEvents()
+    {
+        lock_guard<mutex> lock( m_mutex );
+        return m_events;
+    }
+
+    // Chrome's trace event format, open it in chrome://tracing
+    void WriteTrace(ostream& out)
+    {
+        const vector<LoadEvent> events = GetEvents();
+        out << "{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [" << endl;
+        for (size_t i = 0; i < events.size(); i++)
+        {
+            const LoadEvent& event = events[i];
+            out << "  { \"name\": \"" << EscapeJson(event.name) << "\", \"cat\": \"" << event.category << "\", \"ph\": \"X\", " <<
+                   "\"pid\": 1, \"tid\": " << event.threadId << ", " <<
+                   "\"ts\": " << (uint64_t)(event.start * 1000000.0) << ", \"dur\": " << (uint64_t)(event.duration * 1000000.0) << ", \"args\": { ";
+            for (uint32_t c = 0; c < NUM_LOAD_COUNTERS; c++)
+            {
+                out << (c ? ", " : "") << "\"" << gc_loadCounterNames[c] << "\": " << event.counts.counts[c];
+            }
+            out << " } }" << (i + 1 < events.size() ? "," : "") << endl;
+        }
+        out << "] }" << endl;
+    }
+
+    static string EscapeJson(const string& str)
+    {
+        string escaped;
+        for (const char c : str)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    // Every phase and the slowest assets, for the text overlay
+    string GetSummary()
+    {
+        vector<LoadEvent> events = GetEvents();
+        ostringstream summary;
+        summary.setf(ios::fixed);
+        summary.precision(1);
+        vector<const LoadEvent*> assets;
+        for (const LoadEvent& event : events)
+        {
+            if (string(event.category) == "phase")
+            {
+                summary << event.name << ": " << event.duration * 1000.0 << " ms";
+                AppendCounts(summary, event.counts);
+                summary << endl;
+            }
+            else
+            {
+                assets.push_back(&event);
+            }
+        }
+        sort(assets.begin(), assets.end(), [](const LoadEvent* a, const LoadEvent* b)
+        {
+            return a->duration > b->duration;
+        });
+        for (size_t i = 0; i < assets.size() && i < LOAD_PROFILE_SLOWEST_ASSETS; i++)
+        {
+            summary << "  " << assets[i]->name << ": " << assets[i]->duration * 1000.0 << " ms";
+            AppendCounts(summary, assets[i]->counts);
+            summary << endl;
+        }
+        return summary.str();
+    }
+
+private:
+
+    mutex                       m_mutex;
+    vector<LoadEvent>           m_events;
+    map<thread::id, uint32_t>   m_threadIds;
+    Timer                       m_timer;            // the App's clock isn't there in the console tools
+    atomic<uint64_t>            m_totals[NUM_LOAD_COUNTERS];
+
+    static void AppendCounts(ostream& out, const LoadCounts& counts)
+    {
+        if (counts.counts[LOAD_BYTES_READ])
+        {
+            out << ", " << counts.counts[LOAD_BYTES_READ] / 1024 << " KB read";
+        }
+        if (counts.counts[LOAD_VERTICES])
+        {
+            out << ", " << counts.counts[LOAD_VERTICES] << " vertices";
+        }
+        if (counts.counts[LOAD_IMAGES])
+        {
+            out << ", " << counts.counts[LOAD_IMAGES] << " images";
+        }
+    }
+};
+
+// Times the enclosing scope as one asset of the current load, with the counts made on this thread while
+// it was open. Scopes nest per thread, an inner scope's counts are also charged to the outer one.
+class ScopedLoadTimer
+{
+public:
+
+    ScopedLoadTimer(const string& name) :
+        m_pParent(s_pCurrent)
+    {
+        m_event.name = name;
+        m_event.category = "asset";
+        m_event.threadId = 0;
+        m_event.start = LoadProfiler::s_profiler.GetSeconds();
+        m_event.duration = 0.0;
+        memset(&m_event.counts, 0, sizeof(m_event.counts));
+        s_pCurrent = this;
+    }
+
+    ~ScopedLoadTimer()
+    {
+        m_event.duration = LoadProfiler::s_profiler.GetSeconds() - m_event.start;
+        s_pCurrent = m_pParent;
+        if (m_pParent)
+        {
+            for (uint32_t c = 0; c < NUM_LOAD_COUNTERS; c++)
+            {
+                m_pParent->m_event.counts.counts[c] += m_event.counts.counts[c];
+            }
+        }
+        LoadProfiler::s_profiler.AddEvent(m_event);
+    }
+
+private:
+
+    friend class LoadProfiler;
+
+    static LOAD_THREAD_LOCAL ScopedLoadTimer* s_pCurrent;
+
+    ScopedLoadTimer*    m_pParent;
+    LoadEvent           m_event;
+
+    ScopedLoadTimer(const ScopedLoadTimer&);
+    ScopedLoadTimer& operator=(const ScopedLoadTimer&);
+};
+
+inline void LoadProfiler::Count(const LoadCounter counter, const uint64_t n)
+{
+    s_profiler.m_totals[counter] += n;
+    if (ScopedLoadTimer::s_pCurrent)
+    {
+        ScopedLoadTimer::s_pCurrent->m_event.counts.counts[counter] += n;
+    }
+}
+
+struct LoadPhase
+{
+    string          name;
+    double          seconds;
+    AllocationCount allocations;
+    LoadCounts      counts;
+};
+
+// Splits one load into consecutive named phases, each timed and charged with the allocations and counts
+// made by every thread while it was open. Only the loader thread marks phases, so nothing is locked.
+// Begin() also starts a new profile, unless several loads share one.
+class LoadPhases
+{
+public:
+
+    vector<LoadPhase>   m_phases;
+
+    LoadPhases() :
+        m_open(false),
+        m_startSeconds(0.0)
+    {
+    }
+
+    void Begin(const bool newProfile = true)
+    {
+        m_phases.clear();
+        m_open = false;
+        if (newProfile)
+        {
+            LoadProfiler::s_profiler.Begin();
+        }
+    }
+
+    // Ends the open phase and starts the next one
+    void Mark(const char* name)
+    {
+        End();
+        LoadPhase phase;
+        phase.name = name;
+        phase.seconds = 0.0;
+        m_phases.push_back(phase);
+        m_open = true;
+        m_startSeconds = LoadProfiler::s_profiler.GetSeconds();
+        m_startAllocations = AllocationStats::Get();
+        m_startCounts = LoadProfiler::s_profiler.GetTotals();
+    }
+
+    void End()
+    {
+        if (!m_open)
+        {
+            return;
+        }
+        LoadPhase& phase = m_phases.back();
+        phase.seconds = LoadProfiler::s_profiler.GetSeconds() - m_startSeconds;
+        phase.allocations = AllocationStats::Since(m_startAllocations);
+        const LoadCounts totals = LoadProfiler::s_profiler.GetTotals();
+        for (uint32_t c = 0; c < NUM_LOAD_COUNTERS; c++)
+        {
+            phase.counts.counts[c] = totals.counts[c] - m_startCounts.counts[c];
+        }
+        m_open = false;
+
+        LoadEvent event;
+        event.name = phase.name;
+        event.category = "phase";
+        event.threadId = 0;
+        event.start = m_startSeconds;
+        event.duration = phase.seconds;
+        event.counts = phase.counts;
+        LoadProfiler::s_profiler.AddEvent(event);
+    }
+
+private:
+
+    bool            m_open;
+    double          m_startSeconds;
+    AllocationCount m_startAllocations;
+    LoadCounts      m_startCounts;
+};
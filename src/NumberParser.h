@@ -0,0 +1,235 @@
+#pragma once
+
+#include "Common.h"
+#include <cfloat>
+#include <sstream>
+
+// Locale independent, allocation free decimal parsing for the vertex and index streams.
+// Results are correctly rounded, so they match the stream conversion XmlTree::getValue<float>() does:
+// small mantissas and exponents are exact in a single float operation, longer ones go through an exact
+// double operation and only fall back to the stream when that double sits on a float rounding midpoint.
+class NumberParser
+{
+public:
+
+    // Returns false if the range doesn't start with a number, leaving *pValue unchanged
+    static bool ParseFloat(const char* p, const char* pEnd, float* pValue)
+    {
+        const char* pStart = p;
+        while (p < pEnd && IsSpace(*p))
+        {
+            p++;
+        }
+        const bool negative = p < pEnd && *p == '-';
+        if (p < pEnd && (*p == '-' || *p == '+'))
+        {
+            p++;
+        }
+
+        uint64_t mantissa = 0;
+        int32_t exponent = 0;
+        bool overflow = false;
+        const char* pDigits = p;
+        p = ParseDigits(p, pEnd, &mantissa, &overflow);
+        bool anyDigits = p != pDigits;
+        if (p < pEnd && *p == '.')
+        {
+            const char* pFraction = ++p;
+            p = ParseDigits(p, pEnd, &mantissa, &overflow);
+            exponent -= (int32_t)(p - pFraction);
+            anyDigits = anyDigits || p != pFraction;
+        }
+        if (!anyDigits)
+        {
+            return false;
+        }
+        if (p < pEnd && (*p == 'e' || *p == 'E'))
+        {
+            const char* pExponent = p + 1;
+            const bool negativeExponent = pExponent < pEnd && *pExponent == '-';
+            if (pExponent < pEnd && (*pExponent == '-' || *pExponent == '+'))
+            {
+                pExponent++;
+            }
+            int32_t value = 0;
+            const char* pExponentEnd = pExponent;
+            while (pExponentEnd < pEnd && IsDigit(*pExponentEnd) && value < 10000)
+            {
+                value = value * 10 + (*pExponentEnd++ - '0');
+            }
+            if (pExponentEnd != pExponent)
+            {
+                exponent += negativeExponent ? -value : value;
+            }
+        }
+
+        float value;
+        if (overflow || !FastPath(mantissa, exponent, &value))
+        {
+            return SlowPath(pStart, pEnd, pValue);
+        }
+        *pValue = negative ? -value : value;
+        return true;
+    }
+
+    static bool ParseInt(const char* p, const char* pEnd, int32_t* pValue)
+    {
+        while (p < pEnd && IsSpace(*p))
+        {
+            p++;
+        }
+        const bool negative = p < pEnd && *p == '-';
+        if (p < pEnd && (*p == '-' || *p == '+'))
+        {
+            p++;
+        }
+        uint64_t value = 0;
+        bool overflow = false;
+        const char* pDigits = p;
+        p = ParseDigits(p, pEnd, &value, &overflow);
+        if (p == pDigits || overflow || value > 0x80000000ull - (negative ? 0 : 1))
+        {
+            return false;
+        }
+        *pValue = negative ? (int32_t)(0 - (uint32_t)value) : (int32_t)value;
+        return true;
+    }
+
+    static float ToFloat(const string& str)
+    {
+        float value = 0.f;
+        ParseFloat(str.data(), str.data() + str.size(), &value);
+        return value;
+    }
+
+    static int32_t ToInt(const string& str)
+    {
+        int32_t value = 0;
+        ParseInt(str.data(), str.data() + str.size(), &value);
+        return value;
+    }
+
+private:
+
+    static bool IsDigit(const char c)
+    {
+        return (unsigned char)(c - '0') < 10;
+    }
+
+    static bool IsSpace(const char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    // Eight ASCII digits loaded little endian into one word, as in the "SIMD within a register" trick
+    static bool IsEightDigits(const uint64_t chunk)
+    {
+        return ((chunk & 0xF0F0F0F0F0F0F0F0ull) |
+                (((chunk + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull;
+    }
+
+    static uint32_t EightDigitsValue(uint64_t chunk)
+    {
+        chunk -= 0x3030303030303030ull;
+        chunk = (chunk * 10) + (chunk >> 8);    // pairs
+        chunk = (((chunk & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+                 (((chunk >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+        return (uint32_t)chunk;
+    }
+
+    static bool IsLittleEndian()
+    {
+        const uint16_t word = 1;
+        return *(const uint8_t*)&word == 1;
+    }
+
+    // Accumulates decimal digits into *pValue, eight at a time while they fit, and sets *pOverflow
+    // instead of wrapping once the value passes 64 bits
+    static const char* ParseDigits(const char* p, const char* pEnd, uint64_t* pValue, bool* pOverflow)
+    {
+        uint64_t value = *pValue;
+        if (IsLittleEndian())
+        {
+            while (pEnd - p >= 8 && value < 100000000000ull)    // so value * 1e8 + 99999999 fits
+            {
+                uint64_t chunk;
+                memcpy(&chunk, p, sizeof(chunk));
+                if (!IsEightDigits(chunk))
+                {
+                    break;
+                }
+                value = value * 100000000 + EightDigitsValue(chunk);
+                p += 8;
+            }
+        }
+        while (p < pEnd && IsDigit(*p))
+        {
+            const uint32_t digit = *p++ - '0';
+            if (value > (0xFFFFFFFFFFFFFFFFull - digit) / 10)
+            {
+                *pOverflow = true;
+                continue;
+            }
+            value = value * 10 + digit;
+        }
+        *pValue = value;
+        return p;
+    }
+
+    static bool FastPath(const uint64_t mantissa, const int32_t exponent, float* pValue)
+    {
+        static const float c_pow10f[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+        static const double c_pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                          1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+        if (mantissa == 0)
+        {
+            *pValue = 0.f;
+            return true;
+        }
+
+        // Mantissa and power of ten are both exact floats, so one rounding gives the correctly rounded result
+        if (mantissa <= (1 << 24) && exponent >= -10 && exponent <= 10)
+        {
+            const float m = (float)mantissa;
+            *pValue = exponent < 0 ? m / c_pow10f[-exponent] : m * c_pow10f[exponent];
+            return true;
+        }
+
+        // Same for doubles, but rounding that to float can round twice when the double lands on a midpoint
+        // between floats, those rare cases and anything outside the normal float range take the slow path
+        if (mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22)
+        {
+            const double m = (double)mantissa;
+            const double value = exponent < 0 ? m / c_pow10[-exponent] : m * c_pow10[exponent];
+            if (value < FLT_MIN || value > FLT_MAX)
+            {
+                return false;
+            }
+            uint64_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            const uint64_t c_floatRoundBits = (1ull << 29) - 1;    // double mantissa bits a float drops
+            const uint64_t rounding = bits & c_floatRoundBits;
+            const uint64_t midpoint = 1ull << 28;
+            if (rounding >= midpoint - 1 && rounding <= midpoint + 1)
+            {
+                return false;
+            }
+            *pValue = (float)value;
+            return true;
+        }
+        return false;
+    }
+
+    static bool SlowPath(const char* p, const char* pEnd, float* pValue)
+    {
+        istringstream stream(string(p, pEnd));
+        stream.imbue(locale::classic());
+        float value;
+        if (!(stream >> value))
+        {
+            return false;
+        }
+        *pValue = value;
+        return true;
+    }
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+#include "Common.h"
+#include "BackgroundPlane.h"
+#include "PlaneRenderQueue.h"
+#include "SceneStore.h"
+
+const uint32_t c_noInstance = 0xFFFFFFFF;  // planes left to PlaneRenderQueue
+
+// Everything about a plane that stays fixed for the level, drawn on the shared unit quad
+struct PlaneInstance
+{
+    Vec4f   position;   // xyz, w is 1 for billboards
+    Vec4f   rotation;   // quaternion (x, y, z, w), unused by billboards
+    Vec4f   scale;      // xy scale of the quad, zw texcoord repeat
+};
+
+// Planes sharing blend mode, cull mode and texture, drawn with instanced calls
+struct PlaneInstanceGroup
+{
+    TextureEntry*           pTexture;
+    bool                    additive;
+    bool                    doubleSided;
+    uint32_t                firstInstance;  // into PlaneInstanceGroups::m_instances
+    uint32_t                numInstances;
+};
+
+// Groups background planes by render state and packs their per-instance attribute streams.
+// The static stream is built once per level, only the small frame stream changes as the planes animate.
+// Instances aren't depth sorted, so translucent planes that blend normally are left out of the groups, to
+// be drawn back to front by a PlaneRenderQueue between the cutout and the lightmap groups.
+// This is plain CPU code with no GL calls, the upload and draw live in PlaneRenderer.
+class PlaneInstanceGroups
+{
+public:
+
+    vector<PlaneInstanceGroup>  m_groups;           // in PlaneRenderQueue order, lightmaps last
+    vector<PlaneInstance>       m_instances;
+    vector<Vec4f>               m_frames;           // per instance, texture scale (xy) and offset (zw)
+    vector<uint32_t>            m_planeIndices;     // per instance, into the plane container
+    vector<uint32_t>            m_planeInstances;   // per plane, the inverse of m_planeIndices or c_noInstance
+    vector<uint32_t>            m_translucent;      // planes left out of the groups, in plane container order
+    vector<uint32_t>            m_animated;         // instances with more than one frame
+    uint32_t                    m_numPlanes;
+
+    PlaneInstanceGroups() :
+        m_numPlanes(0)
+    {
+    }
+
+    static PlaneInstance PackInstance(const BackgroundPlane& bp)
+    {
+        // The plane's own texcoords are the shared quad's scaled by the repeat count
+        const Vec2f repeat = bp.m_mesh.getTexCoords()[2] / c_texcoords[2];
+
+        PlaneInstance instance;
+        instance.position = Vec4f(bp.m_pos, bp.m_billboard ? 1.f : 0.f);
+        instance.rotation = Vec4f(bp.m_rot.v, bp.m_rot.w);
+        instance.scale = Vec4f(bp.m_scale.x, bp.m_scale.y, repeat.x, repeat.y);
+        return instance;
+    }
+
+    // The same transform BackgroundPlane::ApplyTextureTransform() puts on the texture matrix
+    static Vec4f PackFrame(const BackgroundPlane& bp, const uint32_t index)
+    {
+        const Vec2f scale = bp.m_spriteScale * bp.m_packedScale;
+        const Vec2f offset = bp.m_packOffset + bp.m_texIndices[index] + 2 * bp.m_packOffset * bp.m_texIndices[index];
+        return Vec4f(scale.x, scale.y, offset.x, offset.y);
+    }
+
+    // Lightmaps blend additively, which is order independent whatever their alpha
+    static bool IsTranslucent(const BackgroundPlane& bp)
+    {
+        return !bp.m_lightmap && PlaneRenderQueue::IsTranslucent(bp.m_texture.get());
+    }
+
+    template<typename PlaneContainer>
+    void Build(const PlaneContainer& planes)
+    {
+        Clear();
+
+        // Texture ids in first use order, so the grouping doesn't depend on allocation addresses
+        map<const TextureEntry*, uint32_t> textureIds;
+        vector<pair<uint64_t, uint32_t> > order;
+        for (uint32_t i = 0; i < planes.size(); i++)
+        {
+            const BackgroundPlane& bp = planes[i];
+            if (IsTranslucent(bp))
+            {
+                m_translucent.push_back(i);
+                continue;
+            }
+            const auto it = textureIds.insert(make_pair(bp.m_texture.get(), (uint32_t)textureIds.size())).first;
+            order.push_back(make_pair(PlaneRenderQueue::MakeSortKey(bp.m_lightmap, false, bp.m_doubleSided, it->second, 0.f), i));
+        }
+        sort(order.begin(), order.end());
+
+        for (const auto& entry : order)
+        {
+            const BackgroundPlane& bp = planes[entry.second];
+            if (m_groups.empty() || entry.first != order[m_groups.back().firstInstance].first)
+            {
+                PlaneInstanceGroup group = { bp.m_texture.get(), bp.m_lightmap, bp.m_doubleSided, (uint32_t)m_instances.size(), 0 };
+                m_groups.push_back(group);
+            }
+            m_groups.back().numInstances++;
+
+            if (bp.m_texIndices.size() > 1)
+            {
+                m_animated.push_back(m_instances.size());
+            }
+            m_instances.push_back(PackInstance(bp));
+            m_frames.push_back(PackFrame(bp, 0));
+            m_planeIndices.push_back(entry.second);
+        }
+        m_numPlanes = planes.size();
+
+        m_planeInstances.assign(m_numPlanes, c_noInstance);
+        for (uint32_t i = 0; i < m_instances.size(); i++)
+        {
+            m_planeInstances[m_planeIndices[i]] = i;
+        }
+    }
+
+    // Returns whether any frame changed
+    template<typename PlaneContainer>
+    bool UpdateFrames(const PlaneContainer& planes, const double seconds)
+    {
+        bool changed = false;
+        for (const uint32_t i : m_animated)
+        {
+            const BackgroundPlane& bp = planes[m_planeIndices[i]];
+            const Vec4f frame = PackFrame(bp, bp.GetFrameIndex(seconds));
+            if (!(frame == m_frames[i]))
+            {
+                m_frames[i] = frame;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    // Repacks only the frames SceneStore::Animate() reported as changed
+    template<typename PlaneContainer>
+    bool UpdateFrames(const PlaneContainer& planes, const SceneStore& store)
+    {
+        bool changed = false;
+        for (const uint32_t i : store.m_changedFrames)
+        {
+            if (m_planeInstances[i] != c_noInstance)
+            {
+                m_frames[m_planeInstances[i]] = PackFrame(planes[i], store.m_planeFrames[i]);
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    void Clear()
+    {
+        m_groups.clear();
+        m_instances.clear();
+        m_frames.clear();
+        m_planeIndices.clear();
+        m_planeInstances.clear();
+        m_translucent.clear();
+        m_animated.clear();
+        m_numPlanes = 0;
+    }
+};
@@ -0,0 +1,214 @@
+#pragma once
+
+#include "Common.h"
+#include "BackgroundPlane.h"
+#include "SceneStore.h"
+#include "FrameProfiler.h"
+
+#define PLANE_SORT_TEXTURE_BITS 20
+#define PLANE_SORT_DEPTH_BITS   24
+
+struct PlaneQueueStats
+{
+    uint32_t    numDraws;
+    uint32_t    blendChanges;
+    uint32_t    cullChanges;
+    uint32_t    textureBinds;
+
+    void Add(const PlaneQueueStats& other)
+    {
+        numDraws += other.numDraws;
+        blendChanges += other.blendChanges;
+        cullChanges += other.cullChanges;
+        textureBinds += other.textureBinds;
+    }
+};
+
+struct PlaneDrawItem
+{
+    uint64_t    key;
+    uint32_t    index;  // into the plane container
+};
+
+// Sorts the visible background planes by render state and submits them in coherent batches, instead of
+// every plane setting and restoring its own blend, cull, texture and matrix state.
+// Planes are alpha tested so transparent texels don't write depth, which makes cutout sprites (alpha only
+// 0 or 1) correct in any order, those are batched by cull mode and texture. Planes with translucent texels
+// still depend on draw order, so they follow the cutouts sorted back to front whatever their state.
+// Lightmaps blend additively so they are order independent and go last, after everything they light.
+class PlaneRenderQueue
+{
+public:
+
+    vector<PlaneDrawItem>   m_items;
+    PlaneQueueStats         m_stats;    // of the last Submit()
+
+    PlaneRenderQueue()
+    {
+        memset(&m_stats, 0, sizeof(m_stats));
+    }
+
+    // Plain function of the plane's state, from the most significant bits: blend mode, translucency, then
+    //   cutout:      cull mode, texture, depth from far to near (normalized to [0,1])
+    //   translucent: depth from far to near, cull mode, texture
+    static uint64_t MakeSortKey(const bool additive, const bool translucent, const bool doubleSided, const uint32_t textureId, const float depth)
+    {
+        const uint64_t depthMax = (1 << PLANE_SORT_DEPTH_BITS) - 1;
+        const uint64_t depthBits = depthMax - (uint64_t)(math<float>::clamp(depth, 0.f, 1.f) * depthMax);
+        const uint64_t stateBits = ((uint64_t)doubleSided << PLANE_SORT_TEXTURE_BITS) | (textureId & ((1 << PLANE_SORT_TEXTURE_BITS) - 1));
+        return ((uint64_t)additive << 63) |
+               ((uint64_t)translucent << 62) |
+               (translucent ? (depthBits << (PLANE_SORT_TEXTURE_BITS + 1)) | stateBits
+                            : (stateBits << PLANE_SORT_DEPTH_BITS) | depthBits);
+    }
+
+    static bool IsTranslucent(const TextureEntry* pEntry)
+    {
+        return pEntry && pEntry->IsTranslucent();
+    }
+
+    void Add(const uint32_t index, const BackgroundPlane& bp, const ViewState& view)
+    {
+        PlaneDrawItem item;
+        item.key = MakeSortKey(bp.m_lightmap, IsTranslucent(bp.m_texture.get()), bp.m_doubleSided, GetTextureId(bp.m_texture.get()),
+                               bp.m_pos.distance(view.eye) / view.farClip);
+        item.index = index;
+        m_items.push_back(item);
+    }
+
+    void Add(const uint32_t index, const SceneStore& store, const ViewState& view)
+    {
+        const uint8_t flags = store.m_planeFlags[index];
+        PlaneDrawItem item;
+        item.key = MakeSortKey((flags & PLANE_FLAG_LIGHTMAP) != 0, IsTranslucent(store.m_planeTextures[index]), (flags & PLANE_FLAG_DOUBLE_SIDED) != 0,
+                               GetTextureId(store.m_planeTextures[index]), store.m_planePositions[index].distance(view.eye) / view.farClip);
+        item.index = index;
+        m_items.push_back(item);
+    }
+
+    void Sort()
+    {
+        sort(m_items.begin(), m_items.end(), [](const PlaneDrawItem& a, const PlaneDrawItem& b)
+        {
+            return a.key != b.key ? a.key < b.key : a.index < b.index;
+        });
+    }
+
+    // Must be called on the GL thread with the view matrix on the modelview stack, which is left unchanged
+    template<typename PlaneContainer>
+    void Submit(PlaneContainer& planes, const ViewState& view)
+    {
+        memset(&m_stats, 0, sizeof(m_stats));
+        if (m_items.empty())
+        {
+            return;
+        }
+
+        const Matrix44f viewMatrix = gl::getModelView();
+        bool additive = false;
+        bool cullDisabled = false;
+        const gl::Texture* pTexture = nullptr;
+        const TextureEntry* pBoundEntry = nullptr;
+
+        glEnable(GL_ALPHA_TEST);
+        glAlphaFunc(GL_GREATER, 0.f);
+
+        for (const PlaneDrawItem& item : m_items)
+        {
+            BackgroundPlane& bp = planes[item.index];
+
+            if (bp.m_lightmap != additive)
+            {
+                additive = bp.m_lightmap;
+                if (additive)
+                {
+                    glDisable(GL_ALPHA_TEST);
+                    glBlendFunc(GL_ONE, GL_ONE);
+                }
+                else
+                {
+                    glEnable(GL_ALPHA_TEST);
+                    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                }
+                m_stats.blendChanges++;
+            }
+
+            if (bp.m_doubleSided != cullDisabled)
+            {
+                cullDisabled = bp.m_doubleSided;
+                if (cullDisabled)
+                {
+                    glDisable(GL_CULL_FACE);
+                }
+                else
+                {
+                    glEnable(GL_CULL_FACE);
+                }
+                m_stats.cullChanges++;
+            }
+
+            if (bp.m_texture.get() != pBoundEntry)
+            {
+                pBoundEntry = bp.m_texture.get();
+                pTexture = &bp.m_texture->GetTexture();
+                pTexture->enableAndBind();
+                m_stats.textureBinds++;
+            }
+
+            glMatrixMode(GL_TEXTURE);
+            glLoadIdentity();
+            bp.ApplyTextureTransform(bp.GetFrameIndex(view.seconds));
+
+            glMatrixMode(GL_MODELVIEW);
+            glLoadMatrixf(viewMatrix);
+            bp.ApplyTransform(view.billboardAngle);
+
+            gl::draw(bp.m_mesh);
+            m_stats.numDraws++;
+            FrameProfiler::CountDraw(bp.m_mesh.getNumTriangles());
+        }
+
+        glMatrixMode(GL_TEXTURE);
+        glLoadIdentity();
+        glMatrixMode(GL_MODELVIEW);
+        glLoadMatrixf(viewMatrix);
+
+        glDisable(GL_ALPHA_TEST);
+        if (additive)
+        {
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        }
+        if (cullDisabled)
+        {
+            glEnable(GL_CULL_FACE);
+        }
+        pTexture->disable();
+        pTexture->unbind();
+    }
+
+    void Clear()
+    {
+        m_items.clear();
+    }
+
+    // Texture ids are only stable while the textures they were assigned to are alive
+    void Reset()
+    {
+        m_items.clear();
+        m_textureIds.clear();
+    }
+
+private:
+
+    map<const TextureEntry*, uint32_t>  m_textureIds;
+
+    uint32_t GetTextureId(const TextureEntry* pEntry)
+    {
+        auto it = m_textureIds.find(pEntry);
+        if (it == m_textureIds.end())
+        {
+            it = m_textureIds.insert(make_pair(pEntry, (uint32_t)m_textureIds.size())).first;
+        }
+        return it->second;
+    }
+};
@@ -0,0 +1,270 @@
+#pragma once
+
+#include "Common.h"
+#include "cinder/gl/Vbo.h"
+#include "cinder/gl/GlslProg.h"
+#include "PlaneInstancing.h"
+#include "FrameProfiler.h"
+
+// Applies a PlaneInstance and its frame to the shared unit quad, matching BackgroundPlane::ApplyTransform()
+// and ApplyTextureTransform() without touching the fixed function matrix stacks
+static const char* c_planeInstanceVert =
+    "#version 120\n"
+    "attribute vec4 instancePosition;\n"
+    "attribute vec4 instanceRotation;\n"
+    "attribute vec4 instanceScale;\n"
+    "attribute vec4 instanceFrame;\n"
+    "uniform float billboardAngle;\n"
+    "void main()\n"
+    "{\n"
+    "    vec3 pos = vec3(gl_Vertex.xy * instanceScale.xy, gl_Vertex.z);\n"
+    "    if (instancePosition.w > 0.5)\n"
+    "    {\n"
+    "        float s = sin(billboardAngle);\n"
+    "        float c = cos(billboardAngle);\n"
+    "        pos = vec3(c * pos.x + s * pos.z, pos.y, c * pos.z - s * pos.x);\n"
+    "    }\n"
+    "    else\n"
+    "    {\n"
+    "        vec3 q = instanceRotation.xyz;\n"
+    "        pos += 2.0 * cross(q, cross(q, pos) + instanceRotation.w * pos);\n"
+    "    }\n"
+    "    vec2 texcoord = gl_MultiTexCoord0.st * instanceScale.zw;\n"
+    "    gl_TexCoord[0] = vec4((texcoord + instanceFrame.zw) * instanceFrame.xy, 0.0, 1.0);\n"
+    "    gl_FrontColor = gl_Color;\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * vec4(pos + instancePosition.xyz, 1.0);\n"
+    "}\n";
+
+static const char* c_planeInstanceFrag =
+    "#version 120\n"
+    "uniform sampler2D tex;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_FragColor = texture2D(tex, gl_TexCoord[0].st) * gl_Color;\n"
+    "}\n";
+
+// Draws each PlaneInstanceGroup with one instanced call per run of visible planes, in PlaneRenderQueue
+// group order. Within a group planes are not depth sorted, which alpha testing makes safe for cutout
+// sprites and additive blending for lightmaps. Translucent planes aren't grouped, the caller draws them
+// back to front between the cutout and the lightmap groups.
+class PlaneRenderer
+{
+public:
+
+    gl::GlslProg        m_shader;
+    GLint               m_positionAttrib;
+    GLint               m_rotationAttrib;
+    GLint               m_scaleAttrib;
+    GLint               m_frameAttrib;
+    gl::Vbo             m_instanceVbo;
+    gl::Vbo             m_frameVbo;
+    gl::VboMesh         m_quad;
+    bool                m_supported;
+    PlaneQueueStats     m_stats;    // of the last Draw()
+
+    PlaneRenderer() :
+        m_positionAttrib(-1),
+        m_rotationAttrib(-1),
+        m_scaleAttrib(-1),
+        m_frameAttrib(-1),
+        m_supported(false)
+    {
+        memset(&m_stats, 0, sizeof(m_stats));
+    }
+
+    // Must be called with the GL context current
+    void Setup()
+    {
+        m_supported = gl::isExtensionAvailable("GL_ARB_draw_instanced") &&
+                      gl::isExtensionAvailable("GL_ARB_instanced_arrays");
+        if (!m_supported)
+        {
+            console() << "WARNING! Instanced arrays not supported, falling back to per-plane drawing" << endl;
+            return;
+        }
+
+        try
+        {
+            m_shader = gl::GlslProg(c_planeInstanceVert, c_planeInstanceFrag);
+        }
+        catch (gl::GlslProgCompileExc& exc)
+        {
+            console() << "WARNING! Plane instancing shader failed to compile: " << exc.what() << endl;
+            m_supported = false;
+            return;
+        }
+
+        m_positionAttrib = m_shader.getAttribLocation("instancePosition");
+        m_rotationAttrib = m_shader.getAttribLocation("instanceRotation");
+        m_scaleAttrib = m_shader.getAttribLocation("instanceScale");
+        m_frameAttrib = m_shader.getAttribLocation("instanceFrame");
+        m_instanceVbo = gl::Vbo(GL_ARRAY_BUFFER);
+        m_frameVbo = gl::Vbo(GL_ARRAY_BUFFER);
+
+        TriMesh quad;
+        quad.appendVertices(&c_positions[0], 4);
+        quad.appendTexCoords(&c_texcoords[0], 4);
+        quad.appendIndices(&c_indices[0], 6);
+        m_quad = gl::VboMesh(quad);
+    }
+
+    void Upload(const PlaneInstanceGroups& groups)
+    {
+        if (!m_supported || groups.m_instances.empty())
+        {
+            return;
+        }
+
+        m_instanceVbo.bind();
+        m_instanceVbo.bufferData(groups.m_instances.size() * sizeof(PlaneInstance), &groups.m_instances[0], GL_STATIC_DRAW);
+        m_instanceVbo.unbind();
+        UploadFrames(groups);
+    }
+
+    void UploadFrames(const PlaneInstanceGroups& groups)
+    {
+        if (!m_supported || groups.m_frames.empty())
+        {
+            return;
+        }
+
+        m_frameVbo.bind();
+        m_frameVbo.bufferData(groups.m_frames.size() * sizeof(Vec4f), &groups.m_frames[0], GL_STREAM_DRAW);
+        m_frameVbo.unbind();
+    }
+
+    // Draws either the cutout or the lightmap groups, visible holds a flag per plane in plane container order
+    void Draw(const PlaneInstanceGroups& groups, const vector<uint8_t>& visible, const ViewState& view, const bool lightmaps)
+    {
+        memset(&m_stats, 0, sizeof(m_stats));
+        if (!m_supported || groups.m_groups.empty())
+        {
+            return;
+        }
+
+        m_shader.bind();
+        m_shader.uniform("tex", 0);
+        m_shader.uniform("billboardAngle", view.billboardAngle * (float)M_PI / 180.f);
+
+        const GLint attribs[] = { m_positionAttrib, m_rotationAttrib, m_scaleAttrib, m_frameAttrib };
+        for (const GLint attrib : attribs)
+        {
+            glEnableVertexAttribArray(attrib);
+            glVertexAttribDivisorARB(attrib, 1);
+        }
+        m_quad.enableClientStates();
+        m_quad.bindAllData();
+
+        glEnable(GL_ALPHA_TEST);
+        glAlphaFunc(GL_GREATER, 0.f);
+
+        bool additive = false;
+        bool cullDisabled = false;
+        const gl::Texture* pTexture = nullptr;
+        for (const PlaneInstanceGroup& group : groups.m_groups)
+        {
+            if (group.additive != lightmaps)
+            {
+                continue;
+            }
+
+            if (group.additive != additive)
+            {
+                additive = group.additive;
+                if (additive)
+                {
+                    glDisable(GL_ALPHA_TEST);
+                    glBlendFunc(GL_ONE, GL_ONE);
+                }
+                else
+                {
+                    glEnable(GL_ALPHA_TEST);
+                    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                }
+                m_stats.blendChanges++;
+            }
+
+            if (group.doubleSided != cullDisabled)
+            {
+                cullDisabled = group.doubleSided;
+                if (cullDisabled)
+                {
+                    glDisable(GL_CULL_FACE);
+                }
+                else
+                {
+                    glEnable(GL_CULL_FACE);
+                }
+                m_stats.cullChanges++;
+            }
+
+            bool bound = false;
+            const uint32_t end = group.firstInstance + group.numInstances;
+            for (uint32_t first = group.firstInstance; first < end; )
+            {
+                // Find the next run of visible instances
+                if (!visible[groups.m_planeIndices[first]])
+                {
+                    first++;
+                    continue;
+                }
+                uint32_t last = first + 1;
+                while (last < end && visible[groups.m_planeIndices[last]])
+                {
+                    last++;
+                }
+
+                if (!bound)
+                {
+                    pTexture = &group.pTexture->GetTexture();
+                    pTexture->bind();
+                    m_stats.textureBinds++;
+                    bound = true;
+                }
+
+                BindInstances(first);
+                glDrawElementsInstancedARB(GL_TRIANGLES, m_quad.getNumIndices(), GL_UNSIGNED_INT, 0, last - first);
+                m_stats.numDraws++;
+                FrameProfiler::CountDraw(m_quad.getNumIndices() / 3 * (last - first));
+                first = last;
+            }
+        }
+
+        glDisable(GL_ALPHA_TEST);
+        if (additive)
+        {
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        }
+        if (cullDisabled)
+        {
+            glEnable(GL_CULL_FACE);
+        }
+        if (pTexture)
+        {
+            pTexture->unbind();
+        }
+
+        gl::VboMesh::unbindBuffers();
+        m_quad.disableClientStates();
+        for (const GLint attrib : attribs)
+        {
+            glVertexAttribDivisorARB(attrib, 0);
+            glDisableVertexAttribArray(attrib);
+        }
+        m_shader.unbind();
+    }
+
+private:
+
+    void BindInstances(const uint32_t first)
+    {
+        m_instanceVbo.bind();
+        const size_t base = first * sizeof(PlaneInstance);
+        glVertexAttribPointer(m_positionAttrib, 4, GL_FLOAT, GL_FALSE, sizeof(PlaneInstance), (const GLvoid*)(base + offsetof(PlaneInstance, position)));
+        glVertexAttribPointer(m_rotationAttrib, 4, GL_FLOAT, GL_FALSE, sizeof(PlaneInstance), (const GLvoid*)(base + offsetof(PlaneInstance, rotation)));
+        glVertexAttribPointer(m_scaleAttrib, 4, GL_FLOAT, GL_FALSE, sizeof(PlaneInstance), (const GLvoid*)(base + offsetof(PlaneInstance, scale)));
+
+        m_frameVbo.bind();
+        glVertexAttribPointer(m_frameAttrib, 4, GL_FLOAT, GL_FALSE, sizeof(Vec4f), (const GLvoid*)(first * sizeof(Vec4f)));
+    }
+};
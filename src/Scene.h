@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Common.h"
+#include "SceneBatch.h"
+
+// Everything a load builds, filled in by applying its scene batches in the order they were published.
+// Plain CPU data, the viewer keeps one on the GL thread and draws from it, FezBatch keeps one per file.
+class Scene
+{
+public:
+
+    Surface                 m_trileSurface;
+    deque<Trile>            m_triles;
+    StaticBatch             m_staticBatch;
+    GreedyMesh              m_greedyMesh;
+    deque<ArtObject>        m_artObjects;
+    deque<BackgroundPlane>  m_backgroundPlanes;
+    SceneChunks             m_sceneChunks;
+    SceneStore              m_sceneStore;       // empty until the level is complete
+
+    // What the batch replaces is swapped into it, so the caller releases it with the batch
+    void Apply(SceneBatch& batch)
+    {
+        if (batch.trileSurface)
+        {
+            m_trileSurface = batch.trileSurface;
+        }
+        m_triles.insert(m_triles.end(), batch.triles.begin(), batch.triles.end());
+        if (batch.pStaticBatch)
+        {
+            m_staticBatch.Swap(*batch.pStaticBatch);
+        }
+        if (batch.pGreedyMesh)
+        {
+            m_greedyMesh.Swap(*batch.pGreedyMesh);
+        }
+        if (batch.pArtObjects)
+        {
+            m_artObjects.swap(*batch.pArtObjects);
+        }
+        if (batch.pBackgroundPlanes)
+        {
+            m_backgroundPlanes.swap(*batch.pBackgroundPlanes);
+        }
+        if (batch.pSceneChunks)
+        {
+            m_sceneChunks.Swap(*batch.pSceneChunks);
+            m_sceneStore.Swap(*batch.pSceneStore);
+        }
+
+        for (auto& reload : batch.artObjectReloads)
+        {
+            const uint32_t index = reload.first;
+            swap(m_artObjects[index], *reload.second);
+            m_sceneChunks.UpdateArtObject(index, m_artObjects[index].GetBounds());
+            m_sceneStore.UpdateArtObject(index, m_artObjects[index]);
+        }
+        for (auto& reload : batch.backgroundPlaneReloads)
+        {
+            const uint32_t index = reload.first;
+            swap(m_backgroundPlanes[index], *reload.second);
+            m_sceneChunks.UpdateBackgroundPlane(index, m_backgroundPlanes[index].GetBounds());
+            m_sceneStore.UpdateBackgroundPlane(index, m_backgroundPlanes[index]);
+        }
+    }
+
+    void Clear()
+    {
+        m_trileSurface = Surface();
+        m_triles.clear();
+        m_staticBatch.Clear();
+        m_greedyMesh.Clear();
+        m_artObjects.clear();
+        m_backgroundPlanes.clear();
+        m_sceneChunks.Clear();
+        m_sceneStore.Clear();
+    }
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Common.h"
+#include "Trile.h"
+#include "ArtObject.h"
+#include "BackgroundPlane.h"
+#include "StaticBatch.h"
+#include "GreedyMesh.h"
+#include "SceneChunks.h"
+#include "SceneStore.h"
+
+#define SCENE_BATCH_TRILES      4096    // triles the loader places before handing them over
+#define SCENE_QUEUE_CAPACITY    64      // batches in flight before the loader waits for draw()
+#define SCENE_APPLY_SECONDS     0.002   // per frame, draw() leaves the rest of the queue for the next one
+
+// Part of a scene built privately by the loader thread and handed to the GL thread through an SpscQueue,
+// which applies it between frames. Every part is optional, an empty or null one leaves the scene as it is.
+// Whatever a batch replaces is swapped into it and released with it on the GL thread.
+struct SceneBatch
+{
+    Surface                                             trileSurface;       // replaces the trile set texture
+    vector<Trile>                                       triles;             // appended
+    shared_ptr<StaticBatch>                             pStaticBatch;
+    shared_ptr<GreedyMesh>                              pGreedyMesh;
+    shared_ptr<deque<ArtObject>>                        pArtObjects;        // the whole set, replacing the current one
+    shared_ptr<deque<BackgroundPlane>>                  pBackgroundPlanes;
+    shared_ptr<SceneChunks>                             pSceneChunks;       // of every trile handed over so far and
+    shared_ptr<SceneStore>                              pSceneStore;        // the art objects and planes of this batch
+    vector<pair<uint32_t, shared_ptr<ArtObject>>>       artObjectReloads;   // swapped into place by index
+    vector<pair<uint32_t, shared_ptr<BackgroundPlane>>> backgroundPlaneReloads;
+};
+
+typedef shared_ptr<SceneBatch> SceneBatchRef;
@@ -0,0 +1,187 @@
+#pragma once
+
+#include "Common.h"
+#include "SceneStore.h"
+#include "TrileInstancing.h"
+#include "PlaneRenderQueue.h"
+
+#define SCENE_BENCHMARK_INSTANCES  100000
+#define SCENE_BENCHMARK_ITERATIONS 20
+
+// Times the per-frame CPU passes over a synthetic scene, once walking the object deques the way the
+// draw loop used to and once scanning a SceneStore of the same objects. Run with -scenebench.
+class SceneBenchmark
+{
+public:
+
+    static void Run(const uint32_t numInstances, ostream& out)
+    {
+        TrileGeometry geometry;
+        for (uint32_t orient = 0; orient < NUM_ORIENTATIONS; orient++)
+        {
+            geometry.bounds[orient] = Bounds(Vec3f(-0.5f, -0.5f, -0.5f), Vec3f(0.5f, 0.5f, 0.5f));
+        }
+
+        TriMesh quad;
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            quad.appendVertex(c_positions[i]);
+            quad.appendTexCoord(c_texcoords[i]);
+        }
+        quad.appendTriangle(c_indices[0], c_indices[1], c_indices[2]);
+        quad.appendTriangle(c_indices[3], c_indices[4], c_indices[5]);
+
+        // Everything on a cube of cells around the origin, a quarter of the planes animated
+        const uint32_t side = (uint32_t)math<float>::ceil(math<float>::pow((float)numInstances, 1.f / 3.f));
+        deque<Trile> triles;
+        deque<ArtObject> artObjects;
+        deque<BackgroundPlane> planes;
+        for (uint32_t i = 0; i < numInstances; i++)
+        {
+            const Vec3f pos = Vec3f((float)(i % side), (float)(i / side % side), (float)(i / side / side)) - Vec3f::one() * (side / 2.f);
+            triles.push_back(Trile(&geometry, i % 16, Vec3f::zero(), i % NUM_ORIENTATIONS, Vec3f::zero(), pos));
+
+            TriMesh mesh;
+            for (uint32_t v = 0; v < 4; v++)
+            {
+                mesh.appendVertex(c_positions[v] + pos);
+            }
+            artObjects.push_back(ArtObject(mesh, TextureRef()));
+
+            BackgroundPlane bp(quad);
+            bp.m_pos = pos;
+            bp.m_scale = Vec3f::one();
+            bp.m_rot = Quatf();
+            bp.m_doubleSided = i % 2 == 0;
+            bp.m_billboard = i % 3 == 0;
+            bp.m_lightmap = i % 5 == 0;
+            bp.m_texIndices.push_back(Vec2f::zero());
+            if (i % 4 == 0)
+            {
+                for (uint32_t frame = 0; frame < 4; frame++)
+                {
+                    bp.m_frames.push_back(1000000 + (i % 8 == 0 ? frame * 500000 : 0));
+                    bp.m_totalDuration += bp.m_frames.back();
+                }
+                bp.m_texIndices.resize(4, Vec2f::zero());
+                bp.BuildTimeline();
+            }
+            planes.push_back(bp);
+        }
+
+        SceneStore store;
+        store.AddTriles(triles);
+        store.AddArtObjects(artObjects);
+        store.AddBackgroundPlanes(planes);
+
+        // Looking at the scene from outside, so about half of it is in view
+        CameraPersp camera;
+        camera.setPerspective(60.f, 16.f / 9.f, 1.f, 1000.f);
+        camera.lookAt(Vec3f(0.f, 0.f, (float)side), Vec3f(side / 2.f, 0.f, 0.f));
+        ViewState view;
+        view.Set(camera, 0.0, true);
+
+        out << "Scene Benchmark: " << numInstances << " Triles, Art Objects and Background Planes, " <<
+               SCENE_BENCHMARK_ITERATIONS << " Iterations" << endl;
+
+        // Cull
+        vector<uint8_t> trileVisible(numInstances), artObjectVisible(numInstances), planeVisible(numInstances);
+        double start = getElapsedSeconds();
+        for (uint32_t n = 0; n < SCENE_BENCHMARK_ITERATIONS; n++)
+        {
+            for (uint32_t i = 0; i < numInstances; i++)
+            {
+                trileVisible[i] = view.frustum.Intersects(triles[i].GetBounds());
+                artObjectVisible[i] = view.frustum.Intersects(artObjects[i].GetBounds());
+                planeVisible[i] = view.frustum.Intersects(planes[i].GetBounds());
+            }
+        }
+        const double dequeCull = getElapsedSeconds() - start;
+        start = getElapsedSeconds();
+        for (uint32_t n = 0; n < SCENE_BENCHMARK_ITERATIONS; n++)
+        {
+            store.Cull(view.frustum);
+        }
+        const double storeCull = getElapsedSeconds() - start;
+        ASSERT(trileVisible == store.m_trileVisible && artObjectVisible == store.m_artObjectVisible && planeVisible == store.m_planeVisible);
+        Print(out, "Cull", dequeCull, storeCull);
+
+        // Animate
+        vector<uint32_t> frames(numInstances, c_noFrame);
+        uint32_t dequeChanges = 0;
+        start = getElapsedSeconds();
+        for (uint32_t n = 0; n < SCENE_BENCHMARK_ITERATIONS; n++)
+        {
+            const double seconds = n * 0.05;
+            for (uint32_t i = 0; i < numInstances; i++)
+            {
+                if (planes[i].m_texIndices.size() > 1)
+                {
+                    const uint32_t index = planes[i].GetFrameIndex(seconds);
+                    dequeChanges += index != frames[i] ? 1 : 0;
+                    frames[i] = index;
+                }
+            }
+        }
+        const double dequeAnimate = getElapsedSeconds() - start;
+        uint32_t storeChanges = 0;
+        start = getElapsedSeconds();
+        for (uint32_t n = 0; n < SCENE_BENCHMARK_ITERATIONS; n++)
+        {
+            store.Animate(n * 0.05);
+            storeChanges += store.m_changedFrames.size();
+        }
+        const double storeAnimate = getElapsedSeconds() - start;
+        Print(out, "Animate", dequeAnimate, storeAnimate);
+
+        // Draw lists, the trile instance groups and the fallback plane queue of the visible objects
+        TrileInstanceGroups trileGroups;
+        PlaneRenderQueue planeQueue;
+        start = getElapsedSeconds();
+        for (uint32_t n = 0; n < SCENE_BENCHMARK_ITERATIONS; n++)
+        {
+            trileGroups.Build(triles, trileVisible);
+
+            planeQueue.Clear();
+            for (uint32_t i = 0; i < numInstances; i++)
+            {
+                if (planeVisible[i])
+                {
+                    planeQueue.Add(i, planes[i], view);
+                }
+            }
+            planeQueue.Sort();
+        }
+        const double dequeDrawLists = getElapsedSeconds() - start;
+        const uint32_t dequeInstances = trileGroups.m_numInstances + planeQueue.m_items.size();
+        start = getElapsedSeconds();
+        for (uint32_t n = 0; n < SCENE_BENCHMARK_ITERATIONS; n++)
+        {
+            trileGroups.Build(store);
+
+            planeQueue.Clear();
+            for (uint32_t i = 0; i < numInstances; i++)
+            {
+                if (store.m_planeVisible[i])
+                {
+                    planeQueue.Add(i, store, view);
+                }
+            }
+            planeQueue.Sort();
+        }
+        const double storeDrawLists = getElapsedSeconds() - start;
+        const uint32_t storeInstances = trileGroups.m_numInstances + planeQueue.m_items.size();
+        Print(out, "Draw Lists", dequeDrawLists, storeDrawLists);
+
+        out << "Scene Benchmark: " << dequeChanges << " / " << storeChanges << " Frame Changes, " <<
+               dequeInstances << " / " << storeInstances << " Visible Instances" << endl;
+    }
+
+private:
+
+    static void Print(ostream& out, const char* pass, const double dequeSeconds, const double storeSeconds)
+    {
+        out << "  " << pass << ": deque " << dequeSeconds * 1000 / SCENE_BENCHMARK_ITERATIONS << " ms, store " <<
+               storeSeconds * 1000 / SCENE_BENCHMARK_ITERATIONS << " ms per pass" << endl;
+    }
+};
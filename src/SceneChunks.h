@@ -0,0 +1,180 @@
+#pragma once
+
+#include "Common.h"
+#include "Frustum.h"
+
+#define SCENE_CHUNK_SIZE 16     // world units (trile cells) per chunk side
+
+struct SceneChunk
+{
+    Vec3i               coord;
+    Bounds              bounds;             // grows to fit everything assigned to the chunk
+    vector<uint32_t>    triles;
+    vector<uint32_t>    artObjects;
+    vector<uint32_t>    backgroundPlanes;
+    bool                visible;
+};
+
+// Splits the level into fixed size chunks so whole groups of objects can be frustum culled at once.
+// Every object lands in the chunk holding the center of its bounds. Plain CPU code with no GL calls.
+class SceneChunks
+{
+public:
+
+    vector<SceneChunk>  m_chunks;
+    vector<uint32_t>    m_trileChunks;              // chunk index per object, in container order
+    vector<uint32_t>    m_artObjectChunks;
+    vector<uint32_t>    m_backgroundPlaneChunks;
+    uint32_t            m_numVisible;
+
+    SceneChunks() :
+        m_numVisible(0)
+    {
+    }
+
+    template<typename TrileContainer>
+    void AddTriles(const TrileContainer& triles)
+    {
+        for (const auto& trile : triles)
+        {
+            const Bounds bounds = trile.GetBounds();
+            SceneChunk& chunk = GetChunk(bounds);
+            chunk.triles.push_back(m_trileChunks.size());
+            m_trileChunks.push_back(&chunk - &m_chunks[0]);
+        }
+    }
+
+    template<typename ArtObjectContainer>
+    void AddArtObjects(const ArtObjectContainer& artObjects)
+    {
+        for (const auto& ao : artObjects)
+        {
+            const Bounds bounds = ao.GetBounds();
+            SceneChunk& chunk = GetChunk(bounds);
+            chunk.artObjects.push_back(m_artObjectChunks.size());
+            m_artObjectChunks.push_back(&chunk - &m_chunks[0]);
+        }
+    }
+
+    template<typename BackgroundPlaneContainer>
+    void AddBackgroundPlanes(const BackgroundPlaneContainer& backgroundPlanes)
+    {
+        for (const auto& bp : backgroundPlanes)
+        {
+            const Bounds bounds = bp.GetBounds();
+            SceneChunk& chunk = GetChunk(bounds);
+            chunk.backgroundPlanes.push_back(m_backgroundPlaneChunks.size());
+            m_backgroundPlaneChunks.push_back(&chunk - &m_chunks[0]);
+        }
+    }
+
+    // An object reloaded in place keeps its chunk, which grows to fit it so culling stays conservative
+    void UpdateArtObject(const uint32_t i, const Bounds& bounds)
+    {
+        if (i < m_artObjectChunks.size())
+        {
+            m_chunks[m_artObjectChunks[i]].bounds.Include(bounds);
+        }
+    }
+
+    void UpdateBackgroundPlane(const uint32_t i, const Bounds& bounds)
+    {
+        if (i < m_backgroundPlaneChunks.size())
+        {
+            m_chunks[m_backgroundPlaneChunks[i]].bounds.Include(bounds);
+        }
+    }
+
+    // Returns whether any chunk changed visibility since the last call
+    bool Cull(const Frustum& frustum)
+    {
+        bool changed = false;
+        m_numVisible = 0;
+        for (SceneChunk& chunk : m_chunks)
+        {
+            const bool visible = frustum.Intersects(chunk.bounds);
+            changed |= visible != chunk.visible;
+            chunk.visible = visible;
+            m_numVisible += visible ? 1 : 0;
+        }
+        return changed;
+    }
+
+    // Objects added after the chunks were built have no chunk yet and are always drawn
+    bool IsTrileVisible(const uint32_t i) const
+    {
+        return IsVisible(m_trileChunks, i);
+    }
+
+    bool IsArtObjectVisible(const uint32_t i) const
+    {
+        return IsVisible(m_artObjectChunks, i);
+    }
+
+    bool IsBackgroundPlaneVisible(const uint32_t i) const
+    {
+        return IsVisible(m_backgroundPlaneChunks, i);
+    }
+
+    void Clear()
+    {
+        m_chunks.clear();
+        m_lookup.clear();
+        m_trileChunks.clear();
+        m_artObjectChunks.clear();
+        m_backgroundPlaneChunks.clear();
+        m_numVisible = 0;
+    }
+
+    void Swap(SceneChunks& other)
+    {
+        m_chunks.swap(other.m_chunks);
+        m_lookup.swap(other.m_lookup);
+        m_trileChunks.swap(other.m_trileChunks);
+        m_artObjectChunks.swap(other.m_artObjectChunks);
+        m_backgroundPlaneChunks.swap(other.m_backgroundPlaneChunks);
+        swap(m_numVisible, other.m_numVisible);
+    }
+
+    static Vec3i GetChunkCoord(const Vec3f& point)
+    {
+        return Vec3i((int)floor(point.x / SCENE_CHUNK_SIZE),
+                     (int)floor(point.y / SCENE_CHUNK_SIZE),
+                     (int)floor(point.z / SCENE_CHUNK_SIZE));
+    }
+
+    // Levels are far smaller than 2^21 chunks on any axis
+    static uint64_t GetChunkKey(const Vec3f& point)
+    {
+        const Vec3i coord = GetChunkCoord(point);
+        return ((uint64_t)(coord.x & 0x1FFFFF) << 42) | ((uint64_t)(coord.y & 0x1FFFFF) << 21) | (uint64_t)(coord.z & 0x1FFFFF);
+    }
+
+private:
+
+    map<uint64_t, uint32_t> m_lookup;   // chunk key to index into m_chunks
+
+    SceneChunk& GetChunk(const Bounds& bounds)
+    {
+        const Vec3f center = bounds.GetCenter();
+        const uint64_t key = GetChunkKey(center);
+        auto it = m_lookup.find(key);
+        if (it == m_lookup.end())
+        {
+            SceneChunk chunk;
+            chunk.coord = GetChunkCoord(center);
+            chunk.visible = true;
+            it = m_lookup.insert(make_pair(key, (uint32_t)m_chunks.size())).first;
+            m_chunks.push_back(chunk);
+        }
+
+        SceneChunk& chunk = m_chunks[it->second];
+        chunk.bounds.Include(bounds);
+        return chunk;
+    }
+
+    bool IsVisible(const vector<uint32_t>& objectChunks, const uint32_t i) const
+    {
+        return i >= objectChunks.size() || m_chunks[objectChunks[i]].visible;
+    }
+};
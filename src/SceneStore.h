@@ -0,0 +1,282 @@
+#pragma once
+
+#include "Common.h"
+#include "Trile.h"
+#include "ArtObject.h"
+#include "BackgroundPlane.h"
+#include "SceneChunks.h"
+
+#define PLANE_FLAG_DOUBLE_SIDED 0x1
+#define PLANE_FLAG_BILLBOARD    0x2
+#define PLANE_FLAG_LIGHTMAP     0x4
+
+const uint32_t c_noFrame = 0xFFFFFFFF;  // animated planes until their first Animate()
+
+// A plane's slice of SceneStore::m_frameEnds, the same timeline BackgroundPlane::GetFrameIndex() walks
+struct PlaneAnimation
+{
+    uint32_t    firstFrameEnd;
+    uint32_t    numFrameEnds;
+    uint32_t    uniformDuration;
+    uint32_t    totalDuration;
+};
+
+// The per-frame view of the scene in structure of arrays form, so culling, animation and building the
+// draw lists are linear scans over small contiguous arrays instead of walks over the fat objects in the
+// deques. The deques still own the meshes and textures, the handles here point into them and deque
+// elements don't move as it grows. Built once the level is complete, plain CPU code with no GL calls.
+class SceneStore
+{
+public:
+
+    // Triles
+    vector<Vec3f>                   m_trilePositions;
+    vector<uint32_t>                m_trileKeys;
+    vector<uint8_t>                 m_trileOrients;
+    vector<const TrileGeometry*>    m_trileGeometry;
+    vector<Bounds>                  m_trileBounds;
+    vector<uint32_t>                m_trileChunks;
+    vector<uint8_t>                 m_trileVisible;     // by chunk, so it only changes when a chunk does
+
+    // Art Objects
+    vector<ArtObject*>              m_artObjects;
+    vector<Bounds>                  m_artObjectBounds;
+    vector<uint32_t>                m_artObjectChunks;
+    vector<uint8_t>                 m_artObjectVisible;
+
+    // Background Planes
+    vector<Vec3f>                   m_planePositions;
+    vector<Bounds>                  m_planeBounds;
+    vector<uint8_t>                 m_planeFlags;       // PLANE_FLAG_*
+    vector<const TextureEntry*>     m_planeTextures;
+    vector<PlaneAnimation>          m_planeAnimations;
+    vector<uint32_t>                m_planeFrames;      // index into m_texIndices of the frame showing, set by Animate()
+    vector<uint32_t>                m_planeChunks;
+    vector<uint8_t>                 m_planeVisible;
+    vector<uint32_t>                m_frameEnds;        // every animated plane's timeline back to back
+    vector<uint32_t>                m_animatedPlanes;   // planes with more than one frame
+    vector<uint32_t>                m_changedFrames;    // planes whose frame changed in the last Animate()
+
+    template<typename TrileContainer>
+    void AddTriles(const TrileContainer& triles)
+    {
+        const size_t size = m_trilePositions.size() + triles.size();
+        m_trilePositions.reserve(size);
+        m_trileKeys.reserve(size);
+        m_trileOrients.reserve(size);
+        m_trileGeometry.reserve(size);
+        m_trileBounds.reserve(size);
+        for (const Trile& trile : triles)
+        {
+            m_trilePositions.push_back(trile.m_pos);
+            m_trileKeys.push_back(trile.m_key);
+            m_trileOrients.push_back((uint8_t)trile.m_orient);
+            m_trileGeometry.push_back(trile.m_pGeometry);
+            m_trileBounds.push_back(trile.GetBounds());
+        }
+        m_trileVisible.resize(size, 1);
+    }
+
+    template<typename ArtObjectContainer>
+    void AddArtObjects(ArtObjectContainer& artObjects)
+    {
+        const size_t size = m_artObjects.size() + artObjects.size();
+        m_artObjects.reserve(size);
+        m_artObjectBounds.reserve(size);
+        for (ArtObject& ao : artObjects)
+        {
+            m_artObjects.push_back(&ao);
+            m_artObjectBounds.push_back(ao.GetBounds());
+        }
+        m_artObjectVisible.resize(size, 1);
+    }
+
+    template<typename BackgroundPlaneContainer>
+    void AddBackgroundPlanes(const BackgroundPlaneContainer& backgroundPlanes)
+    {
+        uint32_t i = m_planePositions.size();
+        const size_t size = i + backgroundPlanes.size();
+        m_planePositions.resize(size);
+        m_planeBounds.resize(size);
+        m_planeFlags.resize(size);
+        m_planeTextures.resize(size);
+        m_planeAnimations.resize(size);
+        m_planeFrames.resize(size);
+        m_planeVisible.resize(size, 1);
+        for (const BackgroundPlane& bp : backgroundPlanes)
+        {
+            SetBackgroundPlane(i++, bp);
+        }
+    }
+
+    // After the art object at i was reloaded in place
+    void UpdateArtObject(const uint32_t i, ArtObject& ao)
+    {
+        m_artObjects[i] = &ao;
+        m_artObjectBounds[i] = ao.GetBounds();
+    }
+
+    // After the background plane at i was reloaded in place. Its old timeline stays unused in m_frameEnds
+    // until the store is rebuilt by the next load.
+    void UpdateBackgroundPlane(const uint32_t i, const BackgroundPlane& bp)
+    {
+        m_animatedPlanes.erase(remove(m_animatedPlanes.begin(), m_animatedPlanes.end(), i), m_animatedPlanes.end());
+        SetBackgroundPlane(i, bp);
+    }
+
+    // Takes the chunk of every object, which must have been added to the chunks in the same order
+    void AssignChunks(const SceneChunks& chunks)
+    {
+        m_trileChunks = chunks.m_trileChunks;
+        m_artObjectChunks = chunks.m_artObjectChunks;
+        m_planeChunks = chunks.m_backgroundPlaneChunks;
+    }
+
+    // Run after SceneChunks::Cull(). Triles only take their chunk's visibility since any change to it
+    // regroups and uploads the instances, everything else is also tested against its own bounds.
+    void Cull(const SceneChunks& chunks, const Frustum& frustum)
+    {
+        for (size_t i = 0; i < m_trileChunks.size(); i++)
+        {
+            m_trileVisible[i] = chunks.m_chunks[m_trileChunks[i]].visible;
+        }
+        for (size_t i = 0; i < m_artObjectChunks.size(); i++)
+        {
+            m_artObjectVisible[i] = chunks.m_chunks[m_artObjectChunks[i]].visible && frustum.Intersects(m_artObjectBounds[i]);
+        }
+        for (size_t i = 0; i < m_planeChunks.size(); i++)
+        {
+            m_planeVisible[i] = chunks.m_chunks[m_planeChunks[i]].visible && frustum.Intersects(m_planeBounds[i]);
+        }
+    }
+
+    // Culls every object against its own bounds, for stores without chunks
+    void Cull(const Frustum& frustum)
+    {
+        for (size_t i = 0; i < m_trileBounds.size(); i++)
+        {
+            m_trileVisible[i] = frustum.Intersects(m_trileBounds[i]);
+        }
+        for (size_t i = 0; i < m_artObjectBounds.size(); i++)
+        {
+            m_artObjectVisible[i] = frustum.Intersects(m_artObjectBounds[i]);
+        }
+        for (size_t i = 0; i < m_planeBounds.size(); i++)
+        {
+            m_planeVisible[i] = frustum.Intersects(m_planeBounds[i]);
+        }
+    }
+
+    // Returns whether any plane changed frame, those are listed in m_changedFrames
+    bool Animate(const double seconds)
+    {
+        m_changedFrames.clear();
+        for (const uint32_t i : m_animatedPlanes)
+        {
+            const uint32_t index = GetFrameIndex(m_planeAnimations[i], seconds);
+            if (index != m_planeFrames[i])
+            {
+                m_planeFrames[i] = index;
+                m_changedFrames.push_back(i);
+            }
+        }
+        return !m_changedFrames.empty();
+    }
+
+    // Matches BackgroundPlane::GetFrameIndex()
+    uint32_t GetFrameIndex(const PlaneAnimation& animation, const double seconds) const
+    {
+        if (animation.numFrameEnds == 0 || animation.totalDuration == 0)
+        {
+            return 0;
+        }
+
+        const uint32_t timeOffset = (uint32_t)(seconds * 10000000) % animation.totalDuration;
+        if (animation.uniformDuration)
+        {
+            return timeOffset == 0 ? 0 : (timeOffset - 1) / animation.uniformDuration;
+        }
+        const auto first = m_frameEnds.begin() + animation.firstFrameEnd;
+        const uint32_t index = lower_bound(first, first + animation.numFrameEnds, timeOffset) - first;
+        ASSERT(index < animation.numFrameEnds);
+        return index;
+    }
+
+    size_t GetNumTriles() const
+    {
+        return m_trilePositions.size();
+    }
+
+    size_t GetNumArtObjects() const
+    {
+        return m_artObjects.size();
+    }
+
+    size_t GetNumBackgroundPlanes() const
+    {
+        return m_planePositions.size();
+    }
+
+    bool IsEmpty() const
+    {
+        return m_trilePositions.empty() && m_artObjects.empty() && m_planePositions.empty();
+    }
+
+    void Clear()
+    {
+        SceneStore empty;
+        Swap(empty);
+    }
+
+    void Swap(SceneStore& other)
+    {
+        m_trilePositions.swap(other.m_trilePositions);
+        m_trileKeys.swap(other.m_trileKeys);
+        m_trileOrients.swap(other.m_trileOrients);
+        m_trileGeometry.swap(other.m_trileGeometry);
+        m_trileBounds.swap(other.m_trileBounds);
+        m_trileChunks.swap(other.m_trileChunks);
+        m_trileVisible.swap(other.m_trileVisible);
+        m_artObjects.swap(other.m_artObjects);
+        m_artObjectBounds.swap(other.m_artObjectBounds);
+        m_artObjectChunks.swap(other.m_artObjectChunks);
+        m_artObjectVisible.swap(other.m_artObjectVisible);
+        m_planePositions.swap(other.m_planePositions);
+        m_planeBounds.swap(other.m_planeBounds);
+        m_planeFlags.swap(other.m_planeFlags);
+        m_planeTextures.swap(other.m_planeTextures);
+        m_planeAnimations.swap(other.m_planeAnimations);
+        m_planeFrames.swap(other.m_planeFrames);
+        m_planeChunks.swap(other.m_planeChunks);
+        m_planeVisible.swap(other.m_planeVisible);
+        m_frameEnds.swap(other.m_frameEnds);
+        m_animatedPlanes.swap(other.m_animatedPlanes);
+        m_changedFrames.swap(other.m_changedFrames);
+    }
+
+private:
+
+    void SetBackgroundPlane(const uint32_t i, const BackgroundPlane& bp)
+    {
+        m_planePositions[i] = bp.m_pos;
+        m_planeBounds[i] = bp.GetBounds();
+        m_planeFlags[i] = (bp.m_doubleSided ? PLANE_FLAG_DOUBLE_SIDED : 0) |
+                          (bp.m_billboard ? PLANE_FLAG_BILLBOARD : 0) |
+                          (bp.m_lightmap ? PLANE_FLAG_LIGHTMAP : 0);
+        m_planeTextures[i] = bp.m_texture.get();
+
+        PlaneAnimation animation = { (uint32_t)m_frameEnds.size(), 0, bp.m_uniformDuration, bp.m_totalDuration };
+        if (bp.m_texIndices.size() > 1)
+        {
+            // Uniform timelines are pure arithmetic and don't need their frame ends
+            if (!bp.m_uniformDuration)
+            {
+                m_frameEnds.insert(m_frameEnds.end(), bp.m_frameEnds.begin(), bp.m_frameEnds.end());
+            }
+            animation.numFrameEnds = bp.m_frameEnds.size();
+            m_animatedPlanes.push_back(i);
+        }
+        m_planeAnimations[i] = animation;
+        m_planeFrames[i] = animation.numFrameEnds ? c_noFrame : 0;
+    }
+};
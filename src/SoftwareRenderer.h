@@ -0,0 +1,343 @@
+#pragma once
+
+#include "Common.h"
+#include "TextureCache.h"
+#include "WorkerPool.h"
+
+#define SOFTWARE_BAND_HEIGHT    16  // rows rasterized by one task
+
+enum SoftwareDrawFlags
+{
+    SOFTWARE_CULL_BACK  = 0x1,      // GL_CULL_FACE with the viewer's clockwise front faces
+    SOFTWARE_ADDITIVE   = 0x2       // glBlendFunc(GL_ONE, GL_ONE) as for lightmaps, otherwise alpha blended
+};
+
+// A Surface's pixels as the rasterizer samples them. Everything is point sampled, the viewer's textures
+// are nearest filtered apart from the smooth lightmaps.
+struct SoftwareTexture
+{
+    Surface         surface;        // keeps the pixels alive
+    const uint8_t*  pData;
+    int32_t         width;
+    int32_t         height;
+    int32_t         rowBytes;
+    uint8_t         pixelInc;
+    uint8_t         redOffset;
+    uint8_t         greenOffset;
+    uint8_t         blueOffset;
+    int8_t          alphaOffset;    // -1 without alpha
+    bool            repeatS;
+    bool            repeatT;
+};
+
+// Transformed and clipped, ready to rasterize
+struct SoftwareTriangle
+{
+    Vec3f       screen[3];      // x and y in pixels from the top left, z is depth in [0,1]
+    Vec3f       invW;           // per vertex, for perspective correct texcoords
+    Vec2f       texcoords[3];   // divided by w
+    uint32_t    texture;
+    uint32_t    flags;
+};
+
+// CPU rasterizer for rendering a loaded scene without a GL context, e.g. for thumbnails on machines
+// without a GPU. Follows the fixed function state the viewer draws with: depth test and write, alpha
+// blending with fully transparent texels discarded, clockwise front faces and a near plane clip.
+// Draw() transforms and bins triangles into horizontal bands on the calling thread, Resolve()
+// rasterizes the bands in parallel. Within a band triangles keep their submission order.
+class SoftwareRenderer
+{
+public:
+
+    SoftwareRenderer() :
+        m_width(0),
+        m_height(0)
+    {
+    }
+
+    void Begin(const int32_t width, const int32_t height, const Colorf& clearColor, const Matrix44f& viewProjection)
+    {
+        m_width = width;
+        m_height = height;
+        m_viewProjection = viewProjection;
+        m_color.assign(width * height, Vec3f(clearColor.r, clearColor.g, clearColor.b));
+        m_depth.assign(width * height, 1.f);
+        m_textures.clear();
+        m_textureIndices.clear();
+        m_triangles.clear();
+        m_bands.assign((height + SOFTWARE_BAND_HEIGHT - 1) / SOFTWARE_BAND_HEIGHT, vector<uint32_t>());
+    }
+
+    // Returns the index Draw() takes, surfaces shared by several objects are only added once
+    uint32_t AddTexture(const Surface& surface, const SamplerState& sampler)
+    {
+        const auto key = make_pair((const void*)surface.getData(), sampler.wrapS == GL_REPEAT || sampler.wrapT == GL_REPEAT);
+        const auto it = m_textureIndices.find(key);
+        if (it != m_textureIndices.end())
+        {
+            return it->second;
+        }
+
+        SoftwareTexture texture;
+        texture.surface = surface;
+        texture.pData = surface.getData();
+        texture.width = surface.getWidth();
+        texture.height = surface.getHeight();
+        texture.rowBytes = surface.getRowBytes();
+        texture.pixelInc = surface.getPixelInc();
+        texture.redOffset = surface.getRedOffset();
+        texture.greenOffset = surface.getGreenOffset();
+        texture.blueOffset = surface.getBlueOffset();
+        texture.alphaOffset = surface.hasAlpha() ? surface.getAlphaOffset() : -1;
+        texture.repeatS = sampler.wrapS == GL_REPEAT;
+        texture.repeatT = sampler.wrapT == GL_REPEAT;
+        m_textures.push_back(texture);
+        m_textureIndices.insert(make_pair(key, (uint32_t)m_textures.size() - 1));
+        return m_textures.size() - 1;
+    }
+
+    // Positions are offset into world space, texcoords are mapped by (texcoord + frame.zw) * frame.xy,
+    // the same texture transform the background planes use
+    void Draw(const vector<Vec3f>& positions, const vector<Vec2f>& texcoords, const vector<uint32_t>& indices,
+              const Vec3f& offset, const uint32_t texture, const Vec4f& frame, const uint32_t flags)
+    {
+        if (texcoords.size() != positions.size() || texture >= m_textures.size() || m_textures[texture].width == 0)
+        {
+            return;
+        }
+
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            ClipVertex triangle[3];
+            for (uint32_t v = 0; v < 3; v++)
+            {
+                const uint32_t index = indices[i + v];
+                triangle[v].clip = m_viewProjection * Vec4f(positions[index] + offset, 1.f);
+                triangle[v].texcoord = (texcoords[index] + Vec2f(frame.z, frame.w)) * Vec2f(frame.x, frame.y);
+            }
+
+            // Clip against the near plane, z >= -w, which leaves at most a quad
+            ClipVertex polygon[4];
+            uint32_t numVertices = 0;
+            for (uint32_t v = 0; v < 3; v++)
+            {
+                const ClipVertex& a = triangle[v];
+                const ClipVertex& b = triangle[(v + 1) % 3];
+                const float da = a.clip.z + a.clip.w;
+                const float db = b.clip.z + b.clip.w;
+                if (da >= 0.f)
+                {
+                    polygon[numVertices++] = a;
+                }
+                if ((da >= 0.f) != (db >= 0.f))
+                {
+                    const float t = da / (da - db);
+                    ClipVertex& clipped = polygon[numVertices++];
+                    clipped.clip = a.clip + (b.clip - a.clip) * t;
+                    clipped.texcoord = a.texcoord + (b.texcoord - a.texcoord) * t;
+                }
+            }
+            for (uint32_t v = 2; v < numVertices; v++)
+            {
+                AddTriangle(polygon[0], polygon[v - 1], polygon[v], texture, flags);
+            }
+        }
+    }
+
+    void Resolve(WorkerPool& workerPool)
+    {
+        workerPool.ParallelFor(m_bands.size(), [&](uint32_t band)
+        {
+            RasterizeBand(band);
+        });
+    }
+
+    Surface GetSurface() const
+    {
+        Surface surface(m_width, m_height, false);
+        uint8_t* pData = surface.getData();
+        const uint8_t pixelInc = surface.getPixelInc();
+        const uint8_t offsets[3] = { surface.getRedOffset(), surface.getGreenOffset(), surface.getBlueOffset() };
+        for (int32_t y = 0; y < m_height; y++)
+        {
+            uint8_t* pPixel = pData + y * surface.getRowBytes();
+            for (int32_t x = 0; x < m_width; x++, pPixel += pixelInc)
+            {
+                const Vec3f& color = m_color[y * m_width + x];
+                for (uint32_t c = 0; c < 3; c++)
+                {
+                    pPixel[offsets[c]] = (uint8_t)(math<float>::clamp(color[c], 0.f, 1.f) * 255.f + 0.5f);
+                }
+            }
+        }
+        return surface;
+    }
+
+    size_t GetNumTriangles() const
+    {
+        return m_triangles.size();
+    }
+
+private:
+
+    struct ClipVertex
+    {
+        Vec4f   clip;
+        Vec2f   texcoord;
+    };
+
+    int32_t                             m_width;
+    int32_t                             m_height;
+    Matrix44f                           m_viewProjection;
+    vector<Vec3f>                       m_color;
+    vector<float>                       m_depth;
+    vector<SoftwareTexture>             m_textures;
+    map<pair<const void*, bool>, uint32_t> m_textureIndices;
+    vector<SoftwareTriangle>            m_triangles;
+    vector<vector<uint32_t> >           m_bands;    // indices into m_triangles overlapping each band
+
+    static float Edge(const Vec3f& a, const Vec3f& b, const float x, const float y)
+    {
+        return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+    }
+
+    // Pixels exactly on an edge belong to the triangle on its top or left, so triangles sharing an edge
+    // don't blend it twice. With positive area in these window coordinates edges run clockwise on screen.
+    static bool IsTopLeft(const Vec3f& a, const Vec3f& b)
+    {
+        return (a.y == b.y && b.x < a.x) || b.y < a.y;
+    }
+
+    void AddTriangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, const uint32_t texture, const uint32_t flags)
+    {
+        const ClipVertex* vertices[3] = { &a, &b, &c };
+        SoftwareTriangle triangle;
+        for (uint32_t v = 0; v < 3; v++)
+        {
+            const Vec4f& clip = vertices[v]->clip;
+            const float invW = 1.f / clip.w;
+            triangle.screen[v] = Vec3f((clip.x * invW * 0.5f + 0.5f) * m_width,
+                                       (0.5f - clip.y * invW * 0.5f) * m_height,
+                                       clip.z * invW * 0.5f + 0.5f);
+            triangle.invW[v] = invW;
+            triangle.texcoords[v] = vertices[v]->texcoord * invW;
+        }
+
+        // Rows run down the screen, so clockwise front faces have positive area here
+        const float area = Edge(triangle.screen[0], triangle.screen[1], triangle.screen[2].x, triangle.screen[2].y);
+        if (area == 0.f || (area < 0.f && (flags & SOFTWARE_CULL_BACK)))
+        {
+            return;
+        }
+        if (area < 0.f)
+        {
+            swap(triangle.screen[1], triangle.screen[2]);
+            swap(triangle.invW[1], triangle.invW[2]);
+            swap(triangle.texcoords[1], triangle.texcoords[2]);
+        }
+        triangle.texture = texture;
+        triangle.flags = flags;
+
+        const float minX = min(triangle.screen[0].x, min(triangle.screen[1].x, triangle.screen[2].x));
+        const float maxX = max(triangle.screen[0].x, max(triangle.screen[1].x, triangle.screen[2].x));
+        const float minY = min(triangle.screen[0].y, min(triangle.screen[1].y, triangle.screen[2].y));
+        const float maxY = max(triangle.screen[0].y, max(triangle.screen[1].y, triangle.screen[2].y));
+        if (maxX < 0.f || minX >= m_width || maxY < 0.f || minY >= m_height)
+        {
+            return;
+        }
+
+        const int32_t firstBand = max(0, (int32_t)minY) / SOFTWARE_BAND_HEIGHT;
+        const int32_t lastBand = min(m_height - 1, (int32_t)maxY) / SOFTWARE_BAND_HEIGHT;
+        for (int32_t band = firstBand; band <= lastBand; band++)
+        {
+            m_bands[band].push_back(m_triangles.size());
+        }
+        m_triangles.push_back(triangle);
+    }
+
+    void RasterizeBand(const uint32_t band)
+    {
+        const int32_t bandMinY = band * SOFTWARE_BAND_HEIGHT;
+        const int32_t bandMaxY = min(m_height, bandMinY + SOFTWARE_BAND_HEIGHT) - 1;
+        for (const uint32_t index : m_bands[band])
+        {
+            const SoftwareTriangle& triangle = m_triangles[index];
+            const Vec3f& v0 = triangle.screen[0];
+            const Vec3f& v1 = triangle.screen[1];
+            const Vec3f& v2 = triangle.screen[2];
+            const SoftwareTexture& texture = m_textures[triangle.texture];
+            const bool additive = (triangle.flags & SOFTWARE_ADDITIVE) != 0;
+
+            const int32_t minX = max(0, (int32_t)math<float>::floor(min(v0.x, min(v1.x, v2.x))));
+            const int32_t maxX = min(m_width - 1, (int32_t)math<float>::ceil(max(v0.x, max(v1.x, v2.x))));
+            const int32_t minY = max(bandMinY, (int32_t)math<float>::floor(min(v0.y, min(v1.y, v2.y))));
+            const int32_t maxY = min(bandMaxY, (int32_t)math<float>::ceil(max(v0.y, max(v1.y, v2.y))));
+            const float invArea = 1.f / Edge(v0, v1, v2.x, v2.y);
+            const bool topLeft[3] = { IsTopLeft(v1, v2), IsTopLeft(v2, v0), IsTopLeft(v0, v1) };
+
+            for (int32_t y = minY; y <= maxY; y++)
+            {
+                const float py = y + 0.5f;
+                for (int32_t x = minX; x <= maxX; x++)
+                {
+                    const float px = x + 0.5f;
+                    const float w[3] = { Edge(v1, v2, px, py), Edge(v2, v0, px, py), Edge(v0, v1, px, py) };
+                    if (!Covers(w[0], topLeft[0]) || !Covers(w[1], topLeft[1]) || !Covers(w[2], topLeft[2]))
+                    {
+                        continue;
+                    }
+
+                    const float b0 = w[0] * invArea;
+                    const float b1 = w[1] * invArea;
+                    const float b2 = w[2] * invArea;
+                    const uint32_t pixel = y * m_width + x;
+                    const float depth = b0 * v0.z + b1 * v1.z + b2 * v2.z;
+                    if (depth >= m_depth[pixel])
+                    {
+                        continue;
+                    }
+
+                    const float perspective = 1.f / (b0 * triangle.invW.x + b1 * triangle.invW.y + b2 * triangle.invW.z);
+                    const Vec2f texcoord = (triangle.texcoords[0] * b0 + triangle.texcoords[1] * b1 + triangle.texcoords[2] * b2) * perspective;
+                    Vec3f color;
+                    float alpha;
+                    Sample(texture, texcoord, &color, &alpha);
+                    if (additive)
+                    {
+                        m_color[pixel] += color;
+                    }
+                    else if (alpha > 0.f)
+                    {
+                        m_color[pixel] = color * alpha + m_color[pixel] * (1.f - alpha);
+                    }
+                    else
+                    {
+                        continue;
+                    }
+                    m_depth[pixel] = depth;
+                }
+            }
+        }
+    }
+
+    static bool Covers(const float w, const bool topLeft)
+    {
+        return w > 0.f || (w == 0.f && topLeft);
+    }
+
+    static int32_t Wrap(const float coord, const int32_t size, const bool repeat)
+    {
+        const float wrapped = repeat ? coord - math<float>::floor(coord) : math<float>::clamp(coord, 0.f, 1.f);
+        return min(size - 1, (int32_t)(wrapped * size));
+    }
+
+    static void Sample(const SoftwareTexture& texture, const Vec2f& texcoord, Vec3f* pColor, float* pAlpha)
+    {
+        const int32_t x = Wrap(texcoord.x, texture.width, texture.repeatS);
+        const int32_t y = Wrap(texcoord.y, texture.height, texture.repeatT);
+        const uint8_t* pPixel = texture.pData + y * texture.rowBytes + x * texture.pixelInc;
+        *pColor = Vec3f(pPixel[texture.redOffset], pPixel[texture.greenOffset], pPixel[texture.blueOffset]) / 255.f;
+        *pAlpha = texture.alphaOffset < 0 ? 1.f : pPixel[texture.alphaOffset] / 255.f;
+    }
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Common.h"
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread. Each side only
+// writes its own index, the release store of an index publishes the slot it passed over.
+// Push() swaps the item in and leaves the producer a default one, so with a shared_ptr the last
+// reference is dropped on the consumer's thread.
+template<typename T, size_t Capacity>
+class SpscQueue
+{
+public:
+
+    SpscQueue() :
+        m_head(0),
+        m_tail(0)
+    {
+    }
+
+    // Producer only, returns false without waiting or taking the item when the queue is full
+    bool Push(T& item)
+    {
+        const size_t tail = m_tail.load(memory_order_relaxed);
+        const size_t next = (tail + 1) % (Capacity + 1);
+        if (next == m_head.load(memory_order_acquire))
+        {
+            return false;
+        }
+        swap(m_slots[tail], item);
+        m_tail.store(next, memory_order_release);
+        return true;
+    }
+
+    // Consumer only, returns false without waiting when the queue is empty
+    bool Pop(T* pItem)
+    {
+        const size_t head = m_head.load(memory_order_relaxed);
+        if (head == m_tail.load(memory_order_acquire))
+        {
+            return false;
+        }
+        *pItem = m_slots[head];
+        m_slots[head] = T();
+        m_head.store((head + 1) % (Capacity + 1), memory_order_release);
+        return true;
+    }
+
+    // Exact on the consumer's thread, possibly stale on the producer's
+    bool IsEmpty() const
+    {
+        return m_head.load(memory_order_acquire) == m_tail.load(memory_order_acquire);
+    }
+
+private:
+
+    T               m_slots[Capacity + 1];  // one more than the capacity, so full and empty differ
+    atomic<size_t>  m_head;                 // next slot to pop, written by the consumer
+    atomic<size_t>  m_tail;                 // next slot to push, written by the producer
+
+    SpscQueue(const SpscQueue&);
+    SpscQueue& operator=(const SpscQueue&);
+};
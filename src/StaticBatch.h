@@ -0,0 +1,217 @@
+#pragma once
+
+#include "Common.h"
+#include "cinder/gl/Vbo.h"
+#include "Trile.h"
+#include "SceneChunks.h"
+#include "CompactMesh.h"
+#include "FrameProfiler.h"
+
+#define STATIC_BATCH_MAX_VERTICES (1 << 20)   // keeps every chunk well inside a 32-bit index range
+
+// Merges the whole (static) trile layer of a level into large world-space meshes, one or more per scene chunk
+// so they can be frustum culled. Build() is plain CPU code meant for the loader thread, Draw() uploads and
+// draws on the GL thread. Compact() optionally swaps the float chunks for quantized ones.
+class StaticBatch
+{
+public:
+
+    deque<TriMesh>      m_chunks;
+    deque<CompactMesh>  m_compactChunks;    // per chunk after Compact(), empty where a chunk stayed float
+    vector<Bounds>      m_bounds;       // per chunk
+    vector<gl::VboMesh> m_vboMeshes;
+    uint32_t            m_maxVertices;
+    uint32_t            m_numTriles;    // source triles merged, including any without geometry
+    uint32_t            m_numDrawnChunks;
+
+    StaticBatch(const uint32_t maxVertices = STATIC_BATCH_MAX_VERTICES) :
+        m_maxVertices(maxVertices),
+        m_numTriles(0),
+        m_numDrawnChunks(0)
+    {
+    }
+
+    // pHiddenSides optionally holds a TrileCulling mask per trile, faces on those sides are left out
+    template<typename TrileContainer>
+    void Build(const TrileContainer& triles, const vector<uint8_t>* pHiddenSides = nullptr)
+    {
+        Clear();
+
+        // Visit the triles scene chunk by scene chunk, a batch chunk never spans two of them
+        vector<pair<uint64_t, uint32_t> > order;
+        order.reserve(triles.size());
+        for (const Trile& trile : triles)
+        {
+            order.push_back(make_pair(SceneChunks::GetChunkKey(trile.GetBounds().GetCenter()), (uint32_t)order.size()));
+        }
+        sort(order.begin(), order.end());
+        m_numTriles = order.size();
+
+        uint64_t chunkKey = 0;
+        for (const auto& entry : order)
+        {
+            const Trile& trile = triles[entry.second];
+            const uint8_t hiddenSides = pHiddenSides ? (*pHiddenSides)[entry.second] : 0;
+            const TriMesh& mesh = trile.m_pGeometry->meshes[trile.m_orient];
+            const size_t numVertices = mesh.getNumVertices();
+            if (numVertices == 0)
+            {
+                continue;
+            }
+            ASSERT(numVertices <= m_maxVertices);
+
+            if (m_chunks.empty() || entry.first != chunkKey || m_chunks.back().getNumVertices() + numVertices > m_maxVertices)
+            {
+                m_chunks.push_back(TriMesh());
+                m_bounds.push_back(Bounds());
+                chunkKey = entry.first;
+            }
+            AppendTrile(trile, mesh, trile.m_pGeometry->faces[trile.m_orient], hiddenSides, &m_chunks.back());
+            m_bounds.back().Include(trile.GetBounds());
+        }
+    }
+
+    // Must be called on the GL thread
+    void Draw(const gl::Texture& texture, const Frustum& frustum = Frustum())
+    {
+        m_numDrawnChunks = 0;
+        if (m_vboMeshes.size() != m_chunks.size())
+        {
+            m_vboMeshes.clear();
+            for (const TriMesh& chunk : m_chunks)
+            {
+                m_vboMeshes.push_back(chunk.getNumVertices() > 0 ? gl::VboMesh(chunk) : gl::VboMesh());
+            }
+        }
+
+        texture.enableAndBind();
+        FrameProfiler::CountStateChanges(1);
+        for (size_t i = 0; i < m_vboMeshes.size(); i++)
+        {
+            if (frustum.Intersects(m_bounds[i]))
+            {
+                if (IsCompact(i))
+                {
+                    m_compactChunks[i].Draw();
+                    FrameProfiler::CountDraw(m_compactChunks[i].m_indices.size() / 3);
+                }
+                else
+                {
+                    gl::draw(m_vboMeshes[i]);
+                    FrameProfiler::CountDraw(m_chunks[i].getNumTriangles());
+                }
+                m_numDrawnChunks++;
+            }
+        }
+        texture.disable();
+        texture.unbind();
+    }
+
+    uint32_t GetNumVertices() const
+    {
+        uint32_t numVertices = 0;
+        for (const TriMesh& chunk : m_chunks)
+        {
+            numVertices += chunk.getNumVertices();
+        }
+        for (const CompactMesh& chunk : m_compactChunks)
+        {
+            numVertices += chunk.GetNumVertices();
+        }
+        return numVertices;
+    }
+
+    // Resident bytes of the vertex data
+    size_t GetVertexBytes() const
+    {
+        size_t bytes = 0;
+        for (const TriMesh& chunk : m_chunks)
+        {
+            bytes += CompactMesh::GetFloatVertexBytes(chunk.getNumVertices());
+        }
+        for (const CompactMesh& chunk : m_compactChunks)
+        {
+            bytes += chunk.GetVertexBytes();
+        }
+        return bytes;
+    }
+
+    // Replaces every chunk a CompactMesh can represent, returns how many were replaced
+    uint32_t Compact()
+    {
+        uint32_t numCompact = 0;
+        m_compactChunks.resize(m_chunks.size());
+        for (size_t i = 0; i < m_chunks.size(); i++)
+        {
+            if (m_compactChunks[i].Build(m_chunks[i]))
+            {
+                numCompact++;
+                m_chunks[i] = TriMesh();
+            }
+        }
+        m_vboMeshes.clear();
+        return numCompact;
+    }
+
+    bool IsCompact(const size_t chunk) const
+    {
+        return chunk < m_compactChunks.size() && !m_compactChunks[chunk].IsEmpty();
+    }
+
+    void Clear()
+    {
+        m_chunks.clear();
+        m_compactChunks.clear();
+        m_bounds.clear();
+        m_vboMeshes.clear();
+        m_numTriles = 0;
+        m_numDrawnChunks = 0;
+    }
+
+    void Swap(StaticBatch& other)
+    {
+        m_chunks.swap(other.m_chunks);
+        m_compactChunks.swap(other.m_compactChunks);
+        m_bounds.swap(other.m_bounds);
+        m_vboMeshes.swap(other.m_vboMeshes);
+        swap(m_maxVertices, other.m_maxVertices);
+        swap(m_numTriles, other.m_numTriles);
+        swap(m_numDrawnChunks, other.m_numDrawnChunks);
+    }
+
+private:
+
+    static void AppendTrile(const Trile& trile, const TriMesh& mesh, const TrileFaces& faces, const uint8_t hiddenSides, TriMesh* pChunk)
+    {
+        const vector<Vec3f>& positions = mesh.getVertices();
+        const vector<Vec3f>& normals = mesh.getNormals();
+        const vector<Vec2f>& texcoords = mesh.getTexCoords();
+        const vector<uint32_t>& indices = mesh.getIndices();
+
+        // Only copy the vertices still referenced by a visible triangle
+        vector<uint32_t> remap(positions.size(), UINT32_MAX);
+        for (size_t tri = 0; tri < indices.size() / 3; tri++)
+        {
+            const uint8_t side = faces.triangleSides[tri];
+            if (side != TRILE_SIDE_NONE && (hiddenSides & (1 << side)))
+            {
+                continue;
+            }
+
+            uint32_t triIndices[3];
+            for (uint32_t corner = 0; corner < 3; corner++)
+            {
+                const uint32_t index = indices[tri * 3 + corner];
+                if (remap[index] == UINT32_MAX)
+                {
+                    remap[index] = pChunk->getNumVertices();
+                    pChunk->appendVertex(positions[index] + trile.m_pos);
+                    pChunk->appendNormal(normals[index]);
+                    pChunk->appendTexCoord(texcoords[index]);
+                }
+                triIndices[corner] = remap[index];
+            }
+            pChunk->appendTriangle(triIndices[0], triIndices[1], triIndices[2]);
+        }
+    }
+};
@@ -0,0 +1,236 @@
+#pragma once
+
+#include "Common.h"
+#include "ImageCache.h"
+#include "FrameProfiler.h"
+
+struct SamplerState
+{
+    GLenum minFilter;
+    GLenum magFilter;
+    GLenum wrapS;
+    GLenum wrapT;
+
+    SamplerState(GLenum filter = GL_NEAREST, GLenum wrapS = GL_CLAMP, GLenum wrapT = GL_CLAMP) :
+        minFilter(filter),
+        magFilter(filter),
+        wrapS(wrapS),
+        wrapT(wrapT)
+    {
+    }
+
+    bool operator<(const SamplerState& rhs) const
+    {
+        if (minFilter != rhs.minFilter) { return minFilter < rhs.minFilter; }
+        if (magFilter != rhs.magFilter) { return magFilter < rhs.magFilter; }
+        if (wrapS != rhs.wrapS) { return wrapS < rhs.wrapS; }
+        return wrapT < rhs.wrapT;
+    }
+};
+
+// One decoded image plus the GL texture created from it for a given sampler state.
+// The GL texture is created lazily by the first draw, so entries can be built on loader threads.
+class TextureEntry
+{
+public:
+
+    fs::path        m_path;
+    Surface         m_surface;
+    SamplerState    m_sampler;
+    gl::Texture     m_texture;
+
+    TextureEntry(const fs::path& path, const Surface& surface, const SamplerState& sampler) :
+        m_path(path),
+        m_surface(surface),
+        m_sampler(sampler),
+        m_translucent(-1)
+    {
+    }
+
+    // Has texels that are neither fully transparent nor opaque. Only background planes ask, so the pixels are
+    // scanned by the first query instead of on every Acquire(), which holds the registry lock.
+    // Thread safe, two threads asking at once both scan and store the same answer.
+    bool IsTranslucent() const
+    {
+        int translucent = m_translucent;
+        if (translucent < 0)
+        {
+            translucent = IsTranslucent(m_surface) ? 1 : 0;
+            m_translucent = translucent;
+        }
+        return translucent != 0;
+    }
+
+    // Alpha testing only discards fully transparent texels, anything in between needs blending in depth order
+    static bool IsTranslucent(const Surface& surface)
+    {
+        if (!surface || !surface.hasAlpha())
+        {
+            return false;
+        }
+
+        const uint8_t* pRow = surface.getData() + surface.getAlphaOffset();
+        for (int32_t y = 0; y < surface.getHeight(); y++, pRow += surface.getRowBytes())
+        {
+            const uint8_t* pAlpha = pRow;
+            for (int32_t x = 0; x < surface.getWidth(); x++, pAlpha += surface.getPixelInc())
+            {
+                if (*pAlpha != 0 && *pAlpha != 255)
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Must be called on the GL thread
+    const gl::Texture& GetTexture()
+    {
+        if (!m_texture)
+        {
+            gl::Texture::Format format;
+            format.setMinFilter(m_sampler.minFilter);
+            format.setMagFilter(m_sampler.magFilter);
+            format.setWrap(m_sampler.wrapS, m_sampler.wrapT);
+            m_texture = gl::Texture(m_surface, format);
+            FrameProfiler::CountTextureUpload();
+        }
+        return m_texture;
+    }
+
+private:
+
+    mutable atomic<int>     m_translucent;  // -1 until IsTranslucent() is first asked
+};
+
+typedef shared_ptr<TextureEntry> TextureRef;
+
+struct TextureCacheStats
+{
+    uint32_t    hits;
+    uint32_t    misses;
+    uint32_t    numTextures;        // live entries
+    size_t      residentCpuBytes;   // unique decoded surfaces referenced by live entries
+    size_t      residentGpuBytes;   // GL textures created so far
+};
+
+// Registry of textures keyed by resolved .png path and sampler state.
+// Objects hold a TextureRef, the entry is released with the last reference.
+class TextureCache
+{
+public:
+
+    static TextureCache s_cache;
+
+    TextureCache() :
+        m_hits(0),
+        m_misses(0)
+    {
+    }
+
+    // Thread safe
+    TextureRef Acquire(const fs::path& png, const SamplerState& sampler)
+    {
+        const auto key = make_pair(png.string(), sampler);
+        {
+            lock_guard<mutex> lock( m_mutex );
+            const auto it = m_entries.find(key);
+            if (it != m_entries.end())
+            {
+                TextureRef pEntry = it->second.lock();
+                if (pEntry)
+                {
+                    m_hits++;
+                    return pEntry;
+                }
+            }
+        }
+
+        // Decode outside the registry lock, the surface cache serializes decodes of the same path
+        const Surface surface = SurfaceCache::s_cache.Load(png);
+
+        lock_guard<mutex> lock( m_mutex );
+        weak_ptr<TextureEntry>& weakEntry = m_entries[key];
+        TextureRef pEntry = weakEntry.lock();
+        if (pEntry)
+        {
+            m_hits++;
+        }
+        else
+        {
+            pEntry = TextureRef(new TextureEntry(png, surface, sampler));
+            weakEntry = pEntry;
+            m_misses++;
+        }
+        return pEntry;
+    }
+
+    // For images that don't come from a file, these are not shared
+    static TextureRef Wrap(const Surface& surface, const SamplerState& sampler)
+    {
+        return TextureRef(new TextureEntry(fs::path(), surface, sampler));
+    }
+
+    // For a .png that changed on disk, the next Acquire() of it creates a new entry from the new pixels.
+    // Objects holding the old entry keep drawing it until they are reloaded.
+    void Invalidate(const fs::path& png)
+    {
+        SurfaceCache::s_cache.Invalidate(png);
+        lock_guard<mutex> lock( m_mutex );
+        for (auto it = m_entries.begin(); it != m_entries.end(); )
+        {
+            if (it->first.first == png.string())
+            {
+                m_entries.erase(it++);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    TextureCacheStats GetStats()
+    {
+        lock_guard<mutex> lock( m_mutex );
+        TextureCacheStats stats = { m_hits, m_misses, 0, 0, 0 };
+        set<const void*> surfaces;
+        for (auto it = m_entries.begin(); it != m_entries.end(); )
+        {
+            TextureRef pEntry = it->second.lock();
+            if (!pEntry)
+            {
+                m_entries.erase(it++);
+                continue;
+            }
+
+            const Surface& surface = pEntry->m_surface;
+            stats.numTextures++;
+            if (surfaces.insert(surface.getData()).second)
+            {
+                stats.residentCpuBytes += surface.getRowBytes() * surface.getHeight();
+            }
+            if (pEntry->m_texture)
+            {
+                stats.residentGpuBytes += pEntry->m_texture.getWidth() * pEntry->m_texture.getHeight() * 4;
+            }
+            ++it;
+        }
+        return stats;
+    }
+
+    void ResetStats()
+    {
+        lock_guard<mutex> lock( m_mutex );
+        m_hits = 0;
+        m_misses = 0;
+    }
+
+private:
+
+    mutex                                                       m_mutex;
+    map<pair<string, SamplerState>, weak_ptr<TextureEntry>>     m_entries;
+    uint32_t                                                    m_hits;
+    uint32_t                                                    m_misses;
+};
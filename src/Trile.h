@@ -1,64 +1,53 @@
 #pragma once
 
 #include "Common.h"
+#include "TrileSet.h"
+#include "FrameProfiler.h"
 
 class Trile
 {
 public:
-    
-    TriMesh m_mesh;
+
+    uint32_t m_key;
+    Vec3f m_pos;
+    uint32_t m_orient;
+    Vec3f m_emplacement;
+    const TrileGeometry* m_pGeometry;
     static gl::Texture* s_pTexture;
 
-    Trile(const XmlTree& trileXml, const Vec3f& trilePos, const uint32_t trileOrient, const Vec3f& trileEmplacement, const Vec3f& offset)
+    Trile(const TrileGeometry* pGeometry, const uint32_t key, const Vec3f& trilePos, const uint32_t trileOrient, const Vec3f& trileEmplacement, const Vec3f& offset) :
+        m_key(key),
+        m_pos(trilePos + offset),
+        m_orient(trileOrient),
+        m_emplacement(trileEmplacement),    // TODO: how to use trileEmplacement?
+        m_pGeometry(pGeometry)
     {
-        vector<Vec3f> positions;
-        vector<Vec3f> normals;
-        vector<Vec2f> texcoords;
-        vector<uint32_t> indices;
-        XmlTree xmlVertices = trileXml.getChild("Trile/Geometry/ShaderInstancedIndexedPrimitives/Vertices");
-    
-        for (const auto& vertex : xmlVertices)
-        {
-            XmlTree posXml = vertex.getChild("Position/Vector3");
-            Vec3f pos = Vec3f(posXml["x"].getValue<float>(),
-                              posXml["y"].getValue<float>(),
-                              posXml["z"].getValue<float>());
-            // TODO: how to use trileEmplacement?
-            pos = pos * gc_orientations[trileOrient];
-            pos += trilePos + offset;
-            positions.push_back(pos);
-        
-            const XmlTree& normXml = vertex.getChild("Normal");
-            normals.push_back(gc_normals[normXml.getValue<int>()]);
-        
-            const XmlTree& coordXml = vertex.getChild("TextureCoord/Vector2");
-            texcoords.push_back(Vec2f(coordXml["x"].getValue<float>(),
-                                      coordXml["y"].getValue<float>()));
-        }
-
-        m_mesh.appendVertices(&positions[0], positions.size());
-        m_mesh.appendNormals(&normals[0], normals.size());
-        m_mesh.appendTexCoords(&texcoords[0], texcoords.size());
-    
-        const XmlTree& xmlIndices = trileXml.getChild("Trile/Geometry/ShaderInstancedIndexedPrimitives/Indices");
-        for (const auto& index : xmlIndices)
-        {
-            indices.push_back(index.getValue<uint32_t>());
-        }
-        m_mesh.appendIndices(&indices[0], indices.size());
+        ASSERT(m_pGeometry);
+        ASSERT(m_orient < NUM_ORIENTATIONS);
     }
-    
+
     ~Trile()
     {
 
     }
 
+    Bounds GetBounds() const
+    {
+        const Bounds& bounds = m_pGeometry->bounds[m_orient];
+        return bounds.IsEmpty() ? bounds : Bounds(bounds.min + m_pos, bounds.max + m_pos);
+    }
+
     void Draw()
     {
         if (s_pTexture)
         {
             s_pTexture->enableAndBind();
-            gl::draw(m_mesh);
+            gl::pushModelView();
+            gl::translate(m_pos);
+            gl::draw(m_pGeometry->meshes[m_orient]);
+            gl::popModelView();
+            FrameProfiler::CountStateChanges(1);
+            FrameProfiler::CountDraw(m_pGeometry->meshes[m_orient].getNumTriangles());
             s_pTexture->disable();
             s_pTexture->unbind();
         }
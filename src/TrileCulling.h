@@ -0,0 +1,134 @@
+#pragma once
+
+#include "Common.h"
+#include "Trile.h"
+#include <unordered_map>
+
+#define TRILE_GRID_TOLERANCE    0.001f  // how far a trile may sit from the level's grid and still fill its cell
+
+// Finds the trile faces that are pressed against a closed side of a neighbouring trile and can never be seen.
+// Plain CPU code, the result is a mask of hidden sides per trile that the static batch and greedy mesh skip
+// when merging. Instanced triles all draw their key's shared mesh, so they keep every face.
+class TrileCulling
+{
+public:
+
+    vector<uint8_t>     m_hiddenSides;      // per trile, in container order, bit per gc_normals side
+    uint32_t            m_numTriangles;     // before culling
+    uint32_t            m_numHiddenTriangles;
+
+    TrileCulling() :
+        m_numTriangles(0),
+        m_numHiddenTriangles(0)
+    {
+    }
+
+    template<typename TrileContainer>
+    void Build(const TrileContainer& triles)
+    {
+        m_hiddenSides.assign(triles.size(), 0);
+        m_numTriangles = 0;
+        m_numHiddenTriangles = 0;
+
+        // Index the closed sides of every occupied grid cell, overlapped triles share a cell.
+        // Triles placed off the grid the others share don't fill their cell, they neither hide nor get hidden.
+        const Vec3f gridOffset = FindGridOffset(triles);
+        unordered_map<uint64_t, uint8_t> closedCells;
+        for (const Trile& trile : triles)
+        {
+            if (IsOnGrid(trile, gridOffset))
+            {
+                closedCells[CellKey(GetCell(trile))] |= trile.m_pGeometry->faces[trile.m_orient].closedSides;
+            }
+        }
+
+        uint32_t i = 0;
+        for (const Trile& trile : triles)
+        {
+            const TrileFaces& faces = trile.m_pGeometry->faces[trile.m_orient];
+            m_numTriangles += faces.triangleSides.size();
+            if (!IsOnGrid(trile, gridOffset))
+            {
+                i++;
+                continue;
+            }
+
+            const Vec3i cell = GetCell(trile);
+            for (uint8_t side = 0; side < NUM_TRILE_SIDES; side++)
+            {
+                if (faces.numTriangles[side] == 0)
+                {
+                    continue;
+                }
+
+                const auto it = closedCells.find(CellKey(cell + GetSideOffset(side)));
+                const uint8_t opposite = (side + 3) % NUM_TRILE_SIDES;
+                if (it != closedCells.end() && (it->second & (1 << opposite)))
+                {
+                    m_hiddenSides[i] |= 1 << side;
+                    m_numHiddenTriangles += faces.numTriangles[side];
+                }
+            }
+            i++;
+        }
+    }
+
+    void Clear()
+    {
+        m_hiddenSides.clear();
+        m_numTriangles = 0;
+        m_numHiddenTriangles = 0;
+    }
+
+    static Vec3i GetCell(const Trile& trile)
+    {
+        return Vec3i((int)floor(trile.m_emplacement.x + 0.5f),
+                     (int)floor(trile.m_emplacement.y + 0.5f),
+                     (int)floor(trile.m_emplacement.z + 0.5f));
+    }
+
+    // Where a trile sits relative to its cell, the same for every trile on the level's grid
+    static Vec3f GetGridOffset(const Trile& trile)
+    {
+        const Vec3i cell = GetCell(trile);
+        return trile.m_pos - Vec3f((float)cell.x, (float)cell.y, (float)cell.z);
+    }
+
+    // The offset most triles share, rounded to the tolerance. Any one trile may be off the grid, the first included.
+    template<typename TrileContainer>
+    static Vec3f FindGridOffset(const TrileContainer& triles)
+    {
+        unordered_map<uint64_t, uint32_t> counts;
+        Vec3i gridOffset(0, 0, 0);
+        uint32_t maxCount = 0;
+        for (const Trile& trile : triles)
+        {
+            const Vec3f offset = GetGridOffset(trile) / TRILE_GRID_TOLERANCE;
+            const Vec3i rounded((int)floor(offset.x + 0.5f), (int)floor(offset.y + 0.5f), (int)floor(offset.z + 0.5f));
+            const uint32_t count = ++counts[CellKey(rounded)];
+            if (count > maxCount)
+            {
+                maxCount = count;
+                gridOffset = rounded;
+            }
+        }
+        return Vec3f((float)gridOffset.x, (float)gridOffset.y, (float)gridOffset.z) * TRILE_GRID_TOLERANCE;
+    }
+
+    static bool IsOnGrid(const Trile& trile, const Vec3f& gridOffset)
+    {
+        return GetGridOffset(trile).distanceSquared(gridOffset) <= TRILE_GRID_TOLERANCE * TRILE_GRID_TOLERANCE;
+    }
+
+    static Vec3i GetSideOffset(const uint8_t side)
+    {
+        const Vec3f& normal = gc_normals[side];
+        return Vec3i((int)normal.x, (int)normal.y, (int)normal.z);
+    }
+
+    // Levels are far smaller than 2^21 cells on any axis
+    static uint64_t CellKey(const Vec3i& cell)
+    {
+        return ((uint64_t)(cell.x & 0x1FFFFF) << 42) | ((uint64_t)(cell.y & 0x1FFFFF) << 21) | (uint64_t)(cell.z & 0x1FFFFF);
+    }
+};
@@ -0,0 +1,173 @@
+#pragma once
+
+#include "Common.h"
+#include "Trile.h"
+#include "SceneStore.h"
+
+// A run of trile instances sharing the same geometry and orientation, drawn with a single instanced call
+struct TrileInstanceGroup
+{
+    uint32_t                key;
+    uint32_t                orient;
+    const TrileGeometry*    pGeometry;
+    uint32_t                firstInstance;  // into TrileInstanceGroups::m_offsets
+    uint32_t                numInstances;
+};
+
+// Groups trile instances by (key, orientation) and builds the per-instance offset buffer.
+// This is plain CPU code with no GL calls, the upload and draw live in TrileRenderer.
+class TrileInstanceGroups
+{
+public:
+
+    vector<TrileInstanceGroup>  m_groups;
+    vector<Vec3f>               m_offsets;  // contiguous per group, in the order the instances were placed
+    uint32_t                    m_numInstances;
+
+    TrileInstanceGroups() :
+        m_numInstances(0)
+    {
+    }
+
+    template<typename TrileContainer>
+    void Build(const TrileContainer& triles)
+    {
+        Clear();
+        for (const Trile& trile : triles)
+        {
+            AddGroup(trile.m_key, trile.m_orient, trile.m_pGeometry);
+        }
+        SortGroups();
+        for (const Trile& trile : triles)
+        {
+            m_groups[GetGroupIndex(trile.m_key, trile.m_orient)].numInstances++;
+        }
+        AssignRanges();
+        for (const Trile& trile : triles)
+        {
+            PlaceInstance(trile.m_key, trile.m_orient, trile.m_pos);
+        }
+    }
+
+    // Only the triles whose flag is set in visible, walked in place
+    template<typename TrileContainer>
+    void Build(const TrileContainer& triles, const vector<uint8_t>& visible)
+    {
+        Clear();
+        for (size_t i = 0; i < triles.size(); i++)
+        {
+            if (visible[i])
+            {
+                AddGroup(triles[i].m_key, triles[i].m_orient, triles[i].m_pGeometry);
+            }
+        }
+        SortGroups();
+        for (size_t i = 0; i < triles.size(); i++)
+        {
+            if (visible[i])
+            {
+                m_groups[GetGroupIndex(triles[i].m_key, triles[i].m_orient)].numInstances++;
+            }
+        }
+        AssignRanges();
+        for (size_t i = 0; i < triles.size(); i++)
+        {
+            if (visible[i])
+            {
+                PlaceInstance(triles[i].m_key, triles[i].m_orient, triles[i].m_pos);
+            }
+        }
+    }
+
+    // The same grouping of only the visible triles in the store, read straight from its arrays
+    void Build(const SceneStore& store)
+    {
+        Clear();
+        m_visible.clear();
+        for (uint32_t i = 0; i < store.GetNumTriles(); i++)
+        {
+            if (store.m_trileVisible[i])
+            {
+                m_visible.push_back(i);
+            }
+        }
+
+        for (const uint32_t i : m_visible)
+        {
+            AddGroup(store.m_trileKeys[i], store.m_trileOrients[i], store.m_trileGeometry[i]);
+        }
+        SortGroups();
+        for (const uint32_t i : m_visible)
+        {
+            m_groups[GetGroupIndex(store.m_trileKeys[i], store.m_trileOrients[i])].numInstances++;
+        }
+        AssignRanges();
+        for (const uint32_t i : m_visible)
+        {
+            PlaceInstance(store.m_trileKeys[i], store.m_trileOrients[i], store.m_trilePositions[i]);
+        }
+    }
+
+    void Clear()
+    {
+        m_groups.clear();
+        m_offsets.clear();
+        m_numInstances = 0;
+        m_groupIndices.clear();
+    }
+
+private:
+
+    map<pair<uint32_t, uint32_t>, uint32_t> m_groupIndices;    // (key, orientation) to index into m_groups
+    vector<uint32_t>                        m_visible;         // store indices, reused between builds
+
+    void AddGroup(const uint32_t key, const uint32_t orient, const TrileGeometry* pGeometry)
+    {
+        const auto groupKey = make_pair(key, orient);
+        if (m_groupIndices.find(groupKey) == m_groupIndices.end())
+        {
+            m_groupIndices.insert(make_pair(groupKey, 0));
+            TrileInstanceGroup group = { key, orient, pGeometry, 0, 0 };
+            m_groups.push_back(group);
+        }
+    }
+
+    // Orders the groups by key then orientation
+    void SortGroups()
+    {
+        sort(m_groups.begin(), m_groups.end(), [](const TrileInstanceGroup& a, const TrileInstanceGroup& b)
+        {
+            return a.key != b.key ? a.key < b.key : a.orient < b.orient;
+        });
+        for (uint32_t i = 0; i < m_groups.size(); i++)
+        {
+            m_groupIndices[make_pair(m_groups[i].key, m_groups[i].orient)] = i;
+        }
+    }
+
+    uint32_t GetGroupIndex(const uint32_t key, const uint32_t orient) const
+    {
+        return m_groupIndices.find(make_pair(key, orient))->second;
+    }
+
+    // Gives each counted group its range of the offset buffer, ready for PlaceInstance()
+    void AssignRanges()
+    {
+        uint32_t first = 0;
+        for (TrileInstanceGroup& group : m_groups)
+        {
+            group.firstInstance = first;
+            first += group.numInstances;
+            group.numInstances = 0;
+        }
+        m_offsets.resize(first);
+        m_numInstances = first;
+    }
+
+    void PlaceInstance(const uint32_t key, const uint32_t orient, const Vec3f& pos)
+    {
+        TrileInstanceGroup& group = m_groups[GetGroupIndex(key, orient)];
+        m_offsets[group.firstInstance + group.numInstances] = pos;
+        group.numInstances++;
+    }
+};
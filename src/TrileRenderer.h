@@ -0,0 +1,140 @@
+#pragma once
+
+#include "Common.h"
+#include "cinder/gl/Vbo.h"
+#include "cinder/gl/GlslProg.h"
+#include "TrileInstancing.h"
+#include "FrameProfiler.h"
+
+// The instance offset is added in trile space, the orientation is already baked into each group's mesh
+static const char* c_trileInstanceVert =
+    "#version 120\n"
+    "attribute vec3 instanceOffset;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+    "    gl_FrontColor = gl_Color;\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * vec4(gl_Vertex.xyz + instanceOffset, 1.0);\n"
+    "}\n";
+
+static const char* c_trileInstanceFrag =
+    "#version 120\n"
+    "uniform sampler2D tex;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_FragColor = texture2D(tex, gl_TexCoord[0].st) * gl_Color;\n"
+    "}\n";
+
+class TrileRenderer
+{
+public:
+
+    gl::GlslProg                    m_shader;
+    GLint                           m_offsetAttrib;
+    gl::Vbo                         m_instanceVbo;
+    map<const TriMesh*, gl::VboMesh> m_vboMeshes;
+    bool                            m_supported;
+    uint32_t                        m_numDrawCalls;
+
+    TrileRenderer() :
+        m_offsetAttrib(-1),
+        m_supported(false),
+        m_numDrawCalls(0)
+    {
+    }
+
+    // Must be called with the GL context current
+    void Setup()
+    {
+        m_supported = gl::isExtensionAvailable("GL_ARB_draw_instanced") &&
+                      gl::isExtensionAvailable("GL_ARB_instanced_arrays");
+        if (!m_supported)
+        {
+            console() << "WARNING! Instanced arrays not supported, falling back to per-trile drawing" << endl;
+            return;
+        }
+
+        try
+        {
+            m_shader = gl::GlslProg(c_trileInstanceVert, c_trileInstanceFrag);
+        }
+        catch (gl::GlslProgCompileExc& exc)
+        {
+            console() << "WARNING! Trile instancing shader failed to compile: " << exc.what() << endl;
+            m_supported = false;
+            return;
+        }
+
+        m_offsetAttrib = m_shader.getAttribLocation("instanceOffset");
+        m_instanceVbo = gl::Vbo(GL_ARRAY_BUFFER);
+    }
+
+    void Upload(const TrileInstanceGroups& groups)
+    {
+        if (!m_supported || groups.m_offsets.empty())
+        {
+            return;
+        }
+
+        m_instanceVbo.bind();
+        m_instanceVbo.bufferData(groups.m_offsets.size() * sizeof(Vec3f), &groups.m_offsets[0], GL_STATIC_DRAW);
+        m_instanceVbo.unbind();
+    }
+
+    void Draw(const TrileInstanceGroups& groups, const gl::Texture& texture)
+    {
+        m_numDrawCalls = 0;
+        if (!m_supported || groups.m_groups.empty())
+        {
+            return;
+        }
+
+        m_shader.bind();
+        m_shader.uniform("tex", 0);
+        texture.bind();
+        FrameProfiler::CountStateChanges(1);
+
+        glEnableVertexAttribArray(m_offsetAttrib);
+        glVertexAttribDivisorARB(m_offsetAttrib, 1);
+
+        for (const TrileInstanceGroup& group : groups.m_groups)
+        {
+            const TriMesh& mesh = group.pGeometry->meshes[group.orient];
+            if (mesh.getNumIndices() == 0)
+            {
+                continue;
+            }
+
+            auto it = m_vboMeshes.find(&mesh);
+            if (it == m_vboMeshes.end())
+            {
+                it = m_vboMeshes.insert(make_pair(&mesh, gl::VboMesh(mesh))).first;
+            }
+            const gl::VboMesh& vboMesh = it->second;
+
+            m_instanceVbo.bind();
+            glVertexAttribPointer(m_offsetAttrib, 3, GL_FLOAT, GL_FALSE, sizeof(Vec3f),
+                                  (const GLvoid*)(group.firstInstance * sizeof(Vec3f)));
+
+            vboMesh.enableClientStates();
+            vboMesh.bindAllData();
+            glDrawElementsInstancedARB(GL_TRIANGLES, vboMesh.getNumIndices(), GL_UNSIGNED_INT, 0, group.numInstances);
+            FrameProfiler::CountDraw(vboMesh.getNumIndices() / 3 * group.numInstances);
+            gl::VboMesh::unbindBuffers();
+            vboMesh.disableClientStates();
+            m_numDrawCalls++;
+        }
+
+        glVertexAttribDivisorARB(m_offsetAttrib, 0);
+        glDisableVertexAttribArray(m_offsetAttrib);
+
+        texture.unbind();
+        m_shader.unbind();
+    }
+
+    // Drops the GPU copies of the trile meshes, e.g. when a new trile set is loaded
+    void Clear()
+    {
+        m_vboMeshes.clear();
+    }
+};
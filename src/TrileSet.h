@@ -0,0 +1,285 @@
+#pragma once
+
+#include "Common.h"
+#include "Frustum.h"
+#include "NumberParser.h"
+#include "GeometryArena.h"
+#include "LoadProfiler.h"
+
+#define NUM_ORIENTATIONS 4
+#define NUM_TRILE_SIDES 6       // one per gc_normals entry
+#define TRILE_SIDE_NONE 0xFF
+
+// A side covered by a single unit quad, corners are indexed by their (u, v) position in the side plane
+// where u runs along axis (side + 1) % 3 and v along axis (side + 2) % 3
+struct TrileQuad
+{
+    Vec2f               texcoords[4];   // at (0,0), (1,0), (0,1), (1,1)
+    bool                ccw;            // winding of its triangles in (u, v)
+};
+
+// Which triangles of an oriented trile mesh lie flat on a side of its unit cell
+struct TrileFaces
+{
+    vector<uint8_t>     triangleSides;                  // gc_normals index per triangle, or TRILE_SIDE_NONE
+    uint32_t            numTriangles[NUM_TRILE_SIDES];
+    uint8_t             closedSides;                    // bit per side that is completely covered
+    uint8_t             quadSides;                      // bit per side that is exactly one TrileQuad
+    TrileQuad           quads[NUM_TRILE_SIDES];
+};
+
+// Geometry for a single trile key, parsed once from the trile set and shared by every level instance.
+// The source arrays live in the arena of the TrileSet that owns the geometry.
+struct TrileGeometry
+{
+    ArenaArray<Vec3f>       positions;
+    ArenaArray<uint8_t>     normals;    // index into gc_normals
+    ArenaArray<Vec2f>       texcoords;
+    ArenaArray<uint32_t>    indices;
+    TriMesh             meshes[NUM_ORIENTATIONS];   // pre-rotated by gc_orientations, in trile space
+    TrileFaces          faces[NUM_ORIENTATIONS];
+    Bounds              bounds[NUM_ORIENTATIONS];   // of each oriented mesh, in trile space
+};
+
+class TrileSet
+{
+public:
+
+    map<uint32_t, TrileGeometry> m_geometry;
+    GeometryArena               m_arena;
+
+    bool Contains(const uint32_t key) const
+    {
+        return m_geometry.find(key) != m_geometry.end();
+    }
+
+    const TrileGeometry* Find(const uint32_t key) const
+    {
+        const auto it = m_geometry.find(key);
+        return it != m_geometry.end() ? &it->second : nullptr;
+    }
+
+    void AddTrile(const uint32_t key, const XmlTree& trileXml)
+    {
+        ParseTrile(trileXml, &m_geometry[key]);
+    }
+
+    // Does not touch the map, so several triles can be parsed in parallel into pre-inserted entries.
+    // The children are counted first so each array is allocated once at its final size.
+    void ParseTrile(const XmlTree& trileXml, TrileGeometry* pGeometry)
+    {
+        TrileGeometry& geometry = *pGeometry;
+
+        const XmlTree& xmlVertices = trileXml.getChild("Trile/Geometry/ShaderInstancedIndexedPrimitives/Vertices");
+        const uint32_t numVertices = distance(xmlVertices.begin(), xmlVertices.end());
+        geometry.positions = m_arena.Allocate<Vec3f>(numVertices);
+        geometry.normals = m_arena.Allocate<uint8_t>(numVertices);
+        geometry.texcoords = m_arena.Allocate<Vec2f>(numVertices);
+        uint32_t i = 0;
+        for (const auto& vertex : xmlVertices)
+        {
+            const XmlTree& posXml = vertex.getChild("Position/Vector3");
+            geometry.positions[i] = Vec3f(NumberParser::ToFloat(posXml["x"].getValue()),
+                                          NumberParser::ToFloat(posXml["y"].getValue()),
+                                          NumberParser::ToFloat(posXml["z"].getValue()));
+
+            const XmlTree& normXml = vertex.getChild("Normal");
+            geometry.normals[i] = NumberParser::ToInt(normXml.getValue());
+
+            const XmlTree& coordXml = vertex.getChild("TextureCoord/Vector2");
+            geometry.texcoords[i] = Vec2f(NumberParser::ToFloat(coordXml["x"].getValue()),
+                                          NumberParser::ToFloat(coordXml["y"].getValue()));
+            i++;
+        }
+
+        const XmlTree& xmlIndices = trileXml.getChild("Trile/Geometry/ShaderInstancedIndexedPrimitives/Indices");
+        geometry.indices = m_arena.Allocate<uint32_t>(distance(xmlIndices.begin(), xmlIndices.end()));
+        i = 0;
+        for (const auto& index : xmlIndices)
+        {
+            geometry.indices[i++] = NumberParser::ToInt(index.getValue());
+        }
+
+        BuildMeshes(geometry);
+    }
+
+    // Adds a trile from already unpacked arrays, e.g. from a baked level
+    void AddTrile(const uint32_t key,
+                  const Vec3f* positions,
+                  const uint8_t* normals,
+                  const Vec2f* texcoords,
+                  const uint32_t numVertices,
+                  const uint32_t* indices,
+                  const uint32_t numIndices)
+    {
+        BuildMeshes(SetTrileArrays(key, positions, normals, texcoords, numVertices, indices, numIndices));
+    }
+
+    // Copies the arrays into the arena and leaves BuildMeshes() to the caller
+    TrileGeometry& SetTrileArrays(const uint32_t key,
+                                  const Vec3f* positions,
+                                  const uint8_t* normals,
+                                  const Vec2f* texcoords,
+                                  const uint32_t numVertices,
+                                  const uint32_t* indices,
+                                  const uint32_t numIndices)
+    {
+        TrileGeometry& geometry = m_geometry[key];
+        geometry.positions = m_arena.Copy(positions, numVertices);
+        geometry.normals = m_arena.Copy(normals, numVertices);
+        geometry.texcoords = m_arena.Copy(texcoords, numVertices);
+        geometry.indices = m_arena.Copy(indices, numIndices);
+        return geometry;
+    }
+
+    static void BuildMeshes(TrileGeometry& geometry)
+    {
+        if (geometry.positions.empty() || geometry.indices.empty())
+        {
+            return;
+        }
+
+        // Every instance only differs by a translation once the orientation is applied,
+        // so bake the four possible orientations here instead of per instance.
+        // The rotated vertices are written straight into the mesh, sized once.
+        for (uint32_t orient = 0; orient < NUM_ORIENTATIONS; orient++)
+        {
+            TriMesh& mesh = geometry.meshes[orient];
+            vector<Vec3f>& positions = mesh.getVertices();
+            vector<Vec3f>& normals = mesh.getNormals();
+            positions.resize(geometry.positions.size());
+            normals.resize(geometry.normals.size());
+            for (size_t i = 0; i < geometry.positions.size(); i++)
+            {
+                positions[i] = geometry.positions[i] * gc_orientations[orient];
+                normals[i] = gc_normals[geometry.normals[i]] * gc_orientations[orient];
+                geometry.bounds[orient].Include(positions[i]);
+            }
+            mesh.getTexCoords().assign(geometry.texcoords.begin(), geometry.texcoords.end());
+            mesh.getIndices().assign(geometry.indices.begin(), geometry.indices.end());
+
+            ClassifyFaces(mesh, &geometry.faces[orient]);
+        }
+        LoadProfiler::Count(LOAD_VERTICES, geometry.positions.size() * NUM_ORIENTATIONS);
+    }
+
+    // A triangle is on a side when all its vertices sit on that side's plane of the unit cell
+    // and it faces outwards, a side is closed when such triangles cover its whole area
+    static void ClassifyFaces(const TriMesh& mesh, TrileFaces* pFaces)
+    {
+        const float c_epsilon = 0.001f;
+        const vector<Vec3f>& positions = mesh.getVertices();
+        const vector<Vec3f>& normals = mesh.getNormals();
+        const vector<uint32_t>& indices = mesh.getIndices();
+
+        float sideArea[NUM_TRILE_SIDES] = { 0.f };
+        memset(pFaces->numTriangles, 0, sizeof(pFaces->numTriangles));
+        pFaces->triangleSides.assign(indices.size() / 3, TRILE_SIDE_NONE);
+        pFaces->closedSides = 0;
+        pFaces->quadSides = 0;
+
+        for (size_t tri = 0; tri < pFaces->triangleSides.size(); tri++)
+        {
+            const Vec3f& p0 = positions[indices[tri * 3]];
+            const Vec3f& p1 = positions[indices[tri * 3 + 1]];
+            const Vec3f& p2 = positions[indices[tri * 3 + 2]];
+
+            for (uint8_t side = 0; side < NUM_TRILE_SIDES; side++)
+            {
+                const uint32_t axis = side % 3;
+                const float plane = side < 3 ? -0.5f : 0.5f;
+                if (math<float>::abs(p0[axis] - plane) < c_epsilon &&
+                    math<float>::abs(p1[axis] - plane) < c_epsilon &&
+                    math<float>::abs(p2[axis] - plane) < c_epsilon &&
+                    normals[indices[tri * 3]].dot(gc_normals[side]) > 0.5f)
+                {
+                    pFaces->triangleSides[tri] = side;
+                    pFaces->numTriangles[side]++;
+                    sideArea[side] += (p1 - p0).cross(p2 - p0).length() / 2;
+                    break;
+                }
+            }
+        }
+
+        for (uint8_t side = 0; side < NUM_TRILE_SIDES; side++)
+        {
+            if (sideArea[side] >= 1.f - c_epsilon)
+            {
+                pFaces->closedSides |= 1 << side;
+                if (pFaces->numTriangles[side] == 2 && ClassifyQuad(mesh, *pFaces, side, &pFaces->quads[side]))
+                {
+                    pFaces->quadSides |= 1 << side;
+                }
+            }
+        }
+    }
+
+    // A closed side made of two triangles is a quad when every vertex sits on a corner of the cell
+    // and vertices sharing a corner also share a texcoord
+    static bool ClassifyQuad(const TriMesh& mesh, const TrileFaces& faces, const uint8_t side, TrileQuad* pQuad)
+    {
+        const float c_epsilon = 0.001f;
+        const vector<Vec3f>& positions = mesh.getVertices();
+        const vector<Vec2f>& texcoords = mesh.getTexCoords();
+        const vector<uint32_t>& indices = mesh.getIndices();
+        const uint32_t uAxis = (side + 1) % 3;
+        const uint32_t vAxis = (side + 2) % 3;
+
+        bool found[4] = { false };
+        bool windingSet = false;
+        for (size_t tri = 0; tri < faces.triangleSides.size(); tri++)
+        {
+            if (faces.triangleSides[tri] != side)
+            {
+                continue;
+            }
+
+            Vec2f corners[3];
+            for (uint32_t i = 0; i < 3; i++)
+            {
+                const uint32_t index = indices[tri * 3 + i];
+                const Vec3f& pos = positions[index];
+                const float u = pos[uAxis] + 0.5f;
+                const float v = pos[vAxis] + 0.5f;
+                const float uCorner = math<float>::floor(u + 0.5f);
+                const float vCorner = math<float>::floor(v + 0.5f);
+                if (math<float>::abs(u - uCorner) > c_epsilon || math<float>::abs(v - vCorner) > c_epsilon)
+                {
+                    return false;
+                }
+
+                const uint32_t corner = (uint32_t)uCorner + (uint32_t)vCorner * 2;
+                if (found[corner] && pQuad->texcoords[corner].distanceSquared(texcoords[index]) > c_epsilon * c_epsilon)
+                {
+                    return false;
+                }
+                found[corner] = true;
+                pQuad->texcoords[corner] = texcoords[index];
+                corners[i] = Vec2f(uCorner, vCorner);
+            }
+
+            const bool ccw = (corners[1] - corners[0]).cross(corners[2] - corners[0]) > 0.f;
+            if (windingSet && ccw != pQuad->ccw)
+            {
+                return false;
+            }
+            pQuad->ccw = ccw;
+            windingSet = true;
+        }
+
+        return found[0] && found[1] && found[2] && found[3];
+    }
+
+    // The geometry and the arena it points into go together
+    void Swap(TrileSet& other)
+    {
+        m_geometry.swap(other.m_geometry);
+        m_arena.Swap(other.m_arena);
+    }
+
+    void Clear()
+    {
+        m_geometry.clear();
+        m_arena.Clear();
+    }
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Common.h"
+#include "Frustum.h"
+
+// Everything the draw paths derive from the camera and clock, computed once per frame in FezViewer::draw()
+struct ViewState
+{
+    Matrix44f   viewProjection;
+    Frustum     frustum;            // contains everything when culling is off
+    Vec3f       eye;
+    float       farClip;
+    float       billboardAngle;     // degrees about Y that turn a billboard towards the camera
+    double      seconds;            // animation time
+
+    ViewState() :
+        farClip(1.f),
+        billboardAngle(0.f),
+        seconds(0.0)
+    {
+    }
+
+    void Set(const CameraPersp& camera, const double time, const bool culling)
+    {
+        viewProjection = camera.getProjectionMatrix() * camera.getModelViewMatrix();
+        frustum = culling ? Frustum(viewProjection) : Frustum();
+        eye = camera.getEyePoint();
+        farClip = camera.getFarClip();
+        seconds = time;
+
+        Vec3f mRight, mUp;
+        camera.getBillboardVectors(&mRight, &mUp);
+        float angleRad = ci::math<float>::acos(mRight.dot(Vec3f(1.f, 0.f, 0.f)));
+        float angleDeg = angleRad * 180.0 / M_PI;
+        angleDeg *= (mRight.z > 0 ? -1 : 1);    // get full 360 degree (signed) rotation
+        billboardAngle = angleDeg;
+    }
+};
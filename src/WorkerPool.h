@@ -0,0 +1,174 @@
+#pragma once
+
+#include "Common.h"
+#include <condition_variable>
+#include <functional>
+
+// Tasks submitted with the same group can be waited on together, without waiting for anyone else's
+struct WorkerGroup
+{
+    uint32_t    numPending;     // guarded by the pool's mutex
+
+    WorkerGroup() :
+        numPending(0)
+    {
+    }
+};
+
+// A fixed set of worker threads consuming a shared task queue.
+// Wait() blocks until every task has finished, Wait(group) only for the tasks of that group.
+class WorkerPool
+{
+public:
+
+    WorkerPool(uint32_t numThreads = 0) :
+        m_numPending(0),
+        m_stop(false)
+    {
+        if (numThreads == 0)
+        {
+            numThreads = max(thread::hardware_concurrency(), 1u);
+        }
+        for (uint32_t i = 0; i < numThreads; i++)
+        {
+            m_threads.push_back(shared_ptr<thread>( new thread( bind( &WorkerPool::WorkerMain, this ) ) ));
+        }
+    }
+
+    ~WorkerPool()
+    {
+        {
+            lock_guard<mutex> lock( m_mutex );
+            m_stop = true;
+        }
+        m_taskReady.notify_all();
+        for (auto& pThread : m_threads)
+        {
+            pThread->join();
+        }
+    }
+
+    uint32_t GetNumThreads() const
+    {
+        return m_threads.size();
+    }
+
+    void Submit(const function<void()>& task, WorkerGroup* pGroup = nullptr)
+    {
+        {
+            lock_guard<mutex> lock( m_mutex );
+            WorkerTask workerTask = { task, pGroup };
+            m_tasks.push_back(workerTask);
+            m_numPending++;
+            if (pGroup)
+            {
+                pGroup->numPending++;
+            }
+        }
+        m_taskReady.notify_one();
+    }
+
+    // Blocks until every submitted task has finished
+    void Wait()
+    {
+        unique_lock<mutex> lock( m_mutex );
+        while (m_numPending > 0)
+        {
+            m_tasksDone.wait(lock);
+        }
+    }
+
+    // Blocks until the group's tasks have finished, running the ones still queued on the calling thread.
+    // So a task can wait on a group of its own without tying up a worker or deadlocking a busy pool.
+    void Wait(WorkerGroup& group)
+    {
+        unique_lock<mutex> lock( m_mutex );
+        while (group.numPending > 0)
+        {
+            const auto it = find_if(m_tasks.begin(), m_tasks.end(), [&](const WorkerTask& task) { return task.pGroup == &group; });
+            if (it == m_tasks.end())
+            {
+                m_tasksDone.wait(lock);
+                continue;
+            }
+            const WorkerTask task = *it;
+            m_tasks.erase(it);
+            lock.unlock();
+            Run(task);
+            lock.lock();
+        }
+    }
+
+    // Runs task(i) for i in [0, count) on the pool and waits for all of them, but not for other tasks
+    void ParallelFor(const uint32_t count, const function<void(uint32_t)>& task)
+    {
+        WorkerGroup group;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            Submit(bind(task, i), &group);
+        }
+        Wait(group);
+    }
+
+private:
+
+    struct WorkerTask
+    {
+        function<void()>    task;
+        WorkerGroup*        pGroup;
+    };
+
+    vector<shared_ptr<thread>>  m_threads;
+    deque<WorkerTask>           m_tasks;
+    mutex                       m_mutex;
+    condition_variable          m_taskReady;
+    condition_variable          m_tasksDone;
+    uint32_t                    m_numPending;
+    bool                        m_stop;
+
+    void WorkerMain()
+    {
+        ci::ThreadSetup threadSetup; // Required for cinder multithreading
+
+        for (;;)
+        {
+            WorkerTask task;
+            {
+                unique_lock<mutex> lock( m_mutex );
+                while (m_tasks.empty() && !m_stop)
+                {
+                    m_taskReady.wait(lock);
+                }
+                if (m_stop)
+                {
+                    return;
+                }
+                task = m_tasks.front();
+                m_tasks.pop_front();
+            }
+            Run(task);
+        }
+    }
+
+    void Run(const WorkerTask& task)
+    {
+        try
+        {
+            task.task();
+        }
+        catch (std::exception& exc)
+        {
+            Log() << "ERROR! Worker task failed: " << exc.what() << endl;
+        }
+
+        {
+            lock_guard<mutex> lock( m_mutex );
+            m_numPending--;
+            const bool groupDone = task.pGroup && --task.pGroup->numPending == 0;
+            if (m_numPending == 0 || groupDone)
+            {
+                m_tasksDone.notify_all();
+            }
+        }
+    }
+};
@@ -0,0 +1,462 @@
+#pragma once
+
+#include "Common.h"
+#include "NumberParser.h"
+#include "LoadProfiler.h"
+#include "boost/interprocess/file_mapping.hpp"
+#include "boost/interprocess/mapped_region.hpp"
+
+enum XmlEvent
+{
+    XML_START_ELEMENT,
+    XML_END_ELEMENT,
+    XML_TEXT,
+    XML_END_DOCUMENT,
+    XML_ERROR
+};
+
+// A range of the source document, not null terminated and with entities still encoded
+struct XmlString
+{
+    const char* begin;
+    const char* end;
+
+    XmlString() :
+        begin(nullptr),
+        end(nullptr)
+    {
+    }
+
+    XmlString(const char* b, const char* e) :
+        begin(b),
+        end(e)
+    {
+    }
+
+    size_t size() const
+    {
+        return end - begin;
+    }
+
+    bool empty() const
+    {
+        return begin == end;
+    }
+
+    bool operator==(const char* str) const
+    {
+        const size_t length = strlen(str);
+        return size() == length && memcmp(begin, str, length) == 0;
+    }
+
+    bool operator!=(const char* str) const
+    {
+        return !(*this == str);
+    }
+
+    // Decodes the predefined and numeric character entities, unknown ones and a bare '&' are kept as written
+    string str() const
+    {
+        string result;
+        result.reserve(size());
+        for (const char* p = begin; p < end; p++)
+        {
+            if (*p != '&')
+            {
+                result.push_back(*p);
+                continue;
+            }
+            const char* semicolon = find(p, end, ';');
+            if (semicolon == end)
+            {
+                result.append(p, end);
+                break;
+            }
+            const XmlString entity(p + 1, semicolon);
+            if (entity == "amp")       { result.push_back('&'); }
+            else if (entity == "lt")   { result.push_back('<'); }
+            else if (entity == "gt")   { result.push_back('>'); }
+            else if (entity == "quot") { result.push_back('"'); }
+            else if (entity == "apos") { result.push_back('\''); }
+            else if (entity.size() > 1 && *entity.begin == '#')
+            {
+                const bool hex = entity.begin[1] == 'x';
+                result.push_back((char)strtol(entity.begin + (hex ? 2 : 1), nullptr, hex ? 16 : 10));
+            }
+            else
+            {
+                result.append(p, semicolon + 1);
+            }
+            p = semicolon;
+        }
+        return result;
+    }
+};
+
+// Minimal pull parser over a memory mapped document, for files too big to hold as an XmlTree.
+// Elements, attributes and text come back as ranges of the mapped file so nothing is allocated per node.
+// Handles what the FEZ content uses: no DTDs, namespaces or encodings besides ASCII compatible ones.
+class XmlPullParser
+{
+public:
+
+    XmlPullParser() :
+        m_pBegin(nullptr),
+        m_pCursor(nullptr),
+        m_pEnd(nullptr),
+        m_event(XML_END_DOCUMENT),
+        m_depth(0),
+        m_pendingEnd(false),
+        m_popDepth(false)
+    {
+    }
+
+    bool Open(const fs::path& file)
+    {
+        try
+        {
+            boost::interprocess::file_mapping mapping(file.string().c_str(), boost::interprocess::read_only);
+            boost::interprocess::mapped_region region(mapping, boost::interprocess::read_only);
+            m_file.swap(mapping);
+            m_region.swap(region);
+        }
+        catch (boost::interprocess::interprocess_exception&)
+        {
+            return false;
+        }
+        Reset((const char*)m_region.get_address(), m_region.get_size());
+        LoadProfiler::Count(LOAD_BYTES_READ, m_region.get_size());
+        return true;
+    }
+
+    // Parses a caller owned buffer, which has to outlive the parser
+    void Reset(const char* pData, const size_t size)
+    {
+        m_pBegin = pData;
+        m_pCursor = pData;
+        m_pEnd = pData + size;
+        m_event = XML_END_DOCUMENT;
+        m_depth = 0;
+        m_pendingEnd = false;
+        m_popDepth = false;
+        m_attributes.clear();
+    }
+
+    const char* GetData() const
+    {
+        return m_pBegin;
+    }
+
+    size_t GetSize() const
+    {
+        return m_pEnd - m_pBegin;
+    }
+
+    XmlEvent Next()
+    {
+        if (m_popDepth)
+        {
+            m_depth--;
+            m_popDepth = false;
+        }
+        if (m_pendingEnd)
+        {
+            // The end of a self closing element
+            m_pendingEnd = false;
+            m_popDepth = true;
+            return m_event = XML_END_ELEMENT;
+        }
+
+        while (m_pCursor < m_pEnd)
+        {
+            if (*m_pCursor != '<')
+            {
+                const char* pStart = m_pCursor;
+                m_pCursor = find(m_pCursor, m_pEnd, '<');
+                if (find_if(pStart, m_pCursor, [](char c) { return !isspace((unsigned char)c); }) != m_pCursor)
+                {
+                    m_text = XmlString(pStart, m_pCursor);
+                    return m_event = XML_TEXT;
+                }
+                continue;
+            }
+
+            if (StartsWith("<?"))
+            {
+                if (!SkipPast("?>")) { return Fail(); }
+            }
+            else if (StartsWith("<!--"))
+            {
+                if (!SkipPast("-->")) { return Fail(); }
+            }
+            else if (StartsWith("<![CDATA["))
+            {
+                const char* pStart = m_pCursor + 9;
+                if (!SkipPast("]]>")) { return Fail(); }
+                m_text = XmlString(pStart, m_pCursor - 3);
+                return m_event = XML_TEXT;
+            }
+            else if (StartsWith("<!"))
+            {
+                if (!SkipPast(">")) { return Fail(); }
+            }
+            else if (StartsWith("</"))
+            {
+                m_pCursor += 2;
+                m_name = ParseName();
+                if (!SkipPast(">") || m_depth == 0) { return Fail(); }
+                m_popDepth = true;
+                return m_event = XML_END_ELEMENT;
+            }
+            else
+            {
+                m_pCursor++;
+                return ParseStartElement();
+            }
+        }
+
+        return m_depth == 0 ? (m_event = XML_END_DOCUMENT) : Fail();
+    }
+
+    XmlEvent GetEvent() const
+    {
+        return m_event;
+    }
+
+    // Of the current element, 1 for the root
+    uint32_t GetDepth() const
+    {
+        return m_depth;
+    }
+
+    const XmlString& GetName() const
+    {
+        return m_name;
+    }
+
+    bool IsNamed(const char* name) const
+    {
+        return m_name == name;
+    }
+
+    const XmlString& GetText() const
+    {
+        return m_text;
+    }
+
+    bool Failed() const
+    {
+        return m_event == XML_ERROR;
+    }
+
+    // Advances to the next child start element of the element at parentDepth, skipping grandchildren.
+    // Returns false once the parent ends.
+    bool NextChild(const uint32_t parentDepth)
+    {
+        for (;;)
+        {
+            switch (Next())
+            {
+            case XML_START_ELEMENT:
+                if (m_depth == parentDepth + 1) { return true; }
+                break;
+            case XML_END_ELEMENT:
+                if (m_depth == parentDepth) { return false; }
+                break;
+            case XML_TEXT:
+                break;
+            default:
+                return false;
+            }
+        }
+    }
+
+    // On a start element, reads its text content and advances to its end
+    bool ReadText(XmlString* pText)
+    {
+        const uint32_t depth = m_depth;
+        *pText = XmlString();
+        for (;;)
+        {
+            switch (Next())
+            {
+            case XML_TEXT:
+                if (m_depth == depth) { *pText = m_text; }
+                break;
+            case XML_END_ELEMENT:
+                if (m_depth == depth) { return true; }
+                break;
+            case XML_START_ELEMENT:
+                break;
+            default:
+                return false;
+            }
+        }
+    }
+
+    // Attributes of the current start element
+
+    bool GetAttribute(const char* name, XmlString* pValue) const
+    {
+        for (const auto& attribute : m_attributes)
+        {
+            if (attribute.first == name)
+            {
+                *pValue = attribute.second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    string GetAttributeString(const char* name) const
+    {
+        XmlString value;
+        return GetAttribute(name, &value) ? value.str() : string();
+    }
+
+    float GetAttributeFloat(const char* name) const
+    {
+        XmlString value;
+        return GetAttribute(name, &value) ? ParseFloat(value) : 0.f;
+    }
+
+    int32_t GetAttributeInt(const char* name) const
+    {
+        XmlString value;
+        return GetAttribute(name, &value) ? ParseInt(value) : 0;
+    }
+
+    // FEZ content writes booleans as "True" and "False"
+    bool GetAttributeBool(const char* name) const
+    {
+        XmlString value;
+        return GetAttribute(name, &value) && value == "True";
+    }
+
+    static float ParseFloat(const XmlString& value)
+    {
+        float result = 0.f;
+        NumberParser::ParseFloat(value.begin, value.end, &result);
+        return result;
+    }
+
+    static int32_t ParseInt(const XmlString& value)
+    {
+        int32_t result = 0;
+        NumberParser::ParseInt(value.begin, value.end, &result);
+        return result;
+    }
+
+private:
+
+    boost::interprocess::file_mapping   m_file;
+    boost::interprocess::mapped_region  m_region;
+    const char*                         m_pBegin;
+    const char*                         m_pCursor;
+    const char*                         m_pEnd;
+    XmlEvent                            m_event;
+    uint32_t                            m_depth;
+    bool                                m_pendingEnd;   // the current element was self closing
+    bool                                m_popDepth;     // the current event ended an element
+    XmlString                           m_name;
+    XmlString                           m_text;
+    vector<pair<XmlString, XmlString> > m_attributes;   // reused between elements
+
+    XmlEvent Fail()
+    {
+        m_pCursor = m_pEnd;
+        return m_event = XML_ERROR;
+    }
+
+    bool StartsWith(const char* str) const
+    {
+        const size_t length = strlen(str);
+        return (size_t)(m_pEnd - m_pCursor) >= length && memcmp(m_pCursor, str, length) == 0;
+    }
+
+    bool SkipPast(const char* str)
+    {
+        const char* pFound = search(m_pCursor, m_pEnd, str, str + strlen(str));
+        if (pFound == m_pEnd)
+        {
+            return false;
+        }
+        m_pCursor = pFound + strlen(str);
+        return true;
+    }
+
+    void SkipSpace()
+    {
+        while (m_pCursor < m_pEnd && isspace((unsigned char)*m_pCursor))
+        {
+            m_pCursor++;
+        }
+    }
+
+    XmlString ParseName()
+    {
+        const char* pStart = m_pCursor;
+        while (m_pCursor < m_pEnd && !isspace((unsigned char)*m_pCursor) &&
+               *m_pCursor != '>' && *m_pCursor != '/' && *m_pCursor != '=')
+        {
+            m_pCursor++;
+        }
+        return XmlString(pStart, m_pCursor);
+    }
+
+    XmlEvent ParseStartElement()
+    {
+        m_name = ParseName();
+        m_attributes.clear();
+        if (m_name.empty())
+        {
+            return Fail();
+        }
+
+        for (;;)
+        {
+            SkipSpace();
+            if (m_pCursor >= m_pEnd)
+            {
+                return Fail();
+            }
+            if (*m_pCursor == '>')
+            {
+                m_pCursor++;
+                break;
+            }
+            if (StartsWith("/>"))
+            {
+                m_pCursor += 2;
+                m_pendingEnd = true;
+                break;
+            }
+
+            const XmlString name = ParseName();
+            SkipSpace();
+            if (name.empty() || m_pCursor >= m_pEnd || *m_pCursor != '=')
+            {
+                return Fail();
+            }
+            m_pCursor++;
+            SkipSpace();
+            if (m_pCursor >= m_pEnd || (*m_pCursor != '"' && *m_pCursor != '\''))
+            {
+                return Fail();
+            }
+            const char quote = *m_pCursor++;
+            const char* pValue = m_pCursor;
+            m_pCursor = find(m_pCursor, m_pEnd, quote);
+            if (m_pCursor == m_pEnd)
+            {
+                return Fail();
+            }
+            m_attributes.push_back(make_pair(name, XmlString(pValue, m_pCursor)));
+            m_pCursor++;
+        }
+
+        m_depth++;
+        return m_event = XML_START_ELEMENT;
+    }
+};
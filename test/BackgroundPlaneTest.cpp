@@ -0,0 +1,120 @@
+#include "Test.h"
+#include "BackgroundPlane.h"
+#include <random>
+
+// The lookup GetFrameIndex() replaced, a walk over the frame durations
+static uint32_t GetFrameIndexLinear(const BackgroundPlane& bp, const double seconds)
+{
+    uint32_t index = 0;
+    uint32_t timeOffset = (uint32_t)(seconds * 10000000) % bp.m_totalDuration;
+    while (timeOffset > bp.m_frames[index])
+    {
+        timeOffset -= bp.m_frames[index];
+        index++;
+    }
+    return index;
+}
+
+static void SetFrames(BackgroundPlane* pPlane, const vector<uint32_t>& frames)
+{
+    pPlane->m_frames = frames;
+    pPlane->m_totalDuration = 0;
+    for (const uint32_t duration : frames)
+    {
+        pPlane->m_totalDuration += duration;
+    }
+    pPlane->BuildTimeline();
+}
+
+// Half a tick in, so the conversion to ticks lands exactly on the tick wanted
+static double TicksToSeconds(const uint64_t ticks)
+{
+    return (ticks + 0.5) / 10000000;
+}
+
+// Every frame boundary and its neighbours, over several loops of the timeline, plus random times
+static void CheckAgainstLinear(const BackgroundPlane& bp, mt19937* pRandom)
+{
+    const uint32_t numLoops = min(5u, 400000000u / bp.m_totalDuration);
+    for (uint32_t loop = 0; loop < numLoops; loop++)
+    {
+        const uint64_t loopStart = (uint64_t)loop * bp.m_totalDuration;
+        uint64_t end = 0;
+        for (size_t i = 0; i <= bp.m_frames.size(); i++)
+        {
+            for (int32_t delta = -1; delta <= 1; delta++)
+            {
+                if (end + delta + loopStart < 0x7FFFFFFF && (int64_t)(end + loopStart) + delta >= 0)
+                {
+                    const double seconds = TicksToSeconds(loopStart + end + delta);
+                    CHECK_EQUAL(GetFrameIndexLinear(bp, seconds), bp.GetFrameIndex(seconds));
+                }
+            }
+            end += i < bp.m_frames.size() ? bp.m_frames[i] : 0;
+        }
+    }
+
+    uniform_int_distribution<uint32_t> ticks(0, 400000000);
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        const double seconds = TicksToSeconds((*pRandom)());
+        CHECK_EQUAL(GetFrameIndexLinear(bp, seconds), bp.GetFrameIndex(seconds));
+        const double loopSeconds = TicksToSeconds(ticks(*pRandom));
+        CHECK_EQUAL(GetFrameIndexLinear(bp, loopSeconds), bp.GetFrameIndex(loopSeconds));
+    }
+}
+
+TEST(FrameIndexMatchesLinearWalk)
+{
+    mt19937 random(1234);
+    BackgroundPlane bp((TriMesh()));
+    for (uint32_t run = 0; run < 200; run++)
+    {
+        // FEZ durations are in 100ns ticks, typically around a tenth of a second
+        uniform_int_distribution<uint32_t> numFrames(1, 24);
+        uniform_int_distribution<uint32_t> duration(run % 2 ? 1 : 100000, run % 2 ? 50 : 3000000);
+        vector<uint32_t> frames(numFrames(random));
+        for (uint32_t& frame : frames)
+        {
+            frame = duration(random);
+        }
+        SetFrames(&bp, frames);
+        CHECK(bp.m_uniformDuration == 0 || frames.size() == 1 || frames[0] == frames[1]);
+        CheckAgainstLinear(bp, &random);
+    }
+}
+
+TEST(FrameIndexUniformDurations)
+{
+    mt19937 random(5678);
+    BackgroundPlane bp((TriMesh()));
+    const uint32_t durations[] = { 1, 3, 1000000, 1666667 };
+    for (const uint32_t duration : durations)
+    {
+        for (uint32_t numFrames = 1; numFrames <= 16; numFrames += 5)
+        {
+            SetFrames(&bp, vector<uint32_t>(numFrames, duration));
+            CHECK_EQUAL(duration, bp.m_uniformDuration);
+            CheckAgainstLinear(bp, &random);
+        }
+    }
+}
+
+// Zero length frames never show, like in the walk
+TEST(FrameIndexZeroDurationFrames)
+{
+    mt19937 random(91011);
+    BackgroundPlane bp((TriMesh()));
+    const uint32_t frames[] = { 0, 500000, 0, 0, 250000, 1000000, 0 };
+    SetFrames(&bp, vector<uint32_t>(frames, frames + 7));
+    CHECK_EQUAL(0u, bp.m_uniformDuration);
+    CheckAgainstLinear(bp, &random);
+
+    CHECK_EQUAL(0u, bp.GetFrameIndex(TicksToSeconds(0)));
+    CHECK_EQUAL(1u, bp.GetFrameIndex(TicksToSeconds(500000)));
+    CHECK_EQUAL(4u, bp.GetFrameIndex(TicksToSeconds(500001)));
+    CHECK_EQUAL(5u, bp.GetFrameIndex(TicksToSeconds(1749999)));
+    CHECK_EQUAL(0u, bp.GetFrameIndex(TicksToSeconds(1750000)));
+    CHECK_EQUAL(1u, bp.GetFrameIndex(TicksToSeconds(1750000 + 1)));
+    CHECK_EQUAL(5u, bp.GetFrameIndex(TicksToSeconds(1750000 + 1750000 - 1)));
+}
@@ -0,0 +1,59 @@
+#include "Test.h"
+#include "BakedLevel.h"
+
+static const char* c_bakedFile = "BakedLevelTest.fezb";
+
+// The sources follow the strings, their times survive the split into two words
+TEST(BakedLevelSources)
+{
+    const time_t levelTime = (time_t)0x123456789ll;
+    const time_t trileSetTime = (time_t)1400000000;
+    {
+        BakedLevelWriter writer(fs::path("levels"));
+        writer.SetTrileSetTexture(fs::path("levels/../trile sets/untitled.png"));
+        writer.AddSource(fs::path("levels/level.xml"), levelTime);
+        writer.AddSource(fs::path("levels/../trile sets/untitled.png"), trileSetTime);
+        CHECK(writer.Write(c_bakedFile));
+    }
+
+    BakedLevelReader reader;
+    CHECK(reader.Open(c_bakedFile));
+    const BakedHeader& header = *reader.m_pHeader;
+    CHECK_EQUAL(2u, header.numStrings);
+    CHECK_EQUAL(2u, header.numSources);
+
+    vector<string> strings(header.numStrings);
+    for (uint32_t i = 0; i < header.numStrings; i++)
+    {
+        CHECK(reader.ReadString(&strings[i]));
+    }
+    const BakedSource* pSources = reader.Read<BakedSource>(header.numSources);
+    CHECK(pSources != nullptr);
+    if (pSources)
+    {
+        CHECK_EQUAL(string("level.xml"), strings[pSources[0].path]);
+        CHECK(levelTime == BakedLevelReader::GetLastWriteTime(pSources[0]));
+        CHECK_EQUAL(header.trileSetTexture, pSources[1].path);
+        CHECK(trileSetTime == BakedLevelReader::GetLastWriteTime(pSources[1]));
+    }
+    CHECK(!reader.Failed());
+
+    reader.Fail();
+    CHECK(reader.Failed());
+    CHECK(reader.Read<uint32_t>(1) == nullptr);
+    remove(c_bakedFile);
+}
+
+// Indices past the vertices and normals past the six faces are corrupt
+TEST(BakedLevelMeshValidation)
+{
+    const uint32_t indices[] = { 0, 1, 2, 2, 1, 3 };
+    const uint8_t normals[] = { 0, 5, 3, 1 };
+    CHECK(BakedLevelReader::IsValidMesh(indices, 6, 4, normals));
+    CHECK(BakedLevelReader::IsValidMesh(indices, 6, 4));
+    CHECK(!BakedLevelReader::IsValidMesh(indices, 6, 3));
+    CHECK(BakedLevelReader::IsValidMesh(nullptr, 0, 0));
+
+    const uint8_t badNormals[] = { 0, 6, 3, 1 };
+    CHECK(!BakedLevelReader::IsValidMesh(indices, 6, 4, badNormals));
+}
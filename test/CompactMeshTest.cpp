@@ -0,0 +1,113 @@
+#include "Test.h"
+#include "CompactMesh.h"
+#include <random>
+
+static TriMesh MakeMesh(mt19937* pRandom, const Vec3f& center, const float extent, const uint32_t numVertices)
+{
+    uniform_real_distribution<float> offset(-extent, extent);
+    uniform_real_distribution<float> unit(0.f, 1.f);
+    TriMesh mesh;
+    for (uint32_t i = 0; i < numVertices; i++)
+    {
+        mesh.appendVertex(center + Vec3f(offset(*pRandom), offset(*pRandom), offset(*pRandom)));
+        mesh.appendNormal(gc_normals[(*pRandom)() % 6]);
+        mesh.appendTexCoord(Vec2f(unit(*pRandom), unit(*pRandom)));
+    }
+    for (uint32_t i = 0; i + 2 < numVertices; i += 3)
+    {
+        mesh.appendTriangle(i, i + 1, i + 2);
+    }
+    return mesh;
+}
+
+// Decoding every vertex is within half a quantization step per axis of the float it came from
+TEST(CompactMeshErrorWithinStep)
+{
+    mt19937 random(18);
+    const Vec3f centers[] = { Vec3f::zero(), Vec3f(16.5f, 3.25f, -7.75f), Vec3f(-200.3f, 95.1f, 731.9f) };
+    float maxPositionError = 0.f;
+    float maxTexcoordError = 0.f;
+    for (const Vec3f& center : centers)
+    {
+        const TriMesh mesh = MakeMesh(&random, center, 120.f, 30000);
+        CompactMesh compact;
+        CHECK(compact.Build(mesh));
+        CHECK_EQUAL(mesh.getNumVertices(), compact.GetNumVertices());
+        CHECK(compact.m_indices == mesh.getIndices());
+        CHECK_EQUAL(compact.m_origin, Vec3f(floor(compact.m_origin.x), floor(compact.m_origin.y), floor(compact.m_origin.z)));
+
+        // Floats near the origin carry some rounding of their own
+        const float slack = compact.m_origin.length() * 2.f * FLT_EPSILON;
+        for (size_t i = 0; i < mesh.getNumVertices(); i++)
+        {
+            const Vec3f positionError = compact.DecodePosition(i) - mesh.getVertices()[i];
+            const Vec2f texcoordError = compact.DecodeTexcoord(i) - mesh.getTexCoords()[i];
+            for (uint32_t axis = 0; axis < 3; axis++)
+            {
+                CHECK(math<float>::abs(positionError[axis]) <= COMPACT_POSITION_TOLERANCE + slack);
+                maxPositionError = max(maxPositionError, math<float>::abs(positionError[axis]));
+            }
+            for (uint32_t axis = 0; axis < 2; axis++)
+            {
+                CHECK(math<float>::abs(texcoordError[axis]) <= COMPACT_TEXCOORD_TOLERANCE + FLT_EPSILON);
+                maxTexcoordError = max(maxTexcoordError, math<float>::abs(texcoordError[axis]));
+            }
+            CHECK_EQUAL(mesh.getNormals()[i], compact.DecodeNormal(i));
+        }
+    }
+
+    // Random input uses most of the step, so the bounds above are tight
+    CHECK(maxPositionError > COMPACT_POSITION_TOLERANCE * 0.9f);
+    CHECK(maxTexcoordError > COMPACT_TEXCOORD_TOLERANCE * 0.9f);
+}
+
+// Positions already on the grid come back exactly, as trile geometry mostly is
+TEST(CompactMeshGridPositionsExact)
+{
+    mt19937 random(19);
+    TriMesh mesh = MakeMesh(&random, Vec3f(40.f, 8.f, -12.f), 30.f, 3000);
+    for (Vec3f& pos : mesh.getVertices())
+    {
+        pos = Vec3f(floor(pos.x * 16.f), floor(pos.y * 16.f), floor(pos.z * 16.f)) / 16.f;
+    }
+    mesh.getTexCoords()[0] = Vec2f::zero();
+    mesh.getTexCoords()[1] = Vec2f::one();
+
+    CompactMesh compact;
+    CHECK(compact.Build(mesh));
+    for (size_t i = 0; i < mesh.getNumVertices(); i++)
+    {
+        CHECK_EQUAL(mesh.getVertices()[i], compact.DecodePosition(i));
+    }
+    CHECK_EQUAL(Vec2f::zero(), compact.DecodeTexcoord(0));
+    CHECK_EQUAL(Vec2f::one(), compact.DecodeTexcoord(1));
+}
+
+TEST(CompactMeshRefusesUnrepresentable)
+{
+    mt19937 random(20);
+    CompactMesh compact;
+
+    // Further than 127 units from the origin chosen at the centre of the bounds
+    TriMesh wide = MakeMesh(&random, Vec3f::zero(), 100.f, 30);
+    wide.getVertices()[0] = Vec3f(-200.f, 0.f, 0.f);
+    wide.getVertices()[1] = Vec3f(200.f, 0.f, 0.f);
+    CHECK(!compact.Build(wide));
+    CHECK(compact.IsEmpty());
+    CHECK_EQUAL((size_t)0, compact.GetNumVertices());
+
+    TriMesh wrapped = MakeMesh(&random, Vec3f::zero(), 1.f, 30);
+    wrapped.getTexCoords()[4] = Vec2f(1.5f, 0.5f);
+    CHECK(!compact.Build(wrapped));
+    wrapped.getTexCoords()[4] = Vec2f(0.5f, -0.01f);
+    CHECK(!compact.Build(wrapped));
+
+    TriMesh tilted = MakeMesh(&random, Vec3f::zero(), 1.f, 30);
+    tilted.getNormals()[7] = Vec3f(1.f, 1.f, 0.f).normalized();
+    CHECK(!compact.Build(tilted));
+
+    TriMesh noNormals = MakeMesh(&random, Vec3f::zero(), 1.f, 30);
+    noNormals.getNormals().clear();
+    CHECK(!compact.Build(noNormals));
+    CHECK(!compact.Build(TriMesh()));
+}
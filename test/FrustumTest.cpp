@@ -0,0 +1,173 @@
+#include "Test.h"
+#include "Frustum.h"
+#include "SceneChunks.h"
+
+// A gluPerspective style projection with a 90 degree field of view, so the side planes are at 45 degrees
+static Matrix44f MakePerspective(const float aspect, const float nearClip, const float farClip)
+{
+    Matrix44f projection;
+    projection.at(0, 0) = 1.f / aspect;
+    projection.at(1, 1) = 1.f;
+    projection.at(2, 2) = (farClip + nearClip) / (nearClip - farClip);
+    projection.at(2, 3) = 2.f * farClip * nearClip / (nearClip - farClip);
+    projection.at(3, 2) = -1.f;
+    projection.at(3, 3) = 0.f;
+    return projection;
+}
+
+static Vec4f Normalized(const Vec4f& plane)
+{
+    const float length = Vec3f(plane.x, plane.y, plane.z).length();
+    return Vec4f(plane.x / length, plane.y / length, plane.z / length, plane.w / length);
+}
+
+static void CheckPlane(const Vec4f& expected, const Vec4f& plane)
+{
+    const Vec4f normalized = Normalized(plane);
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        CHECK_CLOSE(expected[i], normalized[i], 1e-5 * max(1.f, math<float>::abs(expected[i])));
+    }
+}
+
+static Bounds MakeBox(const Vec3f& center, const float halfSize)
+{
+    return Bounds(center - Vec3f::one() * halfSize, center + Vec3f::one() * halfSize);
+}
+
+// The identity is the clip cube itself, each plane is a row 3 +- row i pair
+TEST(FrustumPlanesOfIdentity)
+{
+    const Frustum frustum((Matrix44f()));
+    const Vec4f expected[6] = { Vec4f( 1.f, 0.f, 0.f, 1.f), Vec4f(-1.f, 0.f, 0.f, 1.f),
+                                Vec4f(0.f,  1.f, 0.f, 1.f), Vec4f(0.f, -1.f, 0.f, 1.f),
+                                Vec4f(0.f, 0.f,  1.f, 1.f), Vec4f(0.f, 0.f, -1.f, 1.f) };
+    for (uint32_t i = 0; i < 6; i++)
+    {
+        CHECK_EQUAL(expected[i], frustum.m_planes[i]);
+    }
+}
+
+TEST(FrustumPlanesOfPerspective)
+{
+    const Frustum frustum(MakePerspective(1.f, 1.f, 100.f));
+    const float c_diagonal = 1.f / math<float>::sqrt(2.f);
+    CheckPlane(Vec4f( c_diagonal, 0.f, -c_diagonal, 0.f), frustum.m_planes[0]);    // left
+    CheckPlane(Vec4f(-c_diagonal, 0.f, -c_diagonal, 0.f), frustum.m_planes[1]);    // right
+    CheckPlane(Vec4f(0.f,  c_diagonal, -c_diagonal, 0.f), frustum.m_planes[2]);    // bottom
+    CheckPlane(Vec4f(0.f, -c_diagonal, -c_diagonal, 0.f), frustum.m_planes[3]);    // top
+    CheckPlane(Vec4f(0.f, 0.f, -1.f, -1.f), frustum.m_planes[4]);                  // near
+    CheckPlane(Vec4f(0.f, 0.f,  1.f, 100.f), frustum.m_planes[5]);                 // far
+}
+
+TEST(FrustumInsideOutsideStraddling)
+{
+    const Frustum frustum(MakePerspective(1.f, 1.f, 100.f));
+
+    CHECK(frustum.Intersects(MakeBox(Vec3f(0.f, 0.f, -10.f), 0.5f)));
+    CHECK(frustum.Intersects(MakeBox(Vec3f(5.f, -5.f, -50.f), 2.f)));
+
+    CHECK(!frustum.Intersects(MakeBox(Vec3f(0.f, 0.f, 5.f), 0.5f)));         // behind the eye
+    CHECK(!frustum.Intersects(MakeBox(Vec3f(-20.f, 0.f, -10.f), 0.5f)));     // left
+    CHECK(!frustum.Intersects(MakeBox(Vec3f(0.f, 20.f, -10.f), 0.5f)));      // above
+    CHECK(!frustum.Intersects(MakeBox(Vec3f(0.f, 0.f, -0.25f), 0.5f)));      // before the near plane
+    CHECK(!frustum.Intersects(MakeBox(Vec3f(0.f, 0.f, -200.f), 0.5f)));      // past the far plane
+
+    CHECK(frustum.Intersects(MakeBox(Vec3f(0.f, 0.f, -1.f), 0.5f)));         // across the near plane
+    CHECK(frustum.Intersects(MakeBox(Vec3f(0.f, 0.f, -100.f), 0.5f)));       // across the far plane
+    CHECK(frustum.Intersects(MakeBox(Vec3f(-10.f, 0.f, -10.f), 0.5f)));      // across the left plane
+    CHECK(frustum.Intersects(MakeBox(Vec3f(0.f, -10.5f, -10.f), 1.f)));      // across the bottom plane
+    CHECK(frustum.Intersects(MakeBox(Vec3f(0.f, 0.f, 0.f), 1000.f)));        // around the whole frustum
+
+    CHECK(!frustum.Intersects(Bounds()));
+}
+
+TEST(FrustumFollowsTheView)
+{
+    const Matrix44f view = Matrix44f::createTranslation(Vec3f(-100.f, 0.f, 20.f));  // eye at (100, 0, -20)
+    const Frustum frustum(MakePerspective(2.f, 1.f, 100.f) * view);
+    CHECK(frustum.Intersects(MakeBox(Vec3f(100.f, 0.f, -30.f), 0.5f)));
+    CHECK(frustum.Intersects(MakeBox(Vec3f(80.f, 0.f, -30.f), 0.5f)));       // inside the wider aspect
+    CHECK(!frustum.Intersects(MakeBox(Vec3f(100.f, 20.f, -30.f), 0.5f)));
+    CHECK(!frustum.Intersects(MakeBox(Vec3f(0.f, 0.f, -30.f), 0.5f)));
+    CHECK(!frustum.Intersects(MakeBox(Vec3f(100.f, 0.f, -10.f), 0.5f)));
+}
+
+TEST(FrustumDefaultContainsEverything)
+{
+    const Frustum frustum;
+    CHECK(frustum.Intersects(MakeBox(Vec3f(0.f, 0.f, 0.f), 0.5f)));
+    CHECK(frustum.Intersects(MakeBox(Vec3f(-1e6f, 1e6f, 1e6f), 0.5f)));
+    CHECK(!frustum.Intersects(Bounds()));
+}
+
+// Unit triles centred on their position, the way the trile meshes are built
+struct ChunkTestTrile
+{
+    Vec3f pos;
+
+    ChunkTestTrile(const float x, const float y, const float z) :
+        pos(x, y, z)
+    {
+    }
+
+    Bounds GetBounds() const
+    {
+        return Bounds(pos - Vec3f(0.5f, 0.5f, 0.5f), pos + Vec3f(0.5f, 0.5f, 0.5f));
+    }
+};
+
+TEST(SceneChunksEdgesAndNegativeCoordinates)
+{
+    vector<ChunkTestTrile> triles;
+    triles.push_back(ChunkTestTrile(0.f, 0.f, 0.f));
+    triles.push_back(ChunkTestTrile(15.f, 15.f, 15.f));
+    triles.push_back(ChunkTestTrile(15.5f, 0.f, 0.f));      // bounds across x = 16, centre still inside
+    triles.push_back(ChunkTestTrile(16.f, 0.f, 0.f));       // centre on the edge belongs to the next chunk
+    triles.push_back(ChunkTestTrile(-0.5f, 0.f, 0.f));
+    triles.push_back(ChunkTestTrile(-1.f, -1.f, -1.f));
+    triles.push_back(ChunkTestTrile(-16.f, 0.f, -16.f));
+    triles.push_back(ChunkTestTrile(-16.5f, 0.f, 0.f));
+    triles.push_back(ChunkTestTrile(-17.f, 32.f, -33.f));
+    triles.push_back(ChunkTestTrile(3.f, 5.f, 7.f));
+    const Vec3i expected[] = { Vec3i(0, 0, 0), Vec3i(0, 0, 0), Vec3i(0, 0, 0), Vec3i(1, 0, 0), Vec3i(-1, 0, 0),
+                               Vec3i(-1, -1, -1), Vec3i(-1, 0, -1), Vec3i(-2, 0, 0), Vec3i(-2, 2, -3), Vec3i(0, 0, 0) };
+
+    SceneChunks chunks;
+    chunks.AddTriles(triles);
+    CHECK_EQUAL(triles.size(), chunks.m_trileChunks.size());
+    CHECK_EQUAL((size_t)7, chunks.m_chunks.size());
+    for (uint32_t i = 0; i < triles.size(); i++)
+    {
+        const SceneChunk& chunk = chunks.m_chunks[chunks.m_trileChunks[i]];
+        CHECK_EQUAL(expected[i], chunk.coord);
+        CHECK_EQUAL(expected[i], SceneChunks::GetChunkCoord(triles[i].pos));
+        CHECK(find(chunk.triles.begin(), chunk.triles.end(), i) != chunk.triles.end());
+
+        Bounds bounds = chunk.bounds;
+        bounds.Include(triles[i].GetBounds());
+        CHECK(bounds.min == chunk.bounds.min && bounds.max == chunk.bounds.max);
+    }
+
+    // Chunks with the same coordinates on different axes stay apart
+    CHECK(SceneChunks::GetChunkKey(Vec3f(-1.f, 0.f, 0.f)) != SceneChunks::GetChunkKey(Vec3f(0.f, -1.f, 0.f)));
+    CHECK(SceneChunks::GetChunkKey(Vec3f(-1.f, 0.f, 0.f)) != SceneChunks::GetChunkKey(Vec3f(0.f, 0.f, -1.f)));
+    CHECK(SceneChunks::GetChunkKey(Vec3f(-1.f, 0.f, 0.f)) != SceneChunks::GetChunkKey(Vec3f(16.f, 0.f, 0.f)));
+}
+
+// A chunk is culled as a whole, by the bounds that grew to fit everything assigned to it
+TEST(SceneChunksCullWithGrownBounds)
+{
+    vector<ChunkTestTrile> triles;
+    triles.push_back(ChunkTestTrile(15.5f, 0.f, -10.f));
+    triles.push_back(ChunkTestTrile(40.f, 0.f, -10.f));
+
+    SceneChunks chunks;
+    chunks.AddTriles(triles);
+    const Matrix44f view = Matrix44f::createTranslation(Vec3f(-25.75f, 0.f, 0.f));  // left plane at x = 15.75 for z = -10
+    CHECK(chunks.Cull(Frustum(MakePerspective(1.f, 1.f, 100.f) * view)));
+    CHECK(chunks.IsTrileVisible(0));
+    CHECK(!chunks.IsTrileVisible(1));
+    CHECK_EQUAL(1u, chunks.m_numVisible);
+    CHECK(chunks.IsTrileVisible(2));    // added after the chunks were built
+}
@@ -0,0 +1,184 @@
+#include "Test.h"
+#include "LevelReader.h"
+#include <fstream>
+#include <random>
+
+static const char* c_levelXmlFile = "LevelReaderTest.xml";
+
+// Numbers the way the FEZ exporter writes them, and a few it could
+static string FormatFloat(mt19937* pRandom)
+{
+    const char* formats[] = { "%g", "%.7g", "%.9g", "%E", "%.3f", "%e" };
+    const float value = uniform_real_distribution<float>(-200.f, 200.f)(*pRandom) * ((*pRandom)() % 3 == 0 ? 1e-4f : 1.f);
+    char buffer[64];
+    sprintf(buffer, formats[(*pRandom)() % 6], (*pRandom)() % 17 == 0 ? -0.f : value);
+    return buffer;
+}
+
+static void WriteVector3(ostream& xml, const char* name, mt19937* pRandom)
+{
+    xml << "<" << name << ">\n  <Vector3 x=\"" << FormatFloat(pRandom) << "\" y=\"" << FormatFloat(pRandom) << "\" z=\"" << FormatFloat(pRandom) << "\" />\n</" << name << ">\n";
+}
+
+static void WriteQuaternion(ostream& xml, mt19937* pRandom)
+{
+    xml << "<Rotation><Quaternion x=\"" << FormatFloat(pRandom) << "\" y=\"" << FormatFloat(pRandom) << "\" z=\"" << FormatFloat(pRandom) << "\" w=\"" << FormatFloat(pRandom) << "\" /></Rotation>\n";
+}
+
+static const char* Bool(mt19937* pRandom)
+{
+    return (*pRandom)() % 2 ? "True" : "False";
+}
+
+static void WriteLevel(ostream& xml, mt19937* pRandom)
+{
+    xml << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+           "<!-- Exported level -->\n"
+           "<Level name=\"TEST_LEVEL\" cameraDistance=\"-1\" skyName=\"DEFAULT\" trileSetName=\"Untitled &amp; &quot;Co&quot;\" flat=\"False\">\n"
+           "<Name>TEST_LEVEL</Name>\n";
+    WriteVector3(xml, "Size", pRandom);
+    xml << "<StartingPosition><TrileFace face=\"Front\"><TrileId x=\"1\" y=\"2\" z=\"3\" /></TrileFace></StartingPosition>\n"
+           "<Volumes><Entry key=\"0\"><Volume><Orientations><FaceOrientation>Front</FaceOrientation></Orientations></Volume></Entry></Volumes>\n"
+           "<Triles>\n";
+    for (uint32_t i = 0; i < 500; i++)
+    {
+        xml << "<Entry>\n<TrileEmplacement x=\"" << (int32_t)((*pRandom)() % 64) - 8 << "\" y=\"" << (*pRandom)() % 64 << "\" z=\"" << (*pRandom)() % 64 << "\" />\n"
+               "<TrileInstance trileId=\"" << (int32_t)((*pRandom)() % 300) - 1 << "\" orientation=\"" << (*pRandom)() % 4 << "\">\n";
+        WriteVector3(xml, "Position", pRandom);
+        if (i % 7 == 0)
+        {
+            xml << "<ActorSettings><TrileInstanceActorSettings inactive=\"False\" /></ActorSettings>\n";
+        }
+        if (i % 5 == 0)
+        {
+            xml << "<OverlappedTriles><TrileInstance trileId=\"" << (*pRandom)() % 300 << "\" orientation=\"" << (*pRandom)() % 4 << "\">\n";
+            WriteVector3(xml, "Position", pRandom);
+            xml << "</TrileInstance></OverlappedTriles>\n";
+        }
+        xml << "</TrileInstance>\n</Entry>\n";
+    }
+    xml << "</Triles>\n<ArtObjects>\n";
+    for (uint32_t i = 0; i < 60; i++)
+    {
+        xml << "<Entry key=\"" << i << "\"><ArtObjectInstance name=\"AO_" << i << (i % 9 == 0 ? "&lt;&#65;&gt;" : "") << "\">\n";
+        WriteVector3(xml, "Position", pRandom);
+        WriteQuaternion(xml, pRandom);
+        WriteVector3(xml, "Scale", pRandom);
+        xml << "<ActorSettings><ArtObjectActorSettings inactive=\"False\"><SubtitleColor><Color r=\"1\" g=\"1\" b=\"1\" a=\"1\" /></SubtitleColor></ArtObjectActorSettings></ActorSettings>\n"
+               "</ArtObjectInstance></Entry>\n";
+    }
+    xml << "</ArtObjects>\n<BackgroundPlanes>\n";
+    for (uint32_t i = 0; i < 80; i++)
+    {
+        const bool animated = (*pRandom)() % 3 == 0;
+        xml << "<Entry key=\"" << i << "\"><BackgroundPlane textureName=\"plane_" << i << "\" animated=\"" << (animated ? "True" : "False") <<
+               "\" doubleSided=\"" << Bool(pRandom) << "\" opacity=\"1\" billboard=\"" << Bool(pRandom) << "\" lightMap=\"" << Bool(pRandom) <<
+               "\" pixelatedLightmap=\"" << Bool(pRandom) << "\" clampTexture=\"" << Bool(pRandom) << "\"";
+        if (animated)
+        {
+            xml << " xTextureRepeat=\"" << Bool(pRandom) << "\" yTextureRepeat=\"" << Bool(pRandom) << "\"";
+        }
+        xml << ">\n";
+        WriteVector3(xml, "Position", pRandom);
+        WriteQuaternion(xml, pRandom);
+        WriteVector3(xml, "Scale", pRandom);
+        xml << "<Filter><Color r=\"1\" g=\"1\" b=\"1\" a=\"1\" /></Filter>\n</BackgroundPlane></Entry>\n";
+    }
+    xml << "</BackgroundPlanes>\n<Groups />\n<Scripts />\n</Level>\n";
+}
+
+static void CheckSameQuaternion(const Quatf& expected, const Quatf& actual)
+{
+    CHECK_EQUAL(expected.v, actual.v);
+    CHECK_EQUAL(expected.w, actual.w);
+}
+
+TEST(LevelReaderMatchesXmlTree)
+{
+    mt19937 random(2015);
+    {
+        ofstream xml(c_levelXmlFile, ios::binary);
+        WriteLevel(xml, &random);
+    }
+
+    LevelReader pulled;
+    CHECK(pulled.Read(c_levelXmlFile));
+    LevelReader tree;
+    tree.ReadTree(XmlTree(loadFile(c_levelXmlFile)));
+    remove(c_levelXmlFile);
+
+    CHECK_EQUAL(tree.m_size, pulled.m_size);
+    CHECK_EQUAL(string("Untitled & \"Co\""), tree.m_trileSetName);
+    CHECK_EQUAL(tree.m_trileSetName, pulled.m_trileSetName);
+
+    CHECK_EQUAL((size_t)600, tree.m_triles.size());
+    CHECK_EQUAL(tree.m_triles.size(), pulled.m_triles.size());
+    for (size_t i = 0; i < min(tree.m_triles.size(), pulled.m_triles.size()); i++)
+    {
+        CHECK_EQUAL(tree.m_triles[i].trileId, pulled.m_triles[i].trileId);
+        CHECK_EQUAL(tree.m_triles[i].orientation, pulled.m_triles[i].orientation);
+        CHECK_EQUAL(tree.m_triles[i].position, pulled.m_triles[i].position);
+        CHECK_EQUAL(tree.m_triles[i].emplacement, pulled.m_triles[i].emplacement);
+    }
+
+    CHECK_EQUAL((size_t)60, tree.m_artObjects.size());
+    CHECK_EQUAL(tree.m_artObjects.size(), pulled.m_artObjects.size());
+    CHECK_EQUAL(string("AO_0<A>"), tree.m_artObjects[0].name);
+    for (size_t i = 0; i < min(tree.m_artObjects.size(), pulled.m_artObjects.size()); i++)
+    {
+        CHECK_EQUAL(tree.m_artObjects[i].name, pulled.m_artObjects[i].name);
+        CHECK_EQUAL(tree.m_artObjects[i].position, pulled.m_artObjects[i].position);
+        CheckSameQuaternion(tree.m_artObjects[i].rotation, pulled.m_artObjects[i].rotation);
+        CHECK_EQUAL(tree.m_artObjects[i].scale, pulled.m_artObjects[i].scale);
+    }
+
+    CHECK_EQUAL((size_t)80, tree.m_backgroundPlanes.size());
+    CHECK_EQUAL(tree.m_backgroundPlanes.size(), pulled.m_backgroundPlanes.size());
+    for (size_t i = 0; i < min(tree.m_backgroundPlanes.size(), pulled.m_backgroundPlanes.size()); i++)
+    {
+        const LevelPlaneRecord& expected = tree.m_backgroundPlanes[i];
+        const LevelPlaneRecord& actual = pulled.m_backgroundPlanes[i];
+        CHECK_EQUAL(expected.textureName, actual.textureName);
+        CHECK_EQUAL(expected.position, actual.position);
+        CheckSameQuaternion(expected.rotation, actual.rotation);
+        CHECK_EQUAL(expected.scale, actual.scale);
+        CHECK_EQUAL(expected.animated, actual.animated);
+        CHECK_EQUAL(expected.doubleSided, actual.doubleSided);
+        CHECK_EQUAL(expected.billboard, actual.billboard);
+        CHECK_EQUAL(expected.lightmap, actual.lightmap);
+        CHECK_EQUAL(expected.pixelatedLightmap, actual.pixelatedLightmap);
+        CHECK_EQUAL(expected.clampTexture, actual.clampTexture);
+        CHECK_EQUAL(expected.xTextureRepeat, actual.xTextureRepeat);
+        CHECK_EQUAL(expected.yTextureRepeat, actual.yTextureRepeat);
+    }
+}
+
+TEST(LevelReaderRejectsBadFiles)
+{
+    LevelReader reader;
+    CHECK(!reader.Read("LevelReaderTestMissing.xml"));
+
+    {
+        ofstream xml(c_levelXmlFile, ios::binary);
+        xml << "<?xml version=\"1.0\"?>\n<TrileSet name=\"Untitled\"></TrileSet>\n";
+    }
+    CHECK(!reader.Read(c_levelXmlFile));
+    remove(c_levelXmlFile);
+}
+
+static string DecodeXml(const char* str)
+{
+    return XmlString(str, str + strlen(str)).str();
+}
+
+// Unknown entities and a bare '&' are text, nothing after them is repeated or dropped
+TEST(XmlStringDecodesEntities)
+{
+    CHECK_EQUAL(string("Untitled & \"Co\" <A>"), DecodeXml("Untitled &amp; &quot;Co&quot; &lt;A&gt;"));
+    CHECK_EQUAL(string("AB"), DecodeXml("&#65;&#x42;"));
+    CHECK_EQUAL(string("a&b;c"), DecodeXml("a&b;c"));
+    CHECK_EQUAL(string("&"), DecodeXml("&"));
+    CHECK_EQUAL(string("a & b"), DecodeXml("a & b"));
+    CHECK_EQUAL(string("a &amp"), DecodeXml("a &amp"));
+    CHECK_EQUAL(string("&;&"), DecodeXml("&;&amp;"));
+}
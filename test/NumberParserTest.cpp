@@ -0,0 +1,162 @@
+#include "Test.h"
+#include "NumberParser.h"
+#include <cstdlib>
+#include <random>
+
+static uint32_t FloatBits(const float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// The next representable value away from zero (step 1) or towards it (step -1), for positive values
+template<typename T, typename Bits>
+static T Step(const T value, const int32_t step)
+{
+    Bits bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bits += step;
+    T result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+// Bit for bit, so negative zero and the last place both count
+static void CheckMatchesStrtof(const string& str)
+{
+    float value = 12345.f;
+    const bool parsed = NumberParser::ParseFloat(str.data(), str.data() + str.size(), &value);
+    const float expected = strtof(str.c_str(), nullptr);
+    if (!parsed || FloatBits(value) != FloatBits(expected))
+    {
+        cout << "  \"" << str << "\"" << endl;
+    }
+    CHECK(parsed);
+    CHECK_EQUAL(FloatBits(expected), FloatBits(value));
+}
+
+static string Format(const char* format, const double value)
+{
+    char buffer[512];
+    sprintf(buffer, format, value);
+    return buffer;
+}
+
+TEST(ParseFloatFixedCases)
+{
+    const char* cases[] =
+    {
+        "0", "-0", "+0", "0.0", "-0.0", "-0.000", "-0E+00", "-0e-7", "00000000000000000000", "-.0",
+        "1", "-1", "1.", ".5", "-.5", "0.1", "0.2", "0.3", "1.5", "-2.25", "0.0625", "100", "1e0",
+        // Exponents, in the .NET style FEZ was exported with and others
+        "1E+10", "1E-10", "4.76837158E-07", "-1.1920929E-07", "2.5e3", "2.5E+003", "7e22", "7e-22", "1e38",
+        "3.4028234e38", "1.17549435E-38", "1.2e-37", "9.99999944E-11", "1e+1", "123456789e-17", "5e-5",
+        // The longest mantissas FEZ writes, round trip floats, and longer doubles
+        "0.49999997", "-1.00000012", "0.333333343", "16777216", "16777217", "16777218", "16777219",
+        "33554433", "0.100000001490116119384765625", "-3.14159274101257324", "0.999999940395355224609375",
+        "1.00000005960464477539062500000001", "1.000000059604644775390625", "1.00000017881393432617187499",
+        "12345678901234567890", "123456789012345678901234567890", "0.000000000000000000000000000001",
+        "98765.4321e-3", "1234567.8125", "8388608.5", "8388609.5", "-4194304.25", "0.00000011920928955078125"
+    };
+    for (const char* str : cases)
+    {
+        CheckMatchesStrtof(str);
+    }
+
+    float value = 0.f;
+    const string negativeZero = "-0";
+    CHECK(NumberParser::ParseFloat(negativeZero.data(), negativeZero.data() + negativeZero.size(), &value));
+    CHECK_EQUAL(0x80000000u, FloatBits(value));
+}
+
+TEST(ParseFloatRandomFloats)
+{
+    mt19937 random(16);
+    uniform_int_distribution<int32_t> exponents(-30, 30);
+    const char* formats[] = { "%.9g", "%.8g", "%.7g", "%.6g", "%.17g", "%.9E", "%.3e", "%.12f", "%.25g" };
+    for (uint32_t i = 0; i < 200000; i++)
+    {
+        // Any finite float in range, from its bits, or a decimal with a power of ten scale
+        float value;
+        if (i % 2)
+        {
+            uint32_t bits = random();
+            memcpy(&value, &bits, sizeof(value));
+            if (!(fabs(value) >= FLT_MIN && fabs(value) <= 1e30f))
+            {
+                continue;
+            }
+        }
+        else
+        {
+            value = (float)(uniform_real_distribution<double>(-1.0, 1.0)(random) * pow(10.0, exponents(random)));
+        }
+        CheckMatchesStrtof(Format(formats[i % 9], value));
+    }
+}
+
+// Decimals exactly halfway between two floats, where a double rounding would go wrong, and either side of them
+TEST(ParseFloatMidpoints)
+{
+    mt19937 random(17);
+    uniform_int_distribution<int32_t> exponents(-40, 40);
+    for (uint32_t i = 0; i < 20000; i++)
+    {
+        const float lo = (float)(uniform_real_distribution<double>(1.0, 2.0)(random) * pow(2.0, exponents(random)));
+        const float hi = Step<float, uint32_t>(lo, 1);
+        const double midpoint = ((double)lo + (double)hi) / 2;
+        CheckMatchesStrtof(Format("%.60g", midpoint));
+        CheckMatchesStrtof(Format("%.17g", midpoint));
+        CheckMatchesStrtof(Format("%.17g", Step<double, uint64_t>(midpoint, -1)));
+        CheckMatchesStrtof(Format("%.17g", Step<double, uint64_t>(midpoint, 1)));
+        CheckMatchesStrtof(Format("-%.17g", midpoint));
+    }
+
+    // Integers on float midpoints, short enough for the double fast path
+    for (uint64_t value = (1 << 24) + 1; value < (1 << 24) + 100; value += 2)
+    {
+        CheckMatchesStrtof(Format("%.0f", (double)value));
+        CheckMatchesStrtof(Format("%.0f", (double)(value << 20)));
+    }
+}
+
+TEST(ParseFloatSurroundings)
+{
+    float value = 7.f;
+    const string padded = " \t-12.5e1 ";
+    CHECK(NumberParser::ParseFloat(padded.data(), padded.data() + padded.size(), &value));
+    CHECK_EQUAL(-125.f, value);
+
+    // A number cut short by the end of the range, as inside a bigger buffer
+    const string cut = "3.75e2";
+    CHECK(NumberParser::ParseFloat(cut.data(), cut.data() + 3, &value));
+    CHECK_EQUAL(3.7f, value);
+
+    value = 7.f;
+    const char* invalid[] = { "", "-", ".", "e5", "x1", " " };
+    for (const char* str : invalid)
+    {
+        CHECK(!NumberParser::ParseFloat(str, str + strlen(str), &value));
+        CHECK_EQUAL(7.f, value);
+    }
+}
+
+TEST(ParseInt)
+{
+    const char* cases[] = { "0", "-0", "7", "-7", "+42", "2147483647", "-2147483648", "0012" };
+    for (const char* str : cases)
+    {
+        int32_t value = 0;
+        CHECK(NumberParser::ParseInt(str, str + strlen(str), &value));
+        CHECK_EQUAL((int32_t)strtol(str, nullptr, 10), value);
+    }
+
+    int32_t value = 9;
+    const char* invalid[] = { "", "-", "2147483648", "-2147483649", "99999999999999999999" };
+    for (const char* str : invalid)
+    {
+        CHECK(!NumberParser::ParseInt(str, str + strlen(str), &value));
+        CHECK_EQUAL(9, value);
+    }
+}
@@ -0,0 +1,198 @@
+#include "Test.h"
+#include "PlaneInstancing.h"
+#include <random>
+
+// c_planeInstanceVert on the CPU, for a vertex of the shared quad
+static Vec3f ShadePosition(const PlaneInstance& instance, const Vec3f& vertex, const float billboardRadians)
+{
+    Vec3f pos(vertex.x * instance.scale.x, vertex.y * instance.scale.y, vertex.z);
+    if (instance.position.w > 0.5f)
+    {
+        const float s = math<float>::sin(billboardRadians);
+        const float c = math<float>::cos(billboardRadians);
+        pos = Vec3f(c * pos.x + s * pos.z, pos.y, c * pos.z - s * pos.x);
+    }
+    else
+    {
+        const Vec3f q = instance.rotation.xyz();
+        pos += 2.f * q.cross(q.cross(pos) + instance.rotation.w * pos);
+    }
+    return pos + instance.position.xyz();
+}
+
+static Vec2f ShadeTexcoord(const PlaneInstance& instance, const Vec4f& frame, const Vec2f& texcoord)
+{
+    return Vec2f((texcoord.x * instance.scale.z + frame.z) * frame.x, (texcoord.y * instance.scale.w + frame.w) * frame.y);
+}
+
+// The matrix BackgroundPlane::ApplyTransform() multiplies onto the modelview stack
+static Matrix44f GetFixedFunctionTransform(const BackgroundPlane& bp, const float billboardAngle)
+{
+    Matrix44f transform = Matrix44f::createTranslation(bp.m_pos);
+    if (bp.m_billboard)
+    {
+        transform = transform * Matrix44f::createRotation(Vec3f::yAxis(), toRadians(billboardAngle));
+    }
+    else if (math<float>::abs(bp.m_rot.getAngle()) > 1e-6f)
+    {
+        transform = transform * Matrix44f::createRotation(bp.m_rot.getAxis(), bp.m_rot.getAngle());
+    }
+    return transform * Matrix44f::createScale(bp.m_scale);
+}
+
+// And the one ApplyTextureTransform() loads into the texture matrix
+static Matrix44f GetFixedFunctionTextureTransform(const BackgroundPlane& bp, const uint32_t index)
+{
+    const Vec2f scale = bp.m_spriteScale * bp.m_packedScale;
+    const Vec2f offset = bp.m_packOffset + bp.m_texIndices[index] + 2 * bp.m_packOffset * bp.m_texIndices[index];
+    return Matrix44f::createScale(Vec3f(scale.x, scale.y, 1.f)) * Matrix44f::createTranslation(Vec3f(offset.x, offset.y, 0.f));
+}
+
+static float Random(mt19937* pRandom, const float lo, const float hi)
+{
+    return uniform_real_distribution<float>(lo, hi)(*pRandom);
+}
+
+static void MakePlane(BackgroundPlane* pPlane, mt19937* pRandom, const bool billboard)
+{
+    pPlane->m_pos = Vec3f(Random(pRandom, -100.f, 100.f), Random(pRandom, -10.f, 60.f), Random(pRandom, -100.f, 100.f));
+    pPlane->m_scale = Vec3f(Random(pRandom, 0.5f, 40.f), Random(pRandom, 0.5f, 40.f), 1.f);
+    pPlane->m_rot = Quatf(Vec3f(Random(pRandom, -1.f, 1.f), Random(pRandom, 0.1f, 1.f), Random(pRandom, -1.f, 1.f)), Random(pRandom, 0.1f, 6.f));
+    pPlane->m_billboard = billboard;
+
+    // Repeating planes scale their texcoords, like the BackgroundPlane constructor does
+    const Vec2f repeat(floor(Random(pRandom, 1.f, 5.f)), floor(Random(pRandom, 1.f, 3.f)));
+    pPlane->m_mesh.getVertices().assign(&c_positions[0], &c_positions[4]);
+    pPlane->m_mesh.getTexCoords().clear();
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        pPlane->m_mesh.getTexCoords().push_back(c_texcoords[i] * repeat);
+    }
+
+    // A sprite sheet packed into an atlas
+    const uint32_t columns = 1 + (*pRandom)() % 4;
+    pPlane->m_spriteScale = Vec2f(1.f / columns, 0.5f);
+    pPlane->m_packedScale = Vec2f(Random(pRandom, 0.1f, 1.f), Random(pRandom, 0.1f, 1.f));
+    pPlane->m_packOffset = Vec2f(Random(pRandom, 0.f, 0.1f), Random(pRandom, 0.f, 0.1f));
+    pPlane->m_texIndices.clear();
+    for (uint32_t i = 0; i < columns * 2; i++)
+    {
+        pPlane->m_texIndices.push_back(Vec2f((float)(i % columns), (float)(i / columns)));
+    }
+}
+
+static void CheckPacking(const BackgroundPlane& bp, const float billboardAngle)
+{
+    const PlaneInstance instance = PlaneInstanceGroups::PackInstance(bp);
+    const Matrix44f transform = GetFixedFunctionTransform(bp, billboardAngle);
+    for (uint32_t v = 0; v < 4; v++)
+    {
+        const Vec3f expected = transform.transformPointAffine(bp.m_mesh.getVertices()[v]);
+        const Vec3f shaded = ShadePosition(instance, c_positions[v], toRadians(billboardAngle));
+        CHECK_CLOSE(0.f, expected.distance(shaded), 1e-3f);
+    }
+
+    for (uint32_t index = 0; index < bp.m_texIndices.size(); index++)
+    {
+        const Vec4f frame = PlaneInstanceGroups::PackFrame(bp, index);
+        const Matrix44f textureTransform = GetFixedFunctionTextureTransform(bp, index);
+        for (uint32_t v = 0; v < 4; v++)
+        {
+            const Vec2f texcoord = bp.m_mesh.getTexCoords()[v];
+            const Vec3f expected = textureTransform.transformPointAffine(Vec3f(texcoord.x, texcoord.y, 0.f));
+            const Vec2f shaded = ShadeTexcoord(instance, frame, c_texcoords[v]);
+            CHECK_CLOSE(expected.x, shaded.x, 1e-5f);
+            CHECK_CLOSE(expected.y, shaded.y, 1e-5f);
+        }
+    }
+}
+
+TEST(PlaneInstanceMatchesFixedFunction)
+{
+    mt19937 random(42);
+    BackgroundPlane bp((TriMesh()));
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        MakePlane(&bp, &random, false);
+        CheckPacking(bp, Random(&random, -180.f, 180.f));
+    }
+
+    // No rotation at all, which gl::rotate() skips
+    bp.m_rot = Quatf();
+    CheckPacking(bp, 0.f);
+}
+
+TEST(PlaneInstanceBillboardsMatchFixedFunction)
+{
+    mt19937 random(43);
+    BackgroundPlane bp((TriMesh()));
+    const float angles[] = { 0.f, 45.f, 90.f, -90.f, 180.f, 270.f, 333.3f };
+    for (uint32_t i = 0; i < 20; i++)
+    {
+        MakePlane(&bp, &random, true);
+        for (const float angle : angles)
+        {
+            CheckPacking(bp, angle);
+        }
+    }
+}
+
+static TextureRef MakeTexture(const bool translucent)
+{
+    Surface surface(2, 2, true);
+    memset(surface.getData(), 255, surface.getRowBytes() * surface.getHeight());
+    if (translucent)
+    {
+        surface.getData()[surface.getAlphaOffset()] = 128;
+    }
+    return TextureRef(new TextureEntry(fs::path(), surface, SamplerState()));
+}
+
+// Translucent planes are left to the depth sorted queue, translucent lightmaps are still instanced
+TEST(PlaneInstanceGroupsLeaveOutTranslucent)
+{
+    mt19937 random(44);
+    const TextureRef pCutout = MakeTexture(false);
+    const TextureRef pTranslucent = MakeTexture(true);
+    CHECK(!pCutout->IsTranslucent());
+    CHECK(pTranslucent->IsTranslucent());
+
+    deque<BackgroundPlane> planes;
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        planes.push_back(BackgroundPlane((TriMesh())));
+        BackgroundPlane& bp = planes.back();
+        MakePlane(&bp, &random, i == 3);
+        bp.m_texture = i % 2 ? pTranslucent : pCutout;
+        bp.m_lightmap = i == 5;
+        bp.m_doubleSided = i == 2;
+    }
+
+    PlaneInstanceGroups groups;
+    groups.Build(planes);
+    CHECK_EQUAL(8u, groups.m_numPlanes);
+    CHECK_EQUAL(3u, (uint32_t)groups.m_translucent.size());
+    CHECK_EQUAL(1u, groups.m_translucent[0]);
+    CHECK_EQUAL(3u, groups.m_translucent[1]);
+    CHECK_EQUAL(7u, groups.m_translucent[2]);
+    CHECK_EQUAL(5u, (uint32_t)groups.m_instances.size());
+
+    // Single sided cutouts, double sided cutouts, then the lightmap
+    CHECK_EQUAL(3u, (uint32_t)groups.m_groups.size());
+    CHECK_EQUAL(3u, groups.m_groups[0].numInstances);
+    CHECK(groups.m_groups[1].doubleSided);
+    CHECK(groups.m_groups[2].additive);
+    CHECK_EQUAL(5u, groups.m_planeIndices[groups.m_groups[2].firstInstance]);
+
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        const bool grouped = find(groups.m_translucent.begin(), groups.m_translucent.end(), i) == groups.m_translucent.end();
+        CHECK_EQUAL(grouped, groups.m_planeInstances[i] != c_noInstance);
+        if (grouped)
+        {
+            const PlaneInstance& instance = groups.m_instances[groups.m_planeInstances[i]];
+            CHECK_EQUAL(i, groups.m_planeIndices[groups.m_planeInstances[i]]);
+            CHECK(instance.position.xyz() == planes[i].m_pos);
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#include "Test.h"
+#include "PlaneRenderQueue.h"
+
+TEST(PlaneSortKeyBitLayout)
+{
+    const uint64_t depthMax = (1 << PLANE_SORT_DEPTH_BITS) - 1;
+    CHECK_EQUAL(depthMax, PlaneRenderQueue::MakeSortKey(false, false, false, 0, 0.f));
+    CHECK_EQUAL((uint64_t)0, PlaneRenderQueue::MakeSortKey(false, false, false, 0, 1.f));
+    CHECK_EQUAL((uint64_t)1 << 63, PlaneRenderQueue::MakeSortKey(true, false, false, 0, 1.f));
+
+    // Cutout: cull mode and texture above the depth
+    CHECK_EQUAL((uint64_t)1 << (PLANE_SORT_DEPTH_BITS + PLANE_SORT_TEXTURE_BITS), PlaneRenderQueue::MakeSortKey(false, false, true, 0, 1.f));
+    CHECK_EQUAL((uint64_t)5 << PLANE_SORT_DEPTH_BITS, PlaneRenderQueue::MakeSortKey(false, false, false, 5, 1.f));
+
+    // Translucent: depth above cull mode and texture
+    CHECK_EQUAL((uint64_t)1 << 62, PlaneRenderQueue::MakeSortKey(false, true, false, 0, 1.f));
+    CHECK_EQUAL(((uint64_t)1 << 62) | (depthMax << (PLANE_SORT_TEXTURE_BITS + 1)), PlaneRenderQueue::MakeSortKey(false, true, false, 0, 0.f));
+    CHECK_EQUAL(((uint64_t)1 << 62) | ((uint64_t)1 << PLANE_SORT_TEXTURE_BITS) | 5, PlaneRenderQueue::MakeSortKey(false, true, true, 5, 1.f));
+
+    // The fields never overlap, whatever the inputs
+    const uint64_t all = PlaneRenderQueue::MakeSortKey(true, true, true, 0xFFFFFFFF, 0.f);
+    CHECK_EQUAL((uint64_t)1 << 63 | (uint64_t)1 << 62 | (((uint64_t)1 << (PLANE_SORT_DEPTH_BITS + PLANE_SORT_TEXTURE_BITS + 1)) - 1), all);
+    CHECK_EQUAL(PlaneRenderQueue::MakeSortKey(false, false, false, 3, 0.f), PlaneRenderQueue::MakeSortKey(false, false, false, 3 | (1 << PLANE_SORT_TEXTURE_BITS), 0.f));
+    CHECK_EQUAL(PlaneRenderQueue::MakeSortKey(false, false, false, 3, 0.f), PlaneRenderQueue::MakeSortKey(false, false, false, 3, -2.f));
+    CHECK_EQUAL(PlaneRenderQueue::MakeSortKey(false, true, false, 3, 1.f), PlaneRenderQueue::MakeSortKey(false, true, false, 3, 7.f));
+}
+
+TEST(PlaneSortKeyOrder)
+{
+    // Cutouts batch by state first, far to near within a texture
+    CHECK(PlaneRenderQueue::MakeSortKey(false, false, false, 1, 0.1f) < PlaneRenderQueue::MakeSortKey(false, false, false, 2, 0.9f));
+    CHECK(PlaneRenderQueue::MakeSortKey(false, false, false, 9, 0.1f) < PlaneRenderQueue::MakeSortKey(false, false, true, 0, 0.9f));
+    CHECK(PlaneRenderQueue::MakeSortKey(false, false, false, 1, 0.9f) < PlaneRenderQueue::MakeSortKey(false, false, false, 1, 0.1f));
+
+    // Translucent planes follow every cutout and go back to front across textures and cull modes
+    CHECK(PlaneRenderQueue::MakeSortKey(false, false, true, 9, 0.f) < PlaneRenderQueue::MakeSortKey(false, true, false, 0, 1.f));
+    CHECK(PlaneRenderQueue::MakeSortKey(false, true, false, 1, 0.9f) < PlaneRenderQueue::MakeSortKey(false, true, false, 2, 0.1f));
+    CHECK(PlaneRenderQueue::MakeSortKey(false, true, false, 2, 0.9f) < PlaneRenderQueue::MakeSortKey(false, true, false, 1, 0.1f));
+    CHECK(PlaneRenderQueue::MakeSortKey(false, true, true, 0, 0.5f) < PlaneRenderQueue::MakeSortKey(false, true, false, 0, 0.4f));
+    CHECK(PlaneRenderQueue::MakeSortKey(false, true, false, 0, 0.5f) < PlaneRenderQueue::MakeSortKey(false, true, true, 0, 0.5f));
+
+    // Lightmaps last
+    CHECK(PlaneRenderQueue::MakeSortKey(false, true, true, 9, 0.f) < PlaneRenderQueue::MakeSortKey(true, false, false, 0, 1.f));
+}
+
+TEST(TextureTranslucency)
+{
+    Surface surface(4, 3, true);
+    uint8_t* pData = surface.getData();
+    for (int32_t y = 0; y < surface.getHeight(); y++)
+    {
+        for (int32_t x = 0; x < surface.getWidth(); x++)
+        {
+            pData[y * surface.getRowBytes() + x * surface.getPixelInc() + surface.getAlphaOffset()] = (x + y) & 1 ? 255 : 0;
+        }
+    }
+    CHECK(!TextureEntry::IsTranslucent(surface));
+
+    // Entries share the pixels and only scan them when first asked
+    const TextureRef pEntry = TextureCache::Wrap(surface, SamplerState());
+    pData[2 * surface.getRowBytes() + 3 * surface.getPixelInc() + surface.getAlphaOffset()] = 128;
+    CHECK(TextureEntry::IsTranslucent(surface));
+    CHECK(pEntry->IsTranslucent());
+
+    CHECK(!TextureEntry::IsTranslucent(Surface(4, 3, false)));
+    CHECK(!TextureEntry::IsTranslucent(Surface()));
+}
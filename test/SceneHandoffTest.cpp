@@ -0,0 +1,87 @@
+#include "Test.h"
+#include "HandoffBenchmark.h"
+
+// A loader thread pushes triles through a short queue in batches of varying size, like the level loader
+// with its last partial batch, while this thread pops them. Every trile must arrive exactly once, in order.
+TEST(SceneHandoffQueueOrder)
+{
+    TrileGeometry geometry;
+    const uint32_t numTriles = 50000;
+    const uint32_t side = 37;
+    SpscQueue<SceneBatchRef, 4> queue;
+    atomic<bool> done(false);
+
+    thread loader([&]()
+    {
+        SceneBatchRef pBatch(new SceneBatch());
+        uint32_t batchTriles = 1;
+        for (uint32_t i = 0; i < numTriles; i++)
+        {
+            pBatch->triles.push_back(HandoffBenchmark::MakeTrile(geometry, i, side));
+            if (pBatch->triles.size() == batchTriles || i + 1 == numTriles)
+            {
+                while (!queue.Push(pBatch))
+                {
+                    this_thread::yield();
+                }
+                CHECK(!pBatch);
+                pBatch = SceneBatchRef(new SceneBatch());
+                batchTriles = batchTriles % 97 + 1;
+            }
+        }
+        done = true;
+    });
+
+    // Drains until the loader has finished, so lost triles fail the check rather than hang
+    deque<Trile> triles;
+    for (;;)
+    {
+        const bool finished = done;
+        SceneBatchRef pBatch;
+        if (queue.Pop(&pBatch))
+        {
+            CHECK(!pBatch->triles.empty());
+            triles.insert(triles.end(), pBatch->triles.begin(), pBatch->triles.end());
+        }
+        else if (finished)
+        {
+            break;
+        }
+        else
+        {
+            this_thread::yield();
+        }
+    }
+    loader.join();
+
+    CHECK(queue.IsEmpty());
+    CHECK_EQUAL(0u, HandoffBenchmark::CountMisplaced(triles, numTriles));
+}
+
+TEST(SceneHandoffCountMisplaced)
+{
+    TrileGeometry geometry;
+    deque<Trile> triles;
+    for (uint32_t i = 0; i < 10; i++)
+    {
+        triles.push_back(HandoffBenchmark::MakeTrile(geometry, i, 4));
+    }
+    CHECK_EQUAL(0u, HandoffBenchmark::CountMisplaced(triles, 10));
+    CHECK_EQUAL(2u, HandoffBenchmark::CountMisplaced(triles, 12));
+
+    swap(triles[3], triles[4]);
+    CHECK_EQUAL(2u, HandoffBenchmark::CountMisplaced(triles, 10));
+
+    // 0 1 2 4 4 5 6 7 8, one out of place and one missing
+    triles[4] = triles[3];
+    triles.pop_back();
+    CHECK_EQUAL(2u, HandoffBenchmark::CountMisplaced(triles, 10));
+}
+
+// The whole benchmark, both handoffs, at a size that still takes a few frames
+TEST(SceneHandoffBenchmark)
+{
+    ostringstream out;
+    CHECK(HandoffBenchmark::Run(3 * SCENE_BATCH_TRILES + 5, out));
+    CHECK(out.str().find("ERROR!") == string::npos);
+}
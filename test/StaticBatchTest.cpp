@@ -0,0 +1,142 @@
+#include "Test.h"
+#include "TestTriles.h"
+#include "StaticBatch.h"
+
+// Walks the batch chunks alongside the triles in the order Build() merges them and checks every triangle
+// is the trile's own, moved to the trile's position. Returns the number of triangles compared.
+template<typename TrileContainer>
+static uint32_t CheckGeometry(const StaticBatch& batch, const TrileContainer& triles)
+{
+    vector<pair<uint64_t, uint32_t> > order;
+    for (uint32_t i = 0; i < triles.size(); i++)
+    {
+        order.push_back(make_pair(SceneChunks::GetChunkKey(triles[i].GetBounds().GetCenter()), i));
+    }
+    sort(order.begin(), order.end());
+
+    uint32_t numTriangles = 0;
+    size_t chunk = 0;
+    size_t chunkTriangle = 0;
+    uint64_t chunkKey = order.empty() ? 0 : order[0].first;
+    for (const auto& entry : order)
+    {
+        const Trile& trile = triles[entry.second];
+        const TriMesh& mesh = trile.m_pGeometry->meshes[trile.m_orient];
+        if (chunk < batch.m_chunks.size() && chunkTriangle == batch.m_chunks[chunk].getNumTriangles())
+        {
+            chunk++;
+            chunkTriangle = 0;
+            chunkKey = entry.first;
+        }
+        CHECK_EQUAL(chunkKey, entry.first);
+        CHECK(chunk < batch.m_chunks.size());
+        if (chunk >= batch.m_chunks.size())
+        {
+            break;
+        }
+
+        const TriMesh& merged = batch.m_chunks[chunk];
+        Bounds bounds = batch.m_bounds[chunk];
+        bounds.Include(trile.GetBounds());
+        CHECK(bounds.min == batch.m_bounds[chunk].min && bounds.max == batch.m_bounds[chunk].max);
+        for (size_t tri = 0; tri < mesh.getNumTriangles(); tri++, chunkTriangle++)
+        {
+            for (uint32_t corner = 0; corner < 3; corner++)
+            {
+                const uint32_t index = mesh.getIndices()[tri * 3 + corner];
+                const uint32_t mergedIndex = merged.getIndices()[chunkTriangle * 3 + corner];
+                CHECK(mergedIndex < merged.getNumVertices());
+                CHECK_EQUAL(mesh.getVertices()[index] + trile.m_pos, merged.getVertices()[mergedIndex]);
+                CHECK_EQUAL(mesh.getNormals()[index], merged.getNormals()[mergedIndex]);
+                CHECK_EQUAL(mesh.getTexCoords()[index], merged.getTexCoords()[mergedIndex]);
+            }
+            numTriangles++;
+        }
+    }
+    CHECK_EQUAL(batch.m_chunks.size(), chunk + 1);
+    return numTriangles;
+}
+
+// Enough vertices in a single scene chunk to overflow a batch chunk at the default limit, away from
+// the scene chunk's edges so only the vertex limit splits it
+TEST(StaticBatchSplitsAtMaxVertices)
+{
+    const uint32_t c_quadsPerTrile = 750;
+    const uint32_t c_numTriles = 400;
+    TrileSet trileSet;
+    TestTriles::AddInterior(&trileSet, 1, c_quadsPerTrile);
+
+    vector<Trile> triles;
+    for (uint32_t i = 0; i < c_numTriles; i++)
+    {
+        triles.push_back(TestTriles::MakeTrile(trileSet, 1, Vec3f((float)(4 + i % 8), (float)(4 + i / 8 % 8), (float)(4 + i / 64)), i % NUM_ORIENTATIONS));
+    }
+
+    StaticBatch batch;
+    batch.Build(triles);
+
+    const uint32_t numVertices = c_quadsPerTrile * 4;
+    const uint32_t trilesPerChunk = STATIC_BATCH_MAX_VERTICES / numVertices;
+    CHECK_EQUAL((size_t)((c_numTriles + trilesPerChunk - 1) / trilesPerChunk), batch.m_chunks.size());
+    CHECK_EQUAL(c_numTriles, batch.m_numTriles);
+    CHECK_EQUAL(c_numTriles * numVertices, batch.GetNumVertices());
+    size_t numIndices = 0;
+    for (const TriMesh& chunk : batch.m_chunks)
+    {
+        CHECK(chunk.getNumVertices() <= STATIC_BATCH_MAX_VERTICES);
+        CHECK(chunk.getNumVertices() > STATIC_BATCH_MAX_VERTICES - numVertices || &chunk == &batch.m_chunks.back());
+        numIndices += chunk.getNumIndices();
+    }
+    CHECK_EQUAL((size_t)c_numTriles * c_quadsPerTrile * 6, numIndices);
+    CHECK_EQUAL(c_numTriles * c_quadsPerTrile * 2, CheckGeometry(batch, triles));
+}
+
+// Triles either side of the chunk boundaries at 0 and -16, no batch chunk may span two scene chunks
+TEST(StaticBatchKeepsSceneChunksApart)
+{
+    TrileSet trileSet;
+    TestTriles::AddCube(&trileSet, 1);
+    TestTriles::AddInterior(&trileSet, 2, 3);
+
+    deque<Trile> triles;
+    for (int32_t x = -20; x < 20; x++)
+    {
+        for (int32_t z = -17; z < -14; z++)
+        {
+            triles.push_back(TestTriles::MakeTrile(trileSet, (x + z) & 1 ? 1 : 2, Vec3f((float)x, (float)(x & 3), (float)z), (uint32_t)(x & 3)));
+        }
+    }
+
+    StaticBatch batch(100);
+    batch.Build(triles);
+
+    uint32_t numTriangles = 0;
+    for (const Trile& trile : triles)
+    {
+        numTriangles += trile.m_pGeometry->meshes[trile.m_orient].getNumTriangles();
+    }
+    CHECK_EQUAL(numTriangles, CheckGeometry(batch, triles));
+    for (size_t i = 0; i < batch.m_chunks.size(); i++)
+    {
+        CHECK(batch.m_chunks[i].getNumVertices() <= 100);
+    }
+}
+
+// Hidden sides are left out, and only the vertices they alone used
+TEST(StaticBatchSkipsHiddenSides)
+{
+    TrileSet trileSet;
+    TestTriles::AddCube(&trileSet, 1);
+    vector<Trile> triles;
+    triles.push_back(TestTriles::MakeTrile(trileSet, 1, Vec3f(0.f, 0.f, 0.f)));
+    triles.push_back(TestTriles::MakeTrile(trileSet, 1, Vec3f(1.f, 0.f, 0.f)));
+    vector<uint8_t> hiddenSides(2, 0);
+    hiddenSides[0] = 1 << 3;
+    hiddenSides[1] = (1 << 0) | (1 << 4);
+
+    StaticBatch batch;
+    batch.Build(triles, &hiddenSides);
+    CHECK_EQUAL((size_t)1, batch.m_chunks.size());
+    CHECK_EQUAL((size_t)(12 - 2 + 12 - 4), batch.m_chunks[0].getNumTriangles());
+    CHECK_EQUAL((uint32_t)(24 - 4 + 24 - 8), batch.GetNumVertices());
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Common.h"
+
+// A minimal harness for the parts of the viewer that are plain CPU code. Tests register themselves with
+// TEST(), failed checks are reported and counted but don't stop the test. No GL context or App is
+// created, so tests mustn't call anything that needs either.
+typedef void (*TestFunction)();
+
+class TestRegistry
+{
+public:
+
+    static vector<pair<const char*, TestFunction>>& GetTests()
+    {
+        static vector<pair<const char*, TestFunction>> s_tests;
+        return s_tests;
+    }
+
+    static uint32_t& GetNumFailures()
+    {
+        static uint32_t s_numFailures = 0;
+        return s_numFailures;
+    }
+
+    static void Check(const bool passed, const char* expression, const char* file, const int line)
+    {
+        if (!passed)
+        {
+            Fail(file, line) << expression << endl;
+        }
+    }
+
+    template<typename T, typename U>
+    static void CheckEqual(const T& expected, const U& actual, const char* expression, const char* file, const int line)
+    {
+        if (!(expected == actual))
+        {
+            Fail(file, line) << expression << " is " << Printable(actual) << ", expected " << Printable(expected) << endl;
+        }
+    }
+
+    static void CheckClose(const double expected, const double actual, const double tolerance, const char* expression, const char* file, const int line)
+    {
+        if (!(math<double>::abs(expected - actual) <= tolerance))
+        {
+            Fail(file, line) << expression << " is " << actual << ", expected " << expected << " within " << tolerance << endl;
+        }
+    }
+
+    // Returns the number of failed checks
+    static uint32_t RunAll(ostream& out)
+    {
+        for (const auto& test : GetTests())
+        {
+            const uint32_t numFailures = GetNumFailures();
+            test.second();
+            out << (GetNumFailures() == numFailures ? "  passed " : "  FAILED ") << test.first << endl;
+        }
+        out << GetTests().size() << " tests, " << GetNumFailures() << " failed checks" << endl;
+        return GetNumFailures();
+    }
+
+private:
+
+    // Bytes print as numbers rather than characters
+    template<typename T>
+    static const T& Printable(const T& value)
+    {
+        return value;
+    }
+
+    static uint32_t Printable(const uint8_t value)
+    {
+        return value;
+    }
+
+    static ostream& Fail(const char* file, const int line)
+    {
+        GetNumFailures()++;
+        return cout << file << "(" << line << "): ";
+    }
+};
+
+struct TestRegistrar
+{
+    TestRegistrar(const char* name, const TestFunction function)
+    {
+        TestRegistry::GetTests().push_back(make_pair(name, function));
+    }
+};
+
+#define TEST(name) \
+    static void name(); \
+    static TestRegistrar name##Registrar(#name, name); \
+    static void name()
+
+#define CHECK(x)                                TestRegistry::Check((x), #x, __FILE__, __LINE__)
+#define CHECK_EQUAL(expected, actual)           TestRegistry::CheckEqual((expected), (actual), #actual, __FILE__, __LINE__)
+#define CHECK_CLOSE(expected, actual, tolerance) TestRegistry::CheckClose((expected), (actual), (tolerance), #actual, __FILE__, __LINE__)
@@ -0,0 +1,23 @@
+#include "Test.h"
+#include "Trile.h"
+#include "ImageCache.h"
+#include "TextureCache.h"
+#include "AllocationStats.h"
+#include "LoadProfiler.h"
+#include "FrameProfiler.h"
+
+// The statics FezViewer.cpp defines for the app
+gl::Texture* Trile::s_pTexture;
+SurfaceCache SurfaceCache::s_cache;
+TextureCache TextureCache::s_cache;
+atomic<uint64_t> AllocationStats::s_numAllocations;
+atomic<uint64_t> AllocationStats::s_numBytes;
+LoadProfiler LoadProfiler::s_profiler;
+LOAD_THREAD_LOCAL ScopedLoadTimer* ScopedLoadTimer::s_pCurrent;
+FrameProfiler FrameProfiler::s_profiler;
+
+int main(int argc, char* argv[])
+{
+    cout << "FezViewer Tests" << endl;
+    return TestRegistry::RunAll(cout) == 0 ? 0 : 1;
+}
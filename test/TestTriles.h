@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Common.h"
+#include "TrileSet.h"
+#include "Trile.h"
+
+// Synthetic trile geometry for the tests, built through TrileSet like a loaded trile set so the
+// oriented meshes, bounds and face classification are the real ones
+class TestTriles
+{
+public:
+
+    // A unit cube with one quad per side, every side closed
+    static void AddCube(TrileSet* pTrileSet, const uint32_t key)
+    {
+        vector<Vec3f> positions;
+        vector<uint8_t> normals;
+        vector<Vec2f> texcoords;
+        vector<uint32_t> indices;
+        for (uint8_t side = 0; side < NUM_TRILE_SIDES; side++)
+        {
+            AddQuad(side, Vec2f::zero(), Vec2f::one(), &positions, &normals, &texcoords, &indices);
+        }
+        Add(pTrileSet, key, positions, normals, texcoords, indices);
+    }
+
+    // A cube open on the given sides, so nothing it touches there can be hidden by it
+    static void AddOpenCube(TrileSet* pTrileSet, const uint32_t key, const uint8_t openSides)
+    {
+        vector<Vec3f> positions;
+        vector<uint8_t> normals;
+        vector<Vec2f> texcoords;
+        vector<uint32_t> indices;
+        for (uint8_t side = 0; side < NUM_TRILE_SIDES; side++)
+        {
+            if (!(openSides & (1 << side)))
+            {
+                AddQuad(side, Vec2f::zero(), Vec2f::one(), &positions, &normals, &texcoords, &indices);
+            }
+        }
+        Add(pTrileSet, key, positions, normals, texcoords, indices);
+    }
+
+    // numQuads small quads floating inside the cell, none of them on a side
+    static void AddInterior(TrileSet* pTrileSet, const uint32_t key, const uint32_t numQuads)
+    {
+        vector<Vec3f> positions;
+        vector<uint8_t> normals;
+        vector<Vec2f> texcoords;
+        vector<uint32_t> indices;
+        for (uint32_t quad = 0; quad < numQuads; quad++)
+        {
+            const float z = -0.4f + 0.8f * (quad + 0.5f) / numQuads;
+            const uint32_t first = positions.size();
+            for (uint32_t corner = 0; corner < 4; corner++)
+            {
+                const Vec2f uv((float)(corner & 1), (float)(corner >> 1));
+                positions.push_back(Vec3f(uv.x * 0.5f - 0.25f, uv.y * 0.5f - 0.25f, z));
+                normals.push_back(5);
+                texcoords.push_back(uv * (1.f / (quad + 1)));
+            }
+            const uint32_t quadIndices[] = { 0, 1, 3, 0, 3, 2 };
+            for (const uint32_t index : quadIndices)
+            {
+                indices.push_back(first + index);
+            }
+        }
+        Add(pTrileSet, key, positions, normals, texcoords, indices);
+    }
+
+    static Trile MakeTrile(const TrileSet& trileSet, const uint32_t key, const Vec3f& pos, const uint32_t orient = 2)
+    {
+        return Trile(trileSet.Find(key), key, pos, orient, pos, Vec3f::zero());
+    }
+
+private:
+
+    // Corners at (u, v) in the side plane, wound counter clockwise seen from outside the cell
+    static void AddQuad(const uint8_t side, const Vec2f& uvMin, const Vec2f& uvMax,
+                        vector<Vec3f>* pPositions, vector<uint8_t>* pNormals, vector<Vec2f>* pTexcoords, vector<uint32_t>* pIndices)
+    {
+        const uint32_t axis = side % 3;
+        const uint32_t uAxis = (side + 1) % 3;
+        const uint32_t vAxis = (side + 2) % 3;
+        const uint32_t first = pPositions->size();
+        for (uint32_t corner = 0; corner < 4; corner++)
+        {
+            const Vec2f uv((corner & 1) ? uvMax.x : uvMin.x, (corner & 2) ? uvMax.y : uvMin.y);
+            Vec3f pos;
+            pos[axis] = side < 3 ? -0.5f : 0.5f;
+            pos[uAxis] = uv.x - 0.5f;
+            pos[vAxis] = uv.y - 0.5f;
+            pPositions->push_back(pos);
+            pNormals->push_back(side);
+            pTexcoords->push_back(uv);
+        }
+        const uint32_t ccw[] = { 0, 1, 3, 0, 3, 2 };
+        const uint32_t cw[] = { 0, 3, 1, 0, 2, 3 };
+        for (uint32_t i = 0; i < 6; i++)
+        {
+            pIndices->push_back(first + (side < 3 ? cw[i] : ccw[i]));
+        }
+    }
+
+    static void Add(TrileSet* pTrileSet, const uint32_t key, const vector<Vec3f>& positions, const vector<uint8_t>& normals,
+                    const vector<Vec2f>& texcoords, const vector<uint32_t>& indices)
+    {
+        pTrileSet->AddTrile(key, &positions[0], &normals[0], &texcoords[0], positions.size(), &indices[0], indices.size());
+    }
+};
@@ -0,0 +1,108 @@
+#include "Test.h"
+#include "TestTriles.h"
+#include "TrileCulling.h"
+
+// A trile on cell (x, y, z), placed the way the level loader does with the level's centring offset
+static Trile MakeTrile(const TrileSet& trileSet, const uint32_t key, const int32_t x, const int32_t y, const int32_t z,
+                       const Vec3f& offset, const uint32_t orient = 2)
+{
+    const Vec3f cell((float)x, (float)y, (float)z);
+    return Trile(trileSet.Find(key), key, cell, orient, cell, offset);
+}
+
+// Every face shared by two cubes of a solid block is hidden from both sides, two triangles each
+TEST(TrileCullingSolidBlock)
+{
+    TrileSet trileSet;
+    TestTriles::AddCube(&trileSet, 1);
+    const int32_t c_sizeX = 4, c_sizeY = 3, c_sizeZ = 2;
+    const Vec3f offset(-7.5f, 0.f, -2.5f);  // odd level dimensions leave the grid on half units
+
+    deque<Trile> triles;
+    for (int32_t x = 0; x < c_sizeX; x++)
+    {
+        for (int32_t y = 0; y < c_sizeY; y++)
+        {
+            for (int32_t z = 0; z < c_sizeZ; z++)
+            {
+                triles.push_back(MakeTrile(trileSet, 1, x - 2, y, z - 1, offset, (uint32_t)(x + y + z) % NUM_ORIENTATIONS));
+            }
+        }
+    }
+
+    TrileCulling culling;
+    culling.Build(triles);
+    const uint32_t numSharedFaces = (c_sizeX - 1) * c_sizeY * c_sizeZ + c_sizeX * (c_sizeY - 1) * c_sizeZ + c_sizeX * c_sizeY * (c_sizeZ - 1);
+    CHECK_EQUAL((uint32_t)(c_sizeX * c_sizeY * c_sizeZ * 12), culling.m_numTriangles);
+    CHECK_EQUAL(numSharedFaces * 2 * 2, culling.m_numHiddenTriangles);
+
+    // Corner cubes keep the three sides on the outside of the block
+    CHECK_EQUAL((uint8_t)((1 << 3) | (1 << 4) | (1 << 5)), culling.m_hiddenSides[0]);
+}
+
+// A side only hides what faces it when it is closed, an open neighbour hides nothing
+TEST(TrileCullingOpenNeighbour)
+{
+    TrileSet trileSet;
+    TestTriles::AddCube(&trileSet, 1);
+    TestTriles::AddOpenCube(&trileSet, 2, 1 << 0);
+
+    vector<Trile> triles;
+    triles.push_back(MakeTrile(trileSet, 1, 0, 0, 0, Vec3f::zero()));
+    triles.push_back(MakeTrile(trileSet, 2, 1, 0, 0, Vec3f::zero()));
+
+    TrileCulling culling;
+    culling.Build(triles);
+    CHECK_EQUAL((uint32_t)(12 + 10), culling.m_numTriangles);
+    CHECK_EQUAL(0u, culling.m_numHiddenTriangles);
+    CHECK_EQUAL((uint8_t)0, culling.m_hiddenSides[0]);
+    CHECK_EQUAL((uint8_t)0, culling.m_hiddenSides[1]);
+}
+
+// Triles placed off the grid the others share don't hide faces of the cell they're emplaced on,
+// and aren't hidden by it, even when they overlap their neighbours
+TEST(TrileCullingSkipsOffGridTriles)
+{
+    TrileSet trileSet;
+    TestTriles::AddCube(&trileSet, 1);
+
+    vector<Trile> triles;
+    triles.push_back(MakeTrile(trileSet, 1, 0, 0, 0, Vec3f::zero()));
+    triles.push_back(MakeTrile(trileSet, 1, 0, 1, 0, Vec3f::zero()));
+    triles.push_back(Trile(trileSet.Find(1), 1, Vec3f(1.5f, 0.f, 0.f), 2, Vec3f(1.f, 0.f, 0.f), Vec3f::zero()));
+    triles.push_back(Trile(trileSet.Find(1), 1, Vec3f(0.f, 0.25f, -1.f), 2, Vec3f(0.f, 0.f, -1.f), Vec3f::zero()));
+
+    TrileCulling culling;
+    culling.Build(triles);
+    CHECK_EQUAL(4u * 12, culling.m_numTriangles);
+    CHECK_EQUAL(2u * 2, culling.m_numHiddenTriangles);
+    CHECK_EQUAL((uint8_t)(1 << 4), culling.m_hiddenSides[0]);
+    CHECK_EQUAL((uint8_t)(1 << 1), culling.m_hiddenSides[1]);
+    CHECK_EQUAL((uint8_t)0, culling.m_hiddenSides[2]);
+    CHECK_EQUAL((uint8_t)0, culling.m_hiddenSides[3]);
+}
+
+// The grid is the offset most triles share, so an off-grid trile placed first doesn't take the others off it
+TEST(TrileCullingGridFromMostTriles)
+{
+    TrileSet trileSet;
+    TestTriles::AddCube(&trileSet, 1);
+
+    vector<Trile> triles;
+    triles.push_back(Trile(trileSet.Find(1), 1, Vec3f(0.f, 0.25f, -1.f), 2, Vec3f(0.f, 0.f, -1.f), Vec3f::zero()));
+    triles.push_back(MakeTrile(trileSet, 1, 0, 0, 0, Vec3f::zero()));
+    triles.push_back(MakeTrile(trileSet, 1, 0, 1, 0, Vec3f::zero()));
+    triles.push_back(MakeTrile(trileSet, 1, 1, 0, 0, Vec3f::zero()));
+
+    CHECK(TrileCulling::FindGridOffset(triles).distance(Vec3f::zero()) < TRILE_GRID_TOLERANCE);
+
+    TrileCulling culling;
+    culling.Build(triles);
+    CHECK_EQUAL(2u * 2 * 2, culling.m_numHiddenTriangles);
+    CHECK_EQUAL((uint8_t)0, culling.m_hiddenSides[0]);
+    CHECK_EQUAL((uint8_t)((1 << 3) | (1 << 4)), culling.m_hiddenSides[1]);
+
+    // Nudges smaller than the tolerance don't change the grid
+    triles[2] = Trile(trileSet.Find(1), 1, Vec3f(0.f, 1.0002f, 0.f), 2, Vec3f(0.f, 1.f, 0.f), Vec3f::zero());
+    CHECK(TrileCulling::FindGridOffset(triles).distance(Vec3f::zero()) < TRILE_GRID_TOLERANCE);
+}
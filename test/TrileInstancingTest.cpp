@@ -0,0 +1,156 @@
+#include "Test.h"
+#include "TrileInstancing.h"
+
+// Two trile types with a single distinct vertex per orientation, enough to tell the meshes apart
+static void MakeGeometry(TrileGeometry* pGeometry, const float tag)
+{
+    for (uint32_t orient = 0; orient < NUM_ORIENTATIONS; orient++)
+    {
+        pGeometry->meshes[orient].appendVertex(Vec3f(tag, (float)orient, 0.5f));
+        pGeometry->bounds[orient] = Bounds(Vec3f(-0.5f, -0.5f, -0.5f), Vec3f(0.5f, 0.5f, 0.5f));
+    }
+}
+
+// Interleaves the keys and orientations so no group's instances are next to each other in the level
+static deque<Trile> MakeTriles(const TrileGeometry* pGeometryA, const TrileGeometry* pGeometryB)
+{
+    deque<Trile> triles;
+    for (uint32_t i = 0; i < 50; i++)
+    {
+        const bool isA = i % 3 != 0;
+        const Vec3f pos((float)(i % 5) - 2.f, (float)(i / 5) * 0.5f, -(float)i);
+        triles.push_back(Trile(isA ? pGeometryA : pGeometryB, isA ? 7 : 2, pos, i % NUM_ORIENTATIONS, Vec3f::zero(), Vec3f(0.f, 0.f, 0.25f)));
+    }
+    return triles;
+}
+
+// Checks every trile's instance against the per instance path, where Trile::Draw() translates the
+// trile's oriented mesh by m_pos and the instanced shader adds the packed offset to the group's mesh
+template<typename TrileContainer>
+static void CheckPacking(const TrileInstanceGroups& groups, const TrileContainer& triles)
+{
+    set<pair<uint32_t, uint32_t>> groupKeys;
+    for (const Trile& trile : triles)
+    {
+        groupKeys.insert(make_pair(trile.m_key, trile.m_orient));
+    }
+    CHECK_EQUAL(groupKeys.size(), groups.m_groups.size());
+    CHECK_EQUAL((uint32_t)triles.size(), groups.m_numInstances);
+    CHECK_EQUAL(triles.size(), groups.m_offsets.size());
+
+    uint32_t first = 0;
+    map<pair<uint32_t, uint32_t>, uint32_t> nextInstance;
+    for (uint32_t i = 0; i < groups.m_groups.size(); i++)
+    {
+        const TrileInstanceGroup& group = groups.m_groups[i];
+        if (i > 0)
+        {
+            const TrileInstanceGroup& previous = groups.m_groups[i - 1];
+            CHECK(previous.key < group.key || (previous.key == group.key && previous.orient < group.orient));
+        }
+        CHECK_EQUAL(first, group.firstInstance);
+        first += group.numInstances;
+        nextInstance[make_pair(group.key, group.orient)] = group.firstInstance;
+    }
+    CHECK_EQUAL(groups.m_numInstances, first);
+
+    for (const Trile& trile : triles)
+    {
+        const auto groupKey = make_pair(trile.m_key, trile.m_orient);
+        const TrileInstanceGroup* pGroup = nullptr;
+        for (const TrileInstanceGroup& group : groups.m_groups)
+        {
+            pGroup = make_pair(group.key, group.orient) == groupKey ? &group : pGroup;
+        }
+        CHECK(pGroup != nullptr);
+        if (!pGroup)
+        {
+            continue;
+        }
+        const uint32_t instance = nextInstance[groupKey]++;
+        CHECK(instance < pGroup->firstInstance + pGroup->numInstances);
+        CHECK(pGroup->pGeometry == trile.m_pGeometry);
+        CHECK_EQUAL(trile.m_pos, groups.m_offsets[instance]);
+
+        const Vec3f& vertex = trile.m_pGeometry->meshes[trile.m_orient].getVertices()[0];
+        const Vec3f& groupVertex = pGroup->pGeometry->meshes[pGroup->orient].getVertices()[0];
+        CHECK_EQUAL(vertex + trile.m_pos, groupVertex + groups.m_offsets[instance]);
+    }
+}
+
+TEST(TrileInstancingGroupsAndPacking)
+{
+    TrileGeometry geometryA, geometryB;
+    MakeGeometry(&geometryA, 1.f);
+    MakeGeometry(&geometryB, 2.f);
+    const deque<Trile> triles = MakeTriles(&geometryA, &geometryB);
+
+    TrileInstanceGroups groups;
+    groups.Build(triles);
+    CHECK_EQUAL((size_t)(2 * NUM_ORIENTATIONS), groups.m_groups.size());
+    CheckPacking(groups, triles);
+
+    // A rebuild starts over rather than appending
+    groups.Build(triles);
+    CheckPacking(groups, triles);
+
+    groups.Build(deque<Trile>());
+    CHECK(groups.m_groups.empty());
+    CHECK_EQUAL(0u, groups.m_numInstances);
+}
+
+TEST(TrileInstancingFromStoreSkipsHidden)
+{
+    TrileGeometry geometryA, geometryB;
+    MakeGeometry(&geometryA, 1.f);
+    MakeGeometry(&geometryB, 2.f);
+    const deque<Trile> triles = MakeTriles(&geometryA, &geometryB);
+
+    SceneStore store;
+    store.AddTriles(triles);
+    vector<Trile> visible;
+    for (uint32_t i = 0; i < triles.size(); i++)
+    {
+        store.m_trileVisible[i] = i % 4 != 1;
+        if (store.m_trileVisible[i])
+        {
+            visible.push_back(triles[i]);
+        }
+    }
+
+    TrileInstanceGroups groups;
+    groups.Build(store);
+    CheckPacking(groups, visible);
+
+    TrileInstanceGroups fromTriles;
+    fromTriles.Build(visible);
+    CHECK(fromTriles.m_offsets == groups.m_offsets);
+}
+
+TEST(TrileInstancingVisibleInPlace)
+{
+    TrileGeometry geometryA, geometryB;
+    MakeGeometry(&geometryA, 1.f);
+    MakeGeometry(&geometryB, 2.f);
+    const deque<Trile> triles = MakeTriles(&geometryA, &geometryB);
+
+    vector<uint8_t> flags(triles.size());
+    vector<Trile> visible;
+    for (uint32_t i = 0; i < triles.size(); i++)
+    {
+        flags[i] = i % 3 != 2;
+        if (flags[i])
+        {
+            visible.push_back(triles[i]);
+        }
+    }
+
+    TrileInstanceGroups groups;
+    groups.Build(triles, flags);
+    CheckPacking(groups, visible);
+
+    flags.assign(triles.size(), 0);
+    groups.Build(triles, flags);
+    CHECK(groups.m_groups.empty());
+    CHECK_EQUAL(0u, groups.m_numInstances);
+}
@@ -0,0 +1,69 @@
+#include "Test.h"
+#include "WorkerPool.h"
+
+// A group's wait finishes while another group's task is still blocked
+TEST(WorkerPoolGroupWaitIgnoresOtherGroups)
+{
+    WorkerPool pool(2);
+    atomic<bool> release(false);
+    atomic<bool> blockedDone(false);
+    WorkerGroup blocked;
+    pool.Submit([&]()
+    {
+        while (!release)
+        {
+            this_thread::yield();
+        }
+        blockedDone = true;
+    }, &blocked);
+
+    atomic<uint32_t> sum(0);
+    pool.ParallelFor(100, [&](uint32_t i) { sum += i; });
+    CHECK_EQUAL(4950u, sum.load());
+
+    WorkerGroup other;
+    atomic<uint32_t> numOther(0);
+    for (uint32_t i = 0; i < 10; i++)
+    {
+        pool.Submit([&]() { numOther++; }, &other);
+    }
+    pool.Wait(other);
+    CHECK_EQUAL(10u, numOther.load());
+    CHECK(!blockedDone);
+
+    release = true;
+    pool.Wait(blocked);
+    CHECK(blockedDone);
+}
+
+// Tasks that wait on groups of their own, more of them than there are workers
+TEST(WorkerPoolNestedWaits)
+{
+    WorkerPool pool(1);
+    WorkerGroup outer;
+    atomic<uint32_t> sum(0);
+    for (uint32_t n = 0; n < 4; n++)
+    {
+        pool.Submit([&]()
+        {
+            pool.ParallelFor(50, [&](uint32_t i) { sum += i; });
+        }, &outer);
+    }
+    pool.Wait(outer);
+    CHECK_EQUAL(4u * 1225u, sum.load());
+    CHECK_EQUAL(0u, outer.numPending);
+}
+
+TEST(WorkerPoolWaitAll)
+{
+    WorkerPool pool(3);
+    WorkerGroup group;
+    atomic<uint32_t> count(0);
+    for (uint32_t i = 0; i < 200; i++)
+    {
+        pool.Submit([&]() { count++; }, i % 2 ? &group : nullptr);
+    }
+    pool.Wait();
+    CHECK_EQUAL(200u, count.load());
+    CHECK_EQUAL(0u, group.numPending);
+}